@@ -0,0 +1,201 @@
+#pragma once
+
+#include <opencv2/core.hpp>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Everything that talks to the operating system's screen, mouse or keyboard lives behind chivel::Backend.
+// dllmain.cpp only ever goes through getBackend(), so the Python API behaves the same on every platform.
+
+enum MouseButton
+{
+	BUTTON_LEFT = 0,
+	BUTTON_RIGHT = 1,
+	BUTTON_MIDDLE = 2,
+	BUTTON_X1 = 3, // Button 4
+	BUTTON_X2 = 4  // Button 5
+};
+
+// Key codes exposed to Python. These match the Windows virtual-key codes, so scripts are portable.
+enum Key
+{
+	KEY_BACKSPACE = 0x08,
+	KEY_TAB = 0x09,
+	KEY_ENTER = 0x0D,
+	KEY_SHIFT = 0x10,
+	KEY_CTRL = 0x11,
+	KEY_ALT = 0x12,
+	KEY_PAUSE = 0x13,
+	KEY_CAPSLOCK = 0x14,
+	KEY_ESC = 0x1B,
+	KEY_SPACE = 0x20,
+	KEY_PAGEUP = 0x21,
+	KEY_PAGEDOWN = 0x22,
+	KEY_END = 0x23,
+	KEY_HOME = 0x24,
+	KEY_LEFT = 0x25,
+	KEY_UP = 0x26,
+	KEY_RIGHT = 0x27,
+	KEY_DOWN = 0x28,
+	KEY_PRINTSCREEN = 0x2C,
+	KEY_INSERT = 0x2D,
+	KEY_DELETE = 0x2E,
+	KEY_0 = 0x30, // KEY_1 - KEY_9 follow
+	KEY_A = 0x41, // KEY_B - KEY_Z follow
+	KEY_NUMPAD0 = 0x60, // KEY_NUMPAD1 - KEY_NUMPAD9 follow
+	KEY_MULTIPLY = 0x6A,
+	KEY_ADD = 0x6B,
+	KEY_SEPARATOR = 0x6C,
+	KEY_SUBTRACT = 0x6D,
+	KEY_DECIMAL = 0x6E,
+	KEY_DIVIDE = 0x6F,
+	KEY_F1 = 0x70, // KEY_F2 - KEY_F12 follow
+	KEY_F12 = 0x7B,
+	KEY_NUMLOCK = 0x90,
+	KEY_SCROLLLOCK = 0x91,
+};
+
+namespace chivel
+{
+	// A display, positioned relative to the top left of the primary display.
+	struct DisplayInfo
+	{
+		int x = 0;
+		int y = 0;
+		int width = 0;
+		int height = 0;
+	};
+
+	// A top level window. The handle is an HWND on Windows and a Window on X11.
+	struct WindowInfo
+	{
+		uintptr_t handle = 0;
+		std::string title; // UTF-8
+		std::string className;
+	};
+
+	// Captures one fixed area over and over, keeping its buffers between grabs so nothing is allocated per frame.
+	class CaptureSession
+	{
+	public:
+		virtual ~CaptureSession() = default;
+
+		// Refreshes the frame in place. The frame keeps the same size and data pointer for the life of the session.
+		virtual bool grab() = 0;
+
+		// Like grab, but also lists the areas of the frame that changed since the last grabDamage.
+		// The first call reports the whole frame. By default everything is grabbed and compared in
+		// DAMAGE_TILE sized tiles. Backends that are told what changed only copy those areas.
+		virtual bool grabDamage(std::vector<cv::Rect>& dirty);
+
+		// 8-bit BGR. Only valid until the next grab overwrites it.
+		cv::Mat const& getFrame() const
+		{
+			return frame;
+		}
+
+		static constexpr int DAMAGE_TILE = 32;
+
+	protected:
+		cv::Mat frame;
+
+	private:
+		std::vector<uint64_t> tileHashes;
+	};
+
+	// Makes the image a capture returns out of the pixels the backend captured, which are 8-bit BGR or BGRX
+	// (four channels, where the fourth is padding rather than alpha). Only valid for the length of the call.
+	using CaptureConverter = std::function<cv::Mat(cv::Mat const& pixels)>;
+
+	class Backend
+	{
+	public:
+		virtual ~Backend() = default;
+
+		// Short name of the backend, such as "win32" or "x11".
+		virtual char const* getName() const = 0;
+
+		virtual int getDisplayCount() = 0;
+		virtual bool getDisplay(int displayIndex, DisplayInfo& info) = 0;
+		// Returns the index of the display containing the given point, or -1.
+		virtual int findDisplay(int x, int y) = 0;
+
+		// Captures are always 8-bit BGR. An empty Mat is returned on failure.
+		virtual cv::Mat captureScreen(int displayIndex) = 0;
+		// The rect is relative to the given display.
+		virtual cv::Mat captureRect(int x, int y, int w, int h, int displayIndex) = 0;
+		// Captures several small rects of the given display into results, one Mat each, for when only a few pixels matter.
+		// By default each rect is a captureRect. Backends override it to share the setup between rects.
+		virtual bool captureRects(int displayIndex, std::vector<cv::Rect> const& rects, std::vector<cv::Mat>& results);
+		// Captures the rect, relative to the given display, and returns what convert makes of it. An empty rect is the whole display.
+		// Backends hand over their own capture buffer, so the conversion is the copy out of it. By default the capture
+		// is a captureRect or captureScreen, and convert runs on that.
+		virtual cv::Mat captureConverted(int displayIndex, cv::Rect rect, CaptureConverter const& convert);
+		// Opens a session for repeated captures of the rect, relative to the given display. An empty rect is the whole display.
+		// Sessions are independent of the backend, so they keep working if it is replaced. Returns nullptr on failure.
+		virtual std::unique_ptr<CaptureSession> openCapture(int displayIndex, cv::Rect rect) = 0;
+
+		// Visible top level windows, front to back. This is cached, and the cache is dropped whenever
+		// a window is created, destroyed, shown, hidden or renamed, so calling it often is cheap.
+		virtual std::vector<WindowInfo> getWindows() = 0;
+		// Where the window is right now, relative to the top left of the primary display.
+		// Returns false if the window is gone, hidden or minimized.
+		virtual bool getWindowRect(uintptr_t handle, cv::Rect& rect) = 0;
+
+		virtual bool setCursorPosition(int x, int y) = 0;
+		virtual bool getCursorPosition(int& x, int& y) = 0;
+		virtual bool sendMouseButton(MouseButton button, bool down) = 0;
+		// Each unit is one wheel notch. Positive is up and right.
+		virtual bool sendMouseScroll(int vertical, int horizontal) = 0;
+		virtual bool sendKey(int key, bool down) = 0;
+		// Types a single Unicode code point, regardless of the keyboard layout.
+		virtual bool sendCharacter(char32_t codepoint) = 0;
+	};
+
+	// An input event that the virtual backend received instead of delivering it.
+	struct InputEvent
+	{
+		enum Type
+		{
+			MOUSE_MOVE,
+			MOUSE_DOWN,
+			MOUSE_UP,
+			MOUSE_SCROLL,
+			KEY_DOWN,
+			KEY_UP,
+			CHARACTER,
+		};
+
+		double time; // seconds since the backend was created
+		Type type;
+		int a; // x, button, vertical, key or code point
+		int b; // y or horizontal
+	};
+
+	// An offscreen display that serves frames from an image, a directory of images or a video,
+	// and logs input instead of sending it to the OS. Used for benchmarks and tests.
+	class VirtualBackend : public Backend
+	{
+	public:
+		// Removes and returns all logged events.
+		virtual std::vector<InputEvent> takeEvents() = 0;
+	};
+
+	// The backend for the platform this module was built for.
+	std::unique_ptr<Backend> createNativeBackend();
+
+	// When fps is 0, every capture advances one frame, so runs are fully reproducible.
+	// Otherwise the frame is picked by elapsed time, like a live display running at that rate.
+	// Returns nullptr if the source could not be opened or has no frames.
+	std::unique_ptr<VirtualBackend> createVirtualBackend(std::string const& source, double fps, bool loop);
+
+	// The backend all of chivel goes through. Created on first use.
+	// The pointer keeps the backend alive, so it stays usable while another thread replaces it.
+	std::shared_ptr<Backend> getBackend();
+
+	// Replaces the backend. The old one is destroyed once the last caller holding it lets go.
+	void setBackend(std::shared_ptr<Backend> backend);
+}
@@ -0,0 +1,332 @@
+// backend_virtual.cpp : Offscreen display that replays frames from files and logs input.
+#include "pch.h"
+
+#include "backend.h"
+
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/imgproc.hpp>
+#include <opencv2/videoio.hpp>
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <mutex>
+
+namespace chivel
+{
+	using Clock = std::chrono::steady_clock;
+
+	// The frames being played back. Shared between the backend and its capture sessions.
+	class Playback
+	{
+	public:
+		Playback(double fps, bool loop, Clock::time_point start)
+			: fps(fps), loop(loop), start(start)
+		{
+		}
+
+		// Loads the source. Images and directories are decoded up front, so decoding never shows up in measurements.
+		bool open(std::string const& source)
+		{
+			std::filesystem::path path(source);
+			if (std::filesystem::is_directory(path)) {
+				std::vector<std::filesystem::path> files;
+				for (auto const& entry : std::filesystem::directory_iterator(path)) {
+					if (entry.is_regular_file())
+						files.push_back(entry.path());
+				}
+				std::sort(files.begin(), files.end());
+				for (auto const& file : files) {
+					cv::Mat frame = cv::imread(file.string(), cv::IMREAD_COLOR);
+					if (!frame.empty())
+						frames.push_back(frame);
+				}
+			}
+			else {
+				cv::Mat frame = cv::imread(source, cv::IMREAD_COLOR);
+				if (!frame.empty()) {
+					frames.push_back(frame);
+				}
+				else if (video.open(source)) {
+					video.read(videoFrame);
+				}
+			}
+
+			if (frames.empty() && videoFrame.empty())
+				return false;
+
+			cv::Mat const& first = frames.empty() ? videoFrame : frames.front();
+			size = first.size();
+			return true;
+		}
+
+		cv::Size getSize() const
+		{
+			return size;
+		}
+
+		// Copies the area of the current frame into target, which must already be area sized.
+		// Anything outside of the frame is black, like a real display.
+		void read(cv::Rect area, cv::Mat& target)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			copyArea(nextFrame(), area, target);
+		}
+
+		// Like read, but every area comes from the same frame, so they all show the display at one moment.
+		void read(std::vector<cv::Rect> const& areas, std::vector<cv::Mat>& targets)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			cv::Mat const& frame = nextFrame();
+			for (size_t i = 0; i < areas.size(); i++)
+				copyArea(frame, areas[i], targets[i]);
+		}
+
+	private:
+		double fps;
+		bool loop;
+		Clock::time_point start;
+		std::mutex mutex;
+
+		std::vector<cv::Mat> frames;
+		cv::VideoCapture video;
+		cv::Mat videoFrame;
+		long long videoStart = 0; // timeline index of the first frame of the current pass through the video
+		long long videoIndex = 0; // frame within the video
+		long long captureCount = 0;
+		cv::Size size;
+
+		static void copyArea(cv::Mat const& frame, cv::Rect area, cv::Mat& target)
+		{
+			cv::Rect visible = area & cv::Rect(cv::Point(0, 0), frame.size());
+			if (visible != area)
+				target.setTo(cv::Scalar::all(0));
+			if (!visible.empty())
+				frame(visible).copyTo(target(visible - area.tl()));
+		}
+
+		// The frame the display is showing right now.
+		cv::Mat const& nextFrame()
+		{
+			long long index = fps > 0.0 ? static_cast<long long>(std::chrono::duration<double>(Clock::now() - start).count() * fps) : captureCount;
+			captureCount++;
+
+			if (!frames.empty()) {
+				long long count = static_cast<long long>(frames.size());
+				return frames[static_cast<size_t>(loop ? index % count : std::min(index, count - 1))];
+			}
+
+			// Videos are streamed, so only ever step forwards, rewinding when looping past the end.
+			// Skipped frames are only grabbed, never decoded.
+			bool advanced = false;
+			while (videoStart + videoIndex < index) {
+				if (video.grab()) {
+					videoIndex++;
+				}
+				else {
+					if (!loop)
+						break; // hold the last frame
+					video.set(cv::CAP_PROP_POS_FRAMES, 0);
+					if (!video.grab())
+						break;
+					videoStart += videoIndex + 1;
+					videoIndex = 0;
+				}
+				advanced = true;
+			}
+			if (advanced) {
+				cv::Mat frame;
+				if (video.retrieve(frame) && !frame.empty())
+					videoFrame = frame;
+			}
+			return videoFrame;
+		}
+	};
+
+	class VirtualCaptureSession : public CaptureSession
+	{
+	public:
+		VirtualCaptureSession(std::shared_ptr<Playback> playback, cv::Rect area)
+			: playback(std::move(playback)), area(area)
+		{
+			frame.create(area.height, area.width, CV_8UC3);
+		}
+
+		bool grab() override
+		{
+			playback->read(area, frame);
+			return true;
+		}
+
+	private:
+		std::shared_ptr<Playback> playback;
+		cv::Rect area;
+	};
+
+	class VirtualDisplayBackend : public VirtualBackend
+	{
+	public:
+		VirtualDisplayBackend(double fps, bool loop)
+			: start(Clock::now()), playback(std::make_shared<Playback>(fps, loop, start))
+		{
+		}
+
+		bool open(std::string const& source)
+		{
+			if (!playback->open(source))
+				return false;
+			size = playback->getSize();
+			return true;
+		}
+
+		char const* getName() const override
+		{
+			return "virtual";
+		}
+
+		int getDisplayCount() override
+		{
+			return 1;
+		}
+
+		bool getDisplay(int displayIndex, DisplayInfo& info) override
+		{
+			if (displayIndex != 0)
+				return false;
+			info.x = 0;
+			info.y = 0;
+			info.width = size.width;
+			info.height = size.height;
+			return true;
+		}
+
+		int findDisplay(int x, int y) override
+		{
+			return cv::Rect(cv::Point(0, 0), size).contains(cv::Point(x, y)) ? 0 : -1;
+		}
+
+		cv::Mat captureScreen(int displayIndex) override
+		{
+			return captureRect(0, 0, size.width, size.height, displayIndex);
+		}
+
+		cv::Mat captureRect(int x, int y, int w, int h, int displayIndex) override
+		{
+			if (displayIndex != 0 || w <= 0 || h <= 0)
+				return cv::Mat();
+
+			cv::Mat mat(h, w, CV_8UC3);
+			playback->read(cv::Rect(x, y, w, h), mat);
+			return mat;
+		}
+
+		// One frame for all of the rects. Capturing them one by one would advance a frame per rect when fps is 0.
+		bool captureRects(int displayIndex, std::vector<cv::Rect> const& rects, std::vector<cv::Mat>& results) override
+		{
+			if (displayIndex != 0)
+				return false;
+			results.resize(rects.size());
+			for (size_t i = 0; i < rects.size(); i++) {
+				if (rects[i].width <= 0 || rects[i].height <= 0)
+					return false;
+				results[i].create(rects[i].height, rects[i].width, CV_8UC3);
+			}
+			playback->read(rects, results);
+			return true;
+		}
+
+		std::unique_ptr<CaptureSession> openCapture(int displayIndex, cv::Rect rect) override
+		{
+			if (displayIndex != 0)
+				return nullptr;
+			if (rect.empty())
+				rect = cv::Rect(cv::Point(0, 0), size);
+			return std::make_unique<VirtualCaptureSession>(playback, rect);
+		}
+
+		// The virtual display has no windows
+		std::vector<WindowInfo> getWindows() override
+		{
+			return {};
+		}
+
+		bool getWindowRect(uintptr_t /*handle*/, cv::Rect& /*rect*/) override
+		{
+			return false;
+		}
+
+		bool setCursorPosition(int x, int y) override
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			cursor = cv::Point(x, y);
+			log(InputEvent::MOUSE_MOVE, x, y);
+			return true;
+		}
+
+		bool getCursorPosition(int& x, int& y) override
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			x = cursor.x;
+			y = cursor.y;
+			return true;
+		}
+
+		bool sendMouseButton(MouseButton button, bool down) override
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			log(down ? InputEvent::MOUSE_DOWN : InputEvent::MOUSE_UP, button);
+			return true;
+		}
+
+		bool sendMouseScroll(int vertical, int horizontal) override
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			log(InputEvent::MOUSE_SCROLL, vertical, horizontal);
+			return true;
+		}
+
+		bool sendKey(int key, bool down) override
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			log(down ? InputEvent::KEY_DOWN : InputEvent::KEY_UP, key);
+			return true;
+		}
+
+		bool sendCharacter(char32_t codepoint) override
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			log(InputEvent::CHARACTER, static_cast<int>(codepoint));
+			return true;
+		}
+
+		std::vector<InputEvent> takeEvents() override
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			std::vector<InputEvent> result;
+			result.swap(events);
+			return result;
+		}
+
+	private:
+		Clock::time_point start;
+		std::shared_ptr<Playback> playback;
+		cv::Size size;
+
+		std::mutex mutex;
+		cv::Point cursor;
+		std::vector<InputEvent> events;
+
+		void log(InputEvent::Type type, int a, int b = 0)
+		{
+			double time = std::chrono::duration<double>(Clock::now() - start).count();
+			events.push_back({ time, type, a, b });
+		}
+	};
+
+	std::unique_ptr<VirtualBackend> createVirtualBackend(std::string const& source, double fps, bool loop)
+	{
+		auto backend = std::make_unique<VirtualDisplayBackend>(fps, loop);
+		if (!backend->open(source))
+			return nullptr;
+		return backend;
+	}
+}
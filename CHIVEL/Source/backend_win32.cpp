@@ -0,0 +1,552 @@
+// backend_win32.cpp : GDI capture, SendInput and EnumDisplayDevices.
+#include "pch.h"
+
+#ifdef _WIN32
+
+#include "backend.h"
+
+#include <opencv2/imgproc.hpp>
+#include <atomic>
+#include <future>
+#include <mutex>
+#include <thread>
+
+#include <Windows.h>
+#include <ShellScalingAPI.h> // For GetDpiForMonitor
+#include <dwmapi.h> // For the window bounds without the invisible resize border
+#pragma comment(lib, "Shcore.lib")
+#pragma comment(lib, "Dwmapi.lib")
+
+namespace chivel
+{
+	// Keeps the DCs and a DIB section alive, so each grab is a single BitBlt straight into the frame's pixels.
+	class Win32CaptureSession : public CaptureSession
+	{
+	public:
+		Win32CaptureSession(DISPLAY_DEVICE const& dd, int x, int y, int w, int h)
+			: x(x), y(y)
+		{
+			hScreenDC = CreateDC(NULL, dd.DeviceName, NULL, NULL);
+			if (!hScreenDC)
+				return;
+			hMemoryDC = CreateCompatibleDC(hScreenDC);
+
+			BITMAPINFO bi = {};
+			bi.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
+			bi.bmiHeader.biWidth = w;
+			bi.bmiHeader.biHeight = -h; // negative for top-down bitmap
+			bi.bmiHeader.biPlanes = 1;
+			bi.bmiHeader.biBitCount = 24;
+			bi.bmiHeader.biCompression = BI_RGB;
+
+			void* bits = nullptr;
+			hBitmap = CreateDIBSection(hScreenDC, &bi, DIB_RGB_COLORS, &bits, NULL, 0);
+			if (!hBitmap || !bits)
+				return;
+			hOldBitmap = (HBITMAP)SelectObject(hMemoryDC, hBitmap);
+
+			// DIB rows are padded to 4 bytes
+			size_t step = (static_cast<size_t>(w) * 3 + 3) & ~static_cast<size_t>(3);
+			frame = cv::Mat(h, w, CV_8UC3, bits, step);
+		}
+
+		~Win32CaptureSession() override
+		{
+			if (hOldBitmap)
+				SelectObject(hMemoryDC, hOldBitmap);
+			if (hBitmap)
+				DeleteObject(hBitmap);
+			if (hMemoryDC)
+				DeleteDC(hMemoryDC);
+			if (hScreenDC)
+				DeleteDC(hScreenDC);
+		}
+
+		bool isValid() const
+		{
+			return !frame.empty();
+		}
+
+		bool grab() override
+		{
+			if (!BitBlt(hMemoryDC, 0, 0, frame.cols, frame.rows, hScreenDC, x, y, SRCCOPY))
+				return false;
+			// Make sure GDI is done writing before the pixels are read
+			GdiFlush();
+			return true;
+		}
+
+	private:
+		int x, y;
+		HDC hScreenDC = NULL;
+		HDC hMemoryDC = NULL;
+		HBITMAP hBitmap = NULL;
+		HBITMAP hOldBitmap = NULL;
+	};
+
+	static std::string to_utf8(wchar_t const* text, int length)
+	{
+		if (length <= 0)
+			return std::string();
+		int size = WideCharToMultiByte(CP_UTF8, 0, text, length, nullptr, 0, nullptr, nullptr);
+		std::string result(size, '\0');
+		WideCharToMultiByte(CP_UTF8, 0, text, length, result.data(), size, nullptr, nullptr);
+		return result;
+	}
+
+	// Bumped by the WinEvent hook whenever a top level window appears, disappears, is renamed or comes to the front
+	static std::atomic<uint64_t> window_generation{ 1 };
+
+	static void CALLBACK window_event_proc(HWINEVENTHOOK, DWORD event, HWND hwnd, LONG idObject, LONG, DWORD, DWORD)
+	{
+		if (idObject != OBJID_WINDOW || !hwnd || GetAncestor(hwnd, GA_ROOT) != hwnd)
+			return;
+		switch (event) {
+		case EVENT_OBJECT_CREATE:
+		case EVENT_OBJECT_DESTROY:
+		case EVENT_OBJECT_SHOW:
+		case EVENT_OBJECT_HIDE:
+		case EVENT_OBJECT_NAMECHANGE:
+		case EVENT_SYSTEM_FOREGROUND:
+			window_generation++;
+			break;
+		default:
+			break;
+		}
+	}
+
+	class Win32Backend : public Backend
+	{
+	public:
+		Win32Backend()
+		{
+			// make process DPI aware for mouse scaling
+			SetProcessDpiAwareness(PROCESS_PER_MONITOR_DPI_AWARE);
+		}
+
+		~Win32Backend() override
+		{
+			if (hookThread.joinable()) {
+				PostThreadMessage(hookThreadId, WM_QUIT, 0, 0);
+				hookThread.join();
+			}
+		}
+
+		char const* getName() const override
+		{
+			return "win32";
+		}
+
+		int getDisplayCount() override
+		{
+			int count = 0;
+			EnumDisplayMonitors(
+				nullptr, nullptr,
+				[](HMONITOR, HDC, LPRECT, LPARAM lParam) -> BOOL {
+					int* pCount = reinterpret_cast<int*>(lParam);
+					++(*pCount);
+					return TRUE;
+				},
+				reinterpret_cast<LPARAM>(&count)
+			);
+			return count;
+		}
+
+		bool getDisplay(int displayIndex, DisplayInfo& info) override
+		{
+			DISPLAY_DEVICE dd;
+			DEVMODE dm;
+			if (!getDisplaySettings(displayIndex, dd, dm))
+				return false;
+
+			// dmPosition is relative to the primary display
+			info.x = dm.dmPosition.x;
+			info.y = dm.dmPosition.y;
+			info.width = dm.dmPelsWidth;
+			info.height = dm.dmPelsHeight;
+			return true;
+		}
+
+		int findDisplay(int x, int y) override
+		{
+			MonitorSearch search = { { x, y }, 0, -1, 0, 0 };
+			EnumDisplayMonitors(nullptr, nullptr, monitor_enum_proc, reinterpret_cast<LPARAM>(&search));
+			return search.found;
+		}
+
+		cv::Mat captureScreen(int displayIndex) override
+		{
+			DISPLAY_DEVICE dd;
+			DEVMODE dm;
+			if (!getDisplaySettings(displayIndex, dd, dm))
+				return cv::Mat();
+
+			return captureDC(dd, 0, 0, dm.dmPelsWidth, dm.dmPelsHeight);
+		}
+
+		cv::Mat captureRect(int x, int y, int w, int h, int displayIndex) override
+		{
+			DISPLAY_DEVICE dd;
+			DEVMODE dm;
+			if (!getDisplaySettings(displayIndex, dd, dm))
+				return cv::Mat();
+
+			// Copy the specified rectangle into the bitmap (relative to monitor)
+			return captureDC(dd, x, y, w, h);
+		}
+
+		cv::Mat captureConverted(int displayIndex, cv::Rect rect, CaptureConverter const& convert) override
+		{
+			DISPLAY_DEVICE dd;
+			DEVMODE dm;
+			if (!getDisplaySettings(displayIndex, dd, dm))
+				return cv::Mat();
+			if (rect.empty())
+				rect = cv::Rect(0, 0, dm.dmPelsWidth, dm.dmPelsHeight);
+
+			// GDI hands over 32-bit pixels as they are, so the conversion is the only pass that rearranges them
+			cv::Mat bgrx = captureDC(dd, rect.x, rect.y, rect.width, rect.height, 32);
+			if (bgrx.empty())
+				return bgrx;
+			return convert(bgrx);
+		}
+
+		bool captureRects(int displayIndex, std::vector<cv::Rect> const& rects, std::vector<cv::Mat>& results) override
+		{
+			DISPLAY_DEVICE dd;
+			DEVMODE dm;
+			if (!getDisplaySettings(displayIndex, dd, dm))
+				return false;
+
+			// One DC and one DIB section big enough for the largest rect, so each rect is just a BitBlt of a few pixels.
+			// 32-bit rows are never padded.
+			int w = 1, h = 1;
+			for (cv::Rect const& rect : rects) {
+				if (rect.width > w)
+					w = rect.width;
+				if (rect.height > h)
+					h = rect.height;
+			}
+			HDC hScreenDC = CreateDC(NULL, dd.DeviceName, NULL, NULL);
+			if (!hScreenDC)
+				return false;
+			HDC hMemoryDC = CreateCompatibleDC(hScreenDC);
+
+			BITMAPINFO bi = {};
+			bi.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
+			bi.bmiHeader.biWidth = w;
+			bi.bmiHeader.biHeight = -h; // negative for top-down bitmap
+			bi.bmiHeader.biPlanes = 1;
+			bi.bmiHeader.biBitCount = 32;
+			bi.bmiHeader.biCompression = BI_RGB;
+
+			void* bits = nullptr;
+			HBITMAP hBitmap = CreateDIBSection(hScreenDC, &bi, DIB_RGB_COLORS, &bits, NULL, 0);
+			bool success = hBitmap && bits;
+			if (success) {
+				HBITMAP hOldBitmap = (HBITMAP)SelectObject(hMemoryDC, hBitmap);
+				cv::Mat canvas(h, w, CV_8UC4, bits);
+				results.resize(rects.size());
+				for (size_t i = 0; i < rects.size() && success; i++) {
+					cv::Rect const& rect = rects[i];
+					success = BitBlt(hMemoryDC, 0, 0, rect.width, rect.height, hScreenDC, rect.x, rect.y, SRCCOPY);
+					GdiFlush();
+					cv::cvtColor(canvas(cv::Rect(0, 0, rect.width, rect.height)), results[i], cv::COLOR_BGRA2BGR);
+				}
+				SelectObject(hMemoryDC, hOldBitmap);
+			}
+
+			if (hBitmap)
+				DeleteObject(hBitmap);
+			DeleteDC(hMemoryDC);
+			DeleteDC(hScreenDC);
+			return success;
+		}
+
+		std::unique_ptr<CaptureSession> openCapture(int displayIndex, cv::Rect rect) override
+		{
+			DISPLAY_DEVICE dd;
+			DEVMODE dm;
+			if (!getDisplaySettings(displayIndex, dd, dm))
+				return nullptr;
+
+			if (rect.empty())
+				rect = cv::Rect(0, 0, dm.dmPelsWidth, dm.dmPelsHeight);
+			auto session = std::make_unique<Win32CaptureSession>(dd, rect.x, rect.y, rect.width, rect.height);
+			if (!session->isValid())
+				return nullptr;
+			return session;
+		}
+
+		std::vector<WindowInfo> getWindows() override
+		{
+			std::lock_guard<std::mutex> lock(windowMutex);
+			startWindowHook();
+
+			uint64_t generation = window_generation.load();
+			if (generation != windowsGeneration) {
+				// Read the generation first, so a change during the enumeration is picked up next time
+				windowsGeneration = generation;
+				windows.clear();
+				EnumWindows(window_enum_proc, reinterpret_cast<LPARAM>(&windows));
+			}
+			return windows;
+		}
+
+		bool getWindowRect(uintptr_t handle, cv::Rect& rect) override
+		{
+			HWND hwnd = reinterpret_cast<HWND>(handle);
+			if (!IsWindow(hwnd) || !IsWindowVisible(hwnd) || IsIconic(hwnd))
+				return false;
+
+			RECT bounds;
+			if (FAILED(DwmGetWindowAttribute(hwnd, DWMWA_EXTENDED_FRAME_BOUNDS, &bounds, sizeof(bounds))) &&
+				!GetWindowRect(hwnd, &bounds))
+				return false;
+
+			// Screen coordinates are already relative to the primary display
+			rect = cv::Rect(bounds.left, bounds.top, bounds.right - bounds.left, bounds.bottom - bounds.top);
+			return true;
+		}
+
+		bool setCursorPosition(int x, int y) override
+		{
+			return SetCursorPos(x, y);
+		}
+
+		bool getCursorPosition(int& x, int& y) override
+		{
+			POINT pt;
+			if (!GetCursorPos(&pt))
+				return false;
+			x = pt.x;
+			y = pt.y;
+			return true;
+		}
+
+		bool sendMouseButton(MouseButton button, bool down) override
+		{
+			INPUT input = {};
+			input.type = INPUT_MOUSE;
+
+			switch (button) {
+			case BUTTON_LEFT:
+				input.mi.dwFlags = down ? MOUSEEVENTF_LEFTDOWN : MOUSEEVENTF_LEFTUP;
+				break;
+			case BUTTON_RIGHT:
+				input.mi.dwFlags = down ? MOUSEEVENTF_RIGHTDOWN : MOUSEEVENTF_RIGHTUP;
+				break;
+			case BUTTON_MIDDLE:
+				input.mi.dwFlags = down ? MOUSEEVENTF_MIDDLEDOWN : MOUSEEVENTF_MIDDLEUP;
+				break;
+			case BUTTON_X1:
+				input.mi.dwFlags = down ? MOUSEEVENTF_XDOWN : MOUSEEVENTF_XUP;
+				input.mi.mouseData = XBUTTON1;
+				break;
+			case BUTTON_X2:
+				input.mi.dwFlags = down ? MOUSEEVENTF_XDOWN : MOUSEEVENTF_XUP;
+				input.mi.mouseData = XBUTTON2;
+				break;
+			default:
+				return false;
+			}
+
+			return SendInput(1, &input, sizeof(INPUT)) == 1;
+		}
+
+		bool sendMouseScroll(int vertical, int horizontal) override
+		{
+			// Each wheel "notch" is WHEEL_DELTA (120)
+			INPUT input = {};
+			input.type = INPUT_MOUSE;
+
+			// Vertical scroll
+			if (vertical != 0) {
+				input.mi.dwFlags = MOUSEEVENTF_WHEEL;
+				input.mi.mouseData = vertical * WHEEL_DELTA;
+				if (SendInput(1, &input, sizeof(INPUT)) != 1)
+					return false;
+			}
+
+			// Horizontal scroll
+			if (horizontal != 0) {
+				input.mi.dwFlags = MOUSEEVENTF_HWHEEL;
+				input.mi.mouseData = horizontal * WHEEL_DELTA;
+				if (SendInput(1, &input, sizeof(INPUT)) != 1)
+					return false;
+			}
+
+			return true;
+		}
+
+		bool sendKey(int key, bool down) override
+		{
+			INPUT input = {};
+			input.type = INPUT_KEYBOARD;
+			input.ki.wVk = static_cast<WORD>(key);
+			input.ki.dwFlags = down ? 0 : KEYEVENTF_KEYUP;
+
+			return SendInput(1, &input, sizeof(INPUT)) == 1;
+		}
+
+		bool sendCharacter(char32_t codepoint) override
+		{
+			// KEYEVENTF_UNICODE takes UTF-16 code units, so split anything outside the BMP into a surrogate pair
+			wchar_t units[2];
+			int unitCount = 1;
+			if (codepoint >= 0x10000) {
+				codepoint -= 0x10000;
+				units[0] = static_cast<wchar_t>(0xD800 + (codepoint >> 10));
+				units[1] = static_cast<wchar_t>(0xDC00 + (codepoint & 0x3FF));
+				unitCount = 2;
+			}
+			else {
+				units[0] = static_cast<wchar_t>(codepoint);
+			}
+
+			for (int i = 0; i < unitCount; i++)
+			{
+				// Prepare a KEYBDINPUT for the character
+				INPUT input[2] = {};
+				input[0].type = INPUT_KEYBOARD;
+				input[0].ki.wVk = 0;
+				input[0].ki.wScan = units[i];
+				input[0].ki.dwFlags = KEYEVENTF_UNICODE;
+
+				input[1] = input[0];
+				input[1].ki.dwFlags = KEYEVENTF_UNICODE | KEYEVENTF_KEYUP;
+
+				// Send key down and key up
+				if (SendInput(2, input, sizeof(INPUT)) != 2)
+					return false;
+			}
+			return true;
+		}
+
+	private:
+		std::mutex windowMutex;
+		std::vector<WindowInfo> windows;
+		uint64_t windowsGeneration = 0;
+		std::thread hookThread;
+		DWORD hookThreadId = 0;
+
+		// WinEvent hooks deliver to the thread that set them, and only while it pumps messages, so they get a thread of their own
+		void startWindowHook()
+		{
+			if (hookThread.joinable())
+				return;
+
+			std::promise<DWORD> started;
+			std::future<DWORD> threadId = started.get_future();
+			hookThread = std::thread([&started] {
+				// Make sure the thread has a message queue before anyone posts to it
+				MSG msg;
+				PeekMessage(&msg, NULL, WM_USER, WM_USER, PM_NOREMOVE);
+				HWINEVENTHOOK objectHook = SetWinEventHook(EVENT_OBJECT_CREATE, EVENT_OBJECT_NAMECHANGE, NULL, window_event_proc, 0, 0, WINEVENT_OUTOFCONTEXT);
+				HWINEVENTHOOK foregroundHook = SetWinEventHook(EVENT_SYSTEM_FOREGROUND, EVENT_SYSTEM_FOREGROUND, NULL, window_event_proc, 0, 0, WINEVENT_OUTOFCONTEXT);
+				started.set_value(GetCurrentThreadId());
+
+				while (GetMessage(&msg, NULL, 0, 0) > 0) {
+					TranslateMessage(&msg);
+					DispatchMessage(&msg);
+				}
+
+				if (objectHook)
+					UnhookWinEvent(objectHook);
+				if (foregroundHook)
+					UnhookWinEvent(foregroundHook);
+			});
+			hookThreadId = threadId.get();
+		}
+
+		// EnumWindows goes from the top of the z-order down
+		static BOOL CALLBACK window_enum_proc(HWND hwnd, LPARAM lParam)
+		{
+			if (!IsWindowVisible(hwnd))
+				return TRUE;
+
+			auto* windows = reinterpret_cast<std::vector<WindowInfo>*>(lParam);
+			WindowInfo info;
+			info.handle = reinterpret_cast<uintptr_t>(hwnd);
+
+			wchar_t buffer[512];
+			info.title = to_utf8(buffer, GetWindowTextW(hwnd, buffer, 512));
+			info.className = to_utf8(buffer, GetClassNameW(hwnd, buffer, 512));
+			windows->push_back(std::move(info));
+			return TRUE;
+		}
+
+		struct MonitorSearch {
+			POINT pt;
+			int index;
+			int found;
+			int x, y;
+		};
+
+		static BOOL CALLBACK monitor_enum_proc(HMONITOR hMonitor, HDC, LPRECT lprcMonitor, LPARAM dwData) {
+			MonitorSearch* search = reinterpret_cast<MonitorSearch*>(dwData);
+			if (PtInRect(lprcMonitor, search->pt)) {
+				search->found = search->index;
+				search->x = search->pt.x - lprcMonitor->left;
+				search->y = search->pt.y - lprcMonitor->top;
+				return FALSE; // Stop enumeration
+			}
+			search->index++;
+			return TRUE; // Continue enumeration
+		}
+
+		static bool getDisplaySettings(int displayIndex, DISPLAY_DEVICE& dd, DEVMODE& dm)
+		{
+			dd = {};
+			dd.cb = sizeof(dd);
+			if (!EnumDisplayDevices(NULL, displayIndex, &dd, 0))
+				return false;
+
+			dm = {};
+			dm.dmSize = sizeof(dm);
+			return EnumDisplaySettings(dd.DeviceName, ENUM_CURRENT_SETTINGS, &dm);
+		}
+
+		// 24 bits per pixel is BGR, 32 is BGRX.
+		static cv::Mat captureDC(DISPLAY_DEVICE const& dd, int x, int y, int w, int h, int bits = 24)
+		{
+			// Get the device context of the specific monitor
+			HDC hScreenDC = CreateDC(NULL, dd.DeviceName, NULL, NULL);
+			HDC hMemoryDC = CreateCompatibleDC(hScreenDC);
+
+			// Create a compatible bitmap
+			HBITMAP hBitmap = CreateCompatibleBitmap(hScreenDC, w, h);
+			HBITMAP hOldBitmap = (HBITMAP)SelectObject(hMemoryDC, hBitmap);
+
+			// Copy screen to bitmap
+			BitBlt(hMemoryDC, 0, 0, w, h, hScreenDC, x, y, SRCCOPY);
+
+			// Create OpenCV image
+			BITMAPINFOHEADER bi = { 0 };
+			bi.biSize = sizeof(BITMAPINFOHEADER);
+			bi.biWidth = w;
+			bi.biHeight = -h; // negative for top-down bitmap
+			bi.biPlanes = 1;
+			bi.biBitCount = static_cast<WORD>(bits);
+			bi.biCompression = BI_RGB;
+
+			cv::Mat mat(h, w, bits == 32 ? CV_8UC4 : CV_8UC3);
+			GetDIBits(hMemoryDC, hBitmap, 0, h, mat.data, (BITMAPINFO*)&bi, DIB_RGB_COLORS);
+
+			// Cleanup
+			SelectObject(hMemoryDC, hOldBitmap);
+			DeleteObject(hBitmap);
+			DeleteDC(hMemoryDC);
+			DeleteDC(hScreenDC);
+
+			return mat;
+		}
+	};
+
+	std::unique_ptr<Backend> createNativeBackend()
+	{
+		return std::make_unique<Win32Backend>();
+	}
+}
+
+#endif // _WIN32
@@ -0,0 +1,960 @@
+// backend_x11.cpp : XShm capture, XTest input and XRandR displays.
+#include "pch.h"
+
+#ifndef _WIN32
+
+#include "backend.h"
+
+#include <opencv2/imgproc.hpp>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+
+// Xlib defines macros such as None, Bool and Status, so it must come after every C++ header
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include <X11/Xatom.h>
+#include <X11/XKBlib.h>
+#include <X11/keysym.h>
+#include <X11/extensions/XShm.h>
+#include <X11/extensions/XTest.h>
+#include <X11/extensions/Xrandr.h>
+#include <X11/extensions/Xdamage.h>
+#include <X11/extensions/Xfixes.h>
+
+namespace chivel
+{
+	// Xlib's default error handler exits the process, so errors are recorded instead.
+	// The handler runs on the thread that waits for the failed request's reply, so each thread has its own slot
+	// and capture sessions on other threads cannot clear or fake each other's errors.
+	static thread_local int x11_last_error = 0;
+
+	static int x11_error_handler(Display*, XErrorEvent* event)
+	{
+		x11_last_error = event->error_code;
+		return 0;
+	}
+
+	static KeySym key_to_keysym(int key)
+	{
+		if (key >= KEY_0 && key <= KEY_0 + 9)
+			return XK_0 + (key - KEY_0);
+		if (key >= KEY_A && key <= KEY_A + 25)
+			return XK_a + (key - KEY_A);
+		if (key >= KEY_NUMPAD0 && key <= KEY_NUMPAD0 + 9)
+			return XK_KP_0 + (key - KEY_NUMPAD0);
+		if (key >= KEY_F1 && key <= KEY_F12)
+			return XK_F1 + (key - KEY_F1);
+
+		switch (key) {
+		case KEY_BACKSPACE: return XK_BackSpace;
+		case KEY_TAB: return XK_Tab;
+		case KEY_ENTER: return XK_Return;
+		case KEY_SHIFT: return XK_Shift_L;
+		case KEY_CTRL: return XK_Control_L;
+		case KEY_ALT: return XK_Alt_L;
+		case KEY_PAUSE: return XK_Pause;
+		case KEY_CAPSLOCK: return XK_Caps_Lock;
+		case KEY_ESC: return XK_Escape;
+		case KEY_SPACE: return XK_space;
+		case KEY_PAGEUP: return XK_Page_Up;
+		case KEY_PAGEDOWN: return XK_Page_Down;
+		case KEY_END: return XK_End;
+		case KEY_HOME: return XK_Home;
+		case KEY_LEFT: return XK_Left;
+		case KEY_UP: return XK_Up;
+		case KEY_RIGHT: return XK_Right;
+		case KEY_DOWN: return XK_Down;
+		case KEY_PRINTSCREEN: return XK_Print;
+		case KEY_INSERT: return XK_Insert;
+		case KEY_DELETE: return XK_Delete;
+		case KEY_MULTIPLY: return XK_KP_Multiply;
+		case KEY_ADD: return XK_KP_Add;
+		case KEY_SEPARATOR: return XK_KP_Separator;
+		case KEY_SUBTRACT: return XK_KP_Subtract;
+		case KEY_DECIMAL: return XK_KP_Decimal;
+		case KEY_DIVIDE: return XK_KP_Divide;
+		case KEY_NUMLOCK: return XK_Num_Lock;
+		case KEY_SCROLLLOCK: return XK_Scroll_Lock;
+		case 0x5B: return XK_Super_L; // VK_LWIN
+		case 0x5C: return XK_Super_R; // VK_RWIN
+		case 0xA0: return XK_Shift_L; // VK_LSHIFT
+		case 0xA1: return XK_Shift_R; // VK_RSHIFT
+		case 0xA2: return XK_Control_L; // VK_LCONTROL
+		case 0xA3: return XK_Control_R; // VK_RCONTROL
+		case 0xA4: return XK_Alt_L; // VK_LMENU
+		case 0xA5: return XK_Alt_R; // VK_RMENU
+		default: return NoSymbol;
+		}
+	}
+
+	// Points pixels at the XImage's own memory when it is BGRX, the common case. Returns false for any other layout.
+	static bool view_ximage(XImage* image, cv::Mat& pixels)
+	{
+		if (image->bits_per_pixel != 32 || image->byte_order != LSBFirst ||
+			image->red_mask != 0xFF0000 || image->green_mask != 0xFF00 || image->blue_mask != 0xFF)
+			return false;
+		pixels = cv::Mat(image->height, image->width, CV_8UC4, image->data, image->bytes_per_line);
+		return true;
+	}
+
+	// Copies a ZPixmap XImage into an 8-bit BGR Mat of the same size.
+	static void copy_ximage(XImage* image, cv::Mat& target)
+	{
+		cv::Mat bgrx;
+		if (view_ximage(image, bgrx)) {
+			// OpenCV can drop the padding byte directly
+			cv::cvtColor(bgrx, target, cv::COLOR_BGRA2BGR);
+			return;
+		}
+
+		// Anything else (16-bit visuals, odd masks) goes through XGetPixel
+		auto shift_of = [](unsigned long mask) {
+			int shift = 0;
+			while (mask && !(mask & 1)) {
+				mask >>= 1;
+				shift++;
+			}
+			return shift;
+		};
+		auto scale_of = [](unsigned long mask, int shift) {
+			unsigned long max = mask >> shift;
+			return max ? 255.0 / max : 0.0;
+		};
+		int rs = shift_of(image->red_mask), gs = shift_of(image->green_mask), bs = shift_of(image->blue_mask);
+		double rk = scale_of(image->red_mask, rs), gk = scale_of(image->green_mask, gs), bk = scale_of(image->blue_mask, bs);
+		for (int y = 0; y < image->height; y++) {
+			cv::Vec3b* row = target.ptr<cv::Vec3b>(y);
+			for (int x = 0; x < image->width; x++) {
+				unsigned long pixel = XGetPixel(image, x, y);
+				row[x][0] = static_cast<uchar>(((pixel & image->blue_mask) >> bs) * bk);
+				row[x][1] = static_cast<uchar>(((pixel & image->green_mask) >> gs) * gk);
+				row[x][2] = static_cast<uchar>(((pixel & image->red_mask) >> rs) * rk);
+			}
+		}
+	}
+
+	static cv::Size root_size(Display* display, Window root)
+	{
+		Window rootReturn;
+		int x, y;
+		unsigned int width, height, border, depth;
+		if (!XGetGeometry(display, root, &rootReturn, &x, &y, &width, &height, &border, &depth))
+			return cv::Size();
+		return cv::Size(static_cast<int>(width), static_cast<int>(height));
+	}
+
+	// Reads a whole window property of the given type. Format 32 items come back as longs, as Xlib always does.
+	static bool get_property(Display* display, Window window, Atom property, Atom type, std::vector<unsigned char>& data, unsigned long& count)
+	{
+		Atom actualType;
+		int actualFormat;
+		unsigned long bytesAfter;
+		unsigned char* value = nullptr;
+		x11_last_error = 0;
+		if (XGetWindowProperty(display, window, property, 0, 0x7FFFFFFF, False, type, &actualType, &actualFormat, &count, &bytesAfter, &value) != Success || x11_last_error != 0)
+			return false;
+		if (!value)
+			return false;
+		if (actualType != type) {
+			XFree(value);
+			return false;
+		}
+		size_t itemSize = actualFormat == 32 ? sizeof(long) : actualFormat / 8;
+		data.assign(value, value + count * itemSize);
+		XFree(value);
+		return true;
+	}
+
+	// A shared memory XImage the X server can write into directly.
+	class ShmImage
+	{
+	public:
+		ShmImage(Display* display, int width, int height)
+			: display(display)
+		{
+			int screen = DefaultScreen(display);
+			image = XShmCreateImage(display, DefaultVisual(display, screen), DefaultDepth(display, screen), ZPixmap, nullptr, &info, width, height);
+			if (!image)
+				return;
+
+			info.shmid = shmget(IPC_PRIVATE, static_cast<size_t>(image->bytes_per_line) * image->height, IPC_CREAT | 0600);
+			if (info.shmid < 0) {
+				XDestroyImage(image);
+				image = nullptr;
+				return;
+			}
+			info.shmaddr = image->data = static_cast<char*>(shmat(info.shmid, nullptr, 0));
+			info.readOnly = False;
+
+			x11_last_error = 0;
+			attached = XShmAttach(display, &info) && (XSync(display, False), x11_last_error == 0);
+
+			// Mark the segment for removal now, so it is freed even if the process dies
+			shmctl(info.shmid, IPC_RMID, nullptr);
+		}
+
+		~ShmImage()
+		{
+			if (!image)
+				return;
+			if (attached)
+				XShmDetach(display, &info);
+			XDestroyImage(image);
+			shmdt(info.shmaddr);
+		}
+
+		ShmImage(ShmImage const&) = delete;
+		ShmImage& operator=(ShmImage const&) = delete;
+
+		bool isValid() const
+		{
+			return image && attached;
+		}
+
+		XImage* get() const
+		{
+			return image;
+		}
+
+		// Reads the given area of the drawable, which must match the size of the image.
+		bool grab(Drawable drawable, int x, int y)
+		{
+			x11_last_error = 0;
+			return XShmGetImage(display, drawable, image, x, y, AllPlanes) && x11_last_error == 0;
+		}
+
+	private:
+		Display* display;
+		XImage* image = nullptr;
+		XShmSegmentInfo info = {};
+		bool attached = false;
+	};
+
+	// Keeps one shared memory segment attached and converts straight into the same frame on every grab.
+	// It has its own connection, so grabbing never waits on the backend and can happen from any thread.
+	class X11CaptureSession : public CaptureSession
+	{
+	public:
+		// The area is in root window coordinates.
+		explicit X11CaptureSession(cv::Rect area)
+			: area(area)
+		{
+			frame = cv::Mat(area.height, area.width, CV_8UC3, cv::Scalar::all(0));
+		}
+
+		~X11CaptureSession() override
+		{
+			if (parts)
+				XFixesDestroyRegion(display, parts);
+			if (damage)
+				XDamageDestroy(display, damage);
+			shm.reset();
+			if (display)
+				XCloseDisplay(display);
+		}
+
+		bool open()
+		{
+			display = XOpenDisplay(nullptr);
+			if (!display)
+				return false;
+			root = DefaultRootWindow(display);
+
+			// Anything outside of the screen stays black
+			visible = area & cv::Rect(cv::Point(0, 0), root_size(display, root));
+			if (visible.empty())
+				return true;
+			target = frame(visible - area.tl());
+
+			int major = 0, minor = 0;
+			Bool pixmaps = False;
+			if (XShmQueryVersion(display, &major, &minor, &pixmaps)) {
+				shm = std::make_unique<ShmImage>(display, visible.width, visible.height);
+				if (!shm->isValid())
+					shm.reset(); // Remote displays can't share memory, use XGetImage instead
+			}
+
+			// Without DAMAGE, grabDamage falls back to comparing tiles
+			int event = 0, error = 0;
+			if (XDamageQueryExtension(display, &event, &error) && XFixesQueryExtension(display, &event, &error)) {
+				major = 1;
+				minor = 1;
+				XDamageQueryVersion(display, &major, &minor);
+				major = 5;
+				minor = 0;
+				XFixesQueryVersion(display, &major, &minor); // Must be called before any XFixes request
+				damage = XDamageCreate(display, root, XDamageReportNonEmpty);
+				parts = XFixesCreateRegion(display, nullptr, 0);
+			}
+			return true;
+		}
+
+		bool grab() override
+		{
+			if (visible.empty())
+				return true;
+
+			if (shm) {
+				if (!shm->grab(root, visible.x, visible.y))
+					return false;
+				copy_ximage(shm->get(), target);
+				return true;
+			}
+
+			XImage* image = XGetImage(display, root, visible.x, visible.y, visible.width, visible.height, AllPlanes, ZPixmap);
+			if (!image)
+				return false;
+			copy_ximage(image, target);
+			XDestroyImage(image);
+			return true;
+		}
+
+		bool grabDamage(std::vector<cv::Rect>& dirty) override
+		{
+			if (!damage)
+				return CaptureSession::grabDamage(dirty);
+
+			dirty.clear();
+
+			// The region is read directly, so the notify events are not needed
+			while (XPending(display)) {
+				XEvent event;
+				XNextEvent(display, &event);
+			}
+
+			if (!damageStarted) {
+				XDamageSubtract(display, damage, None, None);
+				if (!grab())
+					return false;
+				damageStarted = true;
+				dirty.push_back(cv::Rect(0, 0, frame.cols, frame.rows));
+				return true;
+			}
+
+			// Take everything damaged since the last grab. Anything damaged from here on is reported next time.
+			XDamageSubtract(display, damage, None, parts);
+			int count = 0;
+			XRectangle* rects = XFixesFetchRegion(display, parts, &count);
+			long long changedArea = 0;
+			for (int i = 0; i < count; i++) {
+				cv::Rect rect = cv::Rect(rects[i].x, rects[i].y, rects[i].width, rects[i].height) & visible;
+				if (rect.empty())
+					continue;
+				dirty.push_back(rect - area.tl());
+				changedArea += rect.area();
+			}
+			if (rects)
+				XFree(rects);
+
+			if (dirty.empty())
+				return true;
+
+			// Past half of the area, one shared memory grab beats a round trip per rect
+			if (changedArea * 2 > visible.area())
+				return grab();
+
+			for (cv::Rect const& rect : dirty) {
+				cv::Rect rootRect = rect + area.tl();
+				XImage* image = XGetImage(display, root, rootRect.x, rootRect.y, rootRect.width, rootRect.height, AllPlanes, ZPixmap);
+				if (!image)
+					return false;
+				cv::Mat part = frame(rect);
+				copy_ximage(image, part);
+				XDestroyImage(image);
+			}
+			return true;
+		}
+
+	private:
+		Display* display = nullptr;
+		Window root = 0;
+		Damage damage = 0;
+		XserverRegion parts = 0;
+		bool damageStarted = false;
+		cv::Rect area;
+		cv::Rect visible;
+		cv::Mat target; // the visible part of the frame
+		std::unique_ptr<ShmImage> shm;
+	};
+
+	class X11Backend : public Backend
+	{
+	public:
+		X11Backend()
+		{
+			XInitThreads();
+			XSetErrorHandler(x11_error_handler);
+
+			display = XOpenDisplay(nullptr);
+			if (!display)
+				return;
+			root = DefaultRootWindow(display);
+
+			netClientList = XInternAtom(display, "_NET_CLIENT_LIST", False);
+			netClientListStacking = XInternAtom(display, "_NET_CLIENT_LIST_STACKING", False);
+			netWmName = XInternAtom(display, "_NET_WM_NAME", False);
+			utf8String = XInternAtom(display, "UTF8_STRING", False);
+
+			int major = 0, minor = 0, event = 0, error = 0;
+			Bool pixmaps = False;
+			hasShm = XShmQueryVersion(display, &major, &minor, &pixmaps);
+			hasXTest = XTestQueryExtension(display, &event, &error, &major, &minor);
+			hasRandr = XRRQueryExtension(display, &event, &error) &&
+				XRRQueryVersion(display, &major, &minor) &&
+				(major > 1 || minor >= 5); // XRRGetMonitors needs RandR 1.5
+		}
+
+		~X11Backend() override
+		{
+			if (display)
+				XCloseDisplay(display);
+		}
+
+		char const* getName() const override
+		{
+			return "x11";
+		}
+
+		int getDisplayCount() override
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (!display)
+				return 0;
+			return static_cast<int>(getMonitors().size());
+		}
+
+		bool getDisplay(int displayIndex, DisplayInfo& info) override
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (!display)
+				return false;
+			std::vector<DisplayInfo> monitors = getMonitors();
+			if (displayIndex < 0 || displayIndex >= static_cast<int>(monitors.size()))
+				return false;
+
+			// Monitors are in root window coordinates, but chivel uses the primary display as the origin
+			info = monitors[displayIndex];
+			info.x -= monitors[0].x;
+			info.y -= monitors[0].y;
+			return true;
+		}
+
+		int findDisplay(int x, int y) override
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (!display)
+				return -1;
+			std::vector<DisplayInfo> monitors = getMonitors();
+			int rootX = x + monitors[0].x;
+			int rootY = y + monitors[0].y;
+			for (size_t i = 0; i < monitors.size(); i++) {
+				DisplayInfo const& m = monitors[i];
+				if (rootX >= m.x && rootX < m.x + m.width && rootY >= m.y && rootY < m.y + m.height)
+					return static_cast<int>(i);
+			}
+			return -1;
+		}
+
+		cv::Mat captureScreen(int displayIndex) override
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (!display)
+				return cv::Mat();
+			std::vector<DisplayInfo> monitors = getMonitors();
+			if (displayIndex < 0 || displayIndex >= static_cast<int>(monitors.size()))
+				return cv::Mat();
+
+			DisplayInfo const& m = monitors[displayIndex];
+			return captureRoot(cv::Rect(m.x, m.y, m.width, m.height));
+		}
+
+		cv::Mat captureRect(int x, int y, int w, int h, int displayIndex) override
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (!display)
+				return cv::Mat();
+			std::vector<DisplayInfo> monitors = getMonitors();
+			if (displayIndex < 0 || displayIndex >= static_cast<int>(monitors.size()))
+				return cv::Mat();
+
+			DisplayInfo const& m = monitors[displayIndex];
+			return captureRoot(cv::Rect(m.x + x, m.y + y, w, h));
+		}
+
+		cv::Mat captureConverted(int displayIndex, cv::Rect rect, CaptureConverter const& convert) override
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (!display)
+				return cv::Mat();
+			std::vector<DisplayInfo> monitors = getMonitors();
+			if (displayIndex < 0 || displayIndex >= static_cast<int>(monitors.size()))
+				return cv::Mat();
+
+			DisplayInfo const& m = monitors[displayIndex];
+			cv::Rect area = rect.empty() ? cv::Rect(m.x, m.y, m.width, m.height) : rect + cv::Point(m.x, m.y);
+			if (area.width <= 0 || area.height <= 0)
+				return cv::Mat();
+
+			// Partly off screen areas are padded with black in a BGR copy first
+			if ((area & cv::Rect(cv::Point(0, 0), root_size(display, root))) != area) {
+				cv::Mat bgr = captureRoot(area);
+				return bgr.empty() ? bgr : convert(bgr);
+			}
+
+			cv::Mat result;
+			bool grabbed = grabRoot(area, [&](XImage* image) {
+				cv::Mat pixels;
+				if (!view_ximage(image, pixels)) {
+					pixels.create(area.height, area.width, CV_8UC3);
+					copy_ximage(image, pixels);
+				}
+				result = convert(pixels);
+			});
+			return grabbed ? result : cv::Mat();
+		}
+
+		bool captureRects(int displayIndex, std::vector<cv::Rect> const& rects, std::vector<cv::Mat>& results) override
+		{
+			// The monitors are looked up once for every rect
+			std::lock_guard<std::mutex> lock(mutex);
+			if (!display)
+				return false;
+			std::vector<DisplayInfo> monitors = getMonitors();
+			if (displayIndex < 0 || displayIndex >= static_cast<int>(monitors.size()))
+				return false;
+
+			DisplayInfo const& m = monitors[displayIndex];
+			results.resize(rects.size());
+			for (size_t i = 0; i < rects.size(); i++) {
+				results[i] = captureRoot(rects[i] + cv::Point(m.x, m.y));
+				if (results[i].empty())
+					return false;
+			}
+			return true;
+		}
+
+		std::unique_ptr<CaptureSession> openCapture(int displayIndex, cv::Rect rect) override
+		{
+			cv::Rect area;
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				if (!display)
+					return nullptr;
+				std::vector<DisplayInfo> monitors = getMonitors();
+				if (displayIndex < 0 || displayIndex >= static_cast<int>(monitors.size()))
+					return nullptr;
+
+				DisplayInfo const& m = monitors[displayIndex];
+				area = rect.empty() ? cv::Rect(m.x, m.y, m.width, m.height) : rect + cv::Point(m.x, m.y);
+			}
+
+			auto session = std::make_unique<X11CaptureSession>(area);
+			if (!session->open())
+				return nullptr;
+			return session;
+		}
+
+		std::vector<WindowInfo> getWindows() override
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (!display)
+				return {};
+
+			if (!watchingWindows) {
+				// Top level windows coming and going, and the window manager's client list changing, drop the window cache.
+				// Only selected once windows are asked for, so nothing queues up for programs that never do.
+				XSelectInput(display, root, SubstructureNotifyMask | PropertyChangeMask);
+				watchingWindows = true;
+			}
+			processEvents();
+			if (windowsDirty) {
+				windows = listWindows();
+				windowsDirty = false;
+			}
+			return windows;
+		}
+
+		bool getWindowRect(uintptr_t handle, cv::Rect& rect) override
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (!display)
+				return false;
+
+			Window window = static_cast<Window>(handle);
+			XWindowAttributes attributes;
+			x11_last_error = 0;
+			if (!XGetWindowAttributes(display, window, &attributes) || x11_last_error != 0)
+				return false;
+			if (attributes.map_state != IsViewable)
+				return false;
+
+			int rootX = 0, rootY = 0;
+			Window child;
+			if (!XTranslateCoordinates(display, window, root, 0, 0, &rootX, &rootY, &child))
+				return false;
+
+			std::vector<DisplayInfo> monitors = getMonitors();
+			rect = cv::Rect(rootX - monitors[0].x, rootY - monitors[0].y, attributes.width, attributes.height);
+			return true;
+		}
+
+		bool setCursorPosition(int x, int y) override
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (!display)
+				return false;
+			std::vector<DisplayInfo> monitors = getMonitors();
+			int rootX = x + monitors[0].x;
+			int rootY = y + monitors[0].y;
+
+			if (hasXTest)
+				XTestFakeMotionEvent(display, -1, rootX, rootY, CurrentTime);
+			else
+				XWarpPointer(display, None, root, 0, 0, 0, 0, rootX, rootY);
+			XFlush(display);
+			return true;
+		}
+
+		bool getCursorPosition(int& x, int& y) override
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (!display)
+				return false;
+
+			Window rootReturn, child;
+			int rootX, rootY, winX, winY;
+			unsigned int mask;
+			if (!XQueryPointer(display, root, &rootReturn, &child, &rootX, &rootY, &winX, &winY, &mask))
+				return false;
+
+			std::vector<DisplayInfo> monitors = getMonitors();
+			x = rootX - monitors[0].x;
+			y = rootY - monitors[0].y;
+			return true;
+		}
+
+		bool sendMouseButton(MouseButton button, bool down) override
+		{
+			unsigned int xbutton;
+			switch (button) {
+			case BUTTON_LEFT: xbutton = Button1; break;
+			case BUTTON_MIDDLE: xbutton = Button2; break;
+			case BUTTON_RIGHT: xbutton = Button3; break;
+			case BUTTON_X1: xbutton = 8; break;
+			case BUTTON_X2: xbutton = 9; break;
+			default: return false;
+			}
+
+			std::lock_guard<std::mutex> lock(mutex);
+			if (!display || !hasXTest)
+				return false;
+			XTestFakeButtonEvent(display, xbutton, down ? True : False, CurrentTime);
+			XFlush(display);
+			return true;
+		}
+
+		bool sendMouseScroll(int vertical, int horizontal) override
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (!display || !hasXTest)
+				return false;
+
+			// X11 has no wheel events, each notch is a press and release of buttons 4-7
+			auto notch = [this](unsigned int xbutton, int count) {
+				for (int i = 0; i < count; i++) {
+					XTestFakeButtonEvent(display, xbutton, True, CurrentTime);
+					XTestFakeButtonEvent(display, xbutton, False, CurrentTime);
+				}
+			};
+			notch(vertical > 0 ? Button4 : Button5, std::abs(vertical));
+			notch(horizontal > 0 ? 7 : 6, std::abs(horizontal));
+			XFlush(display);
+			return true;
+		}
+
+		bool sendKey(int key, bool down) override
+		{
+			KeySym keysym = key_to_keysym(key);
+			if (keysym == NoSymbol)
+				return false;
+
+			std::lock_guard<std::mutex> lock(mutex);
+			if (!display || !hasXTest)
+				return false;
+			KeyCode keycode = XKeysymToKeycode(display, keysym);
+			if (keycode == 0)
+				return false;
+			XTestFakeKeyEvent(display, keycode, down ? True : False, CurrentTime);
+			XFlush(display);
+			return true;
+		}
+
+		bool sendCharacter(char32_t codepoint) override
+		{
+			KeySym keysym;
+			if (codepoint == '\n' || codepoint == '\r')
+				keysym = XK_Return;
+			else if (codepoint == '\t')
+				keysym = XK_Tab;
+			else if (codepoint == '\b')
+				keysym = XK_BackSpace;
+			else if ((codepoint >= 0x20 && codepoint <= 0x7E) || (codepoint >= 0xA0 && codepoint <= 0xFF))
+				keysym = codepoint; // Latin-1 keysyms are the code point
+			else
+				keysym = 0x01000000 | codepoint; // Unicode keysyms
+
+			std::lock_guard<std::mutex> lock(mutex);
+			if (!display || !hasXTest)
+				return false;
+
+			// Characters that are not on the keyboard get temporarily mapped onto an unused keycode
+			KeyCode keycode = XKeysymToKeycode(display, keysym);
+			bool remapped = false;
+			if (keycode == 0) {
+				keycode = findUnusedKeycode();
+				if (keycode == 0)
+					return false;
+				XChangeKeyboardMapping(display, keycode, 1, &keysym, 1);
+				XSync(display, False);
+				remapped = true;
+			}
+
+			// Upper case letters and symbols live on the shifted level of their key
+			bool shift = !remapped &&
+				XkbKeycodeToKeysym(display, keycode, 0, 0) != keysym &&
+				XkbKeycodeToKeysym(display, keycode, 0, 1) == keysym;
+			KeyCode shiftKeycode = XKeysymToKeycode(display, XK_Shift_L);
+
+			if (shift)
+				XTestFakeKeyEvent(display, shiftKeycode, True, CurrentTime);
+			XTestFakeKeyEvent(display, keycode, True, CurrentTime);
+			XTestFakeKeyEvent(display, keycode, False, CurrentTime);
+			if (shift)
+				XTestFakeKeyEvent(display, shiftKeycode, False, CurrentTime);
+
+			if (remapped) {
+				// The events must be processed before the mapping is restored
+				XSync(display, False);
+				KeySym noSymbol = NoSymbol;
+				XChangeKeyboardMapping(display, keycode, 1, &noSymbol, 1);
+			}
+			XFlush(display);
+			return true;
+		}
+
+	private:
+		// Smaller areas are read with XGetImage
+		static constexpr int SHM_MIN_AREA = 64 * 64;
+
+		Display* display = nullptr;
+		Window root = 0;
+		bool hasShm = false;
+		bool hasXTest = false;
+		bool hasRandr = false;
+		std::mutex mutex;
+
+		Atom netClientList = 0;
+		Atom netClientListStacking = 0;
+		Atom netWmName = 0;
+		Atom utf8String = 0;
+		std::vector<WindowInfo> windows;
+		bool windowsDirty = true;
+		bool watchingWindows = false;
+
+		// The backend's connection only ever receives the events selected for the window cache
+		void processEvents()
+		{
+			while (XPending(display)) {
+				XEvent event;
+				XNextEvent(display, &event);
+				switch (event.type) {
+				case CreateNotify:
+				case DestroyNotify:
+				case MapNotify:
+				case UnmapNotify:
+				case ReparentNotify:
+					windowsDirty = true;
+					break;
+				case PropertyNotify:
+					if (event.xproperty.atom == netClientList || event.xproperty.atom == netClientListStacking ||
+						event.xproperty.atom == netWmName || event.xproperty.atom == XA_WM_NAME)
+						windowsDirty = true;
+					break;
+				default:
+					break;
+				}
+			}
+		}
+
+		std::vector<WindowInfo> listWindows()
+		{
+			// With a window manager, its client list has the real application windows in stacking order (bottom to top).
+			// Without one (such as a bare Xvfb), the mapped children of the root are the top level windows.
+			std::vector<Window> handles;
+			std::vector<unsigned char> data;
+			unsigned long count = 0;
+			if (get_property(display, root, netClientListStacking, XA_WINDOW, data, count) ||
+				get_property(display, root, netClientList, XA_WINDOW, data, count)) {
+				long const* items = reinterpret_cast<long const*>(data.data());
+				for (unsigned long i = 0; i < count; i++)
+					handles.push_back(static_cast<Window>(items[i]));
+			}
+			else {
+				Window rootReturn, parent;
+				Window* children = nullptr;
+				unsigned int childCount = 0;
+				if (XQueryTree(display, root, &rootReturn, &parent, &children, &childCount)) {
+					for (unsigned int i = 0; i < childCount; i++) {
+						XWindowAttributes attributes;
+						if (XGetWindowAttributes(display, children[i], &attributes) &&
+							attributes.map_state == IsViewable && !attributes.override_redirect)
+							handles.push_back(children[i]);
+					}
+					if (children)
+						XFree(children);
+				}
+			}
+
+			std::vector<WindowInfo> result;
+			for (auto it = handles.rbegin(); it != handles.rend(); ++it) {
+				Window window = *it;
+				x11_last_error = 0;
+				// Renames show up as property changes on the window itself
+				XSelectInput(display, window, PropertyChangeMask);
+
+				WindowInfo info;
+				info.handle = static_cast<uintptr_t>(window);
+				if (get_property(display, window, netWmName, utf8String, data, count)) {
+					info.title.assign(data.begin(), data.end());
+				}
+				else {
+					char* name = nullptr;
+					if (XFetchName(display, window, &name) && name) {
+						info.title = name;
+						XFree(name);
+					}
+				}
+				XClassHint hint = {};
+				if (XGetClassHint(display, window, &hint)) {
+					if (hint.res_class)
+						info.className = hint.res_class;
+					XFree(hint.res_name);
+					XFree(hint.res_class);
+				}
+				if (x11_last_error == 0)
+					result.push_back(info);
+			}
+			return result;
+		}
+
+		// All monitors in root window coordinates, with the primary monitor first. Never empty.
+		std::vector<DisplayInfo> getMonitors()
+		{
+			std::vector<DisplayInfo> monitors;
+			if (hasRandr) {
+				int count = 0;
+				XRRMonitorInfo* infos = XRRGetMonitors(display, root, True, &count);
+				if (infos) {
+					for (int i = 0; i < count; i++) {
+						DisplayInfo info;
+						info.x = infos[i].x;
+						info.y = infos[i].y;
+						info.width = infos[i].width;
+						info.height = infos[i].height;
+						if (infos[i].primary)
+							monitors.insert(monitors.begin(), info);
+						else
+							monitors.push_back(info);
+					}
+					XRRFreeMonitors(infos);
+				}
+			}
+			if (monitors.empty()) {
+				// No RandR, so the whole screen is one display
+				DisplayInfo info;
+				cv::Size size = root_size(display, root);
+				info.width = size.width;
+				info.height = size.height;
+				monitors.push_back(info);
+			}
+			return monitors;
+		}
+
+		// Captures an area of the root window. Anything outside of the screen is black.
+		cv::Mat captureRoot(cv::Rect area)
+		{
+			if (area.width <= 0 || area.height <= 0)
+				return cv::Mat();
+
+			cv::Mat mat(area.height, area.width, CV_8UC3, cv::Scalar::all(0));
+			cv::Rect visible = area & cv::Rect(cv::Point(0, 0), root_size(display, root));
+			if (visible.empty())
+				return mat;
+
+			cv::Mat target = mat(visible - area.tl());
+			if (!grabRoot(visible, [&target](XImage* image) { copy_ximage(image, target); }))
+				return cv::Mat();
+			return mat;
+		}
+
+		// Reads the area of the root window, which must be on the screen, and hands the XImage to use before it is freed.
+		template <typename Use>
+		bool grabRoot(cv::Rect area, Use&& use)
+		{
+			// Setting up a shared memory segment costs more than sending a few pixels over the socket
+			if (hasShm && area.area() >= SHM_MIN_AREA) {
+				ShmImage image(display, area.width, area.height);
+				if (image.isValid()) {
+					if (!image.grab(root, area.x, area.y))
+						return false;
+					use(image.get());
+					return true;
+				}
+				// Remote displays can't share memory, fall through to XGetImage
+			}
+
+			x11_last_error = 0;
+			XImage* image = XGetImage(display, root, area.x, area.y, area.width, area.height, AllPlanes, ZPixmap);
+			if (!image)
+				return false;
+			use(image);
+			XDestroyImage(image);
+			return true;
+		}
+
+		// Finds a keycode with no keysyms bound to it, or 0.
+		KeyCode findUnusedKeycode()
+		{
+			int minKeycode = 0, maxKeycode = 0, perKeycode = 0;
+			XDisplayKeycodes(display, &minKeycode, &maxKeycode);
+			KeySym* keysyms = XGetKeyboardMapping(display, static_cast<KeyCode>(minKeycode), maxKeycode - minKeycode + 1, &perKeycode);
+			if (!keysyms)
+				return 0;
+
+			KeyCode found = 0;
+			for (int keycode = maxKeycode; keycode >= minKeycode && !found; keycode--) {
+				bool unused = true;
+				for (int i = 0; i < perKeycode; i++) {
+					if (keysyms[(keycode - minKeycode) * perKeycode + i] != NoSymbol) {
+						unused = false;
+						break;
+					}
+				}
+				if (unused)
+					found = static_cast<KeyCode>(keycode);
+			}
+			XFree(keysyms);
+			return found;
+		}
+	};
+
+	std::unique_ptr<Backend> createNativeBackend()
+	{
+		return std::make_unique<X11Backend>();
+	}
+}
+
+#endif // !_WIN32
@@ -0,0 +1,52 @@
+// blend.cpp : Integer alpha blending.
+#include "pch.h"
+
+#include "blend.h"
+
+#include <algorithm>
+
+namespace chivel
+{
+	// v / 255 rounded to the nearest whole number, exact for every v from 0 to 255 * 255
+	static inline int div255(int v)
+	{
+		v += 128;
+		return (v + (v >> 8)) >> 8;
+	}
+
+	// One row of pixels. Fully transparent pixels go through the same math and come out unchanged,
+	// which keeps the loop free of branches so the compiler can vectorize it.
+	template<int DstChannels>
+	static void blend_row(uchar const* src, uchar* dst, int width, int opacity)
+	{
+		for (int x = 0; x < width; x++, src += 4, dst += DstChannels) {
+			int a = (src[3] * opacity + 128) >> 8;
+			int inverse = 255 - a;
+			dst[0] = static_cast<uchar>(div255(src[0] * a + dst[0] * inverse));
+			dst[1] = static_cast<uchar>(div255(src[1] * a + dst[1] * inverse));
+			dst[2] = static_cast<uchar>(div255(src[2] * a + dst[2] * inverse));
+			if constexpr (DstChannels == 4)
+				dst[3] = static_cast<uchar>(div255(255 * a + dst[3] * inverse));
+		}
+	}
+
+	void blendOver(cv::Mat const& src, cv::Mat& dst, double opacity)
+	{
+		CV_Assert(src.type() == CV_8UC4 && (dst.type() == CV_8UC3 || dst.type() == CV_8UC4) && src.size() == dst.size());
+
+		// Opacity as a fraction of 256, so full opacity leaves the source alpha exactly as it is
+		int scale = cvRound(std::min(std::max(opacity, 0.0), 1.0) * 256.0);
+		int rows = src.rows;
+		int cols = src.cols;
+		if (src.isContinuous() && dst.isContinuous()) {
+			cols *= rows;
+			rows = 1;
+		}
+		for (int y = 0; y < rows; y++) {
+			if (dst.channels() == 4)
+				blend_row<4>(src.ptr(y), dst.ptr(y), cols, scale);
+			else
+				blend_row<3>(src.ptr(y), dst.ptr(y), cols, scale);
+		}
+	}
+}
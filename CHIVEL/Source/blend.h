@@ -0,0 +1,15 @@
+#pragma once
+
+#include <opencv2/core.hpp>
+
+// Alpha blending of 8-bit images in integer math.
+
+namespace chivel
+{
+	// Blends an 8-bit BGRA image over an 8-bit BGR or BGRA image of the same size, in place, without allocating.
+	// The source alpha is scaled by opacity (0.0 to 1.0). Each channel becomes (src * a + dst * (255 - a)) / 255, rounded,
+	// which is within 1 of the same blend in floating point. A BGRA destination gets the combined alpha, a + dst * (255 - a) / 255.
+	// The source is straight (not premultiplied) alpha, like every image chivel loads, so src * a premultiplies it on the way.
+	// The destination is not divided by its alpha, which is exact for BGR and opaque BGRA destinations.
+	void blendOver(cv::Mat const& src, cv::Mat& dst, double opacity);
+}
@@ -0,0 +1,173 @@
+// buffer_pool.cpp : Reuses large pixel buffers between Mats.
+#include "pch.h"
+
+#include "buffer_pool.h"
+
+#include <algorithm>
+
+namespace chivel
+{
+	// Rounds a size up to one of eight steps between powers of two, so buffers of nearly the same size share a bucket
+	// and at most an eighth of a buffer goes unused
+	static size_t bucket_size(size_t bytes)
+	{
+		size_t power = 1;
+		while (power <= bytes / 2)
+			power *= 2;
+		size_t step = std::max<size_t>(power / 8, 1);
+		return (bytes + step - 1) / step * step;
+	}
+
+	BufferPool& BufferPool::get()
+	{
+		static BufferPool* pool = new BufferPool();
+		return *pool;
+	}
+
+	void BufferPool::install()
+	{
+		cv::Mat::setDefaultAllocator(&get());
+	}
+
+	BufferPool::Stats BufferPool::getStats() const
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		Stats result = stats;
+		result.limit = limit;
+		return result;
+	}
+
+	void BufferPool::setLimit(size_t bytes)
+	{
+		std::vector<void*> freed;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			limit = bytes;
+			evict(limit, freed);
+		}
+		for (void* buffer : freed)
+			cv::fastFree(buffer);
+	}
+
+	void BufferPool::trim(size_t keep)
+	{
+		std::vector<void*> freed;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			evict(keep, freed);
+		}
+		for (void* buffer : freed)
+			cv::fastFree(buffer);
+	}
+
+	void BufferPool::evict(size_t keep, std::vector<void*>& freed) const
+	{
+		while (stats.retained > keep && !recent.empty()) {
+			Retained oldest = recent.back();
+			auto bucket = buckets.find(oldest.bucket);
+			bucket->second.pop_front();
+			if (bucket->second.empty())
+				buckets.erase(bucket);
+			recent.pop_back();
+			stats.retained -= oldest.bucket;
+			freed.push_back(oldest.buffer);
+		}
+	}
+
+	cv::UMatData* BufferPool::allocate(int dims, const int* sizes, int type, void* data, size_t* step, cv::AccessFlag flags, cv::UMatUsageFlags usageFlags) const
+	{
+		// Memory someone else owns has nothing to reuse
+		if (data)
+			return cv::Mat::getStdAllocator()->allocate(dims, sizes, type, data, step, flags, usageFlags);
+
+		// The same layout as OpenCV's own allocator, rows packed with no padding
+		size_t total = CV_ELEM_SIZE(type);
+		for (int i = dims - 1; i >= 0; i--) {
+			if (step)
+				step[i] = total;
+			total *= sizes[i];
+		}
+
+		cv::UMatData* u = new cv::UMatData(this);
+		u->size = total;
+		if (total < MIN_POOLED) {
+			u->data = u->origdata = static_cast<uchar*>(cv::fastMalloc(total));
+			return u;
+		}
+
+		size_t bucket = bucket_size(total);
+		void* buffer = nullptr;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			auto found = buckets.find(bucket);
+			if (found != buckets.end()) {
+				// The most recently freed one, the most likely to still be in cache
+				auto entry = found->second.back();
+				buffer = entry->buffer;
+				recent.erase(entry);
+				found->second.pop_back();
+				if (found->second.empty())
+					buckets.erase(found);
+				stats.retained -= bucket;
+				stats.hits++;
+			}
+			else {
+				stats.misses++;
+			}
+			stats.inUse += bucket;
+			stats.peak = std::max(stats.peak, stats.inUse + stats.retained);
+		}
+		if (!buffer) {
+			try {
+				buffer = cv::fastMalloc(bucket);
+			}
+			catch (...) {
+				std::lock_guard<std::mutex> lock(mutex);
+				stats.inUse -= bucket;
+				delete u;
+				throw;
+			}
+		}
+		u->data = u->origdata = static_cast<uchar*>(buffer);
+		return u;
+	}
+
+	bool BufferPool::allocate(cv::UMatData* data, cv::AccessFlag /*accessFlags*/, cv::UMatUsageFlags /*usageFlags*/) const
+	{
+		return data != nullptr;
+	}
+
+	void BufferPool::deallocate(cv::UMatData* u) const
+	{
+		if (!u)
+			return;
+		CV_Assert(u->urefcount == 0);
+		CV_Assert(u->refcount == 0);
+
+		if (u->size < MIN_POOLED) {
+			cv::fastFree(u->origdata);
+		}
+		else {
+			size_t bucket = bucket_size(u->size);
+			std::vector<void*> freed;
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				stats.inUse -= bucket;
+				if (bucket <= limit) {
+					// Older buffers make room, so sizes no longer used do not hold on to the space
+					evict(limit - bucket, freed);
+					recent.push_front({ bucket, u->origdata });
+					buckets[bucket].push_back(recent.begin());
+					stats.retained += bucket;
+				}
+				else {
+					freed.push_back(u->origdata);
+				}
+			}
+			for (void* buffer : freed)
+				cv::fastFree(buffer);
+		}
+		u->origdata = nullptr;
+		delete u;
+	}
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <opencv2/core.hpp>
+#include <cstdint>
+#include <deque>
+#include <list>
+#include <map>
+#include <mutex>
+#include <vector>
+
+namespace chivel
+{
+	// Pixel buffer pool, installed as OpenCV's default allocator. Freed buffers go into buckets by size instead of back to the
+	// heap, and the next Mat of a similar size (the same frame size, or an output the same shape as its input) takes one out,
+	// so per-frame processing does not keep mapping and faulting in fresh pages.
+	// Small buffers are left to the heap, which handles them well. At most the limit (MAX_RETAINED by default) is kept,
+	// and when a freed buffer would go over it, the least recently freed buffers of any size go back to the heap first.
+	class BufferPool : public cv::MatAllocator
+	{
+	public:
+		struct Stats
+		{
+			uint64_t hits = 0; // allocations served from the pool
+			uint64_t misses = 0; // allocations big enough for the pool that found nothing to reuse
+			size_t retained = 0; // bytes held for reuse
+			size_t inUse = 0; // bytes allocated through the pool and not yet freed
+			size_t peak = 0; // the most retained and in use bytes there have been together
+			size_t limit = 0; // the most bytes that are retained
+		};
+
+		static constexpr size_t MIN_POOLED = 64 * 1024;
+		static constexpr size_t MAX_RETAINED = 256 * 1024 * 1024;
+
+		// The pool, created the first time and never destroyed, since Mats can outlive everything else.
+		static BufferPool& get();
+		// Makes the pool the allocator of every Mat created from now on.
+		static void install();
+
+		Stats getStats() const;
+		// Sets the most bytes to retain, freeing the least recently used buffers over it. 0 turns reuse off.
+		void setLimit(size_t bytes);
+		// Frees retained buffers, least recently used first, until at most keep bytes are retained
+		void trim(size_t keep = 0);
+
+		cv::UMatData* allocate(int dims, const int* sizes, int type, void* data, size_t* step, cv::AccessFlag flags, cv::UMatUsageFlags usageFlags) const override;
+		bool allocate(cv::UMatData* data, cv::AccessFlag accessFlags, cv::UMatUsageFlags usageFlags) const override;
+		void deallocate(cv::UMatData* data) const override;
+
+	private:
+		BufferPool() = default;
+
+		struct Retained
+		{
+			size_t bucket;
+			void* buffer;
+		};
+
+		mutable std::mutex mutex;
+		// Free buffers, most recently freed first. Each bucket lists its buffers oldest first,
+		// so the oldest buffer overall is always the first of its bucket.
+		mutable std::list<Retained> recent;
+		mutable std::map<size_t, std::deque<std::list<Retained>::iterator>> buckets;
+		mutable Stats stats;
+		size_t limit = MAX_RETAINED;
+
+		// Takes the least recently used buffers out of the pool until at most keep bytes are retained, into freed
+		void evict(size_t keep, std::vector<void*>& freed) const;
+	};
+}
@@ -0,0 +1,309 @@
+// bundle.cpp : Writing and memory mapping template bundles.
+#include "pch.h"
+
+#include "bundle.h"
+
+#include <opencv2/imgproc.hpp>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace chivel
+{
+	static constexpr char MAGIC[8] = { 'C', 'H', 'V', 'L', 'B', 'N', 'D', 'L' };
+	static constexpr uint32_t VERSION = 1;
+	// Cache line aligned, which is plenty for SIMD loads
+	static constexpr uint64_t ALIGNMENT = 64;
+	// Templates smaller than this on either side get no half or quarter variant
+	static constexpr int MIN_VARIANT_SIZE = 8;
+
+	struct FileHeader
+	{
+		char magic[8];
+		uint32_t version;
+		uint32_t count;
+		uint64_t size; // of the whole file
+	};
+
+	struct FilePlane
+	{
+		uint64_t offset; // 0 when the template has no such variant
+		int32_t rows;
+		int32_t cols;
+		int32_t type;
+		int32_t reserved;
+	};
+
+	struct FileEntry
+	{
+		uint64_t nameOffset;
+		uint32_t nameLength;
+		int32_t colorSpace;
+		double mean[4];
+		double stddev[4];
+		FilePlane planes[Bundle::VARIANT_COUNT];
+	};
+
+	static uint64_t align(uint64_t offset)
+	{
+		return (offset + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+	}
+
+	static uint64_t plane_bytes(cv::Mat const& mat)
+	{
+		return static_cast<uint64_t>(mat.rows) * mat.cols * mat.elemSize();
+	}
+
+	bool Bundle::write(std::vector<Template> const& sources, std::string const& path, std::string& error)
+	{
+		// Fill in the smaller variants and the statistics
+		std::vector<Template> templates = sources;
+		for (Template& t : templates) {
+			cv::Mat const& gray = t.variants[GRAY];
+			if (gray.cols >= MIN_VARIANT_SIZE * 2 && gray.rows >= MIN_VARIANT_SIZE * 2)
+				cv::pyrDown(gray, t.variants[HALF]);
+			cv::Mat const& half = t.variants[HALF];
+			if (half.cols >= MIN_VARIANT_SIZE * 2 && half.rows >= MIN_VARIANT_SIZE * 2)
+				cv::pyrDown(half, t.variants[QUARTER]);
+			cv::meanStdDev(t.variants[ORIGINAL], t.mean, t.stddev);
+		}
+
+		// Lay the file out
+		std::vector<FileEntry> entries(templates.size());
+		uint64_t offset = sizeof(FileHeader) + sizeof(FileEntry) * entries.size();
+		for (size_t i = 0; i < templates.size(); i++) {
+			entries[i].nameOffset = offset;
+			entries[i].nameLength = static_cast<uint32_t>(templates[i].name.size());
+			offset += templates[i].name.size();
+		}
+		for (size_t i = 0; i < templates.size(); i++) {
+			Template const& t = templates[i];
+			FileEntry& entry = entries[i];
+			entry.colorSpace = t.colorSpace;
+			for (int c = 0; c < 4; c++) {
+				entry.mean[c] = t.mean[c];
+				entry.stddev[c] = t.stddev[c];
+			}
+			for (int v = 0; v < VARIANT_COUNT; v++) {
+				cv::Mat const& mat = t.variants[v];
+				FilePlane& plane = entry.planes[v];
+				std::memset(&plane, 0, sizeof(plane));
+				if (mat.empty())
+					continue;
+				plane.rows = mat.rows;
+				plane.cols = mat.cols;
+				plane.type = mat.type();
+				// A gray original is its own gray variant, and is stored once
+				if (v == GRAY && mat.data == t.variants[ORIGINAL].data && mat.type() == t.variants[ORIGINAL].type()) {
+					plane.offset = entry.planes[ORIGINAL].offset;
+					continue;
+				}
+				offset = align(offset);
+				plane.offset = offset;
+				offset += plane_bytes(mat);
+			}
+		}
+
+		FileHeader header;
+		std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+		header.version = VERSION;
+		header.count = static_cast<uint32_t>(entries.size());
+		header.size = offset;
+
+		// Write it in the same order, to a new file next to the target that then replaces it in one rename.
+		// Processes that have the old bundle mapped keep reading it whole, and a failed write leaves it as it was.
+		std::filesystem::path target(path);
+		std::filesystem::path temp = target;
+		temp += ".tmp" + std::to_string(std::random_device()());
+		std::ofstream file(temp, std::ios::binary | std::ios::trunc);
+		if (!file) {
+			error = "Failed to open the bundle file for writing";
+			return false;
+		}
+		uint64_t written = 0;
+		auto put = [&](void const* bytes, uint64_t count) {
+			file.write(static_cast<char const*>(bytes), static_cast<std::streamsize>(count));
+			written += count;
+		};
+		auto pad = [&](uint64_t to) {
+			static const char zeros[ALIGNMENT] = {};
+			if (to > written)
+				put(zeros, to - written);
+		};
+		put(&header, sizeof(header));
+		put(entries.data(), sizeof(FileEntry) * entries.size());
+		for (Template const& t : templates)
+			put(t.name.data(), t.name.size());
+		for (size_t i = 0; i < templates.size(); i++) {
+			for (int v = 0; v < VARIANT_COUNT; v++) {
+				FilePlane const& plane = entries[i].planes[v];
+				cv::Mat const& mat = templates[i].variants[v];
+				if (mat.empty() || plane.offset < written)
+					continue;
+				pad(plane.offset);
+				size_t rowBytes = static_cast<size_t>(mat.cols) * mat.elemSize();
+				for (int y = 0; y < mat.rows; y++)
+					put(mat.ptr(y), rowBytes);
+			}
+		}
+		file.close();
+		std::error_code ignored;
+		if (!file) {
+			std::filesystem::remove(temp, ignored);
+			error = "Failed to write the bundle file";
+			return false;
+		}
+		std::error_code renamed;
+		std::filesystem::rename(temp, target, renamed);
+		if (renamed) {
+			std::filesystem::remove(temp, ignored);
+			error = "Failed to replace the bundle file: " + renamed.message();
+			return false;
+		}
+		return true;
+	}
+
+	Bundle::~Bundle()
+	{
+		close();
+	}
+
+	bool Bundle::open(std::string const& path, std::string& error)
+	{
+		close();
+
+#ifdef _WIN32
+		file = CreateFileW(std::filesystem::path(path).c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (file == INVALID_HANDLE_VALUE) {
+			file = nullptr;
+			error = "Failed to open the bundle file";
+			return false;
+		}
+		LARGE_INTEGER fileSize;
+		if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart < static_cast<LONGLONG>(sizeof(FileHeader))) {
+			close();
+			error = "The file is not a bundle";
+			return false;
+		}
+		size = static_cast<size_t>(fileSize.QuadPart);
+		// Copy on write: pages stay shared with every other process until one of them is written to
+		mapping = CreateFileMappingW(file, nullptr, PAGE_WRITECOPY, 0, 0, nullptr);
+		data = mapping ? MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0) : nullptr;
+		if (!data) {
+			close();
+			error = "Failed to map the bundle file";
+			return false;
+		}
+#else
+		int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+		if (fd < 0) {
+			error = "Failed to open the bundle file";
+			return false;
+		}
+		struct stat info;
+		if (fstat(fd, &info) != 0 || info.st_size < static_cast<off_t>(sizeof(FileHeader))) {
+			::close(fd);
+			error = "The file is not a bundle";
+			return false;
+		}
+		size = static_cast<size_t>(info.st_size);
+		// Private: pages stay shared with every other process until one of them is written to
+		void* mapped = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+		::close(fd);
+		if (mapped == MAP_FAILED) {
+			size = 0;
+			error = "Failed to map the bundle file";
+			return false;
+		}
+		data = mapped;
+#endif
+
+		// Everything is checked against the size of the file before anything points into it
+		uchar* base = static_cast<uchar*>(data);
+		FileHeader header;
+		std::memcpy(&header, base, sizeof(header));
+		if (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.version != VERSION || header.size != size
+			|| header.count > (size - sizeof(FileHeader)) / sizeof(FileEntry)) {
+			close();
+			error = "The file is not a bundle, or was written by a different version";
+			return false;
+		}
+
+		templates.resize(header.count);
+		for (uint32_t i = 0; i < header.count; i++) {
+			FileEntry entry;
+			std::memcpy(&entry, base + sizeof(FileHeader) + sizeof(FileEntry) * i, sizeof(entry));
+			bool valid = entry.nameOffset <= size && entry.nameLength <= size - entry.nameOffset;
+			for (int v = 0; valid && v < VARIANT_COUNT; v++) {
+				FilePlane const& plane = entry.planes[v];
+				if (plane.offset == 0)
+					continue;
+				int channels = CV_MAT_CN(plane.type);
+				valid = plane.offset % ALIGNMENT == 0 && plane.rows > 0 && plane.cols > 0 && plane.rows <= 1 << 16 && plane.cols <= 1 << 16
+					&& plane.type == CV_MAKETYPE(CV_MAT_DEPTH(plane.type), channels) && CV_MAT_DEPTH(plane.type) <= CV_64F && channels <= 4;
+				if (valid) {
+					uint64_t bytes = static_cast<uint64_t>(plane.rows) * plane.cols * CV_ELEM_SIZE(plane.type);
+					valid = plane.offset <= size && bytes <= size - plane.offset;
+				}
+			}
+			if (!valid) {
+				close();
+				error = "The bundle file is damaged";
+				return false;
+			}
+
+			Template& t = templates[i];
+			t.name.assign(reinterpret_cast<char const*>(base + entry.nameOffset), entry.nameLength);
+			t.colorSpace = entry.colorSpace;
+			t.mean = cv::Scalar(entry.mean[0], entry.mean[1], entry.mean[2], entry.mean[3]);
+			t.stddev = cv::Scalar(entry.stddev[0], entry.stddev[1], entry.stddev[2], entry.stddev[3]);
+			for (int v = 0; v < VARIANT_COUNT; v++) {
+				FilePlane const& plane = entry.planes[v];
+				if (plane.offset != 0)
+					t.variants[v] = cv::Mat(plane.rows, plane.cols, plane.type, base + plane.offset);
+			}
+		}
+		return true;
+	}
+
+	std::vector<Bundle::Template> const& Bundle::getTemplates() const
+	{
+		return templates;
+	}
+
+	int Bundle::find(std::string const& name) const
+	{
+		for (size_t i = 0; i < templates.size(); i++) {
+			if (templates[i].name == name)
+				return static_cast<int>(i);
+		}
+		return -1;
+	}
+
+	void Bundle::close()
+	{
+		templates.clear();
+#ifdef _WIN32
+		if (data)
+			UnmapViewOfFile(data);
+		if (mapping)
+			CloseHandle(mapping);
+		if (file)
+			CloseHandle(file);
+		mapping = nullptr;
+		file = nullptr;
+#else
+		if (data)
+			munmap(data, size);
+#endif
+		data = nullptr;
+		size = 0;
+	}
+}
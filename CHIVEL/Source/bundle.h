@@ -0,0 +1,69 @@
+#pragma once
+
+#include <opencv2/core.hpp>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace chivel
+{
+	// A file of templates prepared for matching. It is written once, then memory mapped by any number of processes,
+	// which share one copy of it in the page cache and start without decoding or converting anything.
+	// Layout, with offsets from the start of the file:
+	//   FileHeader
+	//   one FileEntry per template
+	//   the names, one after another
+	//   the pixel planes, each starting on a 64 byte boundary, with packed rows
+	// Numbers are in the byte order of the machine that wrote the bundle.
+	class Bundle
+	{
+	public:
+		enum Variant
+		{
+			ORIGINAL,
+			GRAY,
+			HALF, // the gray variant at half size
+			QUARTER, // the gray variant at a quarter size
+			VARIANT_COUNT,
+		};
+
+		struct Template
+		{
+			std::string name;
+			int colorSpace = 0;
+			cv::Mat variants[VARIANT_COUNT]; // empty when the template was too small for that variant
+			cv::Scalar mean;
+			cv::Scalar stddev;
+		};
+
+		// Writes a bundle of the given templates, with only the name, color space, ORIGINAL and GRAY set.
+		// The smaller variants and the statistics are worked out here. Returns false with error set on failure.
+		static bool write(std::vector<Template> const& templates, std::string const& path, std::string& error);
+
+		Bundle() = default;
+		~Bundle();
+
+		Bundle(Bundle const&) = delete;
+		Bundle& operator=(Bundle const&) = delete;
+
+		// Maps a bundle file and checks it. Every Mat in the templates points into the mapping, without copying.
+		// The mapping is private, so nothing written to it reaches the file, but it is shared by every Mat of a template.
+		// Images made from a bundle copy their pixels before the first write, so drawing on one never changes another.
+		bool open(std::string const& path, std::string& error);
+
+		std::vector<Template> const& getTemplates() const;
+		// The index of the template with that name, or -1
+		int find(std::string const& name) const;
+
+	private:
+		std::vector<Template> templates;
+		void* data = nullptr;
+		size_t size = 0;
+#ifdef _WIN32
+		void* file = nullptr;
+		void* mapping = nullptr;
+#endif
+
+		void close();
+	};
+}
@@ -0,0 +1,155 @@
+// capture_stream.cpp : Background capture into a ring of reused frames.
+#include "pch.h"
+
+#include "capture_stream.h"
+
+#include <algorithm>
+#include <chrono>
+
+namespace chivel
+{
+	using Clock = std::chrono::steady_clock;
+
+	static double to_seconds(Clock::time_point time)
+	{
+		return std::chrono::duration<double>(time.time_since_epoch()).count();
+	}
+
+	CaptureStream::CaptureStream(std::unique_ptr<CaptureSession> session, double fps, int buffers)
+		: session(std::move(session)), period(1.0 / fps)
+	{
+		cv::Mat const& frame = this->session->getFrame();
+		slots.resize(static_cast<size_t>(std::max(buffers, 2)));
+		for (Slot& slot : slots)
+			slot.mat.create(frame.size(), frame.type());
+
+		thread = std::thread(&CaptureStream::run, this);
+	}
+
+	CaptureStream::~CaptureStream()
+	{
+		stop();
+	}
+
+	bool CaptureStream::latest(Frame& frame)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (latestSlot < 0)
+			return false;
+		take(frame);
+		return true;
+	}
+
+	bool CaptureStream::next(uint64_t after, double timeout, Frame& frame)
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		auto ready = [&] { return stopped || frameCount > after; };
+		if (timeout < 0.0)
+			published.wait(lock, ready);
+		else if (!published.wait_for(lock, std::chrono::duration<double>(timeout), ready))
+			return false;
+
+		if (frameCount <= after)
+			return false; // stopped
+		take(frame);
+		return true;
+	}
+
+	void CaptureStream::stop()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopped = true;
+		}
+		stopping.notify_all();
+		published.notify_all();
+		// Other callers wait here until the thread is gone
+		std::call_once(joined, [this] { thread.join(); });
+	}
+
+	bool CaptureStream::isStopped()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return stopped;
+	}
+
+	uint64_t CaptureStream::getDropped()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return dropped;
+	}
+
+	uint64_t CaptureStream::getFrameCount()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return frameCount;
+	}
+
+	void CaptureStream::run()
+	{
+		auto duration = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(period));
+		Clock::time_point due = Clock::now();
+
+		std::unique_lock<std::mutex> lock(mutex);
+		while (!stopped) {
+			lock.unlock();
+			bool grabbed = session->grab();
+			Clock::time_point time = Clock::now();
+			lock.lock();
+
+			if (grabbed) {
+				int index = findFreeSlot();
+				if (index < 0) {
+					dropped++;
+				}
+				else {
+					// Nobody can see this slot until it is published, so copy without holding the lock
+					Slot& slot = slots[index];
+					lock.unlock();
+					session->getFrame().copyTo(slot.mat);
+					lock.lock();
+
+					if (latestSlot >= 0 && !latestTaken)
+						dropped++;
+					slot.time = to_seconds(time);
+					slot.number = ++frameCount;
+					latestSlot = index;
+					latestTaken = false;
+					published.notify_all();
+				}
+			}
+
+			// Fixed rate, but never try to catch up on frames that were missed
+			due += duration;
+			Clock::time_point now = Clock::now();
+			if (due < now)
+				due = now;
+			stopping.wait_until(lock, due, [this] { return stopped; });
+		}
+	}
+
+	int CaptureStream::findFreeSlot() const
+	{
+		int count = static_cast<int>(slots.size());
+		for (int i = 1; i <= count; i++) {
+			int index = (std::max(latestSlot, 0) + i) % count;
+			if (index == latestSlot)
+				continue;
+			// The ring holds one reference, anything more is a frame someone is still using.
+			// References are only added under the lock, so a stale count can only make a slot look busy.
+			cv::Mat const& mat = slots[index].mat;
+			if (mat.u && mat.u->refcount == 1)
+				return index;
+		}
+		return -1;
+	}
+
+	void CaptureStream::take(Frame& frame)
+	{
+		Slot const& slot = slots[latestSlot];
+		frame.mat = slot.mat;
+		frame.time = slot.time;
+		frame.number = slot.number;
+		latestTaken = true;
+	}
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include "backend.h"
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+
+namespace chivel
+{
+	// Captures on its own thread into a small ring of preallocated frames, so capturing overlaps with processing.
+	// A frame that has been handed out is never written to again until every copy of it is released.
+	class CaptureStream
+	{
+	public:
+		struct Frame
+		{
+			cv::Mat mat;
+			double time = 0.0; // seconds on std::chrono::steady_clock, only comparable with other frame times
+			uint64_t number = 0; // starts at 1
+		};
+
+		// Starts capturing right away. fps must be positive, and at least 2 buffers are used.
+		CaptureStream(std::unique_ptr<CaptureSession> session, double fps, int buffers);
+		// Stops and joins the capture thread.
+		~CaptureStream();
+
+		CaptureStream(CaptureStream const&) = delete;
+		CaptureStream& operator=(CaptureStream const&) = delete;
+
+		// Gets the most recent frame. Returns false if nothing has been captured yet.
+		bool latest(Frame& frame);
+		// Waits up to timeout seconds for a frame newer than the given frame number. Returns false on timeout or once stopped.
+		bool next(uint64_t after, double timeout, Frame& frame);
+
+		void stop();
+		bool isStopped();
+
+		// Frames that were replaced before anyone took them, or could not be stored because every buffer was in use.
+		uint64_t getDropped();
+		uint64_t getFrameCount();
+
+	private:
+		struct Slot
+		{
+			cv::Mat mat;
+			double time = 0.0;
+			uint64_t number = 0;
+		};
+
+		std::unique_ptr<CaptureSession> session;
+		double period;
+
+		std::mutex mutex;
+		std::condition_variable published; // signaled for every new frame, and on stop
+		std::condition_variable stopping;
+		std::vector<Slot> slots;
+		int latestSlot = -1;
+		bool latestTaken = false;
+		uint64_t frameCount = 0;
+		uint64_t dropped = 0;
+		bool stopped = false;
+
+		std::thread thread;
+		std::once_flag joined;
+
+		void run();
+		// Picks a buffer nobody else is holding, other than the latest frame. Returns -1 if there is none.
+		int findFreeSlot() const;
+		void take(Frame& frame);
+	};
+}
@@ -0,0 +1,152 @@
+// damage.cpp : Tile hashing, and the default damage tracking for capture sessions.
+#include "pch.h"
+
+#include "damage.h"
+#include "backend.h"
+
+#include <cstring>
+
+namespace chivel
+{
+	static uint64_t hash_tile(cv::Mat const& image, cv::Rect tile)
+	{
+		// FNV-1a over 8 byte words, which is plenty to tell two frames apart
+		uint64_t hash = 0xCBF29CE484222325ull;
+		size_t bytes = static_cast<size_t>(tile.width) * image.elemSize();
+		for (int y = tile.y; y < tile.y + tile.height; y++) {
+			uchar const* row = image.ptr(y) + tile.x * image.elemSize();
+			size_t i = 0;
+			for (; i + 8 <= bytes; i += 8) {
+				uint64_t word;
+				std::memcpy(&word, row + i, 8);
+				hash = (hash ^ word) * 0x100000001B3ull;
+			}
+			for (; i < bytes; i++)
+				hash = (hash ^ row[i]) * 0x100000001B3ull;
+		}
+		return hash;
+	}
+
+	void hashTiles(cv::Mat const& image, int tile, std::vector<uint64_t>& hashes)
+	{
+		int columns = (image.cols + tile - 1) / tile;
+		int rows = (image.rows + tile - 1) / tile;
+		hashes.resize(static_cast<size_t>(columns) * rows);
+
+		cv::Rect bounds(0, 0, image.cols, image.rows);
+		for (int row = 0; row < rows; row++) {
+			for (int column = 0; column < columns; column++) {
+				cv::Rect area = cv::Rect(column * tile, row * tile, tile, tile) & bounds;
+				hashes[static_cast<size_t>(row) * columns + column] = hash_tile(image, area);
+			}
+		}
+	}
+
+	std::vector<cv::Rect> mergeTiles(std::vector<uint8_t> const& changed, int tile, cv::Size size)
+	{
+		int columns = (size.width + tile - 1) / tile;
+		int rows = (size.height + tile - 1) / tile;
+		cv::Rect bounds(cv::Point(0, 0), size);
+
+		std::vector<cv::Rect> result;
+		std::vector<size_t> open; // rects that ended on the previous row, and can still grow
+		std::vector<size_t> next;
+		for (int row = 0; row < rows; row++) {
+			next.clear();
+			int column = 0;
+			while (column < columns) {
+				if (!changed[static_cast<size_t>(row) * columns + column]) {
+					column++;
+					continue;
+				}
+				int start = column;
+				while (column < columns && changed[static_cast<size_t>(row) * columns + column])
+					column++;
+
+				cv::Rect run = cv::Rect(start * tile, row * tile, (column - start) * tile, tile) & bounds;
+				bool grown = false;
+				for (size_t index : open) {
+					cv::Rect& rect = result[index];
+					if (rect.x == run.x && rect.width == run.width) {
+						rect.height = run.y + run.height - rect.y;
+						next.push_back(index);
+						grown = true;
+						break;
+					}
+				}
+				if (!grown) {
+					next.push_back(result.size());
+					result.push_back(run);
+				}
+			}
+			open.swap(next);
+		}
+		return result;
+	}
+
+	// Row by row, so memcmp can use the widest compares it has and stop early
+	static bool equal_rows(cv::Mat const& a, cv::Mat const& b, cv::Rect area)
+	{
+		size_t bytes = static_cast<size_t>(area.width) * a.elemSize();
+		size_t offset = static_cast<size_t>(area.x) * a.elemSize();
+		for (int y = area.y; y < area.y + area.height; y++) {
+			if (std::memcmp(a.ptr(y) + offset, b.ptr(y) + offset, bytes) != 0)
+				return false;
+		}
+		return true;
+	}
+
+	std::vector<cv::Rect> diffTiles(cv::Mat const& a, cv::Mat const& b, int tile, int tolerance)
+	{
+		int columns = (a.cols + tile - 1) / tile;
+		int rows = (a.rows + tile - 1) / tile;
+		cv::Rect bounds(0, 0, a.cols, a.rows);
+		std::vector<uint8_t> changed(static_cast<size_t>(columns) * rows);
+
+		cv::parallel_for_(cv::Range(0, rows), [&](cv::Range const& range) {
+			for (int row = range.start; row < range.end; row++) {
+				for (int column = 0; column < columns; column++) {
+					cv::Rect area = cv::Rect(column * tile, row * tile, tile, tile) & bounds;
+					bool same;
+					if (tolerance <= 0)
+						same = equal_rows(a, b, area);
+					else
+						same = equal_rows(a, b, area) || cv::norm(a(area), b(area), cv::NORM_INF) <= tolerance;
+					changed[static_cast<size_t>(row) * columns + column] = !same;
+				}
+			}
+		});
+
+		return mergeTiles(changed, tile, a.size());
+	}
+
+	bool equalPixels(cv::Mat const& a, cv::Mat const& b)
+	{
+		if (a.isContinuous() && b.isContinuous())
+			return std::memcmp(a.data, b.data, a.total() * a.elemSize()) == 0;
+		return equal_rows(a, b, cv::Rect(0, 0, a.cols, a.rows));
+	}
+
+	bool CaptureSession::grabDamage(std::vector<cv::Rect>& dirty)
+	{
+		dirty.clear();
+		if (!grab())
+			return false;
+
+		std::vector<uint64_t> hashes;
+		hashTiles(frame, DAMAGE_TILE, hashes);
+		if (hashes.size() != tileHashes.size()) {
+			// Nothing to compare to, so everything changed
+			tileHashes.swap(hashes);
+			dirty.push_back(cv::Rect(0, 0, frame.cols, frame.rows));
+			return true;
+		}
+
+		std::vector<uint8_t> changed(hashes.size());
+		for (size_t i = 0; i < hashes.size(); i++)
+			changed[i] = hashes[i] != tileHashes[i];
+		tileHashes.swap(hashes);
+		dirty = mergeTiles(changed, DAMAGE_TILE, frame.size());
+		return true;
+	}
+}
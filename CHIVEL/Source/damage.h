@@ -0,0 +1,24 @@
+#pragma once
+
+#include <opencv2/core.hpp>
+#include <cstdint>
+#include <vector>
+
+// Tile based change detection, between frames of a capture or any two images.
+
+namespace chivel
+{
+	// Hashes every tile x tile block of the image, row by row. Tiles on the right and bottom edges may be smaller.
+	void hashTiles(cv::Mat const& image, int tile, std::vector<uint64_t>& hashes);
+
+	// Turns a row by row grid of changed tiles into rects clipped to size.
+	// Runs of changed tiles in a row become one rect, which grows downwards while the row below has the same run.
+	std::vector<cv::Rect> mergeTiles(std::vector<uint8_t> const& changed, int tile, cv::Size size);
+
+	// Compares two images of the same size and type in tile x tile blocks, and returns the merged rects of the tiles that differ.
+	// A tile differs when any channel of any pixel differs by more than tolerance.
+	std::vector<cv::Rect> diffTiles(cv::Mat const& a, cv::Mat const& b, int tile, int tolerance);
+
+	// True when two images of the same size and type are byte for byte identical. Stops at the first difference.
+	bool equalPixels(cv::Mat const& a, cv::Mat const& b);
+}
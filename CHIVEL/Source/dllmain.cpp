@@ -5,12 +5,31 @@
 #include <tesseract/baseapi.h>
 #include <leptonica/allheaders.h>
 #include <Python.h>
-#include <Windows.h>
-#include <ShellScalingAPI.h> // For GetDpiForMonitor
 #include <structmember.h>
-#pragma comment(lib, "Shcore.lib")
 #include <filesystem>
 #include <regex>
+#include <thread>
+#include <mutex>
+#include <chrono>
+#include <cctype>
+#include <cstring>
+#ifndef _WIN32
+#include <dlfcn.h>
+#endif
+
+#include "backend.h"
+#include "blend.h"
+#include "buffer_pool.h"
+#include "bundle.h"
+#include "capture_stream.h"
+#include "damage.h"
+#include "find_color.h"
+#include "image_cache.h"
+#include "image_hash.h"
+#include "image_stats.h"
+#include "image_writer.h"
+#include "lookup_table.h"
+#include "pipeline.h"
 
 #pragma region chivel
 
@@ -24,15 +43,6 @@ enum SimplifyMode
 	SIMPLIFY_ALL = SIMPLIFY_MOVE | SIMPLIFY_CLICK | SIMPLIFY_TYPE | SIMPLIFY_TIME
 };
 
-enum MouseButton
-{
-	BUTTON_LEFT = 0,
-	BUTTON_RIGHT = 1,
-	BUTTON_MIDDLE = 2,
-	BUTTON_X1 = 3, // Button 4
-	BUTTON_X2 = 4  // Button 5
-};
-
 enum FlipMode
 {
 	FLIP_NONE = 0,
@@ -67,96 +77,6 @@ namespace chivel
 		return str.substr(first, last - first + 1);
 	}
 
-	cv::Mat captureScreen(int monitorIndex = 0) {
-		// Get all monitor info
-		DISPLAY_DEVICE dd;
-		dd.cb = sizeof(dd);
-		EnumDisplayDevices(NULL, monitorIndex, &dd, 0);
-
-		DEVMODE dm;
-		dm.dmSize = sizeof(dm);
-		EnumDisplaySettings(dd.DeviceName, ENUM_CURRENT_SETTINGS, &dm);
-
-		int width = dm.dmPelsWidth;
-		int height = dm.dmPelsHeight;
-
-		// Create device contexts
-		HDC hScreenDC = CreateDC(NULL, dd.DeviceName, NULL, NULL);
-		HDC hMemoryDC = CreateCompatibleDC(hScreenDC);
-
-		// Create a compatible bitmap
-		HBITMAP hBitmap = CreateCompatibleBitmap(hScreenDC, width, height);
-		HBITMAP hOldBitmap = (HBITMAP)SelectObject(hMemoryDC, hBitmap);
-
-		// Copy screen to bitmap
-		BitBlt(hMemoryDC, 0, 0, width, height, hScreenDC, 0, 0, SRCCOPY);
-
-		// Create OpenCV image
-		BITMAPINFOHEADER bi = { 0 };
-		bi.biSize = sizeof(BITMAPINFOHEADER);
-		bi.biWidth = width;
-		bi.biHeight = -height; // negative for top-down bitmap
-		bi.biPlanes = 1;
-		bi.biBitCount = 24;
-		bi.biCompression = BI_RGB;
-
-		cv::Mat mat(height, width, CV_8UC3);
-		GetDIBits(hMemoryDC, hBitmap, 0, height, mat.data, (BITMAPINFO*)&bi, DIB_RGB_COLORS);
-
-		// Cleanup
-		SelectObject(hMemoryDC, hOldBitmap);
-		DeleteObject(hBitmap);
-		DeleteDC(hMemoryDC);
-		DeleteDC(hScreenDC);
-
-		return mat;
-	}
-
-	cv::Mat captureRect(int x, int y, int w, int h, int monitorIndex = 0) {
-		// Get monitor info
-		DISPLAY_DEVICE dd;
-		dd.cb = sizeof(dd);
-		EnumDisplayDevices(NULL, monitorIndex, &dd, 0);
-
-		DEVMODE dm;
-		dm.dmSize = sizeof(dm);
-		EnumDisplaySettings(dd.DeviceName, ENUM_CURRENT_SETTINGS, &dm);
-
-		int mon_x = dm.dmPosition.x;
-		int mon_y = dm.dmPosition.y;
-
-		// Get the device context of the specific monitor
-		HDC hScreenDC = CreateDC(NULL, dd.DeviceName, NULL, NULL);
-		HDC hMemoryDC = CreateCompatibleDC(hScreenDC);
-
-		// Create a compatible bitmap
-		HBITMAP hBitmap = CreateCompatibleBitmap(hScreenDC, w, h);
-		HBITMAP hOldBitmap = (HBITMAP)SelectObject(hMemoryDC, hBitmap);
-
-		// Copy the specified rectangle into the bitmap (relative to monitor)
-		BitBlt(hMemoryDC, 0, 0, w, h, hScreenDC, x, y, SRCCOPY);
-
-		// Create OpenCV image
-		BITMAPINFOHEADER bi = { 0 };
-		bi.biSize = sizeof(BITMAPINFOHEADER);
-		bi.biWidth = w;
-		bi.biHeight = -h; // negative for top-down bitmap
-		bi.biPlanes = 1;
-		bi.biBitCount = 24;
-		bi.biCompression = BI_RGB;
-
-		cv::Mat mat(h, w, CV_8UC3);
-		GetDIBits(hMemoryDC, hBitmap, 0, h, mat.data, (BITMAPINFO*)&bi, DIB_RGB_COLORS);
-
-		// Cleanup
-		SelectObject(hMemoryDC, hOldBitmap);
-		DeleteObject(hBitmap);
-		DeleteDC(hMemoryDC);
-		DeleteDC(hScreenDC);
-
-		return mat;
-	}
-
 	// adjusts an image for text reading
 	cv::Mat adjustImage(const cv::Mat& original)
 	{
@@ -192,20 +112,31 @@ namespace chivel
 		return final;
 	}
 
-	cv::Mat readImage(char const* const path, ColorSpace color_space)
+	static int imreadFlags(ColorSpace color_space)
 	{
 		switch (color_space)
 		{
 		case COLOR_SPACE_BGRA:
 		case COLOR_SPACE_RGBA:
-			return cv::imread(path, cv::IMREAD_UNCHANGED);
+			return cv::IMREAD_UNCHANGED;
 		case COLOR_SPACE_GRAY:
-			return cv::imread(path, cv::IMREAD_GRAYSCALE);
+			return cv::IMREAD_GRAYSCALE;
 		default:
-			return cv::imread(path, cv::IMREAD_COLOR);
+			return cv::IMREAD_COLOR;
 		}
 	}
 
+	cv::Mat readImage(char const* const path, ColorSpace color_space)
+	{
+		return cv::imread(path, imreadFlags(color_space));
+	}
+
+	// The same as readImage, from the contents of an image file in memory
+	cv::Mat decodeImage(cv::Mat const& bytes, ColorSpace color_space)
+	{
+		return cv::imdecode(bytes, imreadFlags(color_space));
+	}
+
 	cv::Mat convertColorSpace(cv::Mat const& mat, ColorSpace current, ColorSpace color_space)
 	{
 		if (current == color_space) {
@@ -328,83 +259,180 @@ namespace chivel
 		return converted;
 	}
 
-	int get_display_count() {
-		int count = 0;
-		EnumDisplayMonitors(
-			nullptr, nullptr,
-			[](HMONITOR, HDC, LPRECT, LPARAM lParam) -> BOOL {
-				int* pCount = reinterpret_cast<int*>(lParam);
-				++(*pCount);
-				return TRUE;
-			},
-			reinterpret_cast<LPARAM>(&count)
-		);
-		return count;
-	}
-
-	static BOOL CALLBACK monitor_enum_proc(HMONITOR hMonitor, HDC, LPRECT lprcMonitor, LPARAM dwData) {
-		struct MonitorSearch {
-			POINT pt;
-			int index;
-			int found;
-			int x, y;
-		};
-		MonitorSearch* search = reinterpret_cast<MonitorSearch*>(dwData);
-		if (PtInRect(lprcMonitor, search->pt)) {
-			search->found = search->index;
-			search->x = search->pt.x - lprcMonitor->left;
-			search->y = search->pt.y - lprcMonitor->top;
-			return FALSE; // Stop enumeration
-		}
-		search->index++;
-		return TRUE; // Continue enumeration
-	}
-
-	UINT get_display_dpi(int display_index = 0) {
-		DISPLAY_DEVICE dd;
-		dd.cb = sizeof(dd);
-		if (!EnumDisplayDevices(NULL, display_index, &dd, 0))
-			return 96; // fallback
-
-		DEVMODE dm;
-		dm.dmSize = sizeof(dm);
-		if (!EnumDisplaySettings(dd.DeviceName, ENUM_CURRENT_SETTINGS, &dm))
-			return 96; // fallback
-
-		POINT pt = { dm.dmPosition.x, dm.dmPosition.y };
-		HMONITOR hMonitor = MonitorFromPoint(pt, MONITOR_DEFAULTTONEAREST);
-
-		UINT dpiX = 96, dpiY = 96;
-		if (SUCCEEDED(GetDpiForMonitor(hMonitor, MDT_EFFECTIVE_DPI, &dpiX, &dpiY)))
-			return dpiX;
-		return 96; // fallback
-	}
-
-	//double get_scaling_factor_for_monitor(HMONITOR hMonitor) {
-	//    UINT dpiX = 96, dpiY = 96;
-	//    if (SUCCEEDED(GetDpiForMonitor(hMonitor, MDT_EFFECTIVE_DPI, &dpiX, &dpiY))) {
-	//        return dpiX / 96.0;
-	//    }
-	//    // Fallback for older Windows
-	//    HDC screen = GetDC(NULL);
-	//    int dpi = GetDeviceCaps(screen, LOGPIXELSX);
-	//    ReleaseDC(NULL, screen);
-	//    return dpi / 96.0;
-	//}
-
-	bool setCursorPosition(int x, int y) {
-		// Find the monitor for (x, y)
-		POINT pt = { x, y };
-		HMONITOR hMonitor = MonitorFromPoint(pt, MONITOR_DEFAULTTONEAREST);
-		return SetCursorPos(pt.x, pt.y);
-	}
-
-	POINT getCursorPosition()
+	// How many 8-bit channels an image in the color space has, or 0 if it is unknown
+	int colorSpaceChannels(ColorSpace color_space)
+	{
+		switch (color_space) {
+		case COLOR_SPACE_GRAY:
+			return 1;
+		case COLOR_SPACE_BGR:
+		case COLOR_SPACE_RGB:
+		case COLOR_SPACE_HSV:
+			return 3;
+		case COLOR_SPACE_BGRA:
+		case COLOR_SPACE_RGBA:
+			return 4;
+		default:
+			return 0;
+		}
+	}
+
+	// Shrinks 8-bit BGR or BGRX by an integer factor, averaging each factor x factor block, and converts it in the same pass.
+	// Each output row sums its source rows into a column buffer (a plain loop the compiler vectorizes),
+	// then every block is averaged and converted once, so the source is only read once. The X byte is never read,
+	// and outputs with alpha are opaque.
+	static void shrinkConvert(cv::Mat const& src, cv::Mat& dst, ColorSpace color_space, int factor)
+	{
+		int step = src.channels();
+		int channels = colorSpaceChannels(color_space);
+		bool swap = color_space == COLOR_SPACE_RGB || color_space == COLOR_SPACE_RGBA;
+		int cols = src.cols / factor;
+		int rows = src.rows / factor;
+		dst.create(rows, cols, CV_8UC(channels));
+
+		uint32_t area = static_cast<uint32_t>(factor * factor);
+		int shift = 0;
+		while ((1u << shift) < area)
+			shift++;
+		bool power = (1u << shift) == area;
+
+		cv::parallel_for_(cv::Range(0, rows), [&](cv::Range const& range) {
+			int width = cols * factor * step;
+			std::vector<uint32_t> sums(static_cast<size_t>(width));
+			for (int y = range.start; y < range.end; y++) {
+				std::fill(sums.begin(), sums.end(), 0u);
+				for (int k = 0; k < factor; k++) {
+					uchar const* in = src.ptr(y * factor + k);
+					uint32_t* sum = sums.data();
+					for (int i = 0; i < width; i++)
+						sum[i] += in[i];
+				}
+
+				uchar* out = dst.ptr(y);
+				for (int x = 0; x < cols; x++) {
+					uint32_t b = 0, g = 0, r = 0;
+					uint32_t const* block = sums.data() + x * factor * step;
+					for (int j = 0; j < factor; j++) {
+						b += block[j * step];
+						g += block[j * step + 1];
+						r += block[j * step + 2];
+					}
+					if (power) {
+						b = (b + (area >> 1)) >> shift;
+						g = (g + (area >> 1)) >> shift;
+						r = (r + (area >> 1)) >> shift;
+					}
+					else {
+						b = (b + (area >> 1)) / area;
+						g = (g + (area >> 1)) / area;
+						r = (r + (area >> 1)) / area;
+					}
+
+					if (channels == 1) {
+						// Same fixed point weights as cv::COLOR_BGR2GRAY
+						out[x] = static_cast<uchar>((b * 1868 + g * 9617 + r * 4899 + (1 << 13)) >> 14);
+						continue;
+					}
+					uchar* pixel = out + x * channels;
+					pixel[0] = static_cast<uchar>(swap ? r : b);
+					pixel[1] = static_cast<uchar>(g);
+					pixel[2] = static_cast<uchar>(swap ? b : r);
+					if (channels == 4)
+						pixel[3] = 255;
+				}
+			}
+		});
+	}
+
+	// Converts captured BGR or BGRX pixels without scaling them. The X byte is padding, so it becomes opaque alpha.
+	static cv::Mat convertCapturePixels(cv::Mat const& pixels, ColorSpace color_space)
+	{
+		cv::Mat result;
+		if (pixels.channels() == 4 && colorSpaceChannels(color_space) == 4)
+			shrinkConvert(pixels, result, color_space, 1);
+		else
+			result = convertColorSpace(pixels, pixels.channels() == 4 ? COLOR_SPACE_BGRA : COLOR_SPACE_BGR, color_space);
+		return result;
+	}
+
+	// Turns captured BGR or BGRX pixels (see CaptureConverter) into the requested color space and scale, reading them once
+	// for integer shrink factors (1/2, 1/3, ...) and for no scaling at all. HSV and any other scale are a resize
+	// followed by a conversion. Returns an empty Mat for an unsupported color space.
+	cv::Mat convertCapture(cv::Mat const& pixels, ColorSpace color_space, double scale)
+	{
+		if (color_space == COLOR_SPACE_UNKNOWN)
+			return cv::Mat();
+
+		int factor = static_cast<int>(std::lround(1.0 / scale));
+		bool integer = scale < 1.0 && factor > 1 && std::abs(1.0 / factor - scale) < 1e-9;
+		if (scale == 1.0)
+			return convertCapturePixels(pixels, color_space);
+		if (integer && color_space != COLOR_SPACE_HSV) {
+			cv::Mat result;
+			shrinkConvert(pixels, result, color_space, factor);
+			return result;
+		}
+
+		// Shrink first, so the conversion runs over fewer pixels
+		cv::Mat resized;
+		cv::resize(pixels, resized, cv::Size(), scale, scale, scale < 1.0 ? cv::INTER_AREA : cv::INTER_LINEAR);
+		return convertCapturePixels(resized, color_space);
+	}
+
+	bool Backend::captureRects(int displayIndex, std::vector<cv::Rect> const& rects, std::vector<cv::Mat>& results)
+	{
+		results.resize(rects.size());
+		for (size_t i = 0; i < rects.size(); i++) {
+			cv::Rect const& rect = rects[i];
+			results[i] = captureRect(rect.x, rect.y, rect.width, rect.height, displayIndex);
+			if (results[i].empty())
+				return false;
+		}
+		return true;
+	}
+
+	cv::Mat Backend::captureConverted(int displayIndex, cv::Rect rect, CaptureConverter const& convert)
+	{
+		cv::Mat bgr = rect.empty() ? captureScreen(displayIndex) : captureRect(rect.x, rect.y, rect.width, rect.height, displayIndex);
+		if (bgr.empty())
+			return bgr;
+		return convert(bgr);
+	}
+
+	static std::mutex backend_mutex;
+	static std::shared_ptr<Backend> current_backend;
+
+	std::shared_ptr<Backend> getBackend()
+	{
+		std::lock_guard<std::mutex> lock(backend_mutex);
+		if (!current_backend) {
+			current_backend = createNativeBackend();
+		}
+		return current_backend;
+	}
+
+	void setBackend(std::shared_ptr<Backend> backend)
+	{
+		std::shared_ptr<Backend> previous;
+		{
+			std::lock_guard<std::mutex> lock(backend_mutex);
+			previous = std::move(current_backend);
+			current_backend = std::move(backend);
+		}
+		// Destroyed here, outside of the lock, unless another thread is still using it
+	}
+
+	// The frontmost window whose title and class name both match, or 0. A null pattern matches anything.
+	uintptr_t findWindow(std::regex const* title, std::regex const* className)
 	{
-		POINT pt;
-		GetCursorPos(&pt);
-		HMONITOR hMonitor = MonitorFromPoint(pt, MONITOR_DEFAULTTONEAREST);
-		return pt;
+		for (WindowInfo const& window : getBackend()->getWindows()) {
+			if (title && !std::regex_search(window.title, *title))
+				continue;
+			if (className && !std::regex_search(window.className, *className))
+				continue;
+			return window.handle;
+		}
+		return 0;
 	}
 
 	bool run_python_play_function(const std::string& script_path, const std::string& play_func_name = "play")
@@ -468,6 +496,38 @@ namespace chivel
 
 #pragma region Python
 
+// A few recently freed objects of one type, handed out again by the next allocation of that type instead of going back
+// to the allocator, the way CPython keeps floats and tuples. Loops that create and drop thousands of Points, Rects,
+// Matches and Images per second mostly reuse the same handful of objects. Only called with the GIL held.
+// Subclasses defined in Python are heap types with their own size, so they always go through tp_alloc and tp_free.
+// Reused objects are not zeroed, so the _new functions set every field.
+template<typename T, int Capacity = 64>
+class FreeList
+{
+public:
+	T* alloc(PyTypeObject* type) {
+		if (count > 0 && !(type->tp_flags & Py_TPFLAGS_HEAPTYPE)) {
+			T* object = items[--count];
+			PyObject_Init((PyObject*)object, type);
+			return object;
+		}
+		return (T*)type->tp_alloc(type, 0);
+	}
+
+	void dealloc(T* object) {
+		PyTypeObject* type = Py_TYPE(object);
+		if (count < Capacity && !(type->tp_flags & Py_TPFLAGS_HEAPTYPE)) {
+			items[count++] = object;
+			return;
+		}
+		type->tp_free((PyObject*)object);
+	}
+
+private:
+	T* items[Capacity];
+	int count = 0;
+};
+
 #pragma region Point
 
 typedef struct {
@@ -476,12 +536,14 @@ typedef struct {
 	int y;
 } CHIVELPointObject;
 
+static FreeList<CHIVELPointObject> point_freelist;
+
 static void CHIVELPoint_dealloc(CHIVELPointObject* self) {
-	Py_TYPE(self)->tp_free((PyObject*)self);
+	point_freelist.dealloc(self);
 }
 
 static PyObject* CHIVELPoint_new(PyTypeObject* type, PyObject* args, PyObject* kwds) {
-	CHIVELPointObject* self = (CHIVELPointObject*)type->tp_alloc(type, 0);
+	CHIVELPointObject* self = point_freelist.alloc(type);
 	if (self) {
 		self->x = 0;
 		self->y = 0;
@@ -569,12 +631,14 @@ typedef struct {
 	int height;
 } CHIVELRectObject;
 
+static FreeList<CHIVELRectObject> rect_freelist;
+
 static void CHIVELRect_dealloc(CHIVELRectObject* self) {
-	Py_TYPE(self)->tp_free((PyObject*)self);
+	rect_freelist.dealloc(self);
 }
 
 static PyObject* CHIVELRect_new(PyTypeObject* type, PyObject* args, PyObject* kwds) {
-	CHIVELRectObject* self = (CHIVELRectObject*)type->tp_alloc(type, 0);
+	CHIVELRectObject* self = rect_freelist.alloc(type);
 	if (self) {
 		self->x = 0;
 		self->y = 0;
@@ -673,6 +737,21 @@ static PyObject* create_rect(int x, int y, int width, int height) {
 	return rect_obj;
 }
 
+static PyObject* create_rect_list(std::vector<cv::Rect> const& rects) {
+	PyObject* list = PyList_New(static_cast<Py_ssize_t>(rects.size()));
+	if (!list)
+		return nullptr;
+	for (size_t i = 0; i < rects.size(); ++i) {
+		PyObject* rect = create_rect(rects[i].x, rects[i].y, rects[i].width, rects[i].height);
+		if (!rect) {
+			Py_DECREF(list);
+			return nullptr;
+		}
+		PyList_SET_ITEM(list, i, rect); // Steals reference
+	}
+	return list;
+}
+
 #pragma endregion
 
 #pragma region Match
@@ -681,21 +760,29 @@ typedef struct {
 	PyObject_HEAD
 		PyObject* rect;   // CHIVELRectObject*
 	PyObject* label;  // PyUnicode or Py_None
+	int area;         // Pixels of the found color, 0 for other matches
+	PyObject* centroid; // CHIVELPointObject* or Py_None
 } CHIVELMatchObject;
 
+static FreeList<CHIVELMatchObject> match_freelist;
+
 static void CHIVELMatch_dealloc(CHIVELMatchObject* self) {
 	Py_XDECREF(self->rect);
 	Py_XDECREF(self->label);
-	Py_TYPE(self)->tp_free((PyObject*)self);
+	Py_XDECREF(self->centroid);
+	match_freelist.dealloc(self);
 }
 
 static PyObject* CHIVELMatch_new(PyTypeObject* type, PyObject* args, PyObject* kwds) {
-	CHIVELMatchObject* self = (CHIVELMatchObject*)type->tp_alloc(type, 0);
+	CHIVELMatchObject* self = match_freelist.alloc(type);
 	if (self) {
 		self->rect = Py_None;
 		Py_INCREF(Py_None);
 		self->label = Py_None;
 		Py_INCREF(Py_None);
+		self->area = 0;
+		self->centroid = Py_None;
+		Py_INCREF(Py_None);
 	}
 	return (PyObject*)self;
 }
@@ -733,30 +820,50 @@ static PyObject* CHIVELMatch_repr(CHIVELMatchObject* self) {
 		rect_repr = PyUnicode_FromString("None");
 	}
 
+	// find_color matches also show what was found, other matches leave this empty
+	PyObject* found_repr = NULL;
+	bool has_centroid = self->centroid && self->centroid != Py_None;
+	if (self->area > 0 && has_centroid) {
+		found_repr = PyUnicode_FromFormat(", area=%d, centroid=%R", self->area, self->centroid);
+	}
+	else if (self->area > 0) {
+		found_repr = PyUnicode_FromFormat(", area=%d", self->area);
+	}
+	else if (has_centroid) {
+		found_repr = PyUnicode_FromFormat(", centroid=%R", self->centroid);
+	}
+	else {
+		found_repr = PyUnicode_FromString("");
+	}
+
 	// If label is None, just return "(<rect_repr>)"
 	if (!self->label || self->label == Py_None) {
-		if (rect_repr) {
-			result = PyUnicode_FromFormat("(%U)", rect_repr);
+		if (rect_repr && found_repr) {
+			result = PyUnicode_FromFormat("(%U%U)", rect_repr, found_repr);
 		}
 		Py_XDECREF(rect_repr);
+		Py_XDECREF(found_repr);
 		return result;
 	}
 
 	// Get repr for label
 	label_repr = PyObject_Repr(self->label);
 
-	if (rect_repr && label_repr) {
-		result = PyUnicode_FromFormat("(%U, \"%U\")", rect_repr, label_repr);
+	if (rect_repr && label_repr && found_repr) {
+		result = PyUnicode_FromFormat("(%U, \"%U\"%U)", rect_repr, label_repr, found_repr);
 	}
 
 	Py_XDECREF(rect_repr);
 	Py_XDECREF(label_repr);
+	Py_XDECREF(found_repr);
 	return result;
 }
 
 static PyMemberDef CHIVELMatch_members[] = {
 	{"rect", T_OBJECT_EX, offsetof(CHIVELMatchObject, rect), 0, "rect (chivel.Rect)"},
 	{"label", T_OBJECT, offsetof(CHIVELMatchObject, label), 0, "label (str or None)"},
+	{"area", T_INT, offsetof(CHIVELMatchObject, area), READONLY, "number of pixels found by find_color, 0 otherwise"},
+	{"centroid", T_OBJECT, offsetof(CHIVELMatchObject, centroid), READONLY, "center of mass of the pixels found by find_color (chivel.Point or None)"},
 	{nullptr}
 };
 
@@ -913,26 +1020,49 @@ static PyTypeObject CHIVELColorType = {
 	CHIVELColor_new,
 };
 
+static PyObject* create_color(int r, int g, int b, int a = 255) {
+	PyObject* color_obj = CHIVELColor_new(&CHIVELColorType, nullptr, nullptr);
+	if (!color_obj)
+		return nullptr;
+	CHIVELColorObject* color = (CHIVELColorObject*)color_obj;
+	color->r = r;
+	color->g = g;
+	color->b = b;
+	color->a = a;
+	return color_obj;
+}
+
 #pragma endregion
 
 #pragma region Image
 
 typedef struct {
 	PyObject_HEAD
-		cv::Mat* mat;
+		cv::Mat mat; // Constructed in place by CHIVELImage_new, so an image is one allocation (or none, from the freelist)
 	ColorSpace color_space;
+	PyObject* owner; // Keeps a shared buffer (such as a Capturer's) alive while mat points into it, or nullptr
+	cv::Point origin; // Where the top left pixel is on its display (window captures) or in its parent (views), added to match coordinates
+	cv::UMatData* exported_data; // The pixels exports (numpy.asarray) were made from, and how many of those exports are alive
+	int exports;
 } CHIVELImageObject;
 
+static FreeList<CHIVELImageObject> image_freelist;
+
 static void CHIVELImage_dealloc(CHIVELImageObject* self) {
-	delete self->mat;
-	Py_TYPE(self)->tp_free((PyObject*)self);
+	self->mat.~Mat();
+	Py_XDECREF(self->owner);
+	image_freelist.dealloc(self);
 }
 
 static PyObject* CHIVELImage_new(PyTypeObject* type, PyObject* args, PyObject* kwds) {
-	CHIVELImageObject* self = (CHIVELImageObject*)type->tp_alloc(type, 0);
+	CHIVELImageObject* self = image_freelist.alloc(type);
 	if (self != nullptr) {
-		self->mat = new cv::Mat();
+		new (&self->mat) cv::Mat();
 		self->color_space = COLOR_SPACE_UNKNOWN;
+		self->owner = nullptr;
+		self->origin = cv::Point();
+		self->exported_data = nullptr;
+		self->exports = 0;
 	}
 	return (PyObject*)self;
 }
@@ -946,10 +1076,9 @@ static int CHIVELImage_init(CHIVELImageObject* self, PyObject* args, PyObject* k
 		return -1;
 
 	// Clean up any existing mat
-	if (self->mat) {
-		delete self->mat;
-		self->mat = nullptr;
-	}
+	self->mat.release();
+	Py_CLEAR(self->owner);
+	self->origin = cv::Point();
 
 	if (width > 0 && height > 0 && channels > 0) {
 		int type;
@@ -970,11 +1099,10 @@ static int CHIVELImage_init(CHIVELImageObject* self, PyObject* args, PyObject* k
 			PyErr_SetString(PyExc_ValueError, "channels must be 1, 3, or 4");
 			return -1;
 		}
-		self->mat = new cv::Mat(height, width, type, cv::Scalar(0));
+		self->mat = cv::Mat(height, width, type, cv::Scalar(0));
 	}
 	else {
 		// Default: empty image
-		self->mat = new cv::Mat();
 		self->color_space = COLOR_SPACE_UNKNOWN;
 	}
 
@@ -985,6 +1113,11 @@ static int CHIVELImage_init(CHIVELImageObject* self, PyObject* args, PyObject* k
 static PyObject* CHIVELImage_get_size(CHIVELImageObject* self, PyObject* /*unused*/);
 static PyObject* CHIVELImage_show(CHIVELImageObject* self, PyObject* args, PyObject* kwargs);
 static PyObject* CHIVELImage_clone(CHIVELImageObject* self, PyObject* /*unused*/);
+static PyObject* CHIVELImage_get_origin(CHIVELImageObject* self, PyObject* /*unused*/);
+static PyObject* CHIVELImage_view(CHIVELImageObject* self, PyObject* args);
+static PyObject* CHIVELImage_from_buffer(PyObject* /*unused*/, PyObject* args, PyObject* kwargs);
+static PyObject* CHIVELImage_detach(CHIVELImageObject* self, PyObject* /*unused*/);
+static PyObject* CHIVELImage_equals(CHIVELImageObject* self, PyObject* args, PyObject* kwargs);
 static PyObject* CHIVELImage_crop(CHIVELImageObject* self, PyObject* args);
 static PyObject* CHIVELImage_grayscale(CHIVELImageObject* self, PyObject* /*unused*/);
 static PyObject* CHIVELImage_scale(CHIVELImageObject* self, PyObject* args);
@@ -1011,12 +1144,21 @@ static PyObject* CHIVELImage_merge(PyObject* /*cls*/, PyObject* args);
 static PyObject* CHIVELImage_convert(CHIVELImageObject* self, PyObject* args);
 static PyObject* CHIVELImage_range(CHIVELImageObject* self, PyObject* args);
 static PyObject* CHIVELImage_mask(CHIVELImageObject* self, PyObject* args);
+static PyObject* CHIVELImage_encode(CHIVELImageObject* self, PyObject* args, PyObject* kwargs);
+static PyObject* CHIVELImage_phash(CHIVELImageObject* self, PyObject* args, PyObject* kwargs);
+static PyObject* CHIVELImage_dhash(CHIVELImageObject* self, PyObject* args, PyObject* kwargs);
+static PyObject* CHIVELImage_ahash(CHIVELImageObject* self, PyObject* args, PyObject* kwargs);
+static PyObject* CHIVELImage_stats(CHIVELImageObject* self, PyObject* args, PyObject* kwargs);
 
 static PyMethodDef CHIVELImage_methods[] = {
 	{"get_size", (PyCFunction)CHIVELImage_get_size, METH_NOARGS, "Return (width, height) of the image"},
 	{"show", (PyCFunction)CHIVELImage_show, METH_VARARGS | METH_KEYWORDS, "Display the image in a window"},
 	{"clone", (PyCFunction)CHIVELImage_clone, METH_NOARGS, "Return a new Image object with a copy of the image data"},
+	{"get_origin", (PyCFunction)CHIVELImage_get_origin, METH_NOARGS, "Return where the image's top left pixel is on its display, or in the image it is a view of, which is added to the coordinates of matches found in it"},
+	{"equals", (PyCFunction)CHIVELImage_equals, METH_VARARGS | METH_KEYWORDS, "Check if two images have identical pixels, optionally only within a region"},
+	{"detach", (PyCFunction)CHIVELImage_detach, METH_NOARGS, "Copy the image data out of a shared buffer, such as a Capturer's, so it is kept after the next grab"},
 	{"crop", (PyCFunction)CHIVELImage_crop, METH_VARARGS, "Crop the image to the specified rectangle (x, y, w, h)"},
+	{"view", (PyCFunction)CHIVELImage_view, METH_VARARGS, "Return a new Image of the specified rectangle that shares this image's pixels until either one is drawn on"},
 	{"grayscale", (PyCFunction)CHIVELImage_grayscale, METH_NOARGS, "Convert the image to grayscale"},
 	{"scale", (PyCFunction)CHIVELImage_scale, METH_VARARGS, "Scale the image by (x[, y]) factors"},
 	{"rotate", (PyCFunction)CHIVELImage_rotate, METH_VARARGS, "Rotate the image by a given angle in degrees"},
@@ -1039,12 +1181,126 @@ static PyMethodDef CHIVELImage_methods[] = {
 	{"emboss", (PyCFunction)CHIVELImage_emboss, METH_NOARGS, "Apply an emboss effect to the image"},
 	{"split", (PyCFunction)CHIVELImage_split, METH_NOARGS, "Split the image into its color channels"},
 	{"merge", (PyCFunction)CHIVELImage_merge, METH_VARARGS, "Merge multiple channel images into a single image"},
+	{"from_buffer", (PyCFunction)CHIVELImage_from_buffer, METH_VARARGS | METH_KEYWORDS | METH_STATIC, "Wrap the pixels of an object with the buffer protocol (such as a NumPy array) without copying them"},
 	{"convert", (PyCFunction)CHIVELImage_convert, METH_VARARGS, "Convert the image to a specified color space"},
 	{"range", (PyCFunction)CHIVELImage_range, METH_VARARGS, "Check if the image is within a specified color range"},
 	{"mask", (PyCFunction)CHIVELImage_mask, METH_VARARGS, "Apply a mask to the image"},
+	{"encode", (PyCFunction)CHIVELImage_encode, METH_VARARGS | METH_KEYWORDS, "Encode the image to the bytes of an image file in the given format (png, jpg, webp, bmp, ...), with an optional JPEG/WebP quality or PNG compression"},
+	{"phash", (PyCFunction)CHIVELImage_phash, METH_VARARGS | METH_KEYWORDS, "Get the 64 bit perceptual (DCT) hash of the image, optionally ignoring a list of excluded Rects"},
+	{"dhash", (PyCFunction)CHIVELImage_dhash, METH_VARARGS | METH_KEYWORDS, "Get the 64 bit difference hash of the image, optionally ignoring a list of excluded Rects"},
+	{"ahash", (PyCFunction)CHIVELImage_ahash, METH_VARARGS | METH_KEYWORDS, "Get the 64 bit average hash of the image, optionally ignoring a list of excluded Rects"},
+	{"stats", (PyCFunction)CHIVELImage_stats, METH_VARARGS | METH_KEYWORDS, "Get the per channel mean, stddev, min, max and histogram and the dominant colors of the image, optionally only within a region and a mask, in one pass"},
 	{nullptr, nullptr, 0, nullptr}
 };
 
+static bool is_bundle(PyObject* obj);
+
+// Call before writing to an image's pixels in place. Pixels shared with another Image (such as a view or its parent)
+// or with the load cache are copied first, so the write only shows up in this one. Exports to Python (numpy.asarray) are not counted, so they keep
+// seeing the writes, and neither are pixels the image does not own (Capturer and from_buffer images), which are shared on purpose.
+// Bundle pixels are the exception: every Image of a template points into the same mapping, so they are always copied.
+static void prepare_write(CHIVELImageObject* self) {
+	cv::Mat& mat = self->mat;
+	if (!mat.u) {
+		if (self->owner && is_bundle(self->owner)) {
+			mat = mat.clone();
+			Py_CLEAR(self->owner);
+		}
+		return;
+	}
+	int exports = self->exported_data == mat.u ? self->exports : 0;
+	if (CV_XADD(&mat.u->refcount, 0) > 1 + exports)
+		mat = mat.clone();
+}
+
+// What an exported buffer keeps alive: its own Mat header, so the pixels outlive the image being given new ones,
+// the image's owner, and the shape and strides the Py_buffer points into
+struct CHIVELImageExport {
+	cv::Mat mat;
+	PyObject* owner;
+	Py_ssize_t shape[3];
+	Py_ssize_t strides[3];
+};
+
+static int CHIVELImage_getbuffer(CHIVELImageObject* self, Py_buffer* view, int flags) {
+	// Every export is writable, even when a read-only one is asked for (numpy.asarray, memoryview),
+	// so writes through it are writes in place
+	prepare_write(self);
+	cv::Mat const& mat = self->mat;
+	if (mat.empty()) {
+		PyErr_SetString(PyExc_BufferError, "Image data is empty");
+		view->obj = nullptr;
+		return -1;
+	}
+	if (!(flags & PyBUF_STRIDES) && !mat.isContinuous()) {
+		PyErr_SetString(PyExc_BufferError, "Image data is not contiguous, request a strided buffer");
+		view->obj = nullptr;
+		return -1;
+	}
+
+	char const* format;
+	switch (mat.depth()) {
+	case CV_8U: format = "B"; break;
+	case CV_8S: format = "b"; break;
+	case CV_16U: format = "H"; break;
+	case CV_16S: format = "h"; break;
+	case CV_32S: format = "i"; break;
+	case CV_32F: format = "f"; break;
+	case CV_64F: format = "d"; break;
+	default:
+		PyErr_SetString(PyExc_BufferError, "Image data has an unsupported depth");
+		view->obj = nullptr;
+		return -1;
+	}
+
+	CHIVELImageExport* exported = new CHIVELImageExport();
+	exported->mat = mat;
+	exported->owner = self->owner;
+	Py_XINCREF(exported->owner);
+
+	// Rows, columns and channels, the same layout NumPy and cv2 use. Single channel images are 2D.
+	int ndim = mat.channels() > 1 ? 3 : 2;
+	exported->shape[0] = mat.rows;
+	exported->shape[1] = mat.cols;
+	exported->shape[2] = mat.channels();
+	exported->strides[0] = static_cast<Py_ssize_t>(mat.step[0]);
+	exported->strides[1] = static_cast<Py_ssize_t>(mat.elemSize());
+	exported->strides[2] = static_cast<Py_ssize_t>(mat.elemSize1());
+
+	view->buf = mat.data;
+	view->obj = (PyObject*)self;
+	Py_INCREF(self);
+	view->len = static_cast<Py_ssize_t>(mat.total() * mat.elemSize());
+	view->readonly = 0;
+	view->itemsize = static_cast<Py_ssize_t>(mat.elemSize1());
+	view->format = (flags & PyBUF_FORMAT) ? const_cast<char*>(format) : nullptr;
+	view->ndim = ndim;
+	view->shape = (flags & PyBUF_ND) ? exported->shape : nullptr;
+	view->strides = (flags & PyBUF_STRIDES) ? exported->strides : nullptr;
+	view->suboffsets = nullptr;
+	view->internal = exported;
+
+	if (self->exported_data != mat.u) {
+		self->exported_data = mat.u;
+		self->exports = 0;
+	}
+	self->exports++;
+	return 0;
+}
+
+static void CHIVELImage_releasebuffer(CHIVELImageObject* self, Py_buffer* view) {
+	CHIVELImageExport* exported = (CHIVELImageExport*)view->internal;
+	if (self->exported_data == exported->mat.u && self->exports > 0)
+		self->exports--;
+	Py_XDECREF(exported->owner);
+	delete exported;
+}
+
+static PyBufferProcs CHIVELImage_as_buffer = {
+	(getbufferproc)CHIVELImage_getbuffer,
+	(releasebufferproc)CHIVELImage_releasebuffer,
+};
+
 static PyTypeObject CHIVELImageType = {
 	PyVarObject_HEAD_INIT(NULL, 0)
 	"chivel.Image",             /* tp_name */
@@ -1064,7 +1320,7 @@ static PyTypeObject CHIVELImageType = {
 	0,                         /* tp_str */
 	0,                         /* tp_getattro */
 	0,                         /* tp_setattro */
-	0,                         /* tp_as_buffer */
+	&CHIVELImage_as_buffer,    /* tp_as_buffer */
 	Py_TPFLAGS_DEFAULT |
 	Py_TPFLAGS_BASETYPE,       /* tp_flags */
 	"Chivel Image objects",    /* tp_doc */
@@ -1087,13 +1343,34 @@ static PyTypeObject CHIVELImageType = {
 	CHIVELImage_new,            /* tp_new */
 };
 
+// Wraps a Mat in a new chivel.Image. The Mat header is moved in, not the pixels, so results that are not needed
+// afterwards should be passed with std::move, which saves touching the reference count.
+// When owner is given, the image keeps it alive, and detach() copies the pixels out of it.
+static PyObject* create_image(cv::Mat&& mat, ColorSpace color_space, PyObject* owner = nullptr) {
+	PyObject* image_obj = CHIVELImage_new(&CHIVELImageType, nullptr, nullptr);
+	if (!image_obj)
+		return nullptr;
+
+	CHIVELImageObject* image = (CHIVELImageObject*)image_obj;
+	image->mat = std::move(mat);
+	image->color_space = color_space;
+	Py_XINCREF(owner);
+	image->owner = owner;
+	return image_obj;
+}
+
+// Wraps a Mat that is still needed in a new chivel.Image, sharing its pixels.
+static PyObject* create_image(cv::Mat const& mat, ColorSpace color_space, PyObject* owner = nullptr) {
+	return create_image(cv::Mat(mat), color_space, owner);
+}
+
 static PyObject* CHIVELImage_get_size(CHIVELImageObject* self, PyObject* /*unused*/) {
-	if (!self->mat || self->mat->empty()) {
+	if (self->mat.empty()) {
 		PyErr_SetString(PyExc_ValueError, "Image data is empty");
 		return nullptr;
 	}
-	int width = self->mat->cols;
-	int height = self->mat->rows;
+	int width = self->mat.cols;
+	int height = self->mat.rows;
 
 	return create_point(width, height);
 }
@@ -1104,19 +1381,19 @@ static PyObject* CHIVELImage_show(CHIVELImageObject* self, PyObject* args, PyObj
 	if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|s", (char**)kwlist, &window_name))
 		return nullptr;
 
-	if (!self->mat || self->mat->empty()) {
+	if (self->mat.empty()) {
 		PyErr_SetString(PyExc_ValueError, "Image data is empty");
 		return nullptr;
 	}
 
-	cv::imshow(window_name, *(self->mat));
+	cv::imshow(window_name, self->mat);
 	cv::waitKey(0);
 
 	Py_RETURN_NONE;
 }
 
 static PyObject* CHIVELImage_clone(CHIVELImageObject* self, PyObject* /*unused*/) {
-	if (!self->mat || self->mat->empty()) {
+	if (self->mat.empty()) {
 		PyErr_SetString(PyExc_ValueError, "Image data is empty");
 		return nullptr;
 	}
@@ -1127,12 +1404,157 @@ static PyObject* CHIVELImage_clone(CHIVELImageObject* self, PyObject* /*unused*/
 		return nullptr;
 
 	CHIVELImageObject* new_img = (CHIVELImageObject*)new_obj;
-	delete new_img->mat;
-	new_img->mat = new cv::Mat(self->mat->clone());
+	new_img->mat = self->mat.clone();
+	new_img->color_space = self->color_space;
+	new_img->origin = self->origin;
 
 	return new_obj;
 }
 
+static PyObject* CHIVELImage_get_origin(CHIVELImageObject* self, PyObject* /*unused*/) {
+	return create_point(self->origin.x, self->origin.y);
+}
+
+static PyObject* CHIVELImage_view(CHIVELImageObject* self, PyObject* args) {
+	PyObject* rect_obj = nullptr;
+	if (!PyArg_ParseTuple(args, "O", &rect_obj))
+		return nullptr;
+
+	if (!PyObject_TypeCheck(rect_obj, &CHIVELRectType)) {
+		PyErr_SetString(PyExc_TypeError, "Argument must be a chivel.Rect object");
+		return nullptr;
+	}
+	CHIVELRectObject* rect = (CHIVELRectObject*)rect_obj;
+	cv::Rect area(rect->x, rect->y, rect->width, rect->height);
+
+	if (self->mat.empty()) {
+		PyErr_SetString(PyExc_ValueError, "Image data is empty");
+		return nullptr;
+	}
+	if (area.width <= 0 || area.height <= 0 || (area & cv::Rect(0, 0, self->mat.cols, self->mat.rows)) != area) {
+		PyErr_SetString(PyExc_ValueError, "View rectangle is out of image bounds");
+		return nullptr;
+	}
+
+	// Only a new header, the pixels are shared until one side writes to them
+	PyObject* view_obj = create_image((self->mat)(area), self->color_space, self->owner);
+	if (!view_obj)
+		return nullptr;
+	((CHIVELImageObject*)view_obj)->origin = self->origin + area.tl();
+	return view_obj;
+}
+
+static PyObject* CHIVELImage_from_buffer(PyObject* /*unused*/, PyObject* args, PyObject* kwargs) {
+	PyObject* buffer_obj = nullptr;
+	int color_space = COLOR_SPACE_UNKNOWN;
+	static const char* kwlist[] = { "obj", "color_space", nullptr };
+	if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|i", (char**)kwlist, &buffer_obj, &color_space))
+		return nullptr;
+
+	// The memoryview holds the export, so the image keeps the exporter alive (and the buffer locked) by owning it
+	PyObject* memory = PyMemoryView_FromObject(buffer_obj);
+	if (!memory)
+		return nullptr;
+	Py_buffer const* view = PyMemoryView_GET_BUFFER(memory);
+
+	// A byte order prefix means nothing for single bytes
+	char const* format = view->format ? view->format : "B";
+	if (format[0] && std::strchr("@=<>!", format[0]))
+		format++;
+	if (std::strcmp(format, "B") != 0 || view->itemsize != 1) {
+		PyErr_SetString(PyExc_ValueError, "Buffer must hold 8-bit unsigned pixels");
+		Py_DECREF(memory);
+		return nullptr;
+	}
+	if (view->ndim != 2 && view->ndim != 3) {
+		PyErr_SetString(PyExc_ValueError, "Buffer must have the shape (height, width) or (height, width, channels)");
+		Py_DECREF(memory);
+		return nullptr;
+	}
+
+	int rows = static_cast<int>(view->shape[0]);
+	int cols = static_cast<int>(view->shape[1]);
+	int channels = view->ndim == 3 ? static_cast<int>(view->shape[2]) : 1;
+	if (rows <= 0 || cols <= 0 || (channels != 1 && channels != 3 && channels != 4)) {
+		PyErr_SetString(PyExc_ValueError, "Buffer must be non-empty, with 1, 3, or 4 channels");
+		Py_DECREF(memory);
+		return nullptr;
+	}
+
+	// Rows may be padded, but the pixels within a row must be packed
+	Py_ssize_t row_step = view->strides ? view->strides[0] : static_cast<Py_ssize_t>(cols) * channels;
+	bool packed = !view->strides ||
+		(view->strides[1] == channels && (view->ndim == 2 || view->strides[2] == 1) && row_step >= static_cast<Py_ssize_t>(cols) * channels);
+	if (!packed || view->suboffsets) {
+		PyErr_SetString(PyExc_ValueError, "Buffer must be C-contiguous");
+		Py_DECREF(memory);
+		return nullptr;
+	}
+
+	if (color_space == COLOR_SPACE_UNKNOWN)
+		color_space = channels == 1 ? COLOR_SPACE_GRAY : channels == 4 ? COLOR_SPACE_BGRA : COLOR_SPACE_BGR;
+	if (chivel::colorSpaceChannels(static_cast<ColorSpace>(color_space)) != channels) {
+		PyErr_SetString(PyExc_ValueError, "color_space does not match the number of channels");
+		Py_DECREF(memory);
+		return nullptr;
+	}
+
+	cv::Mat mat(rows, cols, CV_8UC(channels), view->buf, static_cast<size_t>(row_step));
+	PyObject* image_obj;
+	if (view->readonly) {
+		// Image methods work in place, so read only memory (such as bytes) has to be copied
+		image_obj = create_image(mat.clone(), static_cast<ColorSpace>(color_space));
+	}
+	else {
+		image_obj = create_image(mat, static_cast<ColorSpace>(color_space), memory);
+	}
+	Py_DECREF(memory);
+	return image_obj;
+}
+
+static PyObject* CHIVELImage_detach(CHIVELImageObject* self, PyObject* /*unused*/) {
+	if (self->owner) {
+		self->mat = self->mat.clone();
+		Py_CLEAR(self->owner);
+	}
+
+	Py_RETURN_NONE;
+}
+
+static PyObject* CHIVELImage_equals(CHIVELImageObject* self, PyObject* args, PyObject* kwargs) {
+	PyObject* other_obj = nullptr;
+	PyObject* region_obj = Py_None;
+	static const char* kwlist[] = { "other", "region", nullptr };
+	if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|O", (char**)kwlist, &other_obj, &region_obj))
+		return nullptr;
+
+	if (!PyObject_TypeCheck(other_obj, &CHIVELImageType)) {
+		PyErr_SetString(PyExc_TypeError, "other must be a chivel.Image object");
+		return nullptr;
+	}
+	cv::Mat const& a = self->mat;
+	cv::Mat const& b = ((CHIVELImageObject*)other_obj)->mat;
+	if (a.size() != b.size() || a.type() != b.type())
+		Py_RETURN_FALSE;
+	if (a.empty())
+		Py_RETURN_TRUE;
+
+	if (region_obj == Py_None)
+		return PyBool_FromLong(chivel::equalPixels(a, b));
+
+	if (!PyObject_TypeCheck(region_obj, &CHIVELRectType)) {
+		PyErr_SetString(PyExc_TypeError, "region must be a chivel.Rect object");
+		return nullptr;
+	}
+	CHIVELRectObject* r = (CHIVELRectObject*)region_obj;
+	cv::Rect region(r->x, r->y, r->width, r->height);
+	if (region.width <= 0 || region.height <= 0 || (region & cv::Rect(0, 0, a.cols, a.rows)) != region) {
+		PyErr_SetString(PyExc_ValueError, "region is out of image bounds");
+		return nullptr;
+	}
+	return PyBool_FromLong(chivel::equalPixels(a(region), b(region)));
+}
+
 static PyObject* CHIVELImage_crop(CHIVELImageObject* self, PyObject* args) {
 	PyObject* rect_obj = nullptr;
 	if (!PyArg_ParseTuple(args, "O", &rect_obj))
@@ -1148,41 +1570,42 @@ static PyObject* CHIVELImage_crop(CHIVELImageObject* self, PyObject* args) {
 	int w = rect->width;
 	int h = rect->height;
 
-	if (!self->mat || self->mat->empty()) {
+	if (self->mat.empty()) {
 		PyErr_SetString(PyExc_ValueError, "Image data is empty");
 		return nullptr;
 	}
 
 	// Ensure the rectangle is within image bounds
 	if (x < 0 || y < 0 || w <= 0 || h <= 0 ||
-		x + w > self->mat->cols || y + h > self->mat->rows) {
+		x + w > self->mat.cols || y + h > self->mat.rows) {
 		PyErr_SetString(PyExc_ValueError, "Crop rectangle is out of image bounds");
 		return nullptr;
 	}
 
 	// Crop in-place
-	cv::Mat cropped = (*self->mat)(cv::Rect(x, y, w, h)).clone();
-	self->mat->release();
-	*self->mat = cropped;
+	cv::Mat cropped = (self->mat)(cv::Rect(x, y, w, h)).clone();
+	self->mat.release();
+	self->mat = std::move(cropped);
+	self->origin += cv::Point(x, y); // same as a view of the rect
 
 	Py_RETURN_NONE;
 }
 
 static PyObject* CHIVELImage_grayscale(CHIVELImageObject* self, PyObject* /*unused*/) {
-	if (!self->mat || self->mat->empty()) {
+	if (self->mat.empty()) {
 		PyErr_SetString(PyExc_ValueError, "Image data is empty");
 		return nullptr;
 	}
 
-	if (self->mat->channels() == 1) {
+	if (self->mat.channels() == 1) {
 		// Already grayscale, do nothing
 		Py_RETURN_NONE;
 	}
 
 	cv::Mat gray;
-	cv::cvtColor(*self->mat, gray, cv::COLOR_BGR2GRAY);
-	self->mat->release();
-	*self->mat = gray;
+	cv::cvtColor(self->mat, gray, cv::COLOR_BGR2GRAY);
+	self->mat.release();
+	self->mat = std::move(gray);
 
 	Py_RETURN_NONE;
 }
@@ -1201,7 +1624,7 @@ static PyObject* CHIVELImage_scale(CHIVELImageObject* self, PyObject* args) {
 		scale_y = scale_x;
 	}
 
-	if (!self->mat || self->mat->empty()) {
+	if (self->mat.empty()) {
 		PyErr_SetString(PyExc_ValueError, "Image data is empty");
 		return nullptr;
 	}
@@ -1210,17 +1633,18 @@ static PyObject* CHIVELImage_scale(CHIVELImageObject* self, PyObject* args) {
 		return nullptr;
 	}
 
-	int new_width = static_cast<int>(self->mat->cols * scale_x);
-	int new_height = static_cast<int>(self->mat->rows * scale_y);
+	int new_width = static_cast<int>(self->mat.cols * scale_x);
+	int new_height = static_cast<int>(self->mat.rows * scale_y);
 	if (new_width < 1 || new_height < 1) {
 		PyErr_SetString(PyExc_ValueError, "Resulting image size is too small");
 		return nullptr;
 	}
 
 	cv::Mat scaled;
-	cv::resize(*self->mat, scaled, cv::Size(new_width, new_height), 0, 0, cv::INTER_LINEAR);
-	self->mat->release();
-	*self->mat = scaled;
+	cv::resize(self->mat, scaled, cv::Size(new_width, new_height), 0, 0, cv::INTER_LINEAR);
+	self->mat.release();
+	self->mat = std::move(scaled);
+	self->origin = cv::Point(); // the pixels no longer line up with the display
 
 	Py_RETURN_NONE;
 }
@@ -1230,13 +1654,13 @@ static PyObject* CHIVELImage_rotate(CHIVELImageObject* self, PyObject* args) {
 	if (!PyArg_ParseTuple(args, "d", &angle))
 		return nullptr;
 
-	if (!self->mat || self->mat->empty()) {
+	if (self->mat.empty()) {
 		PyErr_SetString(PyExc_ValueError, "Image data is empty");
 		return nullptr;
 	}
 
 	// Get image center
-	cv::Point2f center(self->mat->cols / 2.0f, self->mat->rows / 2.0f);
+	cv::Point2f center(self->mat.cols / 2.0f, self->mat.rows / 2.0f);
 
 	// Compute rotation matrix
 	cv::Mat rot = cv::getRotationMatrix2D(center, angle, 1.0);
@@ -1244,18 +1668,19 @@ static PyObject* CHIVELImage_rotate(CHIVELImageObject* self, PyObject* args) {
 	// Compute bounding box of the rotated image
 	double abs_cos = std::abs(rot.at<double>(0, 0));
 	double abs_sin = std::abs(rot.at<double>(0, 1));
-	int bound_w = int(self->mat->rows * abs_sin + self->mat->cols * abs_cos);
-	int bound_h = int(self->mat->rows * abs_cos + self->mat->cols * abs_sin);
+	int bound_w = int(self->mat.rows * abs_sin + self->mat.cols * abs_cos);
+	int bound_h = int(self->mat.rows * abs_cos + self->mat.cols * abs_sin);
 
 	// Adjust the rotation matrix to take into account translation
 	rot.at<double>(0, 2) += bound_w / 2.0 - center.x;
 	rot.at<double>(1, 2) += bound_h / 2.0 - center.y;
 
 	cv::Mat rotated;
-	cv::warpAffine(*self->mat, rotated, rot, cv::Size(bound_w, bound_h), cv::INTER_LINEAR, cv::BORDER_REPLICATE);
+	cv::warpAffine(self->mat, rotated, rot, cv::Size(bound_w, bound_h), cv::INTER_LINEAR, cv::BORDER_REPLICATE);
 
-	self->mat->release();
-	*self->mat = rotated;
+	self->mat.release();
+	self->mat = std::move(rotated);
+	self->origin = cv::Point(); // the pixels no longer line up with the display
 
 	Py_RETURN_NONE;
 }
@@ -1265,7 +1690,7 @@ static PyObject* CHIVELImage_flip(CHIVELImageObject* self, PyObject* args) {
 	if (!PyArg_ParseTuple(args, "i", &flags))
 		return nullptr;
 
-	if (!self->mat || self->mat->empty()) {
+	if (self->mat.empty()) {
 		PyErr_SetString(PyExc_ValueError, "Image data is empty");
 		return nullptr;
 	}
@@ -1286,9 +1711,10 @@ static PyObject* CHIVELImage_flip(CHIVELImageObject* self, PyObject* args) {
 	}
 
 	cv::Mat flipped;
-	cv::flip(*self->mat, flipped, flipCode);
-	self->mat->release();
-	*self->mat = flipped;
+	cv::flip(self->mat, flipped, flipCode);
+	self->mat.release();
+	self->mat = std::move(flipped);
+	self->origin = cv::Point(); // the pixels no longer line up with the display
 
 	Py_RETURN_NONE;
 }
@@ -1307,7 +1733,7 @@ static PyObject* CHIVELImage_resize(CHIVELImageObject* self, PyObject* args) {
 	int width = point->x;
 	int height = point->y;
 
-	if (!self->mat || self->mat->empty()) {
+	if (self->mat.empty()) {
 		PyErr_SetString(PyExc_ValueError, "Image data is empty");
 		return nullptr;
 	}
@@ -1317,9 +1743,10 @@ static PyObject* CHIVELImage_resize(CHIVELImageObject* self, PyObject* args) {
 	}
 
 	cv::Mat resized;
-	cv::resize(*self->mat, resized, cv::Size(width, height), 0, 0, cv::INTER_LINEAR);
-	self->mat->release();
-	*self->mat = resized;
+	cv::resize(self->mat, resized, cv::Size(width, height), 0, 0, cv::INTER_LINEAR);
+	self->mat.release();
+	self->mat = std::move(resized);
+	self->origin = cv::Point(); // the pixels no longer line up with the display
 
 	Py_RETURN_NONE;
 }
@@ -1332,7 +1759,7 @@ static PyObject* CHIVELImage_draw_rect(CHIVELImageObject* self, PyObject* args,
 	if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|Oi", (char**)kwlist, &rect_obj, &color_obj, &thickness))
 		return nullptr;
 
-	if (!self->mat || self->mat->empty()) {
+	if (self->mat.empty()) {
 		PyErr_SetString(PyExc_ValueError, "Image data is empty");
 		return nullptr;
 	}
@@ -1364,7 +1791,8 @@ static PyObject* CHIVELImage_draw_rect(CHIVELImageObject* self, PyObject* args,
 		return nullptr;
 	}
 
-	cv::rectangle(*self->mat, cv::Rect(x, y, w, h), color, thickness);
+	prepare_write(self);
+	cv::rectangle(self->mat, cv::Rect(x, y, w, h), color, thickness);
 
 	Py_RETURN_NONE;
 }
@@ -1377,7 +1805,7 @@ static PyObject* CHIVELImage_draw_matches(CHIVELImageObject* self, PyObject* arg
 	if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|Oi", (char**)kwlist, &matches_obj, &color_obj, &thickness))
 		return nullptr;
 
-	if (!self->mat || self->mat->empty()) {
+	if (self->mat.empty()) {
 		PyErr_SetString(PyExc_ValueError, "Image data is empty");
 		return nullptr;
 	}
@@ -1399,6 +1827,7 @@ static PyObject* CHIVELImage_draw_matches(CHIVELImageObject* self, PyObject* arg
 		return nullptr;
 	}
 
+	prepare_write(self);
 	Py_ssize_t n = PyList_Size(matches_obj);
 	for (Py_ssize_t i = 0; i < n; ++i) {
 		PyObject* match_obj = PyList_GetItem(matches_obj, i); // Borrowed reference
@@ -1412,14 +1841,15 @@ static PyObject* CHIVELImage_draw_matches(CHIVELImageObject* self, PyObject* arg
 			return nullptr;
 		}
 		CHIVELRectObject* rect = (CHIVELRectObject*)match->rect;
-		int x = rect->x;
-		int y = rect->y;
+		// Matches found in this image are offset by its origin, so take it back off
+		int x = rect->x - self->origin.x;
+		int y = rect->y - self->origin.y;
 		int w = rect->width;
 		int h = rect->height;
 		if (w <= 0 || h <= 0) {
 			continue; // Skip invalid rectangles
 		}
-		cv::rectangle(*self->mat, cv::Rect(x, y, w, h), color, thickness);
+		cv::rectangle(self->mat, cv::Rect(x, y, w, h), color, thickness);
 	}
 
 	Py_RETURN_NONE;
@@ -1434,7 +1864,7 @@ static PyObject* CHIVELImage_draw_line(CHIVELImageObject* self, PyObject* args,
 	if (!PyArg_ParseTupleAndKeywords(args, kwargs, "OO|Oi", (char**)kwlist, &start_obj, &end_obj, &color_obj, &thickness))
 		return nullptr;
 
-	if (!self->mat || self->mat->empty()) {
+	if (self->mat.empty()) {
 		PyErr_SetString(PyExc_ValueError, "Image data is empty");
 		return nullptr;
 	}
@@ -1463,7 +1893,8 @@ static PyObject* CHIVELImage_draw_line(CHIVELImageObject* self, PyObject* args,
 		return nullptr;
 	}
 
-	cv::line(*self->mat, cv::Point(x1, y1), cv::Point(x2, y2), color, thickness);
+	prepare_write(self);
+	cv::line(self->mat, cv::Point(x1, y1), cv::Point(x2, y2), color, thickness);
 
 	Py_RETURN_NONE;
 }
@@ -1478,7 +1909,7 @@ static PyObject* CHIVELImage_draw_text(CHIVELImageObject* self, PyObject* args,
 	if (!PyArg_ParseTupleAndKeywords(args, kwargs, "sO|Oii", (char**)kwlist, &text, &pos_obj, &color_obj, &font_size, &thickness))
 		return nullptr;
 
-	if (!self->mat || self->mat->empty()) {
+	if (self->mat.empty()) {
 		PyErr_SetString(PyExc_ValueError, "Image data is empty");
 		return nullptr;
 	}
@@ -1510,7 +1941,8 @@ static PyObject* CHIVELImage_draw_text(CHIVELImageObject* self, PyObject* args,
 	int use_thickness = (thickness >= 0) ? thickness : std::max(1, font_size / 12);
 	if (use_thickness < 1) use_thickness = 1;
 
-	cv::putText(*self->mat, text, cv::Point(x, y), font_face, font_scale, color, use_thickness, cv::LINE_AA);
+	prepare_write(self);
+	cv::putText(self->mat, text, cv::Point(x, y), font_face, font_scale, color, use_thickness, cv::LINE_AA);
 
 	Py_RETURN_NONE;
 }
@@ -1526,7 +1958,7 @@ static PyObject* CHIVELImage_draw_ellipse(CHIVELImageObject* self, PyObject* arg
 		&center_obj, &radius_or_axes_obj, &color_obj, &thickness, &angle))
 		return nullptr;
 
-	if (!self->mat || self->mat->empty()) {
+	if (self->mat.empty()) {
 		PyErr_SetString(PyExc_ValueError, "Image data is empty");
 		return nullptr;
 	}
@@ -1554,7 +1986,8 @@ static PyObject* CHIVELImage_draw_ellipse(CHIVELImageObject* self, PyObject* arg
 			PyErr_SetString(PyExc_ValueError, "radius must be positive");
 			return nullptr;
 		}
-		cv::circle(*self->mat, cv::Point(cx, cy), radius, color, thickness, cv::LINE_AA);
+		prepare_write(self);
+		cv::circle(self->mat, cv::Point(cx, cy), radius, color, thickness, cv::LINE_AA);
 	}
 	else if (PyTuple_Check(radius_or_axes_obj) && PyTuple_Size(radius_or_axes_obj) == 2) {
 		// Draw ellipse
@@ -1567,7 +2000,8 @@ static PyObject* CHIVELImage_draw_ellipse(CHIVELImageObject* self, PyObject* arg
 			PyErr_SetString(PyExc_ValueError, "axes must be positive");
 			return nullptr;
 		}
-		cv::ellipse(*self->mat, cv::Point(cx, cy), cv::Size(rx, ry), angle, 0, 360, color, thickness, cv::LINE_AA);
+		prepare_write(self);
+		cv::ellipse(self->mat, cv::Point(cx, cy), cv::Size(rx, ry), angle, 0, 360, color, thickness, cv::LINE_AA);
 	}
 	else {
 		PyErr_SetString(PyExc_TypeError, "radius_or_axes must be an int (radius) or tuple of 2 ints (axes)");
@@ -1589,12 +2023,12 @@ static PyObject* CHIVELImage_draw_image(CHIVELImageObject* self, PyObject* args,
 		PyErr_SetString(PyExc_TypeError, "src must be a chivel.Image object");
 		return nullptr;
 	}
-	if (!self->mat || self->mat->empty()) {
+	if (self->mat.empty()) {
 		PyErr_SetString(PyExc_ValueError, "Destination image data is empty");
 		return nullptr;
 	}
 	CHIVELImageObject* src = (CHIVELImageObject*)src_obj;
-	if (!src->mat || src->mat->empty()) {
+	if (src->mat.empty()) {
 		PyErr_SetString(PyExc_ValueError, "Source image data is empty");
 		return nullptr;
 	}
@@ -1610,8 +2044,9 @@ static PyObject* CHIVELImage_draw_image(CHIVELImageObject* self, PyObject* args,
 		return nullptr;
 	}
 
-	cv::Mat& dst = *self->mat;
-	const cv::Mat& srcMat = *src->mat;
+	prepare_write(self);
+	cv::Mat& dst = self->mat;
+	const cv::Mat& srcMat = src->mat;
 
 	int w = srcMat.cols;
 	int h = srcMat.rows;
@@ -1625,33 +2060,17 @@ static PyObject* CHIVELImage_draw_image(CHIVELImageObject* self, PyObject* args,
 	cv::Mat dstROI = dst(cv::Rect(x, y, w, h));
 
 	if (srcMat.channels() == 4) {
-		// Use source alpha channel for blending
-		std::vector<cv::Mat> srcChannels;
-		cv::split(srcMat, srcChannels);
-		cv::Mat srcRGB, srcAlpha;
-		cv::merge(std::vector<cv::Mat>{srcChannels[0], srcChannels[1], srcChannels[2]}, srcRGB);
-		srcAlpha = srcChannels[3];
-
-		// Normalize alpha to [0,1] and multiply by user alpha
-		cv::Mat alphaMask;
-		srcAlpha.convertTo(alphaMask, CV_32F, (alpha / 255.0));
-
-		// Convert to float for blending
-		cv::Mat dstROI32F, srcRGB32F, alphaMask3;
-		dstROI.convertTo(dstROI32F, CV_32F);
-		srcRGB.convertTo(srcRGB32F, CV_32F);
-
-		// Expand alpha to 3 channels
-		cv::Mat alphaMaskChannels[] = { alphaMask, alphaMask, alphaMask };
-		cv::merge(alphaMaskChannels, 3, alphaMask3);
-
-		// Blend: dst = src * alpha + dst * (1 - alpha)
-		cv::Mat blended;
-		cv::multiply(srcRGB32F, alphaMask3, srcRGB32F, 1.0 / 255.0);
-		cv::multiply(dstROI32F, cv::Scalar::all(1.0), dstROI32F, 1.0 / 255.0);
-		cv::multiply(dstROI32F, cv::Scalar::all(1.0) - alphaMask3 / 255.0, dstROI32F);
-		blended = srcRGB32F + dstROI32F;
-		blended.convertTo(dstROI, dstROI.type(), 255.0);
+		if (srcMat.type() != CV_8UC4 || (dst.type() != CV_8UC3 && dst.type() != CV_8UC4)) {
+			PyErr_SetString(PyExc_ValueError, "Images with an alpha channel must be 8-bit, and can only be drawn onto 8-bit BGR or BGRA images");
+			return nullptr;
+		}
+		// Blended in place, reading the source while writing the destination, so a source that overlaps it is copied first
+		cv::Mat blendSrc = srcMat;
+		uchar const* srcEnd = srcMat.ptr(h - 1) + w * srcMat.elemSize();
+		uchar const* dstEnd = dstROI.ptr(h - 1) + w * dstROI.elemSize();
+		if (srcMat.data < dstEnd && dstROI.data < srcEnd)
+			blendSrc = srcMat.clone();
+		chivel::blendOver(blendSrc, dstROI, alpha);
 	}
 	else {
 		// No alpha channel, use uniform alpha
@@ -1670,11 +2089,12 @@ static PyObject* CHIVELImage_draw_image(CHIVELImageObject* self, PyObject* args,
 }
 
 static PyObject* CHIVELImage_invert(CHIVELImageObject* self, PyObject* /*unused*/) {
-	if (!self->mat || self->mat->empty()) {
+	if (self->mat.empty()) {
 		PyErr_SetString(PyExc_ValueError, "Image data is empty");
 		return nullptr;
 	}
-	cv::bitwise_not(*self->mat, *self->mat);
+	prepare_write(self);
+	cv::bitwise_not(self->mat, self->mat);
 	Py_RETURN_NONE;
 }
 
@@ -1683,16 +2103,16 @@ static PyObject* CHIVELImage_brightness(CHIVELImageObject* self, PyObject* args)
 	if (!PyArg_ParseTuple(args, "d", &value))
 		return nullptr;
 
-	if (!self->mat || self->mat->empty()) {
+	if (self->mat.empty()) {
 		PyErr_SetString(PyExc_ValueError, "Image data is empty");
 		return nullptr;
 	}
 
 	// Add brightness (value can be negative or positive)
 	cv::Mat result;
-	self->mat->convertTo(result, -1, 1, value);
-	self->mat->release();
-	*self->mat = result;
+	self->mat.convertTo(result, -1, 1, value);
+	self->mat.release();
+	self->mat = std::move(result);
 
 	Py_RETURN_NONE;
 }
@@ -1702,16 +2122,16 @@ static PyObject* CHIVELImage_contrast(CHIVELImageObject* self, PyObject* args) {
 	if (!PyArg_ParseTuple(args, "d", &factor))
 		return nullptr;
 
-	if (!self->mat || self->mat->empty()) {
+	if (self->mat.empty()) {
 		PyErr_SetString(PyExc_ValueError, "Image data is empty");
 		return nullptr;
 	}
 
 	// Adjust contrast (factor > 1.0 increases, 0 < factor < 1.0 decreases)
 	cv::Mat result;
-	self->mat->convertTo(result, -1, factor, 0);
-	self->mat->release();
-	*self->mat = result;
+	self->mat.convertTo(result, -1, factor, 0);
+	self->mat.release();
+	self->mat = std::move(result);
 
 	Py_RETURN_NONE;
 }
@@ -1721,7 +2141,7 @@ static PyObject* CHIVELImage_sharpen(CHIVELImageObject* self, PyObject* args) {
 	if (!PyArg_ParseTuple(args, "|d", &strength))
 		return nullptr;
 
-	if (!self->mat || self->mat->empty()) {
+	if (self->mat.empty()) {
 		PyErr_SetString(PyExc_ValueError, "Image data is empty");
 		return nullptr;
 	}
@@ -1734,9 +2154,9 @@ static PyObject* CHIVELImage_sharpen(CHIVELImageObject* self, PyObject* args) {
 		0, -strength, 0);
 
 	cv::Mat result;
-	cv::filter2D(*self->mat, result, self->mat->depth(), kernel);
-	self->mat->release();
-	*self->mat = result;
+	cv::filter2D(self->mat, result, self->mat.depth(), kernel);
+	self->mat.release();
+	self->mat = std::move(result);
 
 	Py_RETURN_NONE;
 }
@@ -1758,15 +2178,15 @@ static PyObject* CHIVELImage_blur(CHIVELImageObject* self, PyObject* args) {
 	}
 	ksize = (ksize - 1) * 2 + 1;
 
-	if (!self->mat || self->mat->empty()) {
+	if (self->mat.empty()) {
 		PyErr_SetString(PyExc_ValueError, "Image data is empty");
 		return nullptr;
 	}
 
 	cv::Mat result;
-	cv::GaussianBlur(*self->mat, result, cv::Size(ksize, ksize), 0);
-	self->mat->release();
-	*self->mat = result;
+	cv::GaussianBlur(self->mat, result, cv::Size(ksize, ksize), 0);
+	self->mat.release();
+	self->mat = std::move(result);
 
 	Py_RETURN_NONE;
 }
@@ -1777,24 +2197,24 @@ static PyObject* CHIVELImage_threshold(CHIVELImageObject* self, PyObject* args)
 	if (!PyArg_ParseTuple(args, "|dd", &thresh, &maxval))
 		return nullptr;
 
-	if (!self->mat || self->mat->empty()) {
+	if (self->mat.empty()) {
 		PyErr_SetString(PyExc_ValueError, "Image data is empty");
 		return nullptr;
 	}
 
 	// Convert to grayscale if needed
 	cv::Mat gray;
-	if (self->mat->channels() == 1) {
-		gray = *self->mat;
+	if (self->mat.channels() == 1) {
+		gray = self->mat;
 	}
 	else {
-		cv::cvtColor(*self->mat, gray, cv::COLOR_BGR2GRAY);
+		cv::cvtColor(self->mat, gray, cv::COLOR_BGR2GRAY);
 	}
 
 	cv::Mat result;
 	cv::threshold(gray, result, thresh, maxval, cv::THRESH_BINARY);
-	self->mat->release();
-	*self->mat = result;
+	self->mat.release();
+	self->mat = std::move(result);
 
 	Py_RETURN_NONE;
 }
@@ -1806,15 +2226,15 @@ static PyObject* CHIVELImage_normalize(CHIVELImageObject* self, PyObject* args)
 	if (!PyArg_ParseTuple(args, "|dd", &alpha, &beta))
 		return nullptr;
 
-	if (!self->mat || self->mat->empty()) {
+	if (self->mat.empty()) {
 		PyErr_SetString(PyExc_ValueError, "Image data is empty");
 		return nullptr;
 	}
 
 	cv::Mat result;
-	cv::normalize(*self->mat, result, alpha, beta, norm_type);
-	self->mat->release();
-	*self->mat = result;
+	cv::normalize(self->mat, result, alpha, beta, norm_type);
+	self->mat.release();
+	self->mat = std::move(result);
 
 	Py_RETURN_NONE;
 }
@@ -1825,42 +2245,42 @@ static PyObject* CHIVELImage_edge(CHIVELImageObject* self, PyObject* args) {
 	if (!PyArg_ParseTuple(args, "|dd", &threshold1, &threshold2))
 		return nullptr;
 
-	if (!self->mat || self->mat->empty()) {
+	if (self->mat.empty()) {
 		PyErr_SetString(PyExc_ValueError, "Image data is empty");
 		return nullptr;
 	}
 
 	// Convert to grayscale if needed
 	cv::Mat gray;
-	if (self->mat->channels() == 1) {
-		gray = *self->mat;
+	if (self->mat.channels() == 1) {
+		gray = self->mat;
 	}
 	else {
-		cv::cvtColor(*self->mat, gray, cv::COLOR_BGR2GRAY);
+		cv::cvtColor(self->mat, gray, cv::COLOR_BGR2GRAY);
 	}
 
 	cv::Mat edges;
 	cv::Canny(gray, edges, threshold1, threshold2);
 
-	self->mat->release();
-	*self->mat = edges;
+	self->mat.release();
+	self->mat = std::move(edges);
 
 	Py_RETURN_NONE;
 }
 
 static PyObject* CHIVELImage_emboss(CHIVELImageObject* self, PyObject* /*unused*/) {
-	if (!self->mat || self->mat->empty()) {
+	if (self->mat.empty()) {
 		PyErr_SetString(PyExc_ValueError, "Image data is empty");
 		return nullptr;
 	}
 
 	// Convert to grayscale for classic emboss effect
 	cv::Mat gray;
-	if (self->mat->channels() == 1) {
-		gray = *self->mat;
+	if (self->mat.channels() == 1) {
+		gray = self->mat;
 	}
 	else {
-		cv::cvtColor(*self->mat, gray, cv::COLOR_BGR2GRAY);
+		cv::cvtColor(self->mat, gray, cv::COLOR_BGR2GRAY);
 	}
 
 	// Emboss kernel (diagonal light)
@@ -1875,14 +2295,14 @@ static PyObject* CHIVELImage_emboss(CHIVELImageObject* self, PyObject* /*unused*
 	// Add 128 to shift the result to visible range (optional, but common)
 	cv::add(embossed, cv::Scalar(128), embossed);
 
-	self->mat->release();
-	*self->mat = embossed;
+	self->mat.release();
+	self->mat = std::move(embossed);
 
 	Py_RETURN_NONE;
 }
 
 static PyObject* CHIVELImage_split(CHIVELImageObject* self, PyObject* /*unused*/) {
-	if (!self->mat || self->mat->empty()) {
+	if (self->mat.empty()) {
 		PyErr_SetString(PyExc_ValueError, "Image data is empty");
 		return nullptr;
 	}
@@ -1893,7 +2313,7 @@ static PyObject* CHIVELImage_split(CHIVELImageObject* self, PyObject* /*unused*/
 	}
 
 	std::vector<cv::Mat> channels;
-	cv::split(*self->mat, channels);
+	cv::split(self->mat, channels);
 
 	PyObject* pyList = PyList_New(static_cast<Py_ssize_t>(channels.size()));
 	if (!pyList)
@@ -1906,8 +2326,7 @@ static PyObject* CHIVELImage_split(CHIVELImageObject* self, PyObject* /*unused*/
 			return nullptr;
 		}
 		CHIVELImageObject* img = (CHIVELImageObject*)img_obj;
-		delete img->mat;
-		img->mat = new cv::Mat(channels[i]);
+		img->mat = std::move(channels[i]);
 		img->color_space = COLOR_SPACE_GRAY;
 		PyList_SET_ITEM(pyList, i, img_obj); // Steals reference
 	}
@@ -1942,27 +2361,27 @@ static PyObject* CHIVELImage_merge(PyObject* self, PyObject* args) {
 			return nullptr;
 		}
 		CHIVELImageObject* img = (CHIVELImageObject*)item;
-		if (!img->mat || img->mat->empty()) {
+		if (img->mat.empty()) {
 			Py_DECREF(item);
 			PyErr_SetString(PyExc_ValueError, "All images must be non-empty");
 			return nullptr;
 		}
-		if (img->mat->channels() != 1) {
+		if (img->mat.channels() != 1) {
 			Py_DECREF(item);
 			PyErr_SetString(PyExc_ValueError, "Each image must be single-channel");
 			return nullptr;
 		}
 		if (rows == -1) {
-			rows = img->mat->rows;
-			cols = img->mat->cols;
-			type = img->mat->type();
+			rows = img->mat.rows;
+			cols = img->mat.cols;
+			type = img->mat.type();
 		}
-		else if (img->mat->rows != rows || img->mat->cols != cols || img->mat->type() != type) {
+		else if (img->mat.rows != rows || img->mat.cols != cols || img->mat.type() != type) {
 			Py_DECREF(item);
 			PyErr_SetString(PyExc_ValueError, "All images must have the same size and type");
 			return nullptr;
 		}
-		channels.push_back(*img->mat);
+		channels.push_back(img->mat);
 		Py_DECREF(item);
 	}
 
@@ -1971,10 +2390,7 @@ static PyObject* CHIVELImage_merge(PyObject* self, PyObject* args) {
 
 	// Modify self in-place
 	CHIVELImageObject* out_img = (CHIVELImageObject*)self;
-	if (out_img->mat) {
-		delete out_img->mat;
-	}
-	out_img->mat = new cv::Mat(merged);
+	out_img->mat = std::move(merged);
 
 	// Set color_space based on number of channels
 	switch (static_cast<int>(channels.size())) {
@@ -2001,7 +2417,7 @@ static PyObject* CHIVELImage_convert(CHIVELImageObject* self, PyObject* args) {
 	if (!PyArg_ParseTuple(args, "i", (char**)kwlist, &target_space))
 		return nullptr;
 
-	if (!self->mat || self->mat->empty()) {
+	if (self->mat.empty()) {
 		PyErr_SetString(PyExc_ValueError, "Image data is empty");
 		return nullptr;
 	}
@@ -2015,14 +2431,14 @@ static PyObject* CHIVELImage_convert(CHIVELImageObject* self, PyObject* args) {
 	}
 
 	// convert to the new color space
-	cv::Mat result = chivel::convertColorSpace(*self->mat, src_space, dst_space);
+	cv::Mat result = chivel::convertColorSpace(self->mat, src_space, dst_space);
 	if (result.empty()) {
 		PyErr_SetString(PyExc_ValueError, "Color space conversion failed or unsupported.");
 		return nullptr;
 	}
 
-	self->mat->release();
-	*self->mat = result;
+	self->mat.release();
+	self->mat = std::move(result);
 	self->color_space = dst_space;
 	Py_RETURN_NONE;
 }
@@ -2033,7 +2449,7 @@ static PyObject* CHIVELImage_range(CHIVELImageObject* self, PyObject* args) {
 	if (!PyArg_ParseTuple(args, "OO", &lower_obj, &upper_obj))
 		return nullptr;
 
-	if (!self->mat || self->mat->empty()) {
+	if (self->mat.empty()) {
 		PyErr_SetString(PyExc_ValueError, "Image data is empty");
 		return nullptr;
 	}
@@ -2070,12 +2486,12 @@ static PyObject* CHIVELImage_range(CHIVELImageObject* self, PyObject* args) {
 		return nullptr;
 	}
 
-	cv::Mat input = *self->mat;
+	cv::Mat input = self->mat;
 	cv::Mat mask;
 	cv::inRange(input, cv::Scalar(l0, l1, l2), cv::Scalar(u0, u1, u2), mask);
 
-	self->mat->release();
-	*self->mat = mask;
+	self->mat.release();
+	self->mat = std::move(mask);
 	self->color_space = COLOR_SPACE_GRAY;
 
 	Py_RETURN_NONE;
@@ -2092,72 +2508,2209 @@ static PyObject* CHIVELImage_mask(CHIVELImageObject* self, PyObject* args) {
 	}
 	CHIVELImageObject* mask_img = (CHIVELImageObject*)mask_obj;
 
-	if (!self->mat || self->mat->empty() || !mask_img->mat || mask_img->mat->empty()) {
+	if (self->mat.empty() || mask_img->mat.empty()) {
 		PyErr_SetString(PyExc_ValueError, "Image or mask data is empty");
 		return nullptr;
 	}
-	if (mask_img->mat->type() != CV_8UC1) {
+	if (mask_img->mat.type() != CV_8UC1) {
 		PyErr_SetString(PyExc_TypeError, "Mask must be a single-channel 8-bit image");
 		return nullptr;
 	}
-	if (self->mat->rows != mask_img->mat->rows || self->mat->cols != mask_img->mat->cols) {
+	if (self->mat.rows != mask_img->mat.rows || self->mat.cols != mask_img->mat.cols) {
 		PyErr_SetString(PyExc_ValueError, "Mask size must match image size");
 		return nullptr;
 	}
 
 	cv::Mat result;
-	cv::bitwise_and(*self->mat, *self->mat, result, *mask_img->mat);
+	cv::bitwise_and(self->mat, self->mat, result, mask_img->mat);
 
 	CHIVELImageObject* out_img = (CHIVELImageObject*)self;
-	delete out_img->mat;
-	out_img->mat = new cv::Mat(result);
+	out_img->mat = std::move(result);
 	out_img->color_space = self->color_space;
 	Py_RETURN_NONE;
 }
 
-#pragma endregion
+// Turns the quality and compression arguments of encode and save into imwrite parameters for the file extension.
+// -1 means the encoder's default. Returns false with an exception set when one does not apply or is out of range.
+static bool get_encoder_params(std::string extension, int quality, int compression, std::vector<int>& params) {
+	for (char& c : extension)
+		c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+	bool jpeg = extension == ".jpg" || extension == ".jpeg";
+	bool webp = extension == ".webp";
+	bool png = extension == ".png";
+
+	if (quality != -1) {
+		if (!jpeg && !webp) {
+			PyErr_SetString(PyExc_ValueError, "quality only applies to JPEG and WebP");
+			return false;
+		}
+		if (quality < 1 || quality > 100) {
+			PyErr_SetString(PyExc_ValueError, "quality must be between 1 and 100");
+			return false;
+		}
+		params.push_back(jpeg ? cv::IMWRITE_JPEG_QUALITY : cv::IMWRITE_WEBP_QUALITY);
+		params.push_back(quality);
+	}
+	if (compression != -1) {
+		if (!png) {
+			PyErr_SetString(PyExc_ValueError, "compression only applies to PNG");
+			return false;
+		}
+		if (compression < 0 || compression > 9) {
+			PyErr_SetString(PyExc_ValueError, "compression must be between 0 and 9");
+			return false;
+		}
+		params.push_back(cv::IMWRITE_PNG_COMPRESSION);
+		params.push_back(compression);
+	}
+	return true;
+}
 
-static PyObject* chivel_load(PyObject* self, PyObject* args) {
-	const char* path;
-	int color_space = COLOR_SPACE_BGR; // Default to BGR
-	if (!PyArg_ParseTuple(args, "s|i", &path, &color_space))
+static PyObject* CHIVELImage_encode(CHIVELImageObject* self, PyObject* args, PyObject* kwargs) {
+	const char* format = "png";
+	int quality = -1;
+	int compression = -1;
+	static const char* kwlist[] = { "fmt", "quality", "compression", nullptr };
+	if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|s$ii", (char**)kwlist, &format, &quality, &compression))
 		return nullptr;
 
-	// Load image using OpenCV
-	cv::Mat img = chivel::readImage(path, static_cast<ColorSpace>(color_space));
-	if (img.empty()) {
-		PyErr_SetString(PyExc_IOError, "Failed to load image from path");
+	if (self->mat.empty()) {
+		PyErr_SetString(PyExc_ValueError, "Image data is empty");
 		return nullptr;
 	}
 
-	// Convert to the correct color space
-	ColorSpace current;
-	switch (color_space)
-	{
-	case COLOR_SPACE_BGRA:
-	case COLOR_SPACE_RGBA:
-		current = COLOR_SPACE_BGRA;
-		break;
-	case COLOR_SPACE_GRAY:
-		current = COLOR_SPACE_GRAY;
-		break;
-	default:
-		current = COLOR_SPACE_BGR;
-		break;
-	}
-	img = chivel::convertColorSpace(img, current, static_cast<ColorSpace>(color_space));
+	// Formats are given as an extension, with or without the dot
+	std::string extension = format[0] == '.' ? format : std::string(".") + format;
+	std::vector<int> params;
+	if (!get_encoder_params(extension, quality, compression, params))
+		return nullptr;
 
-	// Create a new chivel.Image object
-	PyObject* image_obj = CHIVELImage_new(&CHIVELImageType, nullptr, nullptr);
-	if (!image_obj)
+	cv::Mat mat = self->mat;
+	std::vector<uchar> bytes;
+	bool encoded = false;
+	std::string error;
+	Py_BEGIN_ALLOW_THREADS
+	try {
+		encoded = cv::imencode(extension, mat, bytes, params);
+	}
+	catch (cv::Exception const& e) {
+		error = e.what();
+	}
+	Py_END_ALLOW_THREADS
+	if (!encoded) {
+		PyErr_SetString(PyExc_ValueError, error.empty() ? "Failed to encode image" : error.c_str());
 		return nullptr;
+	}
+	return PyBytes_FromStringAndSize(reinterpret_cast<char const*>(bytes.data()), static_cast<Py_ssize_t>(bytes.size()));
+}
 
-	CHIVELImageObject* image = (CHIVELImageObject*)image_obj;
-	delete image->mat; // Delete the default empty mat
-	image->mat = new cv::Mat(img); // Assign loaded image
-	image->color_space = static_cast<ColorSpace>(color_space);
+// Reads the exclude argument of the hash functions: None, a Rect, or a sequence of Rects
+static bool parse_hash_exclude(PyObject* exclude_obj, std::vector<cv::Rect>& exclude) {
+	if (!exclude_obj || exclude_obj == Py_None)
+		return true;
 
-	return image_obj;
+	auto add = [&](PyObject* rect_obj) {
+		if (!PyObject_TypeCheck(rect_obj, &CHIVELRectType)) {
+			PyErr_SetString(PyExc_TypeError, "exclude must be a chivel.Rect or a sequence of chivel.Rect objects");
+			return false;
+		}
+		CHIVELRectObject* r = (CHIVELRectObject*)rect_obj;
+		exclude.emplace_back(r->x, r->y, r->width, r->height);
+		return true;
+	};
+	if (PyObject_TypeCheck(exclude_obj, &CHIVELRectType))
+		return add(exclude_obj);
+
+	PyObject* seq = PySequence_Fast(exclude_obj, "exclude must be a chivel.Rect or a sequence of chivel.Rect objects");
+	if (!seq)
+		return false;
+	Py_ssize_t count = PySequence_Fast_GET_SIZE(seq);
+	PyObject** items = PySequence_Fast_ITEMS(seq);
+	for (Py_ssize_t i = 0; i < count; i++) {
+		if (!add(items[i])) {
+			Py_DECREF(seq);
+			return false;
+		}
+	}
+	Py_DECREF(seq);
+	return true;
+}
+
+// Hashes an image without the GIL. Returns false with an exception set on failure.
+static bool hash_image(CHIVELImageObject* image, chivel::HashType type, std::vector<cv::Rect> const& exclude, uint64_t& hash) {
+	cv::Mat mat = image->mat;
+	if (mat.empty()) {
+		PyErr_SetString(PyExc_ValueError, "Image data is empty");
+		return false;
+	}
+	if (mat.depth() != CV_8U || (mat.channels() != 1 && mat.channels() != 3 && mat.channels() != 4)) {
+		PyErr_SetString(PyExc_ValueError, "Hashes are of 8-bit images with 1, 3, or 4 channels");
+		return false;
+	}
+	if (image->color_space == COLOR_SPACE_HSV) {
+		PyErr_SetString(PyExc_ValueError, "HSV images cannot be hashed, convert them first");
+		return false;
+	}
+
+	bool rgb = image->color_space == COLOR_SPACE_RGB || image->color_space == COLOR_SPACE_RGBA;
+	Py_BEGIN_ALLOW_THREADS
+	hash = chivel::imageHash(mat, type, exclude, rgb);
+	Py_END_ALLOW_THREADS
+	return true;
+}
+
+static PyObject* image_hash(CHIVELImageObject* self, PyObject* args, PyObject* kwargs, chivel::HashType type) {
+	PyObject* exclude_obj = Py_None;
+	static const char* kwlist[] = { "exclude", nullptr };
+	if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|O", (char**)kwlist, &exclude_obj))
+		return nullptr;
+
+	std::vector<cv::Rect> exclude;
+	if (!parse_hash_exclude(exclude_obj, exclude))
+		return nullptr;
+	uint64_t hash = 0;
+	if (!hash_image(self, type, exclude, hash))
+		return nullptr;
+	return PyLong_FromUnsignedLongLong(hash);
+}
+
+static PyObject* CHIVELImage_phash(CHIVELImageObject* self, PyObject* args, PyObject* kwargs) {
+	return image_hash(self, args, kwargs, chivel::HashType::Perceptual);
+}
+
+static PyObject* CHIVELImage_dhash(CHIVELImageObject* self, PyObject* args, PyObject* kwargs) {
+	return image_hash(self, args, kwargs, chivel::HashType::Difference);
+}
+
+static PyObject* CHIVELImage_ahash(CHIVELImageObject* self, PyObject* args, PyObject* kwargs) {
+	return image_hash(self, args, kwargs, chivel::HashType::Average);
+}
+
+// A tuple with the first count values of a Scalar, as ints or floats
+static PyObject* scalar_tuple(cv::Scalar const& value, int count, bool integers) {
+	PyObject* tuple = PyTuple_New(count);
+	if (!tuple)
+		return nullptr;
+	for (int c = 0; c < count; c++) {
+		PyObject* item = integers ? PyLong_FromLong(static_cast<long>(value[c])) : PyFloat_FromDouble(value[c]);
+		if (!item) {
+			Py_DECREF(tuple);
+			return nullptr;
+		}
+		PyTuple_SET_ITEM(tuple, c, item);
+	}
+	return tuple;
+}
+
+// The Color of a pixel value in the given color space
+static PyObject* create_color_from(cv::Scalar const& value, int channels, ColorSpace color_space) {
+	cv::Mat pixel(1, 1, CV_8UC(channels), value);
+	cv::Mat bgr;
+	if (color_space == COLOR_SPACE_HSV)
+		cv::cvtColor(pixel, bgr, cv::COLOR_HSV2BGR);
+	else
+		bgr = chivel::convertColorSpace(pixel, color_space, COLOR_SPACE_BGR);
+	uchar const* p = bgr.ptr<uchar>(0);
+	return create_color(p[2], p[1], p[0]);
+}
+
+static PyObject* CHIVELImage_stats(CHIVELImageObject* self, PyObject* args, PyObject* kwargs) {
+	PyObject* region_obj = Py_None;
+	PyObject* mask_obj = Py_None;
+	int dominant_count = 5;
+	static const char* kwlist[] = { "region", "mask", "dominant", nullptr };
+	if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|OO$i", (char**)kwlist, &region_obj, &mask_obj, &dominant_count))
+		return nullptr;
+
+	cv::Mat mat = self->mat;
+	if (mat.empty()) {
+		PyErr_SetString(PyExc_ValueError, "Image data is empty");
+		return nullptr;
+	}
+	if (mat.depth() != CV_8U || (mat.channels() != 1 && mat.channels() != 3 && mat.channels() != 4)) {
+		PyErr_SetString(PyExc_ValueError, "Statistics are of 8-bit images with 1, 3, or 4 channels");
+		return nullptr;
+	}
+	if (dominant_count < 0) {
+		PyErr_SetString(PyExc_ValueError, "dominant must not be negative");
+		return nullptr;
+	}
+
+	cv::Rect region(0, 0, mat.cols, mat.rows);
+	if (region_obj != Py_None) {
+		if (!PyObject_TypeCheck(region_obj, &CHIVELRectType)) {
+			PyErr_SetString(PyExc_TypeError, "region must be a chivel.Rect object");
+			return nullptr;
+		}
+		CHIVELRectObject* r = (CHIVELRectObject*)region_obj;
+		region = cv::Rect(r->x, r->y, r->width, r->height);
+		if (region.width <= 0 || region.height <= 0 || (region & cv::Rect(0, 0, mat.cols, mat.rows)) != region) {
+			PyErr_SetString(PyExc_ValueError, "region is out of image bounds");
+			return nullptr;
+		}
+	}
+
+	// The mask can be the size of the image, and is then cut to the region, or the size of the region
+	cv::Mat mask;
+	if (mask_obj != Py_None) {
+		if (!PyObject_TypeCheck(mask_obj, &CHIVELImageType)) {
+			PyErr_SetString(PyExc_TypeError, "mask must be a chivel.Image object");
+			return nullptr;
+		}
+		mask = ((CHIVELImageObject*)mask_obj)->mat;
+		if (mask.type() != CV_8UC1) {
+			PyErr_SetString(PyExc_TypeError, "Mask must be a single-channel 8-bit image");
+			return nullptr;
+		}
+		if (mask.size() == mat.size())
+			mask = mask(region);
+		else if (mask.size() != region.size()) {
+			PyErr_SetString(PyExc_ValueError, "Mask size must match the image or region size");
+			return nullptr;
+		}
+	}
+
+	// A view of the region, nothing is copied
+	cv::Mat area = mat(region);
+	chivel::ImageStats stats;
+	Py_BEGIN_ALLOW_THREADS
+	stats = chivel::imageStats(area, mask, dominant_count);
+	Py_END_ALLOW_THREADS
+
+	int channels = stats.channels;
+	PyObject* histogram = PyList_New(channels);
+	if (!histogram)
+		return nullptr;
+	for (int c = 0; c < channels; c++) {
+		PyObject* counts = PyList_New(256);
+		if (!counts) {
+			Py_DECREF(histogram);
+			return nullptr;
+		}
+		// Owned by the histogram from here, so dropping it frees every count made so far
+		PyList_SET_ITEM(histogram, c, counts);
+		for (int v = 0; v < 256; v++) {
+			PyObject* count = PyLong_FromUnsignedLongLong(stats.histogram[c][v]);
+			if (!count) {
+				Py_DECREF(histogram);
+				return nullptr;
+			}
+			PyList_SET_ITEM(counts, v, count);
+		}
+	}
+
+	// Images of unknown color space are taken to be in OpenCV's usual order
+	ColorSpace color_space = self->color_space;
+	if (color_space == COLOR_SPACE_UNKNOWN)
+		color_space = channels == 1 ? COLOR_SPACE_GRAY : channels == 4 ? COLOR_SPACE_BGRA : COLOR_SPACE_BGR;
+	PyObject* dominant = PyList_New(0);
+	if (!dominant) {
+		Py_DECREF(histogram);
+		return nullptr;
+	}
+	for (chivel::ImageStats::Dominant const& d : stats.dominant) {
+		cv::Scalar value = d.color;
+		for (int c = 0; c < 4; c++)
+			value[c] = cvRound(value[c]);
+		if (channels == 4)
+			value[3] = 255;
+		PyObject* color_obj = create_color_from(value, channels, color_space);
+		PyObject* item = color_obj ? Py_BuildValue("(Od)", color_obj, d.fraction) : nullptr;
+		Py_XDECREF(color_obj);
+		if (!item || PyList_Append(dominant, item) < 0) {
+			Py_XDECREF(item);
+			Py_DECREF(dominant);
+			Py_DECREF(histogram);
+			return nullptr;
+		}
+		Py_DECREF(item);
+	}
+
+	PyObject* mean = scalar_tuple(stats.mean, channels, false);
+	PyObject* stddev = scalar_tuple(stats.stddev, channels, false);
+	PyObject* min = scalar_tuple(stats.min, channels, true);
+	PyObject* max = scalar_tuple(stats.max, channels, true);
+	PyObject* result = nullptr;
+	if (mean && stddev && min && max) {
+		result = Py_BuildValue("{s:K,s:O,s:O,s:O,s:O,s:O,s:O}",
+			"count", static_cast<unsigned long long>(stats.count),
+			"mean", mean,
+			"stddev", stddev,
+			"min", min,
+			"max", max,
+			"histogram", histogram,
+			"dominant", dominant);
+	}
+	Py_XDECREF(mean);
+	Py_XDECREF(stddev);
+	Py_XDECREF(min);
+	Py_XDECREF(max);
+	Py_DECREF(histogram);
+	Py_DECREF(dominant);
+	return result;
+}
+
+#pragma endregion
+
+#pragma region Capturer
+
+// Checks the color_space and scale arguments of the capture functions.
+static bool check_capture_format(int color_space, double scale) {
+	if (color_space <= COLOR_SPACE_UNKNOWN || color_space > COLOR_SPACE_HSV) {
+		PyErr_SetString(PyExc_ValueError, "Invalid color space");
+		return false;
+	}
+	if (!(scale > 0.0)) {
+		PyErr_SetString(PyExc_ValueError, "scale must be positive");
+		return false;
+	}
+	return true;
+}
+
+// Reads the optional rect argument of the capture types. Leaves rect empty for None.
+static bool parse_capture_rect(PyObject* rect_obj, cv::Rect& rect) {
+	if (!rect_obj || rect_obj == Py_None)
+		return true;
+
+	if (!PyObject_TypeCheck(rect_obj, &CHIVELRectType)) {
+		PyErr_SetString(PyExc_TypeError, "rect must be a chivel.Rect object");
+		return false;
+	}
+	CHIVELRectObject* r = (CHIVELRectObject*)rect_obj;
+	if (r->width <= 0 || r->height <= 0) {
+		PyErr_SetString(PyExc_ValueError, "Width and height must be positive");
+		return false;
+	}
+	rect = cv::Rect(r->x, r->y, r->width, r->height);
+	return true;
+}
+
+typedef struct {
+	PyObject_HEAD
+		chivel::CaptureSession* session;
+	int display_index;
+	int x, y, width, height; // Relative to the display
+} CHIVELCapturerObject;
+
+static void CHIVELCapturer_dealloc(CHIVELCapturerObject* self) {
+	delete self->session;
+	Py_TYPE(self)->tp_free((PyObject*)self);
+}
+
+static PyObject* CHIVELCapturer_new(PyTypeObject* type, PyObject* args, PyObject* kwds) {
+	CHIVELCapturerObject* self = (CHIVELCapturerObject*)type->tp_alloc(type, 0);
+	if (self) {
+		self->session = nullptr;
+		self->display_index = 0;
+		self->x = self->y = self->width = self->height = 0;
+	}
+	return (PyObject*)self;
+}
+
+static int CHIVELCapturer_init(CHIVELCapturerObject* self, PyObject* args, PyObject* kwds) {
+	int display_index = 0;
+	PyObject* rect_obj = nullptr;
+	static const char* kwlist[] = { "display_index", "rect", nullptr };
+	if (!PyArg_ParseTupleAndKeywords(args, kwds, "|iO", (char**)kwlist, &display_index, &rect_obj))
+		return -1;
+
+	// Images from grab() can point into the session's buffer, so it is never replaced
+	if (self->session) {
+		PyErr_SetString(PyExc_RuntimeError, "Capturer is already initialized");
+		return -1;
+	}
+
+	cv::Rect rect;
+	if (!parse_capture_rect(rect_obj, rect))
+		return -1;
+
+	std::unique_ptr<chivel::CaptureSession> session = chivel::getBackend()->openCapture(display_index, rect);
+	if (!session) {
+		PyErr_SetString(PyExc_RuntimeError, "Failed to open a capture of the display");
+		return -1;
+	}
+
+	self->session = session.release();
+	self->display_index = display_index;
+	self->x = rect.x;
+	self->y = rect.y;
+	self->width = self->session->getFrame().cols;
+	self->height = self->session->getFrame().rows;
+	return 0;
+}
+
+static PyObject* CHIVELCapturer_grab(CHIVELCapturerObject* self, PyObject* args, PyObject* kwargs) {
+	int copy = 0;
+	int color_space = COLOR_SPACE_DEFAULT;
+	double scale = 1.0;
+	static const char* kwlist[] = { "copy", "color_space", "scale", nullptr };
+	if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|pid", (char**)kwlist, &copy, &color_space, &scale))
+		return nullptr;
+
+	if (!check_capture_format(color_space, scale))
+		return nullptr;
+
+	if (!self->session) {
+		PyErr_SetString(PyExc_RuntimeError, "Capturer is not initialized");
+		return nullptr;
+	}
+
+	if (!self->session->grab()) {
+		PyErr_SetString(PyExc_RuntimeError, "Failed to capture screen");
+		return nullptr;
+	}
+
+	cv::Mat const& frame = self->session->getFrame();
+	if (color_space != COLOR_SPACE_DEFAULT || scale != 1.0) {
+		// Converted straight out of the reused buffer into a new image, which is never shared
+		return create_image(chivel::convertCapture(frame, static_cast<ColorSpace>(color_space), scale), static_cast<ColorSpace>(color_space));
+	}
+	if (copy)
+		return create_image(frame.clone(), COLOR_SPACE_DEFAULT);
+
+	// No copy, the image shares the session's buffer and sees every later grab
+	return create_image(frame, COLOR_SPACE_DEFAULT, (PyObject*)self);
+}
+
+static PyObject* CHIVELCapturer_grab_damage(CHIVELCapturerObject* self, PyObject* /*unused*/) {
+	if (!self->session) {
+		PyErr_SetString(PyExc_RuntimeError, "Capturer is not initialized");
+		return nullptr;
+	}
+
+	std::vector<cv::Rect> dirty;
+	if (!self->session->grabDamage(dirty)) {
+		PyErr_SetString(PyExc_RuntimeError, "Failed to capture screen");
+		return nullptr;
+	}
+
+	PyObject* image = create_image(self->session->getFrame(), COLOR_SPACE_DEFAULT, (PyObject*)self);
+	if (!image)
+		return nullptr;
+	PyObject* rects = create_rect_list(dirty);
+	if (!rects) {
+		Py_DECREF(image);
+		return nullptr;
+	}
+	return Py_BuildValue("(NN)", image, rects);
+}
+
+static PyObject* CHIVELCapturer_get_rect(CHIVELCapturerObject* self, PyObject* /*unused*/) {
+	return create_rect(self->x, self->y, self->width, self->height);
+}
+
+static PyMethodDef CHIVELCapturer_methods[] = {
+	{"grab", (PyCFunction)CHIVELCapturer_grab, METH_VARARGS | METH_KEYWORDS, "Capture into the reused buffer and return an Image that shares it, unless copy is True"},
+	{"grab_damage", (PyCFunction)CHIVELCapturer_grab_damage, METH_NOARGS, "Update only what changed since the last grab_damage, and return the shared Image with a list of the changed Rects"},
+	{"get_rect", (PyCFunction)CHIVELCapturer_get_rect, METH_NOARGS, "Get the captured rectangle, relative to the display"},
+	{nullptr, nullptr, 0, nullptr}
+};
+
+static PyMemberDef CHIVELCapturer_members[] = {
+	{"display_index", T_INT, offsetof(CHIVELCapturerObject, display_index), READONLY, "display index"},
+	{nullptr}
+};
+
+static PyTypeObject CHIVELCapturerType = {
+	PyVarObject_HEAD_INIT(NULL, 0)
+	"chivel.Capturer",
+	sizeof(CHIVELCapturerObject),
+	0,
+	(destructor)CHIVELCapturer_dealloc,
+	0,
+	0,
+	0,
+	0,
+	0,
+	0,
+	0,
+	0,
+	0,
+	0,
+	0,
+	0,
+	0,
+	0,
+	Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE,
+	"Chivel Capturer objects",
+	0,
+	0,
+	0,
+	0,
+	0,
+	0,
+	CHIVELCapturer_methods,
+	CHIVELCapturer_members,
+	0,
+	0,
+	0,
+	0,
+	0,
+	0,
+	(initproc)CHIVELCapturer_init,
+	0,
+	CHIVELCapturer_new,
+};
+
+#pragma endregion
+
+#pragma region CaptureStream
+
+typedef struct {
+	PyObject_HEAD
+		chivel::CaptureStream* stream;
+	uint64_t last; // Number of the last frame handed out, for next()
+} CHIVELCaptureStreamObject;
+
+static void CHIVELCaptureStream_dealloc(CHIVELCaptureStreamObject* self) {
+	if (self->stream) {
+		// The capture thread never takes the GIL, so it is safe to join while holding it
+		delete self->stream;
+	}
+	Py_TYPE(self)->tp_free((PyObject*)self);
+}
+
+static PyObject* CHIVELCaptureStream_new(PyTypeObject* type, PyObject* args, PyObject* kwds) {
+	CHIVELCaptureStreamObject* self = (CHIVELCaptureStreamObject*)type->tp_alloc(type, 0);
+	if (self) {
+		self->stream = nullptr;
+		self->last = 0;
+	}
+	return (PyObject*)self;
+}
+
+static int CHIVELCaptureStream_init(CHIVELCaptureStreamObject* self, PyObject* args, PyObject* kwds) {
+	int display_index = 0;
+	PyObject* rect_obj = nullptr;
+	double fps = 30.0;
+	int buffers = 3;
+	static const char* kwlist[] = { "display_index", "rect", "fps", "buffers", nullptr };
+	if (!PyArg_ParseTupleAndKeywords(args, kwds, "|iOdi", (char**)kwlist, &display_index, &rect_obj, &fps, &buffers))
+		return -1;
+
+	if (self->stream) {
+		PyErr_SetString(PyExc_RuntimeError, "CaptureStream is already initialized");
+		return -1;
+	}
+	if (fps <= 0.0) {
+		PyErr_SetString(PyExc_ValueError, "fps must be positive");
+		return -1;
+	}
+	if (buffers < 2) {
+		PyErr_SetString(PyExc_ValueError, "buffers must be at least 2");
+		return -1;
+	}
+
+	cv::Rect rect;
+	if (!parse_capture_rect(rect_obj, rect))
+		return -1;
+
+	std::unique_ptr<chivel::CaptureSession> session = chivel::getBackend()->openCapture(display_index, rect);
+	if (!session) {
+		PyErr_SetString(PyExc_RuntimeError, "Failed to open a capture of the display");
+		return -1;
+	}
+
+	self->stream = new chivel::CaptureStream(std::move(session), fps, buffers);
+	return 0;
+}
+
+// Returns (image, timestamp) for a frame taken from the stream.
+static PyObject* create_stream_frame(CHIVELCaptureStreamObject* self, chivel::CaptureStream::Frame const& frame) {
+	self->last = std::max(self->last, frame.number);
+
+	// The image holds a reference to the ring buffer, which keeps the stream from writing to it
+	PyObject* image = create_image(frame.mat, COLOR_SPACE_DEFAULT);
+	if (!image)
+		return nullptr;
+	return Py_BuildValue("(Nd)", image, frame.time);
+}
+
+static PyObject* CHIVELCaptureStream_latest(CHIVELCaptureStreamObject* self, PyObject* /*unused*/) {
+	if (!self->stream) {
+		PyErr_SetString(PyExc_RuntimeError, "CaptureStream is not initialized");
+		return nullptr;
+	}
+
+	chivel::CaptureStream::Frame frame;
+	if (!self->stream->latest(frame))
+		Py_RETURN_NONE;
+	return create_stream_frame(self, frame);
+}
+
+static PyObject* CHIVELCaptureStream_next(CHIVELCaptureStreamObject* self, PyObject* args, PyObject* kwargs) {
+	PyObject* timeout_obj = Py_None;
+	static const char* kwlist[] = { "timeout", nullptr };
+	if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|O", (char**)kwlist, &timeout_obj))
+		return nullptr;
+
+	if (!self->stream) {
+		PyErr_SetString(PyExc_RuntimeError, "CaptureStream is not initialized");
+		return nullptr;
+	}
+
+	double timeout = -1.0; // forever
+	if (timeout_obj != Py_None) {
+		timeout = PyFloat_AsDouble(timeout_obj);
+		if (timeout == -1.0 && PyErr_Occurred())
+			return nullptr;
+		if (timeout < 0.0)
+			timeout = 0.0;
+	}
+
+	// Wait in short slices, so Ctrl+C still works
+	auto deadline = std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(std::max(timeout, 0.0)));
+	chivel::CaptureStream::Frame frame;
+	uint64_t after = self->last;
+	chivel::CaptureStream* stream = self->stream;
+	for (;;) {
+		double slice = 0.1;
+		if (timeout >= 0.0)
+			slice = std::min(slice, std::chrono::duration<double>(deadline - std::chrono::steady_clock::now()).count());
+
+		bool found;
+		Py_BEGIN_ALLOW_THREADS
+		found = stream->next(after, std::max(slice, 0.0), frame);
+		Py_END_ALLOW_THREADS
+		if (found)
+			return create_stream_frame(self, frame);
+
+		if (PyErr_CheckSignals() < 0)
+			return nullptr;
+		if (stream->isStopped() || (timeout >= 0.0 && std::chrono::steady_clock::now() >= deadline))
+			Py_RETURN_NONE;
+	}
+}
+
+static PyObject* CHIVELCaptureStream_get_dropped(CHIVELCaptureStreamObject* self, PyObject* /*unused*/) {
+	if (!self->stream)
+		return PyLong_FromLong(0);
+	return PyLong_FromUnsignedLongLong(self->stream->getDropped());
+}
+
+static PyObject* CHIVELCaptureStream_get_frame_count(CHIVELCaptureStreamObject* self, PyObject* /*unused*/) {
+	if (!self->stream)
+		return PyLong_FromLong(0);
+	return PyLong_FromUnsignedLongLong(self->stream->getFrameCount());
+}
+
+static PyObject* CHIVELCaptureStream_close(CHIVELCaptureStreamObject* self, PyObject* /*unused*/) {
+	if (self->stream) {
+		chivel::CaptureStream* stream = self->stream;
+		Py_BEGIN_ALLOW_THREADS
+		stream->stop();
+		Py_END_ALLOW_THREADS
+	}
+	Py_RETURN_NONE;
+}
+
+static PyMethodDef CHIVELCaptureStream_methods[] = {
+	{"latest", (PyCFunction)CHIVELCaptureStream_latest, METH_NOARGS, "Get the most recent (image, timestamp), or None if nothing has been captured yet"},
+	{"next", (PyCFunction)CHIVELCaptureStream_next, METH_VARARGS | METH_KEYWORDS, "Wait for a frame newer than the last one returned and get its (image, timestamp), or None on timeout"},
+	{"get_dropped", (PyCFunction)CHIVELCaptureStream_get_dropped, METH_NOARGS, "Get the number of frames that were captured but never returned"},
+	{"get_frame_count", (PyCFunction)CHIVELCaptureStream_get_frame_count, METH_NOARGS, "Get the number of frames captured so far"},
+	{"close", (PyCFunction)CHIVELCaptureStream_close, METH_NOARGS, "Stop capturing"},
+	{nullptr, nullptr, 0, nullptr}
+};
+
+static PyTypeObject CHIVELCaptureStreamType = {
+	PyVarObject_HEAD_INIT(NULL, 0)
+	"chivel.CaptureStream",
+	sizeof(CHIVELCaptureStreamObject),
+	0,
+	(destructor)CHIVELCaptureStream_dealloc,
+	0,
+	0,
+	0,
+	0,
+	0,
+	0,
+	0,
+	0,
+	0,
+	0,
+	0,
+	0,
+	0,
+	0,
+	Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE,
+	"Chivel CaptureStream objects",
+	0,
+	0,
+	0,
+	0,
+	0,
+	0,
+	CHIVELCaptureStream_methods,
+	0,
+	0,
+	0,
+	0,
+	0,
+	0,
+	0,
+	(initproc)CHIVELCaptureStream_init,
+	0,
+	CHIVELCaptureStream_new,
+};
+
+#pragma endregion
+
+#pragma region LookupTable
+
+typedef struct {
+	PyObject_HEAD
+		chivel::LookupTable* table;
+} CHIVELLookupTableObject;
+
+static void CHIVELLookupTable_dealloc(CHIVELLookupTableObject* self) {
+	delete self->table;
+	Py_TYPE(self)->tp_free((PyObject*)self);
+}
+
+static PyObject* CHIVELLookupTable_new(PyTypeObject* type, PyObject* args, PyObject* kwds) {
+	CHIVELLookupTableObject* self = (CHIVELLookupTableObject*)type->tp_alloc(type, 0);
+	if (self) {
+		self->table = new chivel::LookupTable();
+	}
+	return (PyObject*)self;
+}
+
+// None means every channel
+static bool parse_lut_channel(PyObject* channel_obj, int& channel) {
+	channel = -1;
+	if (!channel_obj || channel_obj == Py_None)
+		return true;
+	channel = (int)PyLong_AsLong(channel_obj);
+	if (channel == -1 && PyErr_Occurred())
+		return false;
+	if (channel < 0 || channel >= chivel::LookupTable::MAX_CHANNELS) {
+		PyErr_SetString(PyExc_ValueError, "channel must be between 0 and 3, or None for every channel");
+		return false;
+	}
+	return true;
+}
+
+static PyObject* CHIVELLookupTable_brightness(CHIVELLookupTableObject* self, PyObject* args, PyObject* kwargs) {
+	double value = 0.0;
+	PyObject* channel_obj = Py_None;
+	static const char* kwlist[] = { "value", "channel", nullptr };
+	if (!PyArg_ParseTupleAndKeywords(args, kwargs, "d|O", (char**)kwlist, &value, &channel_obj))
+		return nullptr;
+	int channel;
+	if (!parse_lut_channel(channel_obj, channel))
+		return nullptr;
+
+	self->table->brightness(value, channel);
+	Py_INCREF(self);
+	return (PyObject*)self;
+}
+
+static PyObject* CHIVELLookupTable_contrast(CHIVELLookupTableObject* self, PyObject* args, PyObject* kwargs) {
+	double factor = 1.0;
+	PyObject* channel_obj = Py_None;
+	static const char* kwlist[] = { "factor", "channel", nullptr };
+	if (!PyArg_ParseTupleAndKeywords(args, kwargs, "d|O", (char**)kwlist, &factor, &channel_obj))
+		return nullptr;
+	int channel;
+	if (!parse_lut_channel(channel_obj, channel))
+		return nullptr;
+
+	self->table->contrast(factor, channel);
+	Py_INCREF(self);
+	return (PyObject*)self;
+}
+
+static PyObject* CHIVELLookupTable_invert(CHIVELLookupTableObject* self, PyObject* args, PyObject* kwargs) {
+	PyObject* channel_obj = Py_None;
+	static const char* kwlist[] = { "channel", nullptr };
+	if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|O", (char**)kwlist, &channel_obj))
+		return nullptr;
+	int channel;
+	if (!parse_lut_channel(channel_obj, channel))
+		return nullptr;
+
+	self->table->invert(channel);
+	Py_INCREF(self);
+	return (PyObject*)self;
+}
+
+static PyObject* CHIVELLookupTable_threshold(CHIVELLookupTableObject* self, PyObject* args, PyObject* kwargs) {
+	double thresh = 128.0;
+	double maxval = 255.0;
+	PyObject* channel_obj = Py_None;
+	static const char* kwlist[] = { "thresh", "maxval", "channel", nullptr };
+	if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|ddO", (char**)kwlist, &thresh, &maxval, &channel_obj))
+		return nullptr;
+	int channel;
+	if (!parse_lut_channel(channel_obj, channel))
+		return nullptr;
+
+	self->table->threshold(thresh, maxval, channel);
+	Py_INCREF(self);
+	return (PyObject*)self;
+}
+
+static PyObject* CHIVELLookupTable_normalize(CHIVELLookupTableObject* self, PyObject* args, PyObject* kwargs) {
+	double in_min = 0.0;
+	double in_max = 255.0;
+	double alpha = 0.0;
+	double beta = 255.0;
+	PyObject* channel_obj = Py_None;
+	static const char* kwlist[] = { "in_min", "in_max", "alpha", "beta", "channel", nullptr };
+	if (!PyArg_ParseTupleAndKeywords(args, kwargs, "dd|ddO", (char**)kwlist, &in_min, &in_max, &alpha, &beta, &channel_obj))
+		return nullptr;
+	int channel;
+	if (!parse_lut_channel(channel_obj, channel))
+		return nullptr;
+
+	self->table->normalize(in_min, in_max, alpha, beta, channel);
+	Py_INCREF(self);
+	return (PyObject*)self;
+}
+
+static PyObject* CHIVELLookupTable_get_table(CHIVELLookupTableObject* self, PyObject* args) {
+	int channel = 0;
+	if (!PyArg_ParseTuple(args, "|i", &channel))
+		return nullptr;
+	if (channel < 0 || channel >= chivel::LookupTable::MAX_CHANNELS) {
+		PyErr_SetString(PyExc_ValueError, "channel must be between 0 and 3");
+		return nullptr;
+	}
+
+	cv::Mat table = self->table->getTable(channel);
+	return PyBytes_FromStringAndSize(reinterpret_cast<char const*>(table.ptr()), 256);
+}
+
+static PyObject* CHIVELLookupTable_apply(CHIVELLookupTableObject* self, PyObject* args) {
+	PyObject* image_obj = nullptr;
+	if (!PyArg_ParseTuple(args, "O", &image_obj))
+		return nullptr;
+
+	if (!PyObject_TypeCheck(image_obj, &CHIVELImageType)) {
+		PyErr_SetString(PyExc_TypeError, "Argument must be a chivel.Image object");
+		return nullptr;
+	}
+	CHIVELImageObject* image = (CHIVELImageObject*)image_obj;
+	if (image->mat.empty()) {
+		PyErr_SetString(PyExc_ValueError, "Image data is empty");
+		return nullptr;
+	}
+	if (image->mat.depth() != CV_8U || image->mat.channels() > chivel::LookupTable::MAX_CHANNELS) {
+		PyErr_SetString(PyExc_ValueError, "Lookup tables apply to 8-bit images with up to 4 channels");
+		return nullptr;
+	}
+
+	// One pass, in place
+	prepare_write(image);
+	cv::Mat mat = image->mat;
+	chivel::LookupTable table = *self->table; // can be changed by another thread once the GIL is released
+	Py_BEGIN_ALLOW_THREADS
+	table.apply(mat, mat);
+	Py_END_ALLOW_THREADS
+
+	Py_RETURN_NONE;
+}
+
+static PyMethodDef CHIVELLookupTable_methods[] = {
+	{"brightness", (PyCFunction)CHIVELLookupTable_brightness, METH_VARARGS | METH_KEYWORDS, "Add a brightness adjustment by a given value"},
+	{"contrast", (PyCFunction)CHIVELLookupTable_contrast, METH_VARARGS | METH_KEYWORDS, "Add a contrast adjustment by a given factor"},
+	{"invert", (PyCFunction)CHIVELLookupTable_invert, METH_VARARGS | METH_KEYWORDS, "Add an inversion"},
+	{"threshold", (PyCFunction)CHIVELLookupTable_threshold, METH_VARARGS | METH_KEYWORDS, "Add binary thresholding of each channel"},
+	{"normalize", (PyCFunction)CHIVELLookupTable_normalize, METH_VARARGS | METH_KEYWORDS, "Add a mapping of [in_min, in_max] to [min(alpha, beta), max(alpha, beta)], like Image.normalize"},
+	{"get_table", (PyCFunction)CHIVELLookupTable_get_table, METH_VARARGS, "Get the 256 entry table of a channel as bytes"},
+	{"apply", (PyCFunction)CHIVELLookupTable_apply, METH_VARARGS, "Apply the tables to an image in place, in a single pass"},
+	{nullptr, nullptr, 0, nullptr}
+};
+
+static PyTypeObject CHIVELLookupTableType = {
+	PyVarObject_HEAD_INIT(NULL, 0)
+	"chivel.LookupTable",
+	sizeof(CHIVELLookupTableObject),
+	0,
+	(destructor)CHIVELLookupTable_dealloc,
+	0,
+	0,
+	0,
+	0,
+	0,
+	0,
+	0,
+	0,
+	0,
+	0,
+	0,
+	0,
+	0,
+	0,
+	Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE,
+	"Chivel LookupTable objects",
+	0,
+	0,
+	0,
+	0,
+	0,
+	0,
+	CHIVELLookupTable_methods,
+	0,
+	0,
+	0,
+	0,
+	0,
+	0,
+	0,
+	0,
+	0,
+	CHIVELLookupTable_new,
+};
+
+#pragma endregion
+
+#pragma region Pipeline
+
+typedef struct {
+	PyObject_HEAD
+		chivel::Pipeline* pipeline;
+} CHIVELPipelineObject;
+
+static void CHIVELPipeline_dealloc(CHIVELPipelineObject* self) {
+	delete self->pipeline;
+	Py_TYPE(self)->tp_free((PyObject*)self);
+}
+
+static PyObject* CHIVELPipeline_new(PyTypeObject* type, PyObject* args, PyObject* kwds) {
+	CHIVELPipelineObject* self = (CHIVELPipelineObject*)type->tp_alloc(type, 0);
+	if (self) {
+		self->pipeline = new chivel::Pipeline();
+	}
+	return (PyObject*)self;
+}
+
+// Records an operation and returns the pipeline, so calls can be chained
+static PyObject* add_pipeline_op(CHIVELPipelineObject* self, chivel::Pipeline::OpType type, double a = 0.0, double b = 0.0) {
+	self->pipeline->add({ type, a, b });
+	Py_INCREF(self);
+	return (PyObject*)self;
+}
+
+static PyObject* CHIVELPipeline_grayscale(CHIVELPipelineObject* self, PyObject* /*unused*/) {
+	return add_pipeline_op(self, chivel::Pipeline::OpType::Grayscale);
+}
+
+static PyObject* CHIVELPipeline_brightness(CHIVELPipelineObject* self, PyObject* args) {
+	double value = 0.0;
+	if (!PyArg_ParseTuple(args, "d", &value))
+		return nullptr;
+	return add_pipeline_op(self, chivel::Pipeline::OpType::Brightness, value);
+}
+
+static PyObject* CHIVELPipeline_contrast(CHIVELPipelineObject* self, PyObject* args) {
+	double factor = 1.0;
+	if (!PyArg_ParseTuple(args, "d", &factor))
+		return nullptr;
+	return add_pipeline_op(self, chivel::Pipeline::OpType::Contrast, factor);
+}
+
+static PyObject* CHIVELPipeline_invert(CHIVELPipelineObject* self, PyObject* /*unused*/) {
+	return add_pipeline_op(self, chivel::Pipeline::OpType::Invert);
+}
+
+static PyObject* CHIVELPipeline_threshold(CHIVELPipelineObject* self, PyObject* args) {
+	double thresh = 128.0;
+	double maxval = 255.0;
+	if (!PyArg_ParseTuple(args, "|dd", &thresh, &maxval))
+		return nullptr;
+	return add_pipeline_op(self, chivel::Pipeline::OpType::Threshold, thresh, maxval);
+}
+
+static PyObject* CHIVELPipeline_normalize(CHIVELPipelineObject* self, PyObject* args) {
+	double alpha = 0.0;
+	double beta = 255.0;
+	if (!PyArg_ParseTuple(args, "|dd", &alpha, &beta))
+		return nullptr;
+	return add_pipeline_op(self, chivel::Pipeline::OpType::Normalize, alpha, beta);
+}
+
+static PyObject* CHIVELPipeline_blur(CHIVELPipelineObject* self, PyObject* args) {
+	int ksize = 3;
+	if (!PyArg_ParseTuple(args, "|i", &ksize))
+		return nullptr;
+	if (ksize < 1) {
+		PyErr_SetString(PyExc_ValueError, "Blur amount must be a positive integer");
+		return nullptr;
+	}
+	return add_pipeline_op(self, chivel::Pipeline::OpType::Blur, ksize);
+}
+
+static PyObject* CHIVELPipeline_sharpen(CHIVELPipelineObject* self, PyObject* args) {
+	double strength = 1.0;
+	if (!PyArg_ParseTuple(args, "|d", &strength))
+		return nullptr;
+	return add_pipeline_op(self, chivel::Pipeline::OpType::Sharpen, strength);
+}
+
+static PyObject* CHIVELPipeline_edge(CHIVELPipelineObject* self, PyObject* args) {
+	double threshold1 = 100.0;
+	double threshold2 = 200.0;
+	if (!PyArg_ParseTuple(args, "|dd", &threshold1, &threshold2))
+		return nullptr;
+	return add_pipeline_op(self, chivel::Pipeline::OpType::Edge, threshold1, threshold2);
+}
+
+static PyObject* CHIVELPipeline_emboss(CHIVELPipelineObject* self, PyObject* /*unused*/) {
+	return add_pipeline_op(self, chivel::Pipeline::OpType::Emboss);
+}
+
+static PyObject* CHIVELPipeline_resize(CHIVELPipelineObject* self, PyObject* args) {
+	PyObject* point_obj = nullptr;
+	if (!PyArg_ParseTuple(args, "O", &point_obj))
+		return nullptr;
+	if (!PyObject_TypeCheck(point_obj, &CHIVELPointType)) {
+		PyErr_SetString(PyExc_TypeError, "Argument must be a chivel.Point object");
+		return nullptr;
+	}
+	CHIVELPointObject* point = (CHIVELPointObject*)point_obj;
+	if (point->x < 1 || point->y < 1) {
+		PyErr_SetString(PyExc_ValueError, "Width and height must be positive");
+		return nullptr;
+	}
+	return add_pipeline_op(self, chivel::Pipeline::OpType::Resize, point->x, point->y);
+}
+
+static PyObject* CHIVELPipeline_scale(CHIVELPipelineObject* self, PyObject* args) {
+	double scale_x = 1.0;
+	double scale_y = -1.0;
+	if (!PyArg_ParseTuple(args, "d|d", &scale_x, &scale_y))
+		return nullptr;
+	if (PyTuple_Size(args) == 1)
+		scale_y = scale_x;
+	if (scale_x <= 0.0 || scale_y <= 0.0) {
+		PyErr_SetString(PyExc_ValueError, "Scale factors must be positive");
+		return nullptr;
+	}
+	return add_pipeline_op(self, chivel::Pipeline::OpType::Scale, scale_x, scale_y);
+}
+
+static PyObject* CHIVELPipeline_clear(CHIVELPipelineObject* self, PyObject* /*unused*/) {
+	self->pipeline->clear();
+	Py_RETURN_NONE;
+}
+
+// Runs the pipeline on an image's pixels without the GIL. Returns false with an exception set on failure.
+static bool run_pipeline(CHIVELPipelineObject* self, PyObject* image_obj, cv::Mat& result) {
+	if (!PyObject_TypeCheck(image_obj, &CHIVELImageType)) {
+		PyErr_SetString(PyExc_TypeError, "Argument must be a chivel.Image object");
+		return false;
+	}
+	cv::Mat src = ((CHIVELImageObject*)image_obj)->mat;
+	if (src.empty()) {
+		PyErr_SetString(PyExc_ValueError, "Image data is empty");
+		return false;
+	}
+	if (src.depth() != CV_8U || (src.channels() != 1 && src.channels() != 3 && src.channels() != 4)) {
+		PyErr_SetString(PyExc_ValueError, "Pipelines run on 8-bit images with 1, 3, or 4 channels");
+		return false;
+	}
+
+	chivel::Pipeline* pipeline = self->pipeline;
+	std::string error;
+	Py_BEGIN_ALLOW_THREADS
+	try {
+		result = pipeline->run(src);
+	}
+	catch (cv::Exception const& e) {
+		error = e.what();
+	}
+	Py_END_ALLOW_THREADS
+	if (!error.empty()) {
+		PyErr_SetString(PyExc_RuntimeError, error.c_str());
+		return false;
+	}
+	return true;
+}
+
+static PyObject* CHIVELPipeline_run(CHIVELPipelineObject* self, PyObject* args) {
+	PyObject* image_obj = nullptr;
+	if (!PyArg_ParseTuple(args, "O", &image_obj))
+		return nullptr;
+
+	cv::Mat result;
+	if (!run_pipeline(self, image_obj, result))
+		return nullptr;
+
+	CHIVELImageObject* image = (CHIVELImageObject*)image_obj;
+	ColorSpace color_space = result.channels() == 1 ? COLOR_SPACE_GRAY : image->color_space;
+	// Resized pixels no longer line up with the display, the same as Image.resize and Image.scale
+	cv::Point origin = result.size() == image->mat.size() ? image->origin : cv::Point();
+	PyObject* result_obj = create_image(std::move(result), color_space);
+	if (result_obj)
+		((CHIVELImageObject*)result_obj)->origin = origin;
+	return result_obj;
+}
+
+static PyObject* CHIVELPipeline_apply(CHIVELPipelineObject* self, PyObject* args) {
+	PyObject* image_obj = nullptr;
+	if (!PyArg_ParseTuple(args, "O", &image_obj))
+		return nullptr;
+
+	cv::Mat result;
+	if (!run_pipeline(self, image_obj, result))
+		return nullptr;
+
+	// The same as calling the operations on the image, which replace its pixels
+	CHIVELImageObject* image = (CHIVELImageObject*)image_obj;
+	if (result.size() != image->mat.size())
+		image->origin = cv::Point(); // the pixels no longer line up with the display
+	image->mat = result;
+	if (result.channels() == 1)
+		image->color_space = COLOR_SPACE_GRAY;
+	Py_CLEAR(image->owner);
+
+	Py_RETURN_NONE;
+}
+
+static Py_ssize_t CHIVELPipeline_len(CHIVELPipelineObject* self) {
+	return static_cast<Py_ssize_t>(self->pipeline->size());
+}
+
+static PySequenceMethods CHIVELPipeline_as_sequence = {
+	(lenfunc)CHIVELPipeline_len, /* sq_length */
+};
+
+static PyMethodDef CHIVELPipeline_methods[] = {
+	{"grayscale", (PyCFunction)CHIVELPipeline_grayscale, METH_NOARGS, "Add a conversion to grayscale"},
+	{"brightness", (PyCFunction)CHIVELPipeline_brightness, METH_VARARGS, "Add a brightness adjustment by a given value"},
+	{"contrast", (PyCFunction)CHIVELPipeline_contrast, METH_VARARGS, "Add a contrast adjustment by a given factor"},
+	{"invert", (PyCFunction)CHIVELPipeline_invert, METH_NOARGS, "Add an inversion of the colors"},
+	{"threshold", (PyCFunction)CHIVELPipeline_threshold, METH_VARARGS, "Add binary thresholding"},
+	{"normalize", (PyCFunction)CHIVELPipeline_normalize, METH_VARARGS, "Add normalization of the pixel values"},
+	{"blur", (PyCFunction)CHIVELPipeline_blur, METH_VARARGS, "Add a Gaussian blur"},
+	{"sharpen", (PyCFunction)CHIVELPipeline_sharpen, METH_VARARGS, "Add sharpening by a given strength factor"},
+	{"edge", (PyCFunction)CHIVELPipeline_edge, METH_VARARGS, "Add Canny edge detection"},
+	{"emboss", (PyCFunction)CHIVELPipeline_emboss, METH_NOARGS, "Add an emboss effect"},
+	{"resize", (PyCFunction)CHIVELPipeline_resize, METH_VARARGS, "Add a resize to the given size (Point)"},
+	{"scale", (PyCFunction)CHIVELPipeline_scale, METH_VARARGS, "Add scaling by (x[, y]) factors"},
+	{"clear", (PyCFunction)CHIVELPipeline_clear, METH_NOARGS, "Remove all operations"},
+	{"run", (PyCFunction)CHIVELPipeline_run, METH_VARARGS, "Run the operations on an image and return the result as a new Image"},
+	{"apply", (PyCFunction)CHIVELPipeline_apply, METH_VARARGS, "Run the operations on an image in place"},
+	{nullptr, nullptr, 0, nullptr}
+};
+
+static PyTypeObject CHIVELPipelineType = {
+	PyVarObject_HEAD_INIT(NULL, 0)
+	"chivel.Pipeline",
+	sizeof(CHIVELPipelineObject),
+	0,
+	(destructor)CHIVELPipeline_dealloc,
+	0,
+	0,
+	0,
+	0,
+	0,
+	0,
+	&CHIVELPipeline_as_sequence,
+	0,
+	0,
+	0,
+	0,
+	0,
+	0,
+	0,
+	Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE,
+	"Chivel Pipeline objects",
+	0,
+	0,
+	0,
+	0,
+	0,
+	0,
+	CHIVELPipeline_methods,
+	0,
+	0,
+	0,
+	0,
+	0,
+	0,
+	0,
+	0,
+	0,
+	CHIVELPipeline_new,
+};
+
+#pragma endregion
+
+#pragma region Bundle
+
+typedef struct {
+	PyObject_HEAD
+		chivel::Bundle* bundle;
+} CHIVELBundleObject;
+
+static void CHIVELBundle_dealloc(CHIVELBundleObject* self) {
+	// Images from the bundle keep it alive, so nothing points into the mapping anymore
+	delete self->bundle;
+	Py_TYPE(self)->tp_free((PyObject*)self);
+}
+
+static const char* bundle_variant_names[] = { "original", "gray", "half", "quarter" };
+
+// Finds a template by name, or sets KeyError and returns nullptr
+static chivel::Bundle::Template const* find_bundle_template(CHIVELBundleObject* self, PyObject* name_obj) {
+	const char* name = PyUnicode_AsUTF8(name_obj);
+	if (!name)
+		return nullptr;
+	int index = self->bundle->find(name);
+	if (index < 0) {
+		PyErr_SetObject(PyExc_KeyError, name_obj);
+		return nullptr;
+	}
+	return &self->bundle->getTemplates()[index];
+}
+
+// An Image of one variant of a template, sharing the bundle's pixels until it is written to and keeping the bundle alive
+static PyObject* create_bundle_image(CHIVELBundleObject* self, chivel::Bundle::Template const& t, int variant) {
+	ColorSpace color_space = variant == chivel::Bundle::ORIGINAL ? static_cast<ColorSpace>(t.colorSpace) : COLOR_SPACE_GRAY;
+	return create_image(t.variants[variant], color_space, (PyObject*)self);
+}
+
+static PyObject* CHIVELBundle_names(CHIVELBundleObject* self, PyObject* /*unused*/) {
+	std::vector<chivel::Bundle::Template> const& templates = self->bundle->getTemplates();
+	PyObject* list = PyList_New(static_cast<Py_ssize_t>(templates.size()));
+	if (!list)
+		return nullptr;
+	for (size_t i = 0; i < templates.size(); ++i) {
+		PyObject* name = PyUnicode_FromStringAndSize(templates[i].name.data(), static_cast<Py_ssize_t>(templates[i].name.size()));
+		if (!name) {
+			Py_DECREF(list);
+			return nullptr;
+		}
+		PyList_SET_ITEM(list, i, name); // Steals reference
+	}
+	return list;
+}
+
+static PyObject* CHIVELBundle_get(CHIVELBundleObject* self, PyObject* args, PyObject* kwargs) {
+	PyObject* name_obj = nullptr;
+	const char* variant_name = "original";
+	static const char* kwlist[] = { "name", "variant", nullptr };
+	if (!PyArg_ParseTupleAndKeywords(args, kwargs, "U|s", (char**)kwlist, &name_obj, &variant_name))
+		return nullptr;
+
+	int variant = -1;
+	for (int i = 0; i < chivel::Bundle::VARIANT_COUNT; i++) {
+		if (std::strcmp(variant_name, bundle_variant_names[i]) == 0)
+			variant = i;
+	}
+	if (variant < 0) {
+		PyErr_SetString(PyExc_ValueError, "variant must be one of 'original', 'gray', 'half' or 'quarter'");
+		return nullptr;
+	}
+
+	chivel::Bundle::Template const* t = find_bundle_template(self, name_obj);
+	if (!t)
+		return nullptr;
+	if (t->variants[variant].empty()) {
+		PyErr_SetString(PyExc_ValueError, "The template is too small to have that variant");
+		return nullptr;
+	}
+	return create_bundle_image(self, *t, variant);
+}
+
+static PyObject* CHIVELBundle_info(CHIVELBundleObject* self, PyObject* args) {
+	PyObject* name_obj = nullptr;
+	if (!PyArg_ParseTuple(args, "U", &name_obj))
+		return nullptr;
+
+	chivel::Bundle::Template const* t = find_bundle_template(self, name_obj);
+	if (!t)
+		return nullptr;
+	cv::Mat const& original = t->variants[chivel::Bundle::ORIGINAL];
+	int channels = original.channels();
+	PyObject* mean = PyTuple_New(channels);
+	PyObject* stddev = PyTuple_New(channels);
+	if (!mean || !stddev) {
+		Py_XDECREF(mean);
+		Py_XDECREF(stddev);
+		return nullptr;
+	}
+	for (int c = 0; c < channels; c++) {
+		PyTuple_SET_ITEM(mean, c, PyFloat_FromDouble(t->mean[c]));
+		PyTuple_SET_ITEM(stddev, c, PyFloat_FromDouble(t->stddev[c]));
+	}
+
+	PyObject* variants = PyList_New(0);
+	if (!variants) {
+		Py_DECREF(mean);
+		Py_DECREF(stddev);
+		return nullptr;
+	}
+	for (int i = 0; i < chivel::Bundle::VARIANT_COUNT; i++) {
+		if (t->variants[i].empty())
+			continue;
+		PyObject* variant = PyUnicode_FromString(bundle_variant_names[i]);
+		if (!variant || PyList_Append(variants, variant) < 0) {
+			Py_XDECREF(variant);
+			Py_DECREF(variants);
+			Py_DECREF(mean);
+			Py_DECREF(stddev);
+			return nullptr;
+		}
+		Py_DECREF(variant);
+	}
+
+	return Py_BuildValue("{s:i,s:i,s:i,s:N,s:N,s:N}",
+		"width", original.cols,
+		"height", original.rows,
+		"color_space", t->colorSpace,
+		"mean", mean,
+		"stddev", stddev,
+		"variants", variants);
+}
+
+static Py_ssize_t CHIVELBundle_len(CHIVELBundleObject* self) {
+	return static_cast<Py_ssize_t>(self->bundle->getTemplates().size());
+}
+
+static PyObject* CHIVELBundle_getitem(CHIVELBundleObject* self, PyObject* key) {
+	if (!PyUnicode_Check(key)) {
+		PyErr_SetString(PyExc_TypeError, "Bundle keys are template names");
+		return nullptr;
+	}
+	chivel::Bundle::Template const* t = find_bundle_template(self, key);
+	if (!t)
+		return nullptr;
+	return create_bundle_image(self, *t, chivel::Bundle::ORIGINAL);
+}
+
+static int CHIVELBundle_contains(CHIVELBundleObject* self, PyObject* key) {
+	if (!PyUnicode_Check(key))
+		return 0;
+	const char* name = PyUnicode_AsUTF8(key);
+	if (!name)
+		return -1;
+	return self->bundle->find(name) >= 0;
+}
+
+static PyMappingMethods CHIVELBundle_as_mapping = {
+	(lenfunc)CHIVELBundle_len,          /* mp_length */
+	(binaryfunc)CHIVELBundle_getitem,   /* mp_subscript */
+	0,                                  /* mp_ass_subscript */
+};
+
+static PySequenceMethods CHIVELBundle_as_sequence = {
+	0,                                  /* sq_length */
+	0,                                  /* sq_concat */
+	0,                                  /* sq_repeat */
+	0,                                  /* sq_item */
+	0,                                  /* was_sq_slice */
+	0,                                  /* sq_ass_item */
+	0,                                  /* was_sq_ass_slice */
+	(objobjproc)CHIVELBundle_contains,  /* sq_contains */
+};
+
+static PyMethodDef CHIVELBundle_methods[] = {
+	{"names", (PyCFunction)CHIVELBundle_names, METH_NOARGS, "Get the names of the templates, in the order they were saved"},
+	{"get", (PyCFunction)CHIVELBundle_get, METH_VARARGS | METH_KEYWORDS, "Get a template, or one of its variants ('original', 'gray', 'half' or 'quarter'), as an Image sharing the bundle's memory"},
+	{"info", (PyCFunction)CHIVELBundle_info, METH_VARARGS, "Get a template's size, color space, per channel mean and standard deviation, and which variants it has"},
+	{nullptr, nullptr, 0, nullptr}
+};
+
+static PyTypeObject CHIVELBundleType = {
+	PyVarObject_HEAD_INIT(NULL, 0)
+	"chivel.Bundle",
+	sizeof(CHIVELBundleObject),
+	0,
+	(destructor)CHIVELBundle_dealloc,
+	0,
+	0,
+	0,
+	0,
+	0,
+	0,
+	&CHIVELBundle_as_sequence,
+	&CHIVELBundle_as_mapping,
+	0,
+	0,
+	0,
+	0,
+	0,
+	0,
+	Py_TPFLAGS_DEFAULT,
+	"Chivel Bundle objects, opened with open_bundle",
+	0,
+	0,
+	0,
+	0,
+	0,
+	0,
+	CHIVELBundle_methods,
+	0,
+	0,
+	0,
+	0,
+	0,
+	0,
+	0,
+	0,
+	0,
+	0,
+};
+
+static bool is_bundle(PyObject* obj) {
+	return Py_TYPE(obj) == &CHIVELBundleType;
+}
+
+#pragma endregion
+
+#pragma region ScreenIndex
+
+typedef struct {
+	PyObject_HEAD
+		chivel::BKTree* tree;
+	std::vector<cv::Rect>* exclude; // Left out of every image hashed by the index
+	chivel::HashType type;
+	PyObject* labels; // list, indexed by the ids in the tree
+} CHIVELScreenIndexObject;
+
+static int CHIVELScreenIndex_traverse(CHIVELScreenIndexObject* self, visitproc visit, void* arg) {
+	Py_VISIT(self->labels);
+	return 0;
+}
+
+static int CHIVELScreenIndex_clear(CHIVELScreenIndexObject* self) {
+	Py_CLEAR(self->labels);
+	return 0;
+}
+
+static void CHIVELScreenIndex_dealloc(CHIVELScreenIndexObject* self) {
+	PyObject_GC_UnTrack(self);
+	CHIVELScreenIndex_clear(self);
+	delete self->tree;
+	delete self->exclude;
+	Py_TYPE(self)->tp_free((PyObject*)self);
+}
+
+static PyObject* CHIVELScreenIndex_new(PyTypeObject* type, PyObject* args, PyObject* kwds) {
+	CHIVELScreenIndexObject* self = (CHIVELScreenIndexObject*)type->tp_alloc(type, 0);
+	if (self) {
+		self->tree = new chivel::BKTree();
+		self->exclude = new std::vector<cv::Rect>();
+		self->type = chivel::HashType::Perceptual;
+		self->labels = PyList_New(0);
+		if (!self->labels) {
+			Py_DECREF(self);
+			return nullptr;
+		}
+	}
+	return (PyObject*)self;
+}
+
+static int CHIVELScreenIndex_init(CHIVELScreenIndexObject* self, PyObject* args, PyObject* kwds) {
+	const char* kind = "phash";
+	PyObject* exclude_obj = Py_None;
+	static const char* kwlist[] = { "kind", "exclude", nullptr };
+	if (!PyArg_ParseTupleAndKeywords(args, kwds, "|sO", (char**)kwlist, &kind, &exclude_obj))
+		return -1;
+
+	if (std::strcmp(kind, "phash") == 0) {
+		self->type = chivel::HashType::Perceptual;
+	}
+	else if (std::strcmp(kind, "dhash") == 0) {
+		self->type = chivel::HashType::Difference;
+	}
+	else if (std::strcmp(kind, "ahash") == 0) {
+		self->type = chivel::HashType::Average;
+	}
+	else {
+		PyErr_SetString(PyExc_ValueError, "kind must be 'phash', 'dhash' or 'ahash'");
+		return -1;
+	}
+
+	self->exclude->clear();
+	if (!parse_hash_exclude(exclude_obj, *self->exclude))
+		return -1;
+
+	// Hashes of another kind or with other exclusions cannot be compared, so calling __init__ again starts over
+	self->tree->clear();
+	PyObject* labels = PyList_New(0);
+	if (!labels)
+		return -1;
+	Py_XSETREF(self->labels, labels);
+	return 0;
+}
+
+// The labels, which the garbage collector may have cleared. Returns false with an exception set then.
+static bool check_index_labels(CHIVELScreenIndexObject* self) {
+	if (!self->labels) {
+		PyErr_SetString(PyExc_RuntimeError, "ScreenIndex has been cleared");
+		return false;
+	}
+	return true;
+}
+
+// Reads an Image, hashed the index's way, or a hash given as an int. Returns false with an exception set on failure.
+static bool get_index_hash(CHIVELScreenIndexObject* self, PyObject* obj, uint64_t& hash) {
+	if (PyObject_TypeCheck(obj, &CHIVELImageType))
+		return hash_image((CHIVELImageObject*)obj, self->type, *self->exclude, hash);
+	if (PyLong_Check(obj)) {
+		hash = PyLong_AsUnsignedLongLong(obj);
+		return !PyErr_Occurred();
+	}
+	PyErr_SetString(PyExc_TypeError, "Argument must be a chivel.Image object or a hash");
+	return false;
+}
+
+static PyObject* CHIVELScreenIndex_add(CHIVELScreenIndexObject* self, PyObject* args) {
+	PyObject* label = nullptr;
+	PyObject* obj = nullptr;
+	if (!PyArg_ParseTuple(args, "OO", &label, &obj))
+		return nullptr;
+	if (!check_index_labels(self))
+		return nullptr;
+
+	uint64_t hash = 0;
+	if (!get_index_hash(self, obj, hash))
+		return nullptr;
+	if (PyList_Append(self->labels, label) < 0)
+		return nullptr;
+	self->tree->add(hash, static_cast<int>(PyList_GET_SIZE(self->labels) - 1));
+	return PyLong_FromUnsignedLongLong(hash);
+}
+
+static PyObject* CHIVELScreenIndex_query(CHIVELScreenIndexObject* self, PyObject* args, PyObject* kwargs) {
+	PyObject* obj = nullptr;
+	int max_distance = 10;
+	static const char* kwlist[] = { "image", "max_distance", nullptr };
+	if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|i", (char**)kwlist, &obj, &max_distance))
+		return nullptr;
+	if (!check_index_labels(self))
+		return nullptr;
+
+	uint64_t hash = 0;
+	if (!get_index_hash(self, obj, hash))
+		return nullptr;
+	chivel::BKTree::Result result;
+	if (!self->tree->nearest(hash, max_distance, result))
+		Py_RETURN_NONE;
+	return Py_BuildValue("(Oi)", PyList_GET_ITEM(self->labels, result.id), result.distance);
+}
+
+static PyObject* CHIVELScreenIndex_query_all(CHIVELScreenIndexObject* self, PyObject* args, PyObject* kwargs) {
+	PyObject* obj = nullptr;
+	int max_distance = 10;
+	static const char* kwlist[] = { "image", "max_distance", nullptr };
+	if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|i", (char**)kwlist, &obj, &max_distance))
+		return nullptr;
+	if (!check_index_labels(self))
+		return nullptr;
+
+	uint64_t hash = 0;
+	if (!get_index_hash(self, obj, hash))
+		return nullptr;
+	std::vector<chivel::BKTree::Result> results = self->tree->search(hash, max_distance);
+	PyObject* list = PyList_New(static_cast<Py_ssize_t>(results.size()));
+	if (!list)
+		return nullptr;
+	for (size_t i = 0; i < results.size(); i++) {
+		PyObject* item = Py_BuildValue("(Oi)", PyList_GET_ITEM(self->labels, results[i].id), results[i].distance);
+		if (!item) {
+			Py_DECREF(list);
+			return nullptr;
+		}
+		PyList_SET_ITEM(list, static_cast<Py_ssize_t>(i), item);
+	}
+	return list;
+}
+
+static PyObject* CHIVELScreenIndex_hash(CHIVELScreenIndexObject* self, PyObject* args) {
+	PyObject* image_obj = nullptr;
+	if (!PyArg_ParseTuple(args, "O", &image_obj))
+		return nullptr;
+	if (!PyObject_TypeCheck(image_obj, &CHIVELImageType)) {
+		PyErr_SetString(PyExc_TypeError, "Argument must be a chivel.Image object");
+		return nullptr;
+	}
+
+	uint64_t hash = 0;
+	if (!hash_image((CHIVELImageObject*)image_obj, self->type, *self->exclude, hash))
+		return nullptr;
+	return PyLong_FromUnsignedLongLong(hash);
+}
+
+static PyObject* CHIVELScreenIndex_clear_all(CHIVELScreenIndexObject* self, PyObject* /*unused*/) {
+	self->tree->clear();
+	PyObject* labels = PyList_New(0);
+	if (!labels)
+		return nullptr;
+	Py_XSETREF(self->labels, labels);
+	Py_RETURN_NONE;
+}
+
+static Py_ssize_t CHIVELScreenIndex_len(CHIVELScreenIndexObject* self) {
+	return static_cast<Py_ssize_t>(self->tree->size());
+}
+
+static PySequenceMethods CHIVELScreenIndex_as_sequence = {
+	(lenfunc)CHIVELScreenIndex_len, /* sq_length */
+};
+
+static PyMethodDef CHIVELScreenIndex_methods[] = {
+	{"add", (PyCFunction)CHIVELScreenIndex_add, METH_VARARGS, "Add a labelled Image, or a hash, and get its hash"},
+	{"query", (PyCFunction)CHIVELScreenIndex_query, METH_VARARGS | METH_KEYWORDS, "Get the (label, distance) of the closest entry within max_distance bits of an Image or a hash, or None"},
+	{"query_all", (PyCFunction)CHIVELScreenIndex_query_all, METH_VARARGS | METH_KEYWORDS, "Get the (label, distance) of every entry within max_distance bits of an Image or a hash, closest first"},
+	{"hash", (PyCFunction)CHIVELScreenIndex_hash, METH_VARARGS, "Hash an Image the way the index does, with its kind and excluded areas"},
+	{"clear", (PyCFunction)CHIVELScreenIndex_clear_all, METH_NOARGS, "Remove every entry"},
+	{nullptr, nullptr, 0, nullptr}
+};
+
+static PyTypeObject CHIVELScreenIndexType = {
+	PyVarObject_HEAD_INIT(NULL, 0)
+	"chivel.ScreenIndex",
+	sizeof(CHIVELScreenIndexObject),
+	0,
+	(destructor)CHIVELScreenIndex_dealloc,
+	0,
+	0,
+	0,
+	0,
+	0,
+	0,
+	&CHIVELScreenIndex_as_sequence,
+	0,
+	0,
+	0,
+	0,
+	0,
+	0,
+	0,
+	Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE | Py_TPFLAGS_HAVE_GC,
+	"Chivel ScreenIndex objects, for recognizing known screens by image hash",
+	(traverseproc)CHIVELScreenIndex_traverse,
+	(inquiry)CHIVELScreenIndex_clear,
+	0,
+	0,
+	0,
+	0,
+	CHIVELScreenIndex_methods,
+	0,
+	0,
+	0,
+	0,
+	0,
+	0,
+	0,
+	(initproc)CHIVELScreenIndex_init,
+	0,
+	CHIVELScreenIndex_new,
+};
+
+#pragma endregion
+
+#pragma region ProbeSet
+
+// A pixel, or a small area, expected to be a color
+struct CHIVELProbe {
+	cv::Rect rect;
+	cv::Scalar color; // BGR
+	int tolerance;
+};
+
+// The area probes on the display may cover, relative to the display. Looked up once per call, not once per probe.
+static bool get_probe_bounds(int display_index, cv::Rect& bounds) {
+	chivel::DisplayInfo display;
+	if (!chivel::getBackend()->getDisplay(display_index, display)) {
+		PyErr_SetString(PyExc_ValueError, "Invalid display index");
+		return false;
+	}
+	bounds = cv::Rect(0, 0, display.width, display.height);
+	return true;
+}
+
+// Reads a probe position: a Point is that one pixel, and a Rect is the average of its pixels.
+// Probes must be within bounds, since backends disagree on what is read outside of the display.
+static bool parse_probe_area(PyObject* obj, cv::Rect const& bounds, cv::Rect& rect) {
+	if (PyObject_TypeCheck(obj, &CHIVELPointType)) {
+		CHIVELPointObject* point = (CHIVELPointObject*)obj;
+		rect = cv::Rect(point->x, point->y, 1, 1);
+	}
+	else if (PyObject_TypeCheck(obj, &CHIVELRectType)) {
+		CHIVELRectObject* r = (CHIVELRectObject*)obj;
+		if (r->width <= 0 || r->height <= 0) {
+			PyErr_SetString(PyExc_ValueError, "Width and height must be positive");
+			return false;
+		}
+		rect = cv::Rect(r->x, r->y, r->width, r->height);
+	}
+	else {
+		PyErr_SetString(PyExc_TypeError, "Probes must be chivel.Point or chivel.Rect objects");
+		return false;
+	}
+
+	if ((rect & bounds) != rect) {
+		PyErr_SetString(PyExc_ValueError, "Probe is outside of the display");
+		return false;
+	}
+	return true;
+}
+
+// Captures only the probed areas and averages each one. Returns false with an exception set on failure.
+static bool read_probes(int display_index, std::vector<cv::Rect> const& rects, std::vector<cv::Scalar>& colors) {
+	std::vector<cv::Mat> areas;
+	if (!chivel::getBackend()->captureRects(display_index, rects, areas)) {
+		PyErr_SetString(PyExc_RuntimeError, "Failed to capture screen");
+		return false;
+	}
+	colors.resize(areas.size());
+	for (size_t i = 0; i < areas.size(); i++) {
+		cv::Mat const& area = areas[i];
+		if (area.total() == 1) {
+			cv::Vec3b const& pixel = area.at<cv::Vec3b>(0, 0);
+			colors[i] = cv::Scalar(pixel[0], pixel[1], pixel[2]);
+		}
+		else {
+			colors[i] = cv::mean(area);
+		}
+	}
+	return true;
+}
+
+// A list of Colors, from BGR
+static PyObject* create_probe_colors(std::vector<cv::Scalar> const& colors) {
+	PyObject* list = PyList_New(static_cast<Py_ssize_t>(colors.size()));
+	if (!list)
+		return nullptr;
+	for (size_t i = 0; i < colors.size(); i++) {
+		cv::Scalar const& color = colors[i];
+		PyObject* color_obj = create_color(cvRound(color[2]), cvRound(color[1]), cvRound(color[0]));
+		if (!color_obj) {
+			Py_DECREF(list);
+			return nullptr;
+		}
+		PyList_SET_ITEM(list, static_cast<Py_ssize_t>(i), color_obj);
+	}
+	return list;
+}
+
+typedef struct {
+	PyObject_HEAD
+		std::vector<CHIVELProbe>* probes;
+	std::vector<cv::Rect>* rects; // The area of each probe, in order, to hand to the backend
+	int display_index;
+} CHIVELProbeSetObject;
+
+static void CHIVELProbeSet_dealloc(CHIVELProbeSetObject* self) {
+	delete self->probes;
+	delete self->rects;
+	Py_TYPE(self)->tp_free((PyObject*)self);
+}
+
+static PyObject* CHIVELProbeSet_new(PyTypeObject* type, PyObject* args, PyObject* kwds) {
+	CHIVELProbeSetObject* self = (CHIVELProbeSetObject*)type->tp_alloc(type, 0);
+	if (self) {
+		self->probes = new std::vector<CHIVELProbe>();
+		self->rects = new std::vector<cv::Rect>();
+		self->display_index = 0;
+	}
+	return (PyObject*)self;
+}
+
+static int CHIVELProbeSet_init(CHIVELProbeSetObject* self, PyObject* args, PyObject* kwds) {
+	static const char* kwlist[] = { "display_index", nullptr };
+	if (!PyArg_ParseTupleAndKeywords(args, kwds, "|i", (char**)kwlist, &self->display_index))
+		return -1;
+	return 0;
+}
+
+static PyObject* CHIVELProbeSet_add(CHIVELProbeSetObject* self, PyObject* args, PyObject* kwargs) {
+	PyObject* position_obj = nullptr;
+	PyObject* color_obj = nullptr;
+	int tolerance = 0;
+	static const char* kwlist[] = { "position", "color", "tolerance", nullptr };
+	if (!PyArg_ParseTupleAndKeywords(args, kwargs, "OO|i", (char**)kwlist, &position_obj, &color_obj, &tolerance))
+		return nullptr;
+
+	CHIVELProbe probe;
+	cv::Rect bounds;
+	if (!get_probe_bounds(self->display_index, bounds) || !parse_probe_area(position_obj, bounds, probe.rect))
+		return nullptr;
+	if (!PyObject_TypeCheck(color_obj, &CHIVELColorType)) {
+		PyErr_SetString(PyExc_TypeError, "color must be a chivel.Color object");
+		return nullptr;
+	}
+	if (tolerance < 0) {
+		PyErr_SetString(PyExc_ValueError, "tolerance must not be negative");
+		return nullptr;
+	}
+	CHIVELColorObject* color = (CHIVELColorObject*)color_obj;
+	probe.color = cv::Scalar(color->b, color->g, color->r);
+	probe.tolerance = tolerance;
+
+	self->probes->push_back(probe);
+	self->rects->push_back(probe.rect);
+	return PyLong_FromSsize_t(static_cast<Py_ssize_t>(self->probes->size() - 1));
+}
+
+// Whether each probe is within its tolerance of its color, in every channel
+static bool check_probes(CHIVELProbeSetObject* self, std::vector<bool>& results) {
+	std::vector<cv::Scalar> colors;
+	if (!read_probes(self->display_index, *self->rects, colors))
+		return false;
+	results.resize(colors.size());
+	for (size_t i = 0; i < colors.size(); i++) {
+		CHIVELProbe const& probe = (*self->probes)[i];
+		bool within = true;
+		for (int c = 0; c < 3; c++)
+			within = within && std::abs(colors[i][c] - probe.color[c]) <= probe.tolerance;
+		results[i] = within;
+	}
+	return true;
+}
+
+static PyObject* CHIVELProbeSet_check(CHIVELProbeSetObject* self, PyObject* /*unused*/) {
+	std::vector<bool> results;
+	if (!check_probes(self, results))
+		return nullptr;
+	PyObject* list = PyList_New(static_cast<Py_ssize_t>(results.size()));
+	if (!list)
+		return nullptr;
+	for (size_t i = 0; i < results.size(); i++)
+		PyList_SET_ITEM(list, static_cast<Py_ssize_t>(i), PyBool_FromLong(results[i]));
+	return list;
+}
+
+static PyObject* CHIVELProbeSet_all(CHIVELProbeSetObject* self, PyObject* /*unused*/) {
+	std::vector<bool> results;
+	if (!check_probes(self, results))
+		return nullptr;
+	return PyBool_FromLong(std::find(results.begin(), results.end(), false) == results.end());
+}
+
+static PyObject* CHIVELProbeSet_read(CHIVELProbeSetObject* self, PyObject* /*unused*/) {
+	std::vector<cv::Scalar> colors;
+	if (!read_probes(self->display_index, *self->rects, colors))
+		return nullptr;
+	return create_probe_colors(colors);
+}
+
+static PyObject* CHIVELProbeSet_clear(CHIVELProbeSetObject* self, PyObject* /*unused*/) {
+	self->probes->clear();
+	self->rects->clear();
+	Py_RETURN_NONE;
+}
+
+static Py_ssize_t CHIVELProbeSet_len(CHIVELProbeSetObject* self) {
+	return static_cast<Py_ssize_t>(self->probes->size());
+}
+
+static PySequenceMethods CHIVELProbeSet_as_sequence = {
+	(lenfunc)CHIVELProbeSet_len, /* sq_length */
+};
+
+static PyMemberDef CHIVELProbeSet_members[] = {
+	{"display_index", T_INT, offsetof(CHIVELProbeSetObject, display_index), READONLY, "display index"},
+	{nullptr}
+};
+
+static PyMethodDef CHIVELProbeSet_methods[] = {
+	{"add", (PyCFunction)CHIVELProbeSet_add, METH_VARARGS | METH_KEYWORDS, "Add a Point (one pixel) or Rect (its average) expected to be a Color, give or take tolerance in each channel, and get its index"},
+	{"check", (PyCFunction)CHIVELProbeSet_check, METH_NOARGS, "Read only the probed pixels and get whether each one matches its color"},
+	{"all", (PyCFunction)CHIVELProbeSet_all, METH_NOARGS, "Read only the probed pixels and get whether every one matches its color"},
+	{"read", (PyCFunction)CHIVELProbeSet_read, METH_NOARGS, "Read only the probed pixels and get the Color of each probe"},
+	{"clear", (PyCFunction)CHIVELProbeSet_clear, METH_NOARGS, "Remove every probe"},
+	{nullptr, nullptr, 0, nullptr}
+};
+
+static PyTypeObject CHIVELProbeSetType = {
+	PyVarObject_HEAD_INIT(NULL, 0)
+	"chivel.ProbeSet",
+	sizeof(CHIVELProbeSetObject),
+	0,
+	(destructor)CHIVELProbeSet_dealloc,
+	0,
+	0,
+	0,
+	0,
+	0,
+	0,
+	&CHIVELProbeSet_as_sequence,
+	0,
+	0,
+	0,
+	0,
+	0,
+	0,
+	0,
+	Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE,
+	"Chivel ProbeSet objects",
+	0,
+	0,
+	0,
+	0,
+	0,
+	0,
+	CHIVELProbeSet_methods,
+	CHIVELProbeSet_members,
+	0,
+	0,
+	0,
+	0,
+	0,
+	0,
+	(initproc)CHIVELProbeSet_init,
+	0,
+	CHIVELProbeSet_new,
+};
+
+#pragma endregion
+
+// Converts an image fresh from readImage or decodeImage to the color space it was read for
+static cv::Mat finish_read(cv::Mat const& img, int color_space) {
+	if (img.empty())
+		return img;
+
+	// Convert to the correct color space
+	ColorSpace current;
+	switch (color_space)
+	{
+	case COLOR_SPACE_BGRA:
+	case COLOR_SPACE_RGBA:
+		current = COLOR_SPACE_BGRA;
+		break;
+	case COLOR_SPACE_GRAY:
+		current = COLOR_SPACE_GRAY;
+		break;
+	default:
+		current = COLOR_SPACE_BGR;
+		break;
+	}
+	return chivel::convertColorSpace(img, current, static_cast<ColorSpace>(color_space));
+}
+
+// Reads an image file and converts it to the color space. Runs without the GIL, for the load cache.
+static cv::Mat decode_image(std::string const& path, int color_space) {
+	return finish_read(chivel::readImage(path.c_str(), static_cast<ColorSpace>(color_space)), color_space);
+}
+
+static PyObject* chivel_load(PyObject* self, PyObject* args) {
+	const char* path;
+	int color_space = COLOR_SPACE_BGR; // Default to BGR
+	if (!PyArg_ParseTuple(args, "s|i", &path, &color_space))
+		return nullptr;
+
+	// Files that have not changed since they were last loaded come from the cache, sharing its pixels
+	std::string file = path;
+	cv::Mat img;
+	Py_BEGIN_ALLOW_THREADS
+	img = chivel::ImageCache::get().load(file, color_space, decode_image);
+	Py_END_ALLOW_THREADS
+	if (img.empty()) {
+		PyErr_SetString(PyExc_IOError, "Failed to load image from path");
+		return nullptr;
+	}
+
+	return create_image(std::move(img), static_cast<ColorSpace>(color_space));
+}
+
+// Whether a file name matches a pattern where * is any run of characters and ? is any one character
+static bool match_pattern(char const* pattern, char const* name) {
+	char const* star = nullptr;
+	char const* resume = nullptr;
+	while (*name) {
+		if (*pattern == '*') {
+			star = pattern++;
+			resume = name;
+		}
+		else if (*pattern == '?' || *pattern == *name) {
+			pattern++;
+			name++;
+		}
+		else if (star) {
+			// Let the last * take one more character and try again
+			pattern = star + 1;
+			name = ++resume;
+		}
+		else {
+			return false;
+		}
+	}
+	while (*pattern == '*')
+		pattern++;
+	return !*pattern;
+}
+
+static PyObject* chivel_load_dir(PyObject* self, PyObject* args, PyObject* kwargs) {
+	const char* path;
+	const char* pattern = "*.png";
+	int color_space = COLOR_SPACE_BGR;
+	static const char* kwlist[] = { "path", "pattern", "color_space", nullptr };
+	if (!PyArg_ParseTupleAndKeywords(args, kwargs, "s|si", (char**)kwlist, &path, &pattern, &color_space))
+		return nullptr;
+
+	std::vector<std::filesystem::path> files;
+	std::vector<cv::Mat> images;
+	std::string error;
+	Py_BEGIN_ALLOW_THREADS
+	try {
+		for (auto const& entry : std::filesystem::directory_iterator(path)) {
+			if (entry.is_regular_file() && match_pattern(pattern, entry.path().filename().string().c_str()))
+				files.push_back(entry.path());
+		}
+		std::sort(files.begin(), files.end());
+
+		// Decoding is most of the work, and every file is independent
+		images.resize(files.size());
+		cv::parallel_for_(cv::Range(0, static_cast<int>(files.size())), [&](cv::Range const& range) {
+			for (int i = range.start; i < range.end; i++)
+				images[i] = chivel::ImageCache::get().load(files[i].string(), color_space, decode_image);
+		});
+	}
+	catch (std::exception const& e) {
+		error = e.what();
+	}
+	Py_END_ALLOW_THREADS
+	if (!error.empty()) {
+		PyErr_SetString(PyExc_IOError, error.c_str());
+		return nullptr;
+	}
+
+	PyObject* dict = PyDict_New();
+	if (!dict)
+		return nullptr;
+	for (size_t i = 0; i < files.size(); ++i) {
+		// Files that are not images are skipped, the same as the virtual display does
+		if (images[i].empty())
+			continue;
+		PyObject* image = create_image(std::move(images[i]), static_cast<ColorSpace>(color_space));
+		if (!image || PyDict_SetItemString(dict, files[i].stem().string().c_str(), image) < 0) {
+			Py_XDECREF(image);
+			Py_DECREF(dict);
+			return nullptr;
+		}
+		Py_DECREF(image);
+	}
+	return dict;
+}
+
+static PyObject* chivel_clear_image_cache(PyObject* self, PyObject* /*unused*/) {
+	chivel::ImageCache::get().clear();
+	Py_RETURN_NONE;
+}
+
+// Adds one template to a bundle being saved, with its gray variant. Returns false with an exception set on failure.
+static bool add_bundle_template(std::vector<chivel::Bundle::Template>& templates, PyObject* name_obj, PyObject* image_obj) {
+	const char* name = PyUnicode_AsUTF8(name_obj);
+	if (!name)
+		return false;
+	if (!PyObject_TypeCheck(image_obj, &CHIVELImageType)) {
+		PyErr_SetString(PyExc_TypeError, "Templates must be chivel.Image objects");
+		return false;
+	}
+	CHIVELImageObject* image = (CHIVELImageObject*)image_obj;
+	cv::Mat const& mat = image->mat;
+	if (mat.empty()) {
+		PyErr_SetString(PyExc_ValueError, "Image data is empty");
+		return false;
+	}
+	if (mat.depth() != CV_8U || (mat.channels() != 1 && mat.channels() != 3 && mat.channels() != 4)) {
+		PyErr_SetString(PyExc_ValueError, "Templates must be 8-bit images with 1, 3, or 4 channels");
+		return false;
+	}
+
+	chivel::Bundle::Template t;
+	t.name = name;
+	t.colorSpace = image->color_space;
+	t.variants[chivel::Bundle::ORIGINAL] = mat;
+	if (mat.channels() == 1) {
+		t.variants[chivel::Bundle::GRAY] = mat;
+	}
+	else {
+		// Images of unknown color space are taken to be in OpenCV's usual order
+		ColorSpace current = image->color_space;
+		if (current == COLOR_SPACE_UNKNOWN)
+			current = mat.channels() == 4 ? COLOR_SPACE_BGRA : COLOR_SPACE_BGR;
+		t.variants[chivel::Bundle::GRAY] = chivel::convertColorSpace(mat, current, COLOR_SPACE_GRAY);
+	}
+	templates.push_back(t);
+	return true;
+}
+
+static PyObject* chivel_save_bundle(PyObject* self, PyObject* args) {
+	PyObject* templates_obj = nullptr;
+	const char* path;
+	if (!PyArg_ParseTuple(args, "Os", &templates_obj, &path))
+		return nullptr;
+
+	// A dict of name to Image, such as load_dir returns, or a sequence of Images named by their index
+	std::vector<chivel::Bundle::Template> templates;
+	if (PyDict_Check(templates_obj)) {
+		PyObject* key;
+		PyObject* value;
+		Py_ssize_t pos = 0;
+		while (PyDict_Next(templates_obj, &pos, &key, &value)) {
+			if (!PyUnicode_Check(key)) {
+				PyErr_SetString(PyExc_TypeError, "Template names must be strings");
+				return nullptr;
+			}
+			if (!add_bundle_template(templates, key, value))
+				return nullptr;
+		}
+	}
+	else {
+		PyObject* seq = PySequence_Fast(templates_obj, "templates must be a dict of name to chivel.Image, or a sequence of chivel.Image");
+		if (!seq)
+			return nullptr;
+		for (Py_ssize_t i = 0; i < PySequence_Fast_GET_SIZE(seq); ++i) {
+			PyObject* name = PyUnicode_FromFormat("%zd", i);
+			bool added = name && add_bundle_template(templates, name, PySequence_Fast_GET_ITEM(seq, i));
+			Py_XDECREF(name);
+			if (!added) {
+				Py_DECREF(seq);
+				return nullptr;
+			}
+		}
+		Py_DECREF(seq);
+	}
+
+	std::string file = path;
+	std::string error;
+	bool written = false;
+	Py_BEGIN_ALLOW_THREADS
+	try {
+		written = chivel::Bundle::write(templates, file, error);
+	}
+	catch (cv::Exception const& e) {
+		error = e.what();
+	}
+	Py_END_ALLOW_THREADS
+	if (!written) {
+		PyErr_SetString(PyExc_IOError, error.c_str());
+		return nullptr;
+	}
+	Py_RETURN_NONE;
+}
+
+static PyObject* chivel_open_bundle(PyObject* self, PyObject* args) {
+	const char* path;
+	if (!PyArg_ParseTuple(args, "s", &path))
+		return nullptr;
+
+	CHIVELBundleObject* bundle = PyObject_New(CHIVELBundleObject, &CHIVELBundleType);
+	if (!bundle)
+		return nullptr;
+	bundle->bundle = new chivel::Bundle();
+
+	std::string file = path;
+	std::string error;
+	bool opened;
+	Py_BEGIN_ALLOW_THREADS
+	opened = bundle->bundle->open(file, error);
+	Py_END_ALLOW_THREADS
+	if (!opened) {
+		Py_DECREF(bundle);
+		PyErr_SetString(PyExc_IOError, error.c_str());
+		return nullptr;
+	}
+	return (PyObject*)bundle;
 }
 
 cv::Mat readImage(char const* const path, int color_space = COLOR_SPACE_BGR)
@@ -2181,11 +4734,13 @@ cv::Mat readImage(char const* const path, int color_space = COLOR_SPACE_BGR)
 	return img;
 }
 
-static PyObject* chivel_save(PyObject* self, PyObject* args) {
+static PyObject* chivel_save(PyObject* self, PyObject* args, PyObject* kwargs) {
 	PyObject* image_obj;
 	const char* path;
-
-	if (!PyArg_ParseTuple(args, "Os", &image_obj, &path))
+	int quality = -1;
+	int compression = -1;
+	static const char* kwlist[] = { "image", "path", "quality", "compression", nullptr };
+	if (!PyArg_ParseTupleAndKeywords(args, kwargs, "Os|$ii", (char**)kwlist, &image_obj, &path, &quality, &compression))
 		return nullptr;
 
 	if (!PyObject_TypeCheck(image_obj, &CHIVELImageType)) {
@@ -2194,12 +4749,16 @@ static PyObject* chivel_save(PyObject* self, PyObject* args) {
 	}
 
 	CHIVELImageObject* image = (CHIVELImageObject*)image_obj;
-	if (!image->mat || image->mat->empty()) {
+	if (image->mat.empty()) {
 		PyErr_SetString(PyExc_ValueError, "Image data is empty");
 		return nullptr;
 	}
 
-	if (!cv::imwrite(path, *(image->mat))) {
+	std::vector<int> params;
+	if (!get_encoder_params(std::filesystem::path(path).extension().string(), quality, compression, params))
+		return nullptr;
+
+	if (!cv::imwrite(path, image->mat, params)) {
 		PyErr_SetString(PyExc_IOError, "Failed to save image to path");
 		return nullptr;
 	}
@@ -2207,15 +4766,313 @@ static PyObject* chivel_save(PyObject* self, PyObject* args) {
 	Py_RETURN_NONE;
 }
 
+static PyObject* chivel_save_async(PyObject* self, PyObject* args, PyObject* kwargs) {
+	PyObject* image_obj;
+	const char* path;
+	int quality = -1;
+	int compression = -1;
+	static const char* kwlist[] = { "image", "path", "quality", "compression", nullptr };
+	if (!PyArg_ParseTupleAndKeywords(args, kwargs, "Os|$ii", (char**)kwlist, &image_obj, &path, &quality, &compression))
+		return nullptr;
+
+	if (!PyObject_TypeCheck(image_obj, &CHIVELImageType)) {
+		PyErr_SetString(PyExc_TypeError, "First argument must be a chivel.Image object");
+		return nullptr;
+	}
+	CHIVELImageObject* image = (CHIVELImageObject*)image_obj;
+	if (image->mat.empty()) {
+		PyErr_SetString(PyExc_ValueError, "Image data is empty");
+		return nullptr;
+	}
+	std::vector<int> params;
+	if (!get_encoder_params(std::filesystem::path(path).extension().string(), quality, compression, params))
+		return nullptr;
+
+	// The writer's reference makes drawing on the image copy it first. Pixels that can change without that,
+	// shared buffers (Capturer, from_buffer, bundles) and exports to Python, are copied now instead.
+	cv::Mat mat = image->mat;
+	bool exported = image->exports > 0 && image->exported_data == mat.u;
+	if (!mat.u || image->owner || exported)
+		mat = mat.clone();
+
+	std::string file = path;
+	bool queued;
+	Py_BEGIN_ALLOW_THREADS
+	queued = chivel::ImageWriter::get().submit(mat, file, params);
+	Py_END_ALLOW_THREADS
+	if (!queued) {
+		PyErr_SetString(PyExc_RuntimeError, "The background writer has stopped");
+		return nullptr;
+	}
+	Py_RETURN_NONE;
+}
+
+static PyObject* chivel_flush(PyObject* self, PyObject* /*unused*/) {
+	std::vector<std::string> failed;
+	Py_BEGIN_ALLOW_THREADS
+	failed = chivel::ImageWriter::get().flush();
+	Py_END_ALLOW_THREADS
+
+	PyObject* list = PyList_New(static_cast<Py_ssize_t>(failed.size()));
+	if (!list)
+		return nullptr;
+	for (size_t i = 0; i < failed.size(); ++i) {
+		PyObject* path = PyUnicode_FromString(failed[i].c_str());
+		if (!path) {
+			Py_DECREF(list);
+			return nullptr;
+		}
+		PyList_SET_ITEM(list, i, path); // Steals reference
+	}
+	return list;
+}
+
+static PyObject* chivel_decode(PyObject* self, PyObject* args, PyObject* kwargs) {
+	Py_buffer buffer;
+	int color_space = COLOR_SPACE_BGR;
+	static const char* kwlist[] = { "data", "color_space", nullptr };
+	if (!PyArg_ParseTupleAndKeywords(args, kwargs, "y*|i", (char**)kwlist, &buffer, &color_space))
+		return nullptr;
+
+	cv::Mat img;
+	std::string error;
+	Py_BEGIN_ALLOW_THREADS
+	try {
+		cv::Mat bytes(1, static_cast<int>(buffer.len), CV_8U, buffer.buf);
+		img = finish_read(chivel::decodeImage(bytes, static_cast<ColorSpace>(color_space)), color_space);
+	}
+	catch (cv::Exception const& e) {
+		error = e.what();
+	}
+	Py_END_ALLOW_THREADS
+	PyBuffer_Release(&buffer);
+	if (img.empty()) {
+		PyErr_SetString(PyExc_ValueError, error.empty() ? "Failed to decode image" : error.c_str());
+		return nullptr;
+	}
+	return create_image(std::move(img), static_cast<ColorSpace>(color_space));
+}
+
+// One image of a batch: its pixels, then its result, or why it has none
+struct BatchItem {
+	cv::Mat mat;
+	ColorSpace color_space = COLOR_SPACE_UNKNOWN;
+	std::string path;
+	PyObject* error_type = nullptr;
+	std::string error;
+	PyObject* owner = nullptr; // Keeps pixels the image does not own alive while the GIL is released
+};
+
+static PyObject* chivel_batch(PyObject* self, PyObject* args, PyObject* kwargs) {
+	PyObject* images_obj = nullptr;
+	PyObject* ops_obj = nullptr;
+	PyObject* paths_obj = Py_None;
+	static const char* kwlist[] = { "images", "ops", "paths", nullptr };
+	if (!PyArg_ParseTupleAndKeywords(args, kwargs, "OO|O", (char**)kwlist, &images_obj, &ops_obj, &paths_obj))
+		return nullptr;
+
+	if (!PyObject_TypeCheck(ops_obj, &CHIVELPipelineType)) {
+		PyErr_SetString(PyExc_TypeError, "ops must be a chivel.Pipeline object");
+		return nullptr;
+	}
+	PyObject* images = PySequence_Fast(images_obj, "images must be a sequence of chivel.Image objects");
+	if (!images)
+		return nullptr;
+	Py_ssize_t count = PySequence_Fast_GET_SIZE(images);
+
+	PyObject* paths = nullptr;
+	if (paths_obj != Py_None) {
+		paths = PySequence_Fast(paths_obj, "paths must be a sequence of strings");
+		if (!paths) {
+			Py_DECREF(images);
+			return nullptr;
+		}
+		if (PySequence_Fast_GET_SIZE(paths) != count) {
+			PyErr_SetString(PyExc_ValueError, "paths must have one path for every image");
+			Py_DECREF(images);
+			Py_DECREF(paths);
+			return nullptr;
+		}
+	}
+
+	// Everything that needs Python is read up front. Items that cannot run are marked now, and the rest still run.
+	std::vector<BatchItem> items(static_cast<size_t>(count));
+	auto release = [&]() {
+		for (BatchItem& item : items)
+			Py_CLEAR(item.owner);
+		Py_DECREF(images);
+		Py_XDECREF(paths);
+	};
+	for (Py_ssize_t i = 0; i < count; ++i) {
+		BatchItem& item = items[i];
+		if (paths) {
+			const char* path = PyUnicode_AsUTF8(PySequence_Fast_GET_ITEM(paths, i));
+			if (!path) {
+				release();
+				return nullptr;
+			}
+			item.path = path;
+		}
+
+		PyObject* image_obj = PySequence_Fast_GET_ITEM(images, i);
+		if (!PyObject_TypeCheck(image_obj, &CHIVELImageType)) {
+			item.error_type = PyExc_TypeError;
+			item.error = "Item is not a chivel.Image object";
+			continue;
+		}
+		CHIVELImageObject* image = (CHIVELImageObject*)image_obj;
+		item.mat = image->mat;
+		item.color_space = image->color_space;
+		item.owner = image->owner;
+		Py_XINCREF(item.owner);
+		if (item.mat.empty()) {
+			item.error_type = PyExc_ValueError;
+			item.error = "Image data is empty";
+		}
+		else if (item.mat.depth() != CV_8U || (item.mat.channels() != 1 && item.mat.channels() != 3 && item.mat.channels() != 4)) {
+			item.error_type = PyExc_ValueError;
+			item.error = "Pipelines run on 8-bit images with 1, 3, or 4 channels";
+		}
+	}
+
+	// The images are spread over OpenCV's threads. Each thread runs its own copy of the pipeline, with its own buffers.
+	chivel::Pipeline const& pipeline = *((CHIVELPipelineObject*)ops_obj)->pipeline;
+	int stripes = static_cast<int>(std::max<Py_ssize_t>(1, std::min<Py_ssize_t>(count, cv::getNumThreads())));
+	Py_BEGIN_ALLOW_THREADS
+	cv::parallel_for_(cv::Range(0, static_cast<int>(count)), [&](cv::Range const& range) {
+		chivel::Pipeline local(pipeline);
+		for (int i = range.start; i < range.end; i++) {
+			BatchItem& item = items[i];
+			if (item.error_type)
+				continue;
+			try {
+				item.mat = local.run(item.mat);
+				if (!item.path.empty() && !cv::imwrite(item.path, item.mat)) {
+					item.error_type = PyExc_IOError;
+					item.error = "Failed to save image to path";
+				}
+			}
+			catch (std::exception const& e) {
+				item.error_type = PyExc_RuntimeError;
+				item.error = e.what();
+			}
+		}
+	}, stripes);
+	Py_END_ALLOW_THREADS
+	release();
+
+	PyObject* list = PyList_New(count);
+	if (!list)
+		return nullptr;
+	for (Py_ssize_t i = 0; i < count; ++i) {
+		BatchItem& item = items[i];
+		PyObject* result;
+		if (item.error_type) {
+			result = PyObject_CallFunction(item.error_type, "s", item.error.c_str());
+		}
+		else {
+			ColorSpace color_space = item.mat.channels() == 1 ? COLOR_SPACE_GRAY : item.color_space;
+			result = create_image(std::move(item.mat), color_space);
+		}
+		if (!result) {
+			Py_DECREF(list);
+			return nullptr;
+		}
+		PyList_SET_ITEM(list, i, result); // Steals reference
+	}
+	return list;
+}
+
+// std::regex reports bad patterns by throwing, which must not reach Python
+static bool compile_search_regex(const char* search_str, std::regex& search_regex) {
+	try {
+		search_regex = std::regex(chivel::trim(search_str));
+		return true;
+	}
+	catch (std::regex_error const& e) {
+		PyErr_SetString(PyExc_ValueError, e.what());
+		return false;
+	}
+}
+
+// Accepts a window handle, or a title pattern that picks the frontmost window whose title matches
+static bool parse_window(PyObject* window_obj, uintptr_t& handle) {
+	if (PyLong_Check(window_obj)) {
+		handle = static_cast<uintptr_t>(PyLong_AsUnsignedLongLong(window_obj));
+		return !PyErr_Occurred();
+	}
+	if (PyUnicode_Check(window_obj)) {
+		std::regex title;
+		if (!compile_search_regex(PyUnicode_AsUTF8(window_obj), title))
+			return false;
+		handle = chivel::findWindow(&title, nullptr);
+		if (!handle) {
+			PyErr_SetString(PyExc_LookupError, "No window title matches");
+			return false;
+		}
+		return true;
+	}
+	PyErr_SetString(PyExc_TypeError, "window must be a window handle (int) or a title (str)");
+	return false;
+}
+
+// Finds the display the window is on, and the part of the window on that display, relative to the display
+static bool get_window_area(uintptr_t handle, int& display_index, cv::Rect& area) {
+	std::shared_ptr<chivel::Backend> backend = chivel::getBackend();
+	cv::Rect window;
+	if (!backend->getWindowRect(handle, window)) {
+		PyErr_SetString(PyExc_RuntimeError, "Window does not exist or is not visible");
+		return false;
+	}
+
+	// The top left corner can be just off screen (such as a maximized window's border), so fall back to the center
+	display_index = backend->findDisplay(window.x, window.y);
+	if (display_index < 0)
+		display_index = backend->findDisplay(window.x + window.width / 2, window.y + window.height / 2);
+	chivel::DisplayInfo display;
+	if (display_index < 0 || !backend->getDisplay(display_index, display)) {
+		PyErr_SetString(PyExc_RuntimeError, "Window is not on any display");
+		return false;
+	}
+
+	area = (window - cv::Point(display.x, display.y)) & cv::Rect(0, 0, display.width, display.height);
+	if (area.empty()) {
+		PyErr_SetString(PyExc_RuntimeError, "Window is not on any display");
+		return false;
+	}
+	return true;
+}
+
 static PyObject* chivel_capture(PyObject* self, PyObject* args, PyObject* kwargs) {
 	PyObject* rect_obj = nullptr;
+	PyObject* window_obj = nullptr;
 	int displayIndex = 0;
-	static const char* kwlist[] = { "display_index", "rect", nullptr };
-	if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|iO", (char**)kwlist, &displayIndex, &rect_obj))
+	int color_space = COLOR_SPACE_DEFAULT;
+	double scale = 1.0;
+	static const char* kwlist[] = { "display_index", "rect", "color_space", "scale", "window", nullptr };
+	if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|iOidO", (char**)kwlist, &displayIndex, &rect_obj, &color_space, &scale, &window_obj))
 		return nullptr;
 
-	cv::Mat img;
-	if (rect_obj && rect_obj != Py_None) {
+	if (!check_capture_format(color_space, scale))
+		return nullptr;
+
+	// The area of the display to capture, or empty for all of it
+	cv::Rect area;
+	cv::Point origin;
+	if (window_obj && window_obj != Py_None) {
+		if (rect_obj && rect_obj != Py_None) {
+			PyErr_SetString(PyExc_ValueError, "rect and window cannot both be given");
+			return nullptr;
+		}
+		uintptr_t handle = 0;
+		// The window's area of the screen, so anything on top of it is captured too
+		if (!parse_window(window_obj, handle) || !get_window_area(handle, displayIndex, area))
+			return nullptr;
+		// Matches in a scaled image are in scaled pixels, which no longer line up with the display
+		if (scale == 1.0)
+			origin = area.tl();
+	}
+	else if (rect_obj && rect_obj != Py_None) {
 		// Expect a chivel.Rect object
 		if (!PyObject_TypeCheck(rect_obj, &CHIVELRectType)) {
 			PyErr_SetString(PyExc_TypeError, "rect must be a chivel.Rect object");
@@ -2230,10 +5087,23 @@ static PyObject* chivel_capture(PyObject* self, PyObject* args, PyObject* kwargs
 			PyErr_SetString(PyExc_ValueError, "Width and height must be positive");
 			return nullptr;
 		}
-		img = chivel::captureRect(x, y, w, h, displayIndex);
+		area = cv::Rect(x, y, w, h);
+	}
+
+	cv::Mat img;
+	std::shared_ptr<chivel::Backend> backend = chivel::getBackend();
+	if (color_space != COLOR_SPACE_DEFAULT || scale != 1.0) {
+		// Converted and scaled on the way out of the backend's capture buffer, with no full size BGR copy in between
+		ColorSpace target = static_cast<ColorSpace>(color_space);
+		img = backend->captureConverted(displayIndex, area, [target, scale](cv::Mat const& pixels) {
+			return chivel::convertCapture(pixels, target, scale);
+		});
+	}
+	else if (area.empty()) {
+		img = backend->captureScreen(displayIndex);
 	}
 	else {
-		img = chivel::captureScreen(displayIndex);
+		img = backend->captureRect(area.x, area.y, area.width, area.height, displayIndex);
 	}
 
 	if (img.empty()) {
@@ -2241,20 +5111,82 @@ static PyObject* chivel_capture(PyObject* self, PyObject* args, PyObject* kwargs
 		return nullptr;
 	}
 
-	PyObject* image_obj = CHIVELImage_new(&CHIVELImageType, nullptr, nullptr);
-	if (!image_obj)
+	PyObject* image_obj = create_image(std::move(img), static_cast<ColorSpace>(color_space));
+	if (image_obj)
+		((CHIVELImageObject*)image_obj)->origin = origin;
+	return image_obj;
+}
+
+static PyObject* chivel_probe(PyObject* self, PyObject* args, PyObject* kwargs) {
+	PyObject* points_obj = nullptr;
+	int displayIndex = 0;
+	static const char* kwlist[] = { "points", "display_index", nullptr };
+	if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|i", (char**)kwlist, &points_obj, &displayIndex))
 		return nullptr;
 
-	CHIVELImageObject* image = (CHIVELImageObject*)image_obj;
-	delete image->mat;
-	image->mat = new cv::Mat(img);
-	image->color_space = COLOR_SPACE_DEFAULT;
+	cv::Rect bounds;
+	if (!get_probe_bounds(displayIndex, bounds))
+		return nullptr;
+
+	PyObject* seq = PySequence_Fast(points_obj, "points must be a sequence of chivel.Point or chivel.Rect objects");
+	if (!seq)
+		return nullptr;
+	Py_ssize_t count = PySequence_Fast_GET_SIZE(seq);
+	PyObject** items = PySequence_Fast_ITEMS(seq);
+	std::vector<cv::Rect> rects(static_cast<size_t>(count));
+	for (Py_ssize_t i = 0; i < count; i++) {
+		if (!parse_probe_area(items[i], bounds, rects[i])) {
+			Py_DECREF(seq);
+			return nullptr;
+		}
+	}
+	Py_DECREF(seq);
+
+	std::vector<cv::Scalar> colors;
+	if (!read_probes(displayIndex, rects, colors))
+		return nullptr;
+	return create_probe_colors(colors);
+}
+
+static PyObject* chivel_diff(PyObject* self, PyObject* args, PyObject* kwargs) {
+	PyObject* a_obj = nullptr;
+	PyObject* b_obj = nullptr;
+	int tile = 32;
+	int tolerance = 0;
+	static const char* kwlist[] = { "a", "b", "tile", "tolerance", nullptr };
+	if (!PyArg_ParseTupleAndKeywords(args, kwargs, "OO|ii", (char**)kwlist, &a_obj, &b_obj, &tile, &tolerance))
+		return nullptr;
+
+	if (!PyObject_TypeCheck(a_obj, &CHIVELImageType) || !PyObject_TypeCheck(b_obj, &CHIVELImageType)) {
+		PyErr_SetString(PyExc_TypeError, "Arguments must be chivel.Image objects");
+		return nullptr;
+	}
+	cv::Mat a = ((CHIVELImageObject*)a_obj)->mat;
+	cv::Mat b = ((CHIVELImageObject*)b_obj)->mat;
+	if (a.empty() || b.empty()) {
+		PyErr_SetString(PyExc_ValueError, "Image data is empty");
+		return nullptr;
+	}
+	if (a.size() != b.size() || a.type() != b.type()) {
+		PyErr_SetString(PyExc_ValueError, "Images must be the same size and type");
+		return nullptr;
+	}
+	if (tile <= 0) {
+		PyErr_SetString(PyExc_ValueError, "tile must be positive");
+		return nullptr;
+	}
+
+	std::vector<cv::Rect> rects;
+	Py_BEGIN_ALLOW_THREADS
+	rects = chivel::diffTiles(a, b, tile, tolerance);
+	Py_END_ALLOW_THREADS
 
-	return image_obj;
+	return create_rect_list(rects);
 }
 
 static std::filesystem::path get_module_dir()
 {
+#ifdef _WIN32
 	wchar_t path[MAX_PATH];
 	HMODULE hModule = NULL;
 	// Get handle to the current module (NULL = this DLL)
@@ -2263,16 +5195,171 @@ static std::filesystem::path get_module_dir()
 		GetModuleFileNameW(hModule, path, MAX_PATH);
 		return std::filesystem::path(path).parent_path();
 	}
+#else
+	// Find the shared object this function was loaded from
+	Dl_info info;
+	if (dladdr(reinterpret_cast<void*>(&get_module_dir), &info) && info.dli_fname) {
+		return std::filesystem::absolute(info.dli_fname).parent_path();
+	}
+#endif
 	// fallback: current working directory
 	return std::filesystem::current_path();
 }
 
+namespace chivel
+{
+	// Finds every place the template matches at or above threshold, with overlapping matches grouped. Does not touch Python.
+	std::vector<cv::Rect> findImage(cv::Mat const& source, cv::Mat const& templ, double threshold)
+	{
+		cv::Mat result;
+		cv::matchTemplate(source, templ, result, cv::TM_CCOEFF_NORMED);
+
+		std::vector<cv::Rect> rects;
+		std::vector<int> weights;
+
+		double minVal, maxVal;
+		cv::Point minLoc, maxLoc;
+		cv::Mat mask = cv::Mat::ones(result.size(), CV_8U);
+
+		while (true) {
+			cv::minMaxLoc(result, &minVal, &maxVal, &minLoc, &maxLoc, mask);
+			if (maxVal < threshold)
+				break;
+
+			cv::Rect region(maxLoc.x, maxLoc.y, templ.cols, templ.rows);
+			rects.push_back(region);
+
+			// Suppress this region in the mask to avoid duplicate matches
+			region &= cv::Rect(0, 0, mask.cols, mask.rows);
+			mask(region) = 0;
+		}
+
+		// Group similar rectangles
+		if (!rects.empty()) {
+			cv::groupRectangles(rects, weights, 1, 0.5);
+		}
+		return rects;
+	}
+
+	bool initTesseract(tesseract::TessBaseAPI& tess)
+	{
+		std::filesystem::path tessdata_path = get_module_dir() / "tessdata";
+		// use the bundled tessdata when present, otherwise the system installation (Linux packages)
+		std::string tessdata = std::filesystem::exists(tessdata_path) ? tessdata_path.string() : std::string();
+		if (tess.Init(tessdata.empty() ? nullptr : tessdata.c_str(), "eng", tesseract::OEM_LSTM_ONLY) != 0)
+			return false;
+		tess.SetPageSegMode(tesseract::PSM_SPARSE_TEXT);
+		tess.SetVariable("user_defined_dpi", "300");
+		return true;
+	}
+
+	struct TextMatch
+	{
+		cv::Rect rect;
+		std::string text;
+	};
+
+	// Runs OCR on the source and returns the text at the given level that matches the regex. Does not touch Python.
+	std::vector<TextMatch> findText(tesseract::TessBaseAPI& tess, cv::Mat const& original, std::regex const& search_regex, double threshold, int level)
+	{
+		int width = original.cols;
+		int height = original.rows;
+		cv::Mat src = chivel::adjustImage(original);
+
+		tess.SetImage(src.data, src.cols, src.rows, 1, static_cast<int>(src.step));
+		tess.Recognize(nullptr);
+		tesseract::ResultIterator* ri = tess.GetIterator();
+		tesseract::PageIteratorLevel pil = static_cast<tesseract::PageIteratorLevel>(level);
+
+		double scaleX = static_cast<double>(width) / src.cols;
+		double scaleY = static_cast<double>(height) / src.rows;
+
+		std::vector<TextMatch> matches;
+		if (ri != nullptr) {
+			do {
+				const char* word = ri->GetUTF8Text(pil);
+				std::string word_str(word ? word : "");
+				word_str = chivel::trim(word_str);
+				if (word) {
+					delete[] word; // Clean up the allocated memory
+				}
+
+				float conf = ri->Confidence(pil);
+				if (word_str.empty() || conf < threshold * 100.0f) {
+					continue;
+				}
+				// Scale bounding box coordinates
+				int x1, y1, x2, y2;
+				if (ri->BoundingBox(pil, &x1, &y1, &x2, &y2)) {
+					x1 = static_cast<int>(x1 * scaleX);
+					y1 = static_cast<int>(y1 * scaleY);
+					x2 = static_cast<int>(x2 * scaleX);
+					y2 = static_cast<int>(y2 * scaleY);
+					std::smatch word_match;
+					if (std::regex_match(word_str, word_match, search_regex)) {
+						matches.push_back({ cv::Rect(x1, y1, x2 - x1, y2 - y1), word_str });
+					}
+				}
+			} while (ri->Next(pil));
+			delete ri;
+		}
+		return matches;
+	}
+}
+
+// Builds the list of chivel.Match objects returned by the find functions. Rects are moved by offset.
+static PyObject* create_match_list(std::vector<cv::Rect> const& rects, cv::Point offset = cv::Point()) {
+	PyObject* matches = PyList_New(0);
+	if (!matches)
+		return nullptr;
+	for (const auto& r : rects) {
+		PyObject* rect_obj = create_rect(r.x + offset.x, r.y + offset.y, r.width, r.height);
+		if (!rect_obj) {
+			Py_DECREF(matches);
+			return nullptr;
+		}
+		PyObject* match_obj = create_match(rect_obj);
+		Py_DECREF(rect_obj);
+		if (!match_obj || PyList_Append(matches, match_obj) < 0) {
+			Py_XDECREF(match_obj);
+			Py_DECREF(matches);
+			return nullptr;
+		}
+		Py_DECREF(match_obj);
+	}
+	return matches;
+}
+
+static PyObject* create_match_list(std::vector<chivel::TextMatch> const& text_matches, cv::Point offset = cv::Point()) {
+	PyObject* matches = PyList_New(0);
+	if (!matches)
+		return nullptr;
+	for (const auto& m : text_matches) {
+		PyObject* rect_obj = create_rect(m.rect.x + offset.x, m.rect.y + offset.y, m.rect.width, m.rect.height);
+		if (!rect_obj) {
+			Py_DECREF(matches);
+			return nullptr;
+		}
+		PyObject* label_obj = PyUnicode_FromString(m.text.c_str());
+		PyObject* match_obj = label_obj ? create_match(rect_obj, label_obj) : nullptr;
+		Py_DECREF(rect_obj);
+		Py_XDECREF(label_obj);
+		if (!match_obj || PyList_Append(matches, match_obj) < 0) {
+			Py_XDECREF(match_obj);
+			Py_DECREF(matches);
+			return nullptr;
+		}
+		Py_DECREF(match_obj);
+	}
+	return matches;
+}
+
 static PyObject* chivel_find_image(PyObject* self, PyObject* args, PyObject* kwargs) {
    PyObject* source_obj;
    PyObject* search_obj;
    double threshold = 0.8; // Default threshold for match quality
 
-   static const char* kwlist[] = { "source", "search", "threshold" };
+   static const char* kwlist[] = { "source", "search", "threshold", nullptr };
    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "OO|d", (char**)kwlist, &source_obj, &search_obj, &threshold))
        return nullptr;
 
@@ -2287,165 +5374,827 @@ static PyObject* chivel_find_image(PyObject* self, PyObject* args, PyObject* kwa
    }
 
    CHIVELImageObject* source = (CHIVELImageObject*)source_obj;
-   if (!source->mat || source->mat->empty()) {
+   if (source->mat.empty()) {
        PyErr_SetString(PyExc_ValueError, "Source image is empty");
        return nullptr;
    }
 
    CHIVELImageObject* templ = (CHIVELImageObject*)search_obj;
-   if (!templ->mat || templ->mat->empty()) {
+   if (templ->mat.empty()) {
        PyErr_SetString(PyExc_ValueError, "Template image is empty");
        return nullptr;
    }
 
-   cv::Mat result;
-   int result_cols = source->mat->cols - templ->mat->cols + 1;
-   int result_rows = source->mat->rows - templ->mat->rows + 1;
-   if (result_cols <= 0 || result_rows <= 0) {
-       PyErr_SetString(PyExc_ValueError, "Template image is larger than source image");
-       return nullptr;
-   }
-   result.create(result_rows, result_cols, CV_32FC1);
+   if (templ->mat.cols > source->mat.cols || templ->mat.rows > source->mat.rows) {
+       PyErr_SetString(PyExc_ValueError, "Template image is larger than source image");
+       return nullptr;
+   }
+
+   std::vector<cv::Rect> rects = chivel::findImage(source->mat, templ->mat, threshold);
+   return create_match_list(rects, source->origin);
+}
+
+static PyObject* chivel_find_text(PyObject* self, PyObject* args, PyObject* kwargs) {  
+   PyObject* source_obj;
+   const char* search_str;
+   double threshold = 0.0; // Default threshold for match quality
+   int level = tesseract::RIL_PARA; // Default to PARA
+
+   static const char* kwlist[] = { "source", "search", "threshold", "text_level", nullptr };  
+   if (!PyArg_ParseTupleAndKeywords(args, kwargs, "Os|di", (char**)kwlist, &source_obj, &search_str, &threshold, &level))  
+       return nullptr;  
+
+   if (!PyObject_TypeCheck(source_obj, &CHIVELImageType)) {  
+       PyErr_SetString(PyExc_TypeError, "First argument must be a chivel.Image object");  
+       return nullptr;  
+   }  
+
+   CHIVELImageObject* source = (CHIVELImageObject*)source_obj;  
+   if (source->mat.empty()) {  
+       PyErr_SetString(PyExc_ValueError, "Source image is empty");  
+       return nullptr;  
+   }  
+
+   // Perform OCR and search for the text  
+   std::regex search_regex;  
+   if (!compile_search_regex(search_str, search_regex))  
+       return nullptr;  
+
+   tesseract::TessBaseAPI tess;  
+   if (!chivel::initTesseract(tess)) {  
+       PyErr_SetString(PyExc_RuntimeError, "Could not initialize tesseract.");  
+       return nullptr;  
+   }  
+
+   std::vector<chivel::TextMatch> matches = chivel::findText(tess, source->mat, search_regex, threshold, level);  
+   return create_match_list(matches, source->origin);  
+}
+
+// Reads a Color, converted to the color space it is compared in, or a 3-tuple taken as it is
+static bool parse_find_color(PyObject* color_obj, ColorSpace color_space, cv::Scalar& color) {
+	if (PyObject_TypeCheck(color_obj, &CHIVELColorType)) {
+		CHIVELColorObject* col = (CHIVELColorObject*)color_obj;
+		cv::Mat pixel(1, 1, CV_8UC3, cv::Scalar(col->b, col->g, col->r));
+		cv::Mat converted = chivel::convertColorSpace(pixel, COLOR_SPACE_BGR, color_space);
+		color = cv::Scalar::all(0);
+		for (int c = 0; c < converted.channels(); c++)
+			color[c] = converted.ptr<uchar>(0)[c];
+		return true;
+	}
+	int c0, c1, c2;
+	if (PyTuple_Check(color_obj) && PyTuple_Size(color_obj) == 3 && PyArg_ParseTuple(color_obj, "iii", &c0, &c1, &c2)) {
+		color = cv::Scalar(c0, c1, c2);
+		return true;
+	}
+	PyErr_Clear();
+	PyErr_SetString(PyExc_TypeError, "color must be a chivel.Color or 3-tuple of ints");
+	return false;
+}
+
+static PyObject* chivel_find_color(PyObject* self, PyObject* args, PyObject* kwargs) {
+	PyObject* source_obj = nullptr;
+	PyObject* color_obj = nullptr;
+	PyObject* tolerance_obj = nullptr;
+	int min_area = 1;
+	PyObject* region_obj = Py_None;
+	int hsv = 0;
+	static const char* kwlist[] = { "source", "color", "tolerance", "min_area", "region", "hsv", nullptr };
+	if (!PyArg_ParseTupleAndKeywords(args, kwargs, "OO|OiOp", (char**)kwlist, &source_obj, &color_obj, &tolerance_obj, &min_area, &region_obj, &hsv))
+		return nullptr;
+
+	if (!PyObject_TypeCheck(source_obj, &CHIVELImageType)) {
+		PyErr_SetString(PyExc_TypeError, "First argument must be a chivel.Image object");
+		return nullptr;
+	}
+	CHIVELImageObject* source = (CHIVELImageObject*)source_obj;
+	cv::Mat mat = source->mat;
+	if (mat.empty()) {
+		PyErr_SetString(PyExc_ValueError, "Source image is empty");
+		return nullptr;
+	}
+	if (mat.depth() != CV_8U || (mat.channels() != 1 && mat.channels() != 3 && mat.channels() != 4)) {
+		PyErr_SetString(PyExc_ValueError, "find_color searches 8-bit images with 1, 3, or 4 channels");
+		return nullptr;
+	}
+
+	// The same tolerance for every channel, or one each
+	cv::Scalar tolerance = cv::Scalar::all(0);
+	if (tolerance_obj && PyLong_Check(tolerance_obj)) {
+		tolerance = cv::Scalar::all(static_cast<double>(PyLong_AsLong(tolerance_obj)));
+	}
+	else if (tolerance_obj && tolerance_obj != Py_None) {
+		int t0, t1, t2;
+		if (!PyTuple_Check(tolerance_obj) || PyTuple_Size(tolerance_obj) != 3 || !PyArg_ParseTuple(tolerance_obj, "iii", &t0, &t1, &t2)) {
+			PyErr_Clear();
+			PyErr_SetString(PyExc_TypeError, "tolerance must be an int or a 3-tuple of ints");
+			return nullptr;
+		}
+		tolerance = cv::Scalar(t0, t1, t2);
+	}
+	if (PyErr_Occurred())
+		return nullptr;
+	for (int c = 0; c < 3; c++) {
+		if (tolerance[c] < 0) {
+			PyErr_SetString(PyExc_ValueError, "tolerance must not be negative");
+			return nullptr;
+		}
+	}
+
+	cv::Rect region(0, 0, mat.cols, mat.rows);
+	if (region_obj != Py_None) {
+		if (!PyObject_TypeCheck(region_obj, &CHIVELRectType)) {
+			PyErr_SetString(PyExc_TypeError, "region must be a chivel.Rect object");
+			return nullptr;
+		}
+		CHIVELRectObject* r = (CHIVELRectObject*)region_obj;
+		region = cv::Rect(r->x, r->y, r->width, r->height);
+		if (region.width <= 0 || region.height <= 0 || (region & cv::Rect(0, 0, mat.cols, mat.rows)) != region) {
+			PyErr_SetString(PyExc_ValueError, "region is out of image bounds");
+			return nullptr;
+		}
+	}
+
+	// Images of unknown color space are taken to be in OpenCV's usual order
+	ColorSpace current = source->color_space;
+	if (current == COLOR_SPACE_UNKNOWN)
+		current = mat.channels() == 1 ? COLOR_SPACE_GRAY : mat.channels() == 4 ? COLOR_SPACE_BGRA : COLOR_SPACE_BGR;
+	ColorSpace compared = hsv ? COLOR_SPACE_HSV : current;
+	cv::Scalar color;
+	if (!parse_find_color(color_obj, compared, color))
+		return nullptr;
+
+	std::vector<chivel::ColorRegion> regions;
+	std::string error;
+	Py_BEGIN_ALLOW_THREADS
+	try {
+		// Only the region is converted, and never copied otherwise
+		cv::Mat area = chivel::convertColorSpace(mat(region), current, compared);
+		regions = chivel::findColor(area, color, tolerance, compared == COLOR_SPACE_HSV, min_area);
+	}
+	catch (cv::Exception const& e) {
+		error = e.what();
+	}
+	Py_END_ALLOW_THREADS
+	if (!error.empty()) {
+		PyErr_SetString(PyExc_RuntimeError, error.c_str());
+		return nullptr;
+	}
+
+	cv::Point offset = source->origin + region.tl();
+	PyObject* matches = PyList_New(0);
+	if (!matches)
+		return nullptr;
+	for (chivel::ColorRegion const& r : regions) {
+		PyObject* rect_obj = create_rect(r.rect.x + offset.x, r.rect.y + offset.y, r.rect.width, r.rect.height);
+		PyObject* match_obj = rect_obj ? create_match(rect_obj) : nullptr;
+		Py_XDECREF(rect_obj);
+		PyObject* centroid_obj = match_obj ? create_point(cvRound(r.centroid.x) + offset.x, cvRound(r.centroid.y) + offset.y) : nullptr;
+		if (!centroid_obj || PyList_Append(matches, match_obj) < 0) {
+			Py_XDECREF(centroid_obj);
+			Py_XDECREF(match_obj);
+			Py_DECREF(matches);
+			return nullptr;
+		}
+		CHIVELMatchObject* match = (CHIVELMatchObject*)match_obj;
+		match->area = r.area;
+		Py_SETREF(match->centroid, centroid_obj);
+		Py_DECREF(match_obj);
+	}
+	return matches;
+}
+
+static PyObject* chivel_wait_for(PyObject* self, PyObject* args, PyObject* kwargs) {
+	PyObject* target_obj = nullptr;
+	PyObject* region_obj = Py_None;
+	double timeout = 10.0;
+	double interval = 0.05;
+	int display_index = 0;
+	double threshold = -1.0;
+	int level = tesseract::RIL_PARA;
+	static const char* kwlist[] = { "target", "region", "timeout", "interval", "display_index", "threshold", "text_level", nullptr };
+	if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|Oddidi", (char**)kwlist, &target_obj, &region_obj, &timeout, &interval, &display_index, &threshold, &level))
+		return nullptr;
+
+	bool is_text = PyUnicode_Check(target_obj);
+	cv::Mat templ;
+	std::regex search_regex;
+	if (is_text) {
+		const char* search_str = PyUnicode_AsUTF8(target_obj);
+		if (!search_str || !compile_search_regex(search_str, search_regex))
+			return nullptr;
+		if (threshold < 0.0)
+			threshold = 0.0;
+	}
+	else if (PyObject_TypeCheck(target_obj, &CHIVELImageType)) {
+		templ = ((CHIVELImageObject*)target_obj)->mat;
+		if (templ.empty()) {
+			PyErr_SetString(PyExc_ValueError, "Template image is empty");
+			return nullptr;
+		}
+		if (templ.type() != CV_8UC3) {
+			PyErr_SetString(PyExc_ValueError, "Template image must be BGR, like captures");
+			return nullptr;
+		}
+		if (threshold < 0.0)
+			threshold = 0.8;
+	}
+	else {
+		PyErr_SetString(PyExc_TypeError, "target must be a chivel.Image object or a string");
+		return nullptr;
+	}
+
+	cv::Rect region;
+	if (!parse_capture_rect(region_obj, region))
+		return nullptr;
+
+	std::unique_ptr<chivel::CaptureSession> session = chivel::getBackend()->openCapture(display_index, region);
+	if (!session) {
+		PyErr_SetString(PyExc_RuntimeError, "Failed to open a capture of the display");
+		return nullptr;
+	}
+	cv::Size size = session->getFrame().size();
+	if (!is_text && (templ.cols > size.width || templ.rows > size.height)) {
+		PyErr_SetString(PyExc_ValueError, "Template image is larger than the region");
+		return nullptr;
+	}
+
+	using Clock = std::chrono::steady_clock;
+	auto seconds = [](double value) { return std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(std::max(value, 0.0))); };
+	Clock::time_point deadline = Clock::now() + seconds(timeout);
+	Clock::duration period = seconds(interval);
+
+	tesseract::TessBaseAPI tess;
+	std::vector<cv::Rect> found;
+	std::vector<chivel::TextMatch> found_text;
+	const char* error = nullptr;
+	bool interrupted = false;
+
+	Py_BEGIN_ALLOW_THREADS
+	if (is_text && !chivel::initTesseract(tess))
+		error = "Could not initialize tesseract.";
+
+	std::vector<cv::Rect> dirty;
+	while (!error) {
+		Clock::time_point tick = Clock::now();
+
+		// The capture buffer is reused, and only what changed since the last poll is copied into it
+		if (!session->grabDamage(dirty)) {
+			error = "Failed to capture screen";
+			break;
+		}
+
+		// Nothing changed, so nothing new can match. The first grab always reports the whole frame.
+		cv::Mat const& frame = session->getFrame();
+		if (!dirty.empty()) {
+			if (is_text) {
+				found_text = chivel::findText(tess, frame, search_regex, threshold, level);
+				if (!found_text.empty())
+					break;
+			}
+			else {
+				// Every earlier poll came up empty, so only placements that overlap a changed pixel can match now
+				cv::Rect area = dirty[0];
+				for (cv::Rect const& rect : dirty)
+					area |= rect;
+				area.x -= templ.cols - 1;
+				area.y -= templ.rows - 1;
+				area.width += 2 * (templ.cols - 1);
+				area.height += 2 * (templ.rows - 1);
+				area &= cv::Rect(cv::Point(0, 0), size);
+
+				if (area.width >= templ.cols && area.height >= templ.rows) {
+					found = chivel::findImage(frame(area), templ, threshold);
+					for (cv::Rect& rect : found)
+						rect += area.tl();
+					if (!found.empty())
+						break;
+				}
+			}
+		}
+
+		if (Clock::now() >= deadline)
+			break;
+
+		// Let Ctrl+C through between polls
+		Py_BLOCK_THREADS
+		interrupted = PyErr_CheckSignals() < 0;
+		Py_UNBLOCK_THREADS
+		if (interrupted)
+			break;
+
+		std::this_thread::sleep_until(std::min(tick + period, deadline));
+	}
+	Py_END_ALLOW_THREADS
+
+	if (interrupted)
+		return nullptr;
+	if (error) {
+		PyErr_SetString(PyExc_RuntimeError, error);
+		return nullptr;
+	}
+
+	// Matches are relative to the display, not the region, so they can be clicked directly
+	if (is_text)
+		return create_match_list(found_text, region.tl());
+	return create_match_list(found, region.tl());
+}
+
+#pragma region Watcher
+
+namespace chivel
+{
+	struct Watch
+	{
+		int id = 0;
+		cv::Rect region; // In frame coordinates
+		bool isText = false;
+		cv::Mat templ; // Grayscale
+		std::regex search;
+		double threshold = 0.0;
+		int level = 0;
+		std::unique_ptr<tesseract::TessBaseAPI> tess; // Created on first use, one per watch so watches can run in parallel
+		PyObject* callback = nullptr;
+
+		// Results of the latest evaluation
+		bool present = false;
+		bool pending = false; // present changed and the callback has not run yet
+		bool evaluated = false;
+		bool failed = false;
+		std::vector<cv::Rect> rects;
+		std::vector<TextMatch> text;
+
+		double lastSeconds = 0.0;
+		double totalSeconds = 0.0;
+		uint64_t evaluations = 0;
+
+		void evaluate(cv::Mat const& gray)
+		{
+			auto start = std::chrono::steady_clock::now();
+			cv::Mat area = gray(region);
+			bool found = false;
+			if (isText) {
+				if (!tess) {
+					tess = std::make_unique<tesseract::TessBaseAPI>();
+					failed = !initTesseract(*tess);
+				}
+				if (!failed) {
+					text = findText(*tess, area, search, threshold, level);
+					found = !text.empty();
+				}
+			}
+			else {
+				rects = findImage(area, templ, threshold);
+				found = !rects.empty();
+			}
+
+			// Watches start absent, so the first evaluation only counts as a transition when the target is there
+			pending = pending || found != present;
+			present = found;
+			evaluated = true;
+
+			lastSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+			totalSeconds += lastSeconds;
+			evaluations++;
+		}
+	};
+}
+
+typedef struct {
+	PyObject_HEAD
+		chivel::CaptureSession* session;
+	std::vector<std::unique_ptr<chivel::Watch>>* watches;
+	cv::Mat* gray; // The frame converted once, shared by every watch
+	cv::Point origin; // Top left of the captured area, relative to the display
+	double interval;
+	int next_id;
+	bool polling;
+	bool stopping;
+} CHIVELWatcherObject;
+
+static int CHIVELWatcher_traverse(CHIVELWatcherObject* self, visitproc visit, void* arg) {
+	if (self->watches) {
+		for (auto const& watch : *self->watches)
+			Py_VISIT(watch->callback);
+	}
+	return 0;
+}
+
+static int CHIVELWatcher_clear(CHIVELWatcherObject* self) {
+	if (self->watches) {
+		for (auto const& watch : *self->watches)
+			Py_CLEAR(watch->callback);
+	}
+	return 0;
+}
+
+static void CHIVELWatcher_dealloc(CHIVELWatcherObject* self) {
+	PyObject_GC_UnTrack(self);
+	CHIVELWatcher_clear(self);
+	delete self->watches;
+	delete self->gray;
+	delete self->session;
+	Py_TYPE(self)->tp_free((PyObject*)self);
+}
+
+static PyObject* CHIVELWatcher_new(PyTypeObject* type, PyObject* args, PyObject* kwds) {
+	CHIVELWatcherObject* self = (CHIVELWatcherObject*)type->tp_alloc(type, 0);
+	if (self) {
+		self->session = nullptr;
+		self->watches = new std::vector<std::unique_ptr<chivel::Watch>>();
+		self->gray = new cv::Mat();
+		self->origin = cv::Point();
+		self->interval = 0.05;
+		self->next_id = 1;
+		self->polling = false;
+		self->stopping = false;
+	}
+	return (PyObject*)self;
+}
+
+static int CHIVELWatcher_init(CHIVELWatcherObject* self, PyObject* args, PyObject* kwds) {
+	int display_index = 0;
+	PyObject* rect_obj = Py_None;
+	double interval = 0.05;
+	static const char* kwlist[] = { "display_index", "rect", "interval", nullptr };
+	if (!PyArg_ParseTupleAndKeywords(args, kwds, "|iOd", (char**)kwlist, &display_index, &rect_obj, &interval))
+		return -1;
+
+	if (self->session) {
+		PyErr_SetString(PyExc_RuntimeError, "Watcher is already initialized");
+		return -1;
+	}
+
+	cv::Rect rect;
+	if (!parse_capture_rect(rect_obj, rect))
+		return -1;
+
+	std::unique_ptr<chivel::CaptureSession> session = chivel::getBackend()->openCapture(display_index, rect);
+	if (!session) {
+		PyErr_SetString(PyExc_RuntimeError, "Failed to open a capture of the display");
+		return -1;
+	}
+
+	self->session = session.release();
+	self->origin = rect.tl();
+	self->interval = std::max(interval, 0.0);
+	return 0;
+}
+
+static PyObject* CHIVELWatcher_add(CHIVELWatcherObject* self, PyObject* args, PyObject* kwargs) {
+	PyObject* target_obj = nullptr;
+	PyObject* callback = Py_None;
+	PyObject* region_obj = Py_None;
+	double threshold = -1.0;
+	int level = tesseract::RIL_PARA;
+	static const char* kwlist[] = { "target", "callback", "region", "threshold", "text_level", nullptr };
+	if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|OOdi", (char**)kwlist, &target_obj, &callback, &region_obj, &threshold, &level))
+		return nullptr;
+
+	if (!self->session) {
+		PyErr_SetString(PyExc_RuntimeError, "Watcher is not initialized");
+		return nullptr;
+	}
+	if (self->polling) {
+		PyErr_SetString(PyExc_RuntimeError, "Watches cannot be added while the Watcher is evaluating");
+		return nullptr;
+	}
+	if (callback != Py_None && !PyCallable_Check(callback)) {
+		PyErr_SetString(PyExc_TypeError, "callback must be callable");
+		return nullptr;
+	}
+
+	auto watch = std::make_unique<chivel::Watch>();
+	watch->level = level;
+	if (PyUnicode_Check(target_obj)) {
+		const char* search_str = PyUnicode_AsUTF8(target_obj);
+		if (!search_str || !compile_search_regex(search_str, watch->search))
+			return nullptr;
+		watch->isText = true;
+		watch->threshold = threshold < 0.0 ? 0.0 : threshold;
+	}
+	else if (PyObject_TypeCheck(target_obj, &CHIVELImageType)) {
+		cv::Mat const& templ = ((CHIVELImageObject*)target_obj)->mat;
+		if (templ.empty()) {
+			PyErr_SetString(PyExc_ValueError, "Template image is empty");
+			return nullptr;
+		}
+		switch (templ.channels()) {
+		case 1: templ.copyTo(watch->templ); break;
+		case 3: cv::cvtColor(templ, watch->templ, cv::COLOR_BGR2GRAY); break;
+		case 4: cv::cvtColor(templ, watch->templ, cv::COLOR_BGRA2GRAY); break;
+		default:
+			PyErr_SetString(PyExc_ValueError, "Template image must have 1, 3 or 4 channels");
+			return nullptr;
+		}
+		watch->threshold = threshold < 0.0 ? 0.8 : threshold;
+	}
+	else {
+		PyErr_SetString(PyExc_TypeError, "target must be a chivel.Image object or a string");
+		return nullptr;
+	}
+
+	// Regions are given relative to the display, like everything else
+	cv::Rect frame_rect(cv::Point(0, 0), self->session->getFrame().size());
+	cv::Rect region = frame_rect;
+	if (region_obj != Py_None) {
+		if (!parse_capture_rect(region_obj, region))
+			return nullptr;
+		region = (region - self->origin) & frame_rect;
+	}
+	if (region.width < watch->templ.cols || region.height < watch->templ.rows || region.empty()) {
+		PyErr_SetString(PyExc_ValueError, "region must be inside the watched area, and at least as large as the template");
+		return nullptr;
+	}
+	watch->region = region;
+
+	watch->id = self->next_id++;
+	Py_INCREF(callback);
+	watch->callback = callback;
+	int id = watch->id;
+	self->watches->push_back(std::move(watch));
+	return PyLong_FromLong(id);
+}
+
+static PyObject* CHIVELWatcher_remove(CHIVELWatcherObject* self, PyObject* args) {
+	int id = 0;
+	if (!PyArg_ParseTuple(args, "i", &id))
+		return nullptr;
+
+	if (self->polling) {
+		PyErr_SetString(PyExc_RuntimeError, "Watches cannot be removed while the Watcher is evaluating");
+		return nullptr;
+	}
+
+	auto& watches = *self->watches;
+	for (auto it = watches.begin(); it != watches.end(); ++it) {
+		if ((*it)->id == id) {
+			Py_CLEAR((*it)->callback);
+			watches.erase(it);
+			Py_RETURN_NONE;
+		}
+	}
+	PyErr_SetString(PyExc_KeyError, "No watch with that id");
+	return nullptr;
+}
+
+static PyObject* create_watch_matches(CHIVELWatcherObject* self, chivel::Watch const& watch) {
+	cv::Point offset = self->origin + watch.region.tl();
+	if (!watch.present)
+		return PyList_New(0);
+	if (watch.isText)
+		return create_match_list(watch.text, offset);
+	return create_match_list(watch.rects, offset);
+}
+
+// Captures once and evaluates every watch whose region changed. Returns the ids that changed state, or nullptr on error.
+static PyObject* watcher_poll(CHIVELWatcherObject* self) {
+	if (!self->session) {
+		PyErr_SetString(PyExc_RuntimeError, "Watcher is not initialized");
+		return nullptr;
+	}
+	if (self->polling) {
+		PyErr_SetString(PyExc_RuntimeError, "Watcher is already evaluating");
+		return nullptr;
+	}
+
+	chivel::CaptureSession* session = self->session;
+	std::vector<chivel::Watch*> due;
+	bool grabbed;
+	self->polling = true;
+	Py_BEGIN_ALLOW_THREADS
+	std::vector<cv::Rect> dirty;
+	grabbed = session->grabDamage(dirty);
+	if (grabbed) {
+		// One conversion for every watch. On a still screen the last one is still current.
+		if (!dirty.empty())
+			cv::cvtColor(session->getFrame(), *self->gray, cv::COLOR_BGR2GRAY);
+
+		// A watch only needs another look when something inside its region changed,
+		// or when it was added after the last look and has never been evaluated
+		for (auto const& watch : *self->watches) {
+			bool touched = !watch->evaluated;
+			for (size_t i = 0; i < dirty.size() && !touched; i++)
+				touched = (dirty[i] & watch->region).area() > 0;
+			if (touched)
+				due.push_back(watch.get());
+		}
+
+		cv::Mat const& gray = *self->gray;
+		cv::parallel_for_(cv::Range(0, static_cast<int>(due.size())), [&](cv::Range const& range) {
+			for (int i = range.start; i < range.end; i++)
+				due[i]->evaluate(gray);
+		});
+	}
+	Py_END_ALLOW_THREADS
+	self->polling = false;
+
+	if (!grabbed) {
+		PyErr_SetString(PyExc_RuntimeError, "Failed to capture screen");
+		return nullptr;
+	}
 
-   cv::matchTemplate(*(source->mat), *(templ->mat), result, cv::TM_CCOEFF_NORMED);
+	// Collect everything first, since callbacks may add or remove watches
+	struct Call {
+		PyObject* callback;
+		PyObject* args;
+	};
+	std::vector<Call> calls;
+	auto release_calls = [&calls]() {
+		for (Call& call : calls) {
+			Py_DECREF(call.callback);
+			Py_DECREF(call.args);
+		}
+	};
 
-   std::vector<cv::Rect> rects;
-   std::vector<int> weights;
+	PyObject* changed = PyList_New(0);
+	if (!changed)
+		return nullptr;
+	for (chivel::Watch* watch : due) {
+		if (watch->failed) {
+			PyErr_SetString(PyExc_RuntimeError, "Could not initialize tesseract.");
+			break;
+		}
+		if (!watch->pending)
+			continue;
+		watch->pending = false;
+
+		PyObject* id = PyLong_FromLong(watch->id);
+		int appended = id ? PyList_Append(changed, id) : -1;
+		Py_XDECREF(id);
+		if (appended < 0)
+			break;
 
-   double minVal, maxVal;
-   cv::Point minLoc, maxLoc;
-   cv::Mat mask = cv::Mat::ones(result.size(), CV_8U);
+		if (watch->callback != Py_None) {
+			PyObject* matches = create_watch_matches(self, *watch);
+			PyObject* callback_args = matches ? Py_BuildValue("(iN)", watch->id, matches) : nullptr;
+			if (!callback_args)
+				break;
+			Py_INCREF(watch->callback);
+			calls.push_back({ watch->callback, callback_args });
+		}
+	}
+	if (PyErr_Occurred()) {
+		release_calls();
+		Py_DECREF(changed);
+		return nullptr;
+	}
 
-   while (true) {
-       cv::minMaxLoc(result, &minVal, &maxVal, &minLoc, &maxLoc, mask);
-       if (maxVal < threshold)
-           break;
+	// Callbacks run in the order the watches were added. The first exception stops the rest.
+	bool failed = false;
+	for (Call& call : calls) {
+		if (failed)
+			break;
+		PyObject* result = PyObject_CallObject(call.callback, call.args);
+		failed = !result;
+		Py_XDECREF(result);
+	}
+	release_calls();
+	if (failed) {
+		Py_DECREF(changed);
+		return nullptr;
+	}
+	return changed;
+}
 
-       int x = maxLoc.x;
-       int y = maxLoc.y;
-       int w = templ->mat->cols;
-       int h = templ->mat->rows;
+static PyObject* CHIVELWatcher_poll(CHIVELWatcherObject* self, PyObject* /*unused*/) {
+	return watcher_poll(self);
+}
 
-       rects.push_back(cv::Rect(x, y, w, h));
+static PyObject* CHIVELWatcher_run(CHIVELWatcherObject* self, PyObject* args, PyObject* kwargs) {
+	PyObject* timeout_obj = Py_None;
+	static const char* kwlist[] = { "timeout", nullptr };
+	if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|O", (char**)kwlist, &timeout_obj))
+		return nullptr;
 
-       // Suppress this region in the mask to avoid duplicate matches
-       cv::Rect region(x, y, w, h);
-       region &= cv::Rect(0, 0, mask.cols, mask.rows);
-       mask(region) = 0;
-   }
+	double timeout = -1.0; // forever
+	if (timeout_obj != Py_None) {
+		timeout = PyFloat_AsDouble(timeout_obj);
+		if (timeout == -1.0 && PyErr_Occurred())
+			return nullptr;
+	}
 
-   // Group similar rectangles
-   if (!rects.empty()) {
-       cv::groupRectangles(rects, weights, 1, 0.5);
-   }
+	using Clock = std::chrono::steady_clock;
+	auto seconds = [](double value) { return std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(std::max(value, 0.0))); };
+	Clock::time_point deadline = Clock::now() + seconds(timeout);
+	Clock::duration period = seconds(self->interval);
 
-   PyObject* matches = PyList_New(0);
-   for (const auto& r : rects) {
-       // Create a chivel.Rect object
-       PyObject* rect_obj = create_rect(r.x, r.y, r.width, r.height);
+	self->stopping = false;
+	while (!self->stopping) {
+		Clock::time_point tick = Clock::now();
+		PyObject* changed = watcher_poll(self);
+		if (!changed)
+			return nullptr;
+		Py_DECREF(changed);
 
-       // Create a chivel.Match object
-       PyObject* match_obj = create_match(rect_obj);
+		if (PyErr_CheckSignals() < 0)
+			return nullptr;
+		Clock::time_point wake = tick + period;
+		if (timeout >= 0.0) {
+			if (Clock::now() >= deadline)
+				break;
+			wake = std::min(wake, deadline);
+		}
 
-       PyList_Append(matches, match_obj);
-       Py_DECREF(rect_obj);
-       Py_DECREF(match_obj);
-   }
-   return matches;
+		Py_BEGIN_ALLOW_THREADS
+		std::this_thread::sleep_until(wake);
+		Py_END_ALLOW_THREADS
+	}
+
+	Py_RETURN_NONE;
 }
 
-static PyObject* chivel_find_text(PyObject* self, PyObject* args, PyObject* kwargs) {  
-   PyObject* source_obj;
-   const char* search_str;
-   double threshold = 0.0; // Default threshold for match quality
-   int level = tesseract::RIL_PARA; // Default to PARA
+static PyObject* CHIVELWatcher_stop(CHIVELWatcherObject* self, PyObject* /*unused*/) {
+	self->stopping = true;
+	Py_RETURN_NONE;
+}
 
-   static const char* kwlist[] = { "source", "search", "threshold", "text_level", nullptr };  
-   if (!PyArg_ParseTupleAndKeywords(args, kwargs, "Os|di", (char**)kwlist, &source_obj, &search_str, &threshold, &level))  
-       return nullptr;  
+static PyObject* CHIVELWatcher_get_matches(CHIVELWatcherObject* self, PyObject* args) {
+	int id = 0;
+	if (!PyArg_ParseTuple(args, "i", &id))
+		return nullptr;
 
-   if (!PyObject_TypeCheck(source_obj, &CHIVELImageType)) {  
-       PyErr_SetString(PyExc_TypeError, "First argument must be a chivel.Image object");  
-       return nullptr;  
-   }  
+	for (auto const& watch : *self->watches) {
+		if (watch->id == id)
+			return create_watch_matches(self, *watch);
+	}
+	PyErr_SetString(PyExc_KeyError, "No watch with that id");
+	return nullptr;
+}
 
-   CHIVELImageObject* source = (CHIVELImageObject*)source_obj;  
-   if (!source->mat || source->mat->empty()) {  
-       PyErr_SetString(PyExc_ValueError, "Source image is empty");  
-       return nullptr;  
-   }  
+static PyObject* CHIVELWatcher_get_timings(CHIVELWatcherObject* self, PyObject* /*unused*/) {
+	PyObject* timings = PyDict_New();
+	if (!timings)
+		return nullptr;
 
-   // Perform OCR and search for the text  
-   std::string search_trimmed = chivel::trim(search_str);  
-   std::regex search_regex(search_trimmed);  
+	for (auto const& watch : *self->watches) {
+		double average = watch->evaluations ? watch->totalSeconds / watch->evaluations : 0.0;
+		PyObject* key = PyLong_FromLong(watch->id);
+		PyObject* value = Py_BuildValue("(ddK)", watch->lastSeconds, average, static_cast<unsigned long long>(watch->evaluations));
+		if (!key || !value || PyDict_SetItem(timings, key, value) < 0) {
+			Py_XDECREF(key);
+			Py_XDECREF(value);
+			Py_DECREF(timings);
+			return nullptr;
+		}
+		Py_DECREF(key);
+		Py_DECREF(value);
+	}
+	return timings;
+}
 
-   cv::Mat original = *(source->mat);  
-   int width = original.cols;  
-   int height = original.rows;  
-   cv::Mat src = chivel::adjustImage(original);  
+static PyMethodDef CHIVELWatcher_methods[] = {
+	{"add", (PyCFunction)CHIVELWatcher_add, METH_VARARGS | METH_KEYWORDS, "Watch for an image or text, optionally within a region, and get the id of the watch"},
+	{"remove", (PyCFunction)CHIVELWatcher_remove, METH_VARARGS, "Stop a watch by id"},
+	{"poll", (PyCFunction)CHIVELWatcher_poll, METH_NOARGS, "Capture once, evaluate the watches and call back the ones that appeared or disappeared"},
+	{"run", (PyCFunction)CHIVELWatcher_run, METH_VARARGS | METH_KEYWORDS, "Poll every interval until stop() is called or the timeout passes"},
+	{"stop", (PyCFunction)CHIVELWatcher_stop, METH_NOARGS, "Make run() return after the current poll"},
+	{"get_matches", (PyCFunction)CHIVELWatcher_get_matches, METH_VARARGS, "Get the current matches of a watch"},
+	{"get_timings", (PyCFunction)CHIVELWatcher_get_timings, METH_NOARGS, "Get {id: (last_seconds, average_seconds, evaluations)} for every watch"},
+	{nullptr, nullptr, 0, nullptr}
+};
 
-   tesseract::TessBaseAPI tess;  
-   std::filesystem::path tessdata_path = get_module_dir() / "tessdata";  
-   if (tess.Init(tessdata_path.string().c_str(), "eng", tesseract::OEM_LSTM_ONLY) != 0) {  
-       PyErr_SetString(PyExc_RuntimeError, "Could not initialize tesseract.");  
-       return nullptr;  
-   }  
-   tess.SetPageSegMode(tesseract::PSM_SPARSE_TEXT);  
-   tess.SetVariable("user_defined_dpi", "300");  
-   tess.SetImage(src.data, src.cols, src.rows, 1, static_cast<int>(src.step));  
-   tess.Recognize(nullptr);  
-   tesseract::ResultIterator* ri = tess.GetIterator();  
-   tesseract::PageIteratorLevel pil = static_cast<tesseract::PageIteratorLevel>(level);  
-
-   double scaleX = static_cast<double>(width) / src.cols;  
-   double scaleY = static_cast<double>(height) / src.rows;  
-
-   PyObject* matches = PyList_New(0);  
-   if (ri != nullptr) {  
-       do {  
-           const char* word = ri->GetUTF8Text(pil);  
-           std::string word_str(word ? word : "");  
-           word_str = chivel::trim(word_str);  
-           if (word) {  
-               delete[] word; // Clean up the allocated memory  
-           }  
-
-           float conf = ri->Confidence(pil);  
-           if (word_str.empty() || conf < threshold * 100.0f) {  
-               continue;  
-           }  
-           // Scale bounding box coordinates  
-           int x1, y1, x2, y2;  
-           if (ri->BoundingBox(pil, &x1, &y1, &x2, &y2)) {  
-               x1 = static_cast<int>(x1 * scaleX);  
-               y1 = static_cast<int>(y1 * scaleY);  
-               x2 = static_cast<int>(x2 * scaleX);  
-               y2 = static_cast<int>(y2 * scaleY);  
-               std::smatch word_match;  
-               if (std::regex_match(word_str, word_match, search_regex)) {  
-                   // Create a chivel.Rect object  
-                   PyObject* rect_obj = create_rect(x1, y1, x2 - x1, y2 - y1);  
-                   if (!rect_obj) {  
-                       return nullptr; // Error creating rect object  
-                   }  
-
-                   // Create a chivel.Match object  
-                   PyObject* match_obj = create_match(rect_obj, PyUnicode_FromString(word_str.c_str()));  
-                   if (!match_obj) {  
-                       Py_DECREF(rect_obj);  
-                       return nullptr; // Error creating match object  
-                   }  
-
-                   PyList_Append(matches, match_obj);  
-                   Py_DECREF(rect_obj);  
-                   Py_DECREF(match_obj);  
-               }  
-           }  
-       } while (ri->Next(pil));  
-   }  
+static PyTypeObject CHIVELWatcherType = {
+	PyVarObject_HEAD_INIT(NULL, 0)
+	"chivel.Watcher",
+	sizeof(CHIVELWatcherObject),
+	0,
+	(destructor)CHIVELWatcher_dealloc,
+	0,
+	0,
+	0,
+	0,
+	0,
+	0,
+	0,
+	0,
+	0,
+	0,
+	0,
+	0,
+	0,
+	0,
+	Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE | Py_TPFLAGS_HAVE_GC,
+	"Chivel Watcher objects",
+	(traverseproc)CHIVELWatcher_traverse,
+	(inquiry)CHIVELWatcher_clear,
+	0,
+	0,
+	0,
+	0,
+	CHIVELWatcher_methods,
+	0,
+	0,
+	0,
+	0,
+	0,
+	0,
+	0,
+	(initproc)CHIVELWatcher_init,
+	0,
+	CHIVELWatcher_new,
+};
 
-   return matches;  
-}
+#pragma endregion
 
 static PyObject* chivel_mouse_move(PyObject* self, PyObject* args, PyObject* kwds) {
 	PyObject* pos_obj = nullptr;
@@ -2456,22 +6205,14 @@ static PyObject* chivel_mouse_move(PyObject* self, PyObject* args, PyObject* kwd
 		return nullptr;
 
 	// Get monitor info
-	DISPLAY_DEVICE dd;
-	dd.cb = sizeof(dd);
-	if (!EnumDisplayDevices(NULL, display_index, &dd, 0)) {
+	chivel::DisplayInfo display;
+	if (!chivel::getBackend()->getDisplay(display_index, display)) {
 		PyErr_SetString(PyExc_ValueError, "Invalid monitor index");
 		return nullptr;
 	}
 
-	DEVMODE dm;
-	dm.dmSize = sizeof(dm);
-	if (!EnumDisplaySettings(dd.DeviceName, ENUM_CURRENT_SETTINGS, &dm)) {
-		PyErr_SetString(PyExc_RuntimeError, "Failed to get monitor settings");
-		return nullptr;
-	}
-
-	int mon_x = dm.dmPosition.x;
-	int mon_y = dm.dmPosition.y;
+	int mon_x = display.x;
+	int mon_y = display.y;
 
 	int x = 0, y = 0;
 	bool found = false;
@@ -2511,7 +6252,7 @@ static PyObject* chivel_mouse_move(PyObject* self, PyObject* args, PyObject* kwd
 	int abs_x = mon_x + x;
 	int abs_y = mon_y + y;
 
-	if (!chivel::setCursorPosition(abs_x, abs_y)) {
+	if (!chivel::getBackend()->setCursorPosition(abs_x, abs_y)) {
 		PyErr_SetString(PyExc_RuntimeError, "Failed to move mouse cursor");
 		return nullptr;
 	}
@@ -2531,42 +6272,15 @@ static PyObject* chivel_mouse_click(PyObject* self, PyObject* args, PyObject* kw
 		return nullptr;
 	}
 
-	INPUT inputs[2] = {};
-	inputs[0].type = INPUT_MOUSE;
-	inputs[1].type = INPUT_MOUSE;
-
-	switch (button) {
-	case 0: // Left
-		inputs[0].mi.dwFlags = MOUSEEVENTF_LEFTDOWN;
-		inputs[1].mi.dwFlags = MOUSEEVENTF_LEFTUP;
-		break;
-	case 1: // Right
-		inputs[0].mi.dwFlags = MOUSEEVENTF_RIGHTDOWN;
-		inputs[1].mi.dwFlags = MOUSEEVENTF_RIGHTUP;
-		break;
-	case 2: // Middle
-		inputs[0].mi.dwFlags = MOUSEEVENTF_MIDDLEDOWN;
-		inputs[1].mi.dwFlags = MOUSEEVENTF_MIDDLEUP;
-		break;
-	case 3: // X1 (Button 4)
-		inputs[0].mi.dwFlags = MOUSEEVENTF_XDOWN;
-		inputs[1].mi.dwFlags = MOUSEEVENTF_XUP;
-		inputs[0].mi.mouseData = XBUTTON1;
-		inputs[1].mi.mouseData = XBUTTON1;
-		break;
-	case 4: // X2 (Button 5)
-		inputs[0].mi.dwFlags = MOUSEEVENTF_XDOWN;
-		inputs[1].mi.dwFlags = MOUSEEVENTF_XUP;
-		inputs[0].mi.mouseData = XBUTTON2;
-		inputs[1].mi.mouseData = XBUTTON2;
-		break;
-	default:
+	if (button < BUTTON_LEFT || button > BUTTON_X2) {
 		PyErr_SetString(PyExc_ValueError, "Button must be 1 (left), 2 (right), 3 (middle), 4 (X1), or 5 (X2)");
 		return nullptr;
 	}
 
+	std::shared_ptr<chivel::Backend> backend = chivel::getBackend();
 	for (int i = 0; i < count; ++i) {
-		if (SendInput(2, inputs, sizeof(INPUT)) != 2) {
+		if (!backend->sendMouseButton(static_cast<MouseButton>(button), true) ||
+			!backend->sendMouseButton(static_cast<MouseButton>(button), false)) {
 			PyErr_SetString(PyExc_RuntimeError, "Failed to send mouse click event");
 			return nullptr;
 		}
@@ -2581,33 +6295,12 @@ static PyObject* chivel_mouse_down(PyObject* self, PyObject* args, PyObject* kwd
 	if (!PyArg_ParseTupleAndKeywords(args, kwds, "|i", (char**)kwlist, &button))
 		return nullptr;
 
-	INPUT input = {};
-	input.type = INPUT_MOUSE;
-
-	switch (button) {
-	case 0: // Left
-		input.mi.dwFlags = MOUSEEVENTF_LEFTDOWN;
-		break;
-	case 1: // Right
-		input.mi.dwFlags = MOUSEEVENTF_RIGHTDOWN;
-		break;
-	case 2: // Middle
-		input.mi.dwFlags = MOUSEEVENTF_MIDDLEDOWN;
-		break;
-	case 3: // X1 (Button 4)
-		input.mi.dwFlags = MOUSEEVENTF_XDOWN;
-		input.mi.mouseData = XBUTTON1;
-		break;
-	case 4: // X2 (Button 5)
-		input.mi.dwFlags = MOUSEEVENTF_XDOWN;
-		input.mi.mouseData = XBUTTON2;
-		break;
-	default:
+	if (button < BUTTON_LEFT || button > BUTTON_X2) {
 		PyErr_SetString(PyExc_ValueError, "Button must be 1 (left), 2 (right), 3 (middle), 4 (X1), or 5 (X2)");
 		return nullptr;
 	}
 
-	if (SendInput(1, &input, sizeof(INPUT)) != 1) {
+	if (!chivel::getBackend()->sendMouseButton(static_cast<MouseButton>(button), true)) {
 		PyErr_SetString(PyExc_RuntimeError, "Failed to send mouse down event");
 		return nullptr;
 	}
@@ -2621,33 +6314,12 @@ static PyObject* chivel_mouse_up(PyObject* self, PyObject* args, PyObject* kwds)
 	if (!PyArg_ParseTupleAndKeywords(args, kwds, "|i", (char**)kwlist, &button))
 		return nullptr;
 
-	INPUT input = {};
-	input.type = INPUT_MOUSE;
-
-	switch (button) {
-	case 0: // Left
-		input.mi.dwFlags = MOUSEEVENTF_LEFTUP;
-		break;
-	case 1: // Right
-		input.mi.dwFlags = MOUSEEVENTF_RIGHTUP;
-		break;
-	case 2: // Middle
-		input.mi.dwFlags = MOUSEEVENTF_MIDDLEUP;
-		break;
-	case 3: // X1 (Button 4)
-		input.mi.dwFlags = MOUSEEVENTF_XUP;
-		input.mi.mouseData = XBUTTON1;
-		break;
-	case 4: // X2 (Button 5)
-		input.mi.dwFlags = MOUSEEVENTF_XUP;
-		input.mi.mouseData = XBUTTON2;
-		break;
-	default:
+	if (button < BUTTON_LEFT || button > BUTTON_X2) {
 		PyErr_SetString(PyExc_ValueError, "Button must be 1 (left), 2 (right), 3 (middle), 4 (X1), or 5 (X2)");
 		return nullptr;
 	}
 
-	if (SendInput(1, &input, sizeof(INPUT)) != 1) {
+	if (!chivel::getBackend()->sendMouseButton(static_cast<MouseButton>(button), false)) {
 		PyErr_SetString(PyExc_RuntimeError, "Failed to send mouse up event");
 		return nullptr;
 	}
@@ -2668,28 +6340,9 @@ static PyObject* chivel_mouse_scroll(PyObject* self, PyObject* args, PyObject* k
 		return nullptr;
 	}
 
-	// Each wheel "notch" is WHEEL_DELTA (120)
-	INPUT input = {};
-	input.type = INPUT_MOUSE;
-
-	// Vertical scroll
-	if (vertical != 0) {
-		input.mi.dwFlags = MOUSEEVENTF_WHEEL;
-		input.mi.mouseData = vertical * WHEEL_DELTA;
-		if (SendInput(1, &input, sizeof(INPUT)) != 1) {
-			PyErr_SetString(PyExc_RuntimeError, "Failed to send vertical mouse wheel event");
-			return nullptr;
-		}
-	}
-
-	// Horizontal scroll
-	if (horizontal != 0) {
-		input.mi.dwFlags = MOUSEEVENTF_HWHEEL;
-		input.mi.mouseData = horizontal * WHEEL_DELTA;
-		if (SendInput(1, &input, sizeof(INPUT)) != 1) {
-			PyErr_SetString(PyExc_RuntimeError, "Failed to send horizontal mouse wheel event");
-			return nullptr;
-		}
+	if (!chivel::getBackend()->sendMouseScroll(vertical, horizontal)) {
+		PyErr_SetString(PyExc_RuntimeError, "Failed to send mouse wheel event");
+		return nullptr;
 	}
 
 	Py_RETURN_NONE;
@@ -2707,39 +6360,35 @@ static PyObject* chivel_type(PyObject* self, PyObject* args, PyObject* kwds) {
 		return nullptr;
 	}
 
-	// Convert to wide string for Unicode support
-	int wlen = MultiByteToWideChar(CP_UTF8, 0, text, -1, nullptr, 0);
-	if (wlen <= 1) {
+	// Convert to code points for Unicode support
+	PyObject* unicode = PyUnicode_FromString(text);
+	if (!unicode)
+		return nullptr;
+	Py_ssize_t length = PyUnicode_GetLength(unicode);
+	if (length < 1) {
+		Py_DECREF(unicode);
 		PyErr_SetString(PyExc_ValueError, "Failed to convert text to wide string");
 		return nullptr;
 	}
-	std::wstring wtext(wlen - 1, L'\0');
-	MultiByteToWideChar(CP_UTF8, 0, text, -1, &wtext[0], wlen);
+	Py_UCS4* codepoints = PyUnicode_AsUCS4Copy(unicode);
+	Py_DECREF(unicode);
+	if (!codepoints)
+		return nullptr;
 
-	DWORD ms = static_cast<DWORD>(wait * 1000.0);
-	for (size_t i = 0; i < wtext.size(); i++)
+	std::shared_ptr<chivel::Backend> backend = chivel::getBackend();
+	std::chrono::duration<double> delay(wait);
+	for (Py_ssize_t i = 0; i < length; i++)
 	{
-		wchar_t ch = wtext[i];
-
-		// Prepare a KEYBDINPUT for the character
-		INPUT input[2] = {};
-		input[0].type = INPUT_KEYBOARD;
-		input[0].ki.wVk = 0;
-		input[0].ki.wScan = ch;
-		input[0].ki.dwFlags = KEYEVENTF_UNICODE;
-
-		input[1] = input[0];
-		input[1].ki.dwFlags = KEYEVENTF_UNICODE | KEYEVENTF_KEYUP;
-
 		// Send key down and key up
-		SendInput(2, input, sizeof(INPUT));
+		backend->sendCharacter(static_cast<char32_t>(codepoints[i]));
 
 		// Wait between keys
-		if (i < wtext.size() - 1) // Don't wait after the last character
+		if (i < length - 1) // Don't wait after the last character
 		{
-			Sleep(ms);
+			std::this_thread::sleep_for(delay);
 		}
 	}
+	PyMem_Free(codepoints);
 
 	Py_RETURN_NONE;
 }
@@ -2760,21 +6409,13 @@ static PyObject* chivel_key_click(PyObject* self, PyObject* args, PyObject* kwds
 		return nullptr;
 	}
 
-	INPUT inputs[2] = {};
-	inputs[0].type = INPUT_KEYBOARD;
-	inputs[0].ki.wVk = key;
-	inputs[0].ki.dwFlags = 0; // key down
-
-	inputs[1].type = INPUT_KEYBOARD;
-	inputs[1].ki.wVk = key;
-	inputs[1].ki.dwFlags = KEYEVENTF_KEYUP; // key up
-
+	std::shared_ptr<chivel::Backend> backend = chivel::getBackend();
 	for (int i = 0; i < count; ++i) {
-		if (SendInput(1, &inputs[0], sizeof(INPUT)) != 1) {
+		if (!backend->sendKey(key, true)) {
 			PyErr_SetString(PyExc_RuntimeError, "Failed to send key down event");
 			return nullptr;
 		}
-		if (SendInput(1, &inputs[1], sizeof(INPUT)) != 1) {
+		if (!backend->sendKey(key, false)) {
 			PyErr_SetString(PyExc_RuntimeError, "Failed to send key up event");
 			return nullptr;
 		}
@@ -2793,12 +6434,7 @@ static PyObject* chivel_key_down(PyObject* self, PyObject* args) {
 		return nullptr;
 	}
 
-	INPUT input = {};
-	input.type = INPUT_KEYBOARD;
-	input.ki.wVk = key;
-	input.ki.dwFlags = 0; // key down
-
-	if (SendInput(1, &input, sizeof(INPUT)) != 1) {
+	if (!chivel::getBackend()->sendKey(key, true)) {
 		PyErr_SetString(PyExc_RuntimeError, "Failed to send key down event");
 		return nullptr;
 	}
@@ -2816,12 +6452,7 @@ static PyObject* chivel_key_up(PyObject* self, PyObject* args) {
 		return nullptr;
 	}
 
-	INPUT input = {};
-	input.type = INPUT_KEYBOARD;
-	input.ki.wVk = key;
-	input.ki.dwFlags = KEYEVENTF_KEYUP; // key up
-
-	if (SendInput(1, &input, sizeof(INPUT)) != 1) {
+	if (!chivel::getBackend()->sendKey(key, false)) {
 		PyErr_SetString(PyExc_RuntimeError, "Failed to send key up event");
 		return nullptr;
 	}
@@ -2839,8 +6470,7 @@ static PyObject* chivel_wait(PyObject* self, PyObject* args) {
 		return nullptr;
 	}
 
-	DWORD ms = static_cast<DWORD>(seconds * 1000.0);
-	Sleep(ms);
+	std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
 
 	Py_RETURN_NONE;
 }
@@ -2848,7 +6478,7 @@ static PyObject* chivel_wait(PyObject* self, PyObject* args) {
 static PyObject* chivel_record(PyObject* self, PyObject* args, PyObject* kwds) {
 	const char* output_path = "recording.py";
 	int simplify = SIMPLIFY_ALL;
-	int stop_key = VK_F12; // Default to F12
+	int stop_key = KEY_F12; // Default to F12
 	static const char* kwlist[] = { "output_path", "simplify", "stop_key", nullptr };
 	if (!PyArg_ParseTupleAndKeywords(args, kwds, "|sip", (char**)kwlist, &output_path, &simplify, &stop_key))
 		return nullptr;
@@ -2894,7 +6524,7 @@ static PyObject* chivel_play(PyObject* self, PyObject* args) {
 
 	bool ok = chivel::run_python_play_function(script_path, play_func_name);
 	if (!ok) {
-		PyErr_SetString(PyExc_RuntimeError, std::format("Failed to run {}() in the given script.", play_func_name).c_str());
+		PyErr_SetString(PyExc_RuntimeError, ("Failed to run " + std::string(play_func_name) + "() in the given script.").c_str());
 		return nullptr;
 	}
 
@@ -2903,46 +6533,31 @@ static PyObject* chivel_play(PyObject* self, PyObject* args) {
 
 static PyObject* chivel_get_location(PyObject* self, PyObject* args) {
 	// Get mouse position in screen coordinates
-	POINT pt = chivel::getCursorPosition();
+	int x = 0, y = 0;
+	std::shared_ptr<chivel::Backend> backend = chivel::getBackend();
+	backend->getCursorPosition(x, y);
 
 	// Find which monitor contains the point
-	struct MonitorSearch {
-		POINT pt;
-		int index;
-		int found;
-		int x, y;
-	} search = { pt, 0, -1, 0, 0 };
-
-	EnumDisplayMonitors(nullptr, nullptr, chivel::monitor_enum_proc, reinterpret_cast<LPARAM>(&search));
+	int display_index = backend->findDisplay(x, y);
 
-	PyObject* point_obj = create_point(pt.x, pt.y);
+	PyObject* point_obj = create_point(x, y);
 	if (!point_obj)
 		return nullptr;
 
-	int display_index = search.found;
-
 	return Py_BuildValue("(Oi)", point_obj, display_index);
 }
 
 static PyObject* chivel_mouse_get_display(PyObject* self, PyObject* args) {
 	// Get mouse position in screen coordinates
-	POINT pt;
-	if (!GetCursorPos(&pt)) {
+	int x = 0, y = 0;
+	std::shared_ptr<chivel::Backend> backend = chivel::getBackend();
+	if (!backend->getCursorPosition(x, y)) {
 		PyErr_SetString(PyExc_RuntimeError, "Failed to get mouse position");
 		return nullptr;
 	}
 
 	// Find which monitor contains the point
-	struct MonitorSearch {
-		POINT pt;
-		int index;
-		int found;
-		int x, y;
-	} search = { pt, 0, -1, 0, 0 };
-
-	EnumDisplayMonitors(nullptr, nullptr, chivel::monitor_enum_proc, reinterpret_cast<LPARAM>(&search));
-
-	return PyLong_FromLong(search.found);
+	return PyLong_FromLong(backend->findDisplay(x, y));
 }
 
 static PyObject* chivel_display_get_rect(PyObject* self, PyObject* args) {
@@ -2950,36 +6565,185 @@ static PyObject* chivel_display_get_rect(PyObject* self, PyObject* args) {
 	if (!PyArg_ParseTuple(args, "|i", &display_index))
 		return nullptr;
 
-	DISPLAY_DEVICE dd;
-	dd.cb = sizeof(dd);
-	if (!EnumDisplayDevices(NULL, display_index, &dd, 0)) {
+	chivel::DisplayInfo display;
+	if (!chivel::getBackend()->getDisplay(display_index, display)) {
 		PyErr_SetString(PyExc_ValueError, "Invalid display index");
 		return nullptr;
 	}
 
-	DEVMODE dm;
-	dm.dmSize = sizeof(dm);
-	if (!EnumDisplaySettings(dd.DeviceName, ENUM_CURRENT_SETTINGS, &dm)) {
-		PyErr_SetString(PyExc_RuntimeError, "Failed to get display settings");
+	// Return a chivel.Rect object instead of a tuple
+	return create_rect(display.x, display.y, display.width, display.height);
+}
+
+static PyObject* chivel_window_list(PyObject* self, PyObject* /*unused*/) {
+	std::vector<chivel::WindowInfo> windows = chivel::getBackend()->getWindows();
+	PyObject* list = PyList_New(static_cast<Py_ssize_t>(windows.size()));
+	if (!list)
 		return nullptr;
+
+	for (size_t i = 0; i < windows.size(); i++) {
+		chivel::WindowInfo const& window = windows[i];
+		// Titles can hold anything, so replace bytes that are not valid UTF-8 rather than failing
+		PyObject* item = Py_BuildValue("(KNN)", static_cast<unsigned long long>(window.handle),
+			PyUnicode_DecodeUTF8(window.title.data(), static_cast<Py_ssize_t>(window.title.size()), "replace"),
+			PyUnicode_DecodeUTF8(window.className.data(), static_cast<Py_ssize_t>(window.className.size()), "replace"));
+		if (!item) {
+			Py_DECREF(list);
+			return nullptr;
+		}
+		PyList_SET_ITEM(list, static_cast<Py_ssize_t>(i), item);
 	}
+	return list;
+}
 
-	// dmPosition is relative to the primary display
-	int x = dm.dmPosition.x;
-	int y = dm.dmPosition.y;
-	int width = dm.dmPelsWidth;
-	int height = dm.dmPelsHeight;
+static PyObject* chivel_window_find(PyObject* self, PyObject* args, PyObject* kwargs) {
+	const char* title_str = nullptr;
+	const char* class_str = nullptr;
+	static const char* kwlist[] = { "title", "class_name", nullptr };
+	if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|zz", (char**)kwlist, &title_str, &class_str))
+		return nullptr;
 
-	// Return a chivel.Rect object instead of a tuple
-	PyObject* rect_obj = CHIVELRect_new(&CHIVELRectType, nullptr, nullptr);
-	if (!rect_obj)
+	std::regex title, class_name;
+	if (title_str && !compile_search_regex(title_str, title))
 		return nullptr;
-	CHIVELRectObject* rect = (CHIVELRectObject*)rect_obj;
-	rect->x = x;
-	rect->y = y;
-	rect->width = width;
-	rect->height = height;
-	return rect_obj;
+	if (class_str && !compile_search_regex(class_str, class_name))
+		return nullptr;
+
+	uintptr_t handle = chivel::findWindow(title_str ? &title : nullptr, class_str ? &class_name : nullptr);
+	if (!handle)
+		Py_RETURN_NONE;
+	return PyLong_FromUnsignedLongLong(static_cast<unsigned long long>(handle));
+}
+
+static PyObject* chivel_window_get_rect(PyObject* self, PyObject* args) {
+	unsigned long long handle = 0;
+	if (!PyArg_ParseTuple(args, "K", &handle))
+		return nullptr;
+
+	cv::Rect rect;
+	if (!chivel::getBackend()->getWindowRect(static_cast<uintptr_t>(handle), rect))
+		Py_RETURN_NONE;
+	return create_rect(rect.x, rect.y, rect.width, rect.height);
+}
+
+static PyObject* chivel_use_virtual_display(PyObject* self, PyObject* args, PyObject* kwargs) {
+	const char* source = nullptr;
+	double fps = 0.0;
+	int loop = 1;
+	static const char* kwlist[] = { "source", "fps", "loop", nullptr };
+	if (!PyArg_ParseTupleAndKeywords(args, kwargs, "s|dp", (char**)kwlist, &source, &fps, &loop))
+		return nullptr;
+
+	if (fps < 0.0) {
+		PyErr_SetString(PyExc_ValueError, "fps must be non-negative");
+		return nullptr;
+	}
+
+	std::unique_ptr<chivel::VirtualBackend> backend = chivel::createVirtualBackend(source, fps, loop != 0);
+	if (!backend) {
+		PyErr_SetString(PyExc_IOError, "Failed to load frames for the virtual display");
+		return nullptr;
+	}
+	chivel::setBackend(std::move(backend));
+
+	Py_RETURN_NONE;
+}
+
+static PyObject* chivel_use_native_display(PyObject* self, PyObject* /*unused*/) {
+	chivel::setBackend(chivel::createNativeBackend());
+	Py_RETURN_NONE;
+}
+
+static PyObject* chivel_get_backend(PyObject* self, PyObject* /*unused*/) {
+	return PyUnicode_FromString(chivel::getBackend()->getName());
+}
+
+static PyObject* chivel_virtual_events(PyObject* self, PyObject* /*unused*/) {
+	std::shared_ptr<chivel::VirtualBackend> backend = std::dynamic_pointer_cast<chivel::VirtualBackend>(chivel::getBackend());
+	if (!backend) {
+		PyErr_SetString(PyExc_RuntimeError, "The virtual display is not in use");
+		return nullptr;
+	}
+
+	std::vector<chivel::InputEvent> events = backend->takeEvents();
+	PyObject* list = PyList_New(static_cast<Py_ssize_t>(events.size()));
+	if (!list)
+		return nullptr;
+
+	for (size_t i = 0; i < events.size(); ++i) {
+		chivel::InputEvent const& event = events[i];
+		PyObject* item = nullptr;
+		switch (event.type) {
+		case chivel::InputEvent::MOUSE_MOVE:
+			item = Py_BuildValue("(dsii)", event.time, "mouse_move", event.a, event.b);
+			break;
+		case chivel::InputEvent::MOUSE_DOWN:
+			item = Py_BuildValue("(dsi)", event.time, "mouse_down", event.a);
+			break;
+		case chivel::InputEvent::MOUSE_UP:
+			item = Py_BuildValue("(dsi)", event.time, "mouse_up", event.a);
+			break;
+		case chivel::InputEvent::MOUSE_SCROLL:
+			item = Py_BuildValue("(dsii)", event.time, "mouse_scroll", event.a, event.b);
+			break;
+		case chivel::InputEvent::KEY_DOWN:
+			item = Py_BuildValue("(dsi)", event.time, "key_down", event.a);
+			break;
+		case chivel::InputEvent::KEY_UP:
+			item = Py_BuildValue("(dsi)", event.time, "key_up", event.a);
+			break;
+		case chivel::InputEvent::CHARACTER:
+			item = Py_BuildValue("(dsC)", event.time, "type", event.a);
+			break;
+		}
+		if (!item) {
+			Py_DECREF(list);
+			return nullptr;
+		}
+		PyList_SET_ITEM(list, i, item); // Steals reference
+	}
+
+	return list;
+}
+
+static PyObject* chivel_memory_stats(PyObject* self, PyObject* /*unused*/) {
+	chivel::BufferPool::Stats stats = chivel::BufferPool::get().getStats();
+	return Py_BuildValue("{s:K,s:K,s:n,s:n,s:n,s:n}",
+		"hits", static_cast<unsigned long long>(stats.hits),
+		"misses", static_cast<unsigned long long>(stats.misses),
+		"retained_bytes", static_cast<Py_ssize_t>(stats.retained),
+		"in_use_bytes", static_cast<Py_ssize_t>(stats.inUse),
+		"peak_bytes", static_cast<Py_ssize_t>(stats.peak),
+		"limit_bytes", static_cast<Py_ssize_t>(stats.limit));
+}
+
+static PyObject* chivel_buffer_pool_trim(PyObject* self, PyObject* args) {
+	Py_ssize_t keep = 0;
+	if (!PyArg_ParseTuple(args, "|n", &keep))
+		return nullptr;
+	if (keep < 0) {
+		PyErr_SetString(PyExc_ValueError, "keep must not be negative");
+		return nullptr;
+	}
+	chivel::BufferPool::get().trim(static_cast<size_t>(keep));
+	Py_RETURN_NONE;
+}
+
+static PyObject* chivel_buffer_pool_limit(PyObject* self, PyObject* args) {
+	Py_ssize_t bytes = 0;
+	if (!PyArg_ParseTuple(args, "n", &bytes))
+		return nullptr;
+	if (bytes < 0) {
+		PyErr_SetString(PyExc_ValueError, "bytes must not be negative");
+		return nullptr;
+	}
+	chivel::BufferPool::get().setLimit(static_cast<size_t>(bytes));
+	Py_RETURN_NONE;
+}
+
+// Finishes queued saves before the process goes away. Called by Python after finalizing, with no Python left to use.
+static void stop_image_writer() {
+	chivel::ImageWriter::get().stop();
 }
 
 // Module initialization
@@ -2988,8 +6752,16 @@ static int chivel_module_exec(PyObject* module)
 	// do not print openCV stuff
 	cv::utils::logging::setLogLevel(cv::utils::logging::LOG_LEVEL_SILENT);
 
-	// make process DPI aware for mouse scaling
-	SetProcessDpiAwareness(PROCESS_PER_MONITOR_DPI_AWARE);
+	// reuse large pixel buffers instead of returning them to the heap
+	chivel::BufferPool::install();
+
+	// finish saves that are still queued when Python exits
+	static bool writer_registered = false;
+	if (!writer_registered && Py_AtExit(stop_image_writer) == 0)
+		writer_registered = true;
+
+	// create the platform backend up front, so it is configured before anything else runs
+	std::shared_ptr<chivel::Backend> backend = chivel::getBackend();
 
 	if (PyType_Ready(&CHIVELRectType) < 0)
 		return -1;
@@ -3031,6 +6803,70 @@ static int chivel_module_exec(PyObject* module)
 		return -1;
 	}
 
+	if (PyType_Ready(&CHIVELCapturerType) < 0)
+		return -1;
+	Py_INCREF(&CHIVELCapturerType);
+	if (PyModule_AddObject(module, "Capturer", (PyObject*)&CHIVELCapturerType) < 0) {
+		Py_DECREF(&CHIVELCapturerType);
+		return -1;
+	}
+
+	if (PyType_Ready(&CHIVELCaptureStreamType) < 0)
+		return -1;
+	Py_INCREF(&CHIVELCaptureStreamType);
+	if (PyModule_AddObject(module, "CaptureStream", (PyObject*)&CHIVELCaptureStreamType) < 0) {
+		Py_DECREF(&CHIVELCaptureStreamType);
+		return -1;
+	}
+
+	if (PyType_Ready(&CHIVELWatcherType) < 0)
+		return -1;
+	Py_INCREF(&CHIVELWatcherType);
+	if (PyModule_AddObject(module, "Watcher", (PyObject*)&CHIVELWatcherType) < 0) {
+		Py_DECREF(&CHIVELWatcherType);
+		return -1;
+	}
+
+	if (PyType_Ready(&CHIVELLookupTableType) < 0)
+		return -1;
+	Py_INCREF(&CHIVELLookupTableType);
+	if (PyModule_AddObject(module, "LookupTable", (PyObject*)&CHIVELLookupTableType) < 0) {
+		Py_DECREF(&CHIVELLookupTableType);
+		return -1;
+	}
+
+	if (PyType_Ready(&CHIVELPipelineType) < 0)
+		return -1;
+	Py_INCREF(&CHIVELPipelineType);
+	if (PyModule_AddObject(module, "Pipeline", (PyObject*)&CHIVELPipelineType) < 0) {
+		Py_DECREF(&CHIVELPipelineType);
+		return -1;
+	}
+
+	if (PyType_Ready(&CHIVELBundleType) < 0)
+		return -1;
+	Py_INCREF(&CHIVELBundleType);
+	if (PyModule_AddObject(module, "Bundle", (PyObject*)&CHIVELBundleType) < 0) {
+		Py_DECREF(&CHIVELBundleType);
+		return -1;
+	}
+
+	if (PyType_Ready(&CHIVELScreenIndexType) < 0)
+		return -1;
+	Py_INCREF(&CHIVELScreenIndexType);
+	if (PyModule_AddObject(module, "ScreenIndex", (PyObject*)&CHIVELScreenIndexType) < 0) {
+		Py_DECREF(&CHIVELScreenIndexType);
+		return -1;
+	}
+
+	if (PyType_Ready(&CHIVELProbeSetType) < 0)
+		return -1;
+	Py_INCREF(&CHIVELProbeSetType);
+	if (PyModule_AddObject(module, "ProbeSet", (PyObject*)&CHIVELProbeSetType) < 0) {
+		Py_DECREF(&CHIVELProbeSetType);
+		return -1;
+	}
+
 	// Text search levels
 	PyModule_AddIntConstant(module, "TEXT_BLOCK", tesseract::RIL_BLOCK);
 	PyModule_AddIntConstant(module, "TEXT_PARAGRAPH", tesseract::RIL_PARA);
@@ -3039,48 +6875,48 @@ static int chivel_module_exec(PyObject* module)
 	PyModule_AddIntConstant(module, "TEXT_SYMBOL", tesseract::RIL_SYMBOL);
 
 	// Display count
-	PyModule_AddIntConstant(module, "DISPLAY_COUNT", chivel::get_display_count());
+	PyModule_AddIntConstant(module, "DISPLAY_COUNT", backend->getDisplayCount());
 
 	// Keys
-	PyModule_AddIntConstant(module, "KEY_BACKSPACE", VK_BACK);
-	PyModule_AddIntConstant(module, "KEY_TAB", VK_TAB);
-	PyModule_AddIntConstant(module, "KEY_ENTER", VK_RETURN);
-	PyModule_AddIntConstant(module, "KEY_SHIFT", VK_SHIFT);
-	PyModule_AddIntConstant(module, "KEY_CTRL", VK_CONTROL);
-	PyModule_AddIntConstant(module, "KEY_ALT", VK_MENU);
-	PyModule_AddIntConstant(module, "KEY_PAUSE", VK_PAUSE);
-	PyModule_AddIntConstant(module, "KEY_CAPSLOCK", VK_CAPITAL);
-	PyModule_AddIntConstant(module, "KEY_ESC", VK_ESCAPE);
-	PyModule_AddIntConstant(module, "KEY_SPACE", VK_SPACE);
-	PyModule_AddIntConstant(module, "KEY_PAGEUP", VK_PRIOR);
-	PyModule_AddIntConstant(module, "KEY_PAGEDOWN", VK_NEXT);
-	PyModule_AddIntConstant(module, "KEY_END", VK_END);
-	PyModule_AddIntConstant(module, "KEY_HOME", VK_HOME);
-	PyModule_AddIntConstant(module, "KEY_LEFT", VK_LEFT);
-	PyModule_AddIntConstant(module, "KEY_UP", VK_UP);
-	PyModule_AddIntConstant(module, "KEY_RIGHT", VK_RIGHT);
-	PyModule_AddIntConstant(module, "KEY_DOWN", VK_DOWN);
-	PyModule_AddIntConstant(module, "KEY_PRINTSCREEN", VK_SNAPSHOT);
-	PyModule_AddIntConstant(module, "KEY_INSERT", VK_INSERT);
-	PyModule_AddIntConstant(module, "KEY_DELETE", VK_DELETE);
-	PyModule_AddIntConstant(module, "KEY_NUMLOCK", VK_NUMLOCK);
-	PyModule_AddIntConstant(module, "KEY_SCROLLLOCK", VK_SCROLL);
-	PyModule_AddIntConstant(module, "KEY_NUMPAD0", VK_NUMPAD0);
-	PyModule_AddIntConstant(module, "KEY_NUMPAD1", VK_NUMPAD1);
-	PyModule_AddIntConstant(module, "KEY_NUMPAD2", VK_NUMPAD2);
-	PyModule_AddIntConstant(module, "KEY_NUMPAD3", VK_NUMPAD3);
-	PyModule_AddIntConstant(module, "KEY_NUMPAD4", VK_NUMPAD4);
-	PyModule_AddIntConstant(module, "KEY_NUMPAD5", VK_NUMPAD5);
-	PyModule_AddIntConstant(module, "KEY_NUMPAD6", VK_NUMPAD6);
-	PyModule_AddIntConstant(module, "KEY_NUMPAD7", VK_NUMPAD7);
-	PyModule_AddIntConstant(module, "KEY_NUMPAD8", VK_NUMPAD8);
-	PyModule_AddIntConstant(module, "KEY_NUMPAD9", VK_NUMPAD9);
-	PyModule_AddIntConstant(module, "KEY_MULTIPLY", VK_MULTIPLY);
-	PyModule_AddIntConstant(module, "KEY_ADD", VK_ADD);
-	PyModule_AddIntConstant(module, "KEY_SEPARATOR", VK_SEPARATOR);
-	PyModule_AddIntConstant(module, "KEY_SUBTRACT", VK_SUBTRACT);
-	PyModule_AddIntConstant(module, "KEY_DECIMAL", VK_DECIMAL);
-	PyModule_AddIntConstant(module, "KEY_DIVIDE", VK_DIVIDE);
+	PyModule_AddIntConstant(module, "KEY_BACKSPACE", KEY_BACKSPACE);
+	PyModule_AddIntConstant(module, "KEY_TAB", KEY_TAB);
+	PyModule_AddIntConstant(module, "KEY_ENTER", KEY_ENTER);
+	PyModule_AddIntConstant(module, "KEY_SHIFT", KEY_SHIFT);
+	PyModule_AddIntConstant(module, "KEY_CTRL", KEY_CTRL);
+	PyModule_AddIntConstant(module, "KEY_ALT", KEY_ALT);
+	PyModule_AddIntConstant(module, "KEY_PAUSE", KEY_PAUSE);
+	PyModule_AddIntConstant(module, "KEY_CAPSLOCK", KEY_CAPSLOCK);
+	PyModule_AddIntConstant(module, "KEY_ESC", KEY_ESC);
+	PyModule_AddIntConstant(module, "KEY_SPACE", KEY_SPACE);
+	PyModule_AddIntConstant(module, "KEY_PAGEUP", KEY_PAGEUP);
+	PyModule_AddIntConstant(module, "KEY_PAGEDOWN", KEY_PAGEDOWN);
+	PyModule_AddIntConstant(module, "KEY_END", KEY_END);
+	PyModule_AddIntConstant(module, "KEY_HOME", KEY_HOME);
+	PyModule_AddIntConstant(module, "KEY_LEFT", KEY_LEFT);
+	PyModule_AddIntConstant(module, "KEY_UP", KEY_UP);
+	PyModule_AddIntConstant(module, "KEY_RIGHT", KEY_RIGHT);
+	PyModule_AddIntConstant(module, "KEY_DOWN", KEY_DOWN);
+	PyModule_AddIntConstant(module, "KEY_PRINTSCREEN", KEY_PRINTSCREEN);
+	PyModule_AddIntConstant(module, "KEY_INSERT", KEY_INSERT);
+	PyModule_AddIntConstant(module, "KEY_DELETE", KEY_DELETE);
+	PyModule_AddIntConstant(module, "KEY_NUMLOCK", KEY_NUMLOCK);
+	PyModule_AddIntConstant(module, "KEY_SCROLLLOCK", KEY_SCROLLLOCK);
+	PyModule_AddIntConstant(module, "KEY_NUMPAD0", KEY_NUMPAD0);
+	PyModule_AddIntConstant(module, "KEY_NUMPAD1", KEY_NUMPAD0 + 1);
+	PyModule_AddIntConstant(module, "KEY_NUMPAD2", KEY_NUMPAD0 + 2);
+	PyModule_AddIntConstant(module, "KEY_NUMPAD3", KEY_NUMPAD0 + 3);
+	PyModule_AddIntConstant(module, "KEY_NUMPAD4", KEY_NUMPAD0 + 4);
+	PyModule_AddIntConstant(module, "KEY_NUMPAD5", KEY_NUMPAD0 + 5);
+	PyModule_AddIntConstant(module, "KEY_NUMPAD6", KEY_NUMPAD0 + 6);
+	PyModule_AddIntConstant(module, "KEY_NUMPAD7", KEY_NUMPAD0 + 7);
+	PyModule_AddIntConstant(module, "KEY_NUMPAD8", KEY_NUMPAD0 + 8);
+	PyModule_AddIntConstant(module, "KEY_NUMPAD9", KEY_NUMPAD0 + 9);
+	PyModule_AddIntConstant(module, "KEY_MULTIPLY", KEY_MULTIPLY);
+	PyModule_AddIntConstant(module, "KEY_ADD", KEY_ADD);
+	PyModule_AddIntConstant(module, "KEY_SEPARATOR", KEY_SEPARATOR);
+	PyModule_AddIntConstant(module, "KEY_SUBTRACT", KEY_SUBTRACT);
+	PyModule_AddIntConstant(module, "KEY_DECIMAL", KEY_DECIMAL);
+	PyModule_AddIntConstant(module, "KEY_DIVIDE", KEY_DIVIDE);
 	PyModule_AddIntConstant(module, "KEY_0", 0x30);
 	PyModule_AddIntConstant(module, "KEY_1", 0x31);
 	PyModule_AddIntConstant(module, "KEY_2", 0x32);
@@ -3117,18 +6953,18 @@ static int chivel_module_exec(PyObject* module)
 	PyModule_AddIntConstant(module, "KEY_X", 0x58);
 	PyModule_AddIntConstant(module, "KEY_Y", 0x59);
 	PyModule_AddIntConstant(module, "KEY_Z", 0x5A);
-	PyModule_AddIntConstant(module, "KEY_F1", VK_F1);
-	PyModule_AddIntConstant(module, "KEY_F2", VK_F2);
-	PyModule_AddIntConstant(module, "KEY_F3", VK_F3);
-	PyModule_AddIntConstant(module, "KEY_F4", VK_F4);
-	PyModule_AddIntConstant(module, "KEY_F5", VK_F5);
-	PyModule_AddIntConstant(module, "KEY_F6", VK_F6);
-	PyModule_AddIntConstant(module, "KEY_F7", VK_F7);
-	PyModule_AddIntConstant(module, "KEY_F8", VK_F8);
-	PyModule_AddIntConstant(module, "KEY_F9", VK_F9);
-	PyModule_AddIntConstant(module, "KEY_F10", VK_F10);
-	PyModule_AddIntConstant(module, "KEY_F11", VK_F11);
-	PyModule_AddIntConstant(module, "KEY_F12", VK_F12);
+	PyModule_AddIntConstant(module, "KEY_F1", KEY_F1);
+	PyModule_AddIntConstant(module, "KEY_F2", KEY_F1 + 1);
+	PyModule_AddIntConstant(module, "KEY_F3", KEY_F1 + 2);
+	PyModule_AddIntConstant(module, "KEY_F4", KEY_F1 + 3);
+	PyModule_AddIntConstant(module, "KEY_F5", KEY_F1 + 4);
+	PyModule_AddIntConstant(module, "KEY_F6", KEY_F1 + 5);
+	PyModule_AddIntConstant(module, "KEY_F7", KEY_F1 + 6);
+	PyModule_AddIntConstant(module, "KEY_F8", KEY_F1 + 7);
+	PyModule_AddIntConstant(module, "KEY_F9", KEY_F1 + 8);
+	PyModule_AddIntConstant(module, "KEY_F10", KEY_F1 + 9);
+	PyModule_AddIntConstant(module, "KEY_F11", KEY_F1 + 10);
+	PyModule_AddIntConstant(module, "KEY_F12", KEY_F12);
 
 	PyModule_AddIntConstant(module, "BUTTON_LEFT", BUTTON_LEFT);
 	PyModule_AddIntConstant(module, "BUTTON_RIGHT", BUTTON_RIGHT);
@@ -3166,17 +7002,29 @@ static void chivel_module_free(void* module)
 #pragma endregion
 
 static PyModuleDef_Slot chivel_slots[] = {
-	{Py_mod_exec, chivel_module_exec},
+	{Py_mod_exec, (void*)chivel_module_exec},
 	{0, nullptr}
 };
 
 // Method definition object
 static PyMethodDef chivelMethods[] = {
-	{"load", chivel_load, METH_VARARGS, "Load an image from a file"},
-	{"save", chivel_save, METH_VARARGS, "Save an image to a file"},
-	{"capture", (PyCFunction)chivel_capture, METH_VARARGS | METH_KEYWORDS, "Capture the screen or a specific rectangle"},
+	{"load", chivel_load, METH_VARARGS, "Load an image from a file, or from the cache if the file has not changed since it was last loaded"},
+	{"load_dir", (PyCFunction)chivel_load_dir, METH_VARARGS | METH_KEYWORDS, "Load the images in a directory whose file names match a pattern, in parallel, as a dict of file name without extension to Image"},
+	{"clear_image_cache", chivel_clear_image_cache, METH_NOARGS, "Drop every cached decoded image, so the next loads read the files again"},
+	{"save_bundle", chivel_save_bundle, METH_VARARGS, "Save templates, with their gray, half and quarter size variants and statistics, to a bundle file that open_bundle can map"},
+	{"open_bundle", chivel_open_bundle, METH_VARARGS, "Memory map a bundle file, whose templates are Images that share its pages with every process that opened it"},
+	{"save", (PyCFunction)chivel_save, METH_VARARGS | METH_KEYWORDS, "Save an image to a file, with an optional JPEG/WebP quality or PNG compression"},
+	{"save_async", (PyCFunction)chivel_save_async, METH_VARARGS | METH_KEYWORDS, "Queue an image to be saved to a file on a background thread, waiting only if the queue is full"},
+	{"flush", chivel_flush, METH_NOARGS, "Wait until every queued save is written, and get the paths that failed since the last flush"},
+	{"decode", (PyCFunction)chivel_decode, METH_VARARGS | METH_KEYWORDS, "Decode the bytes of an image file into an Image"},
+	{"batch", (PyCFunction)chivel_batch, METH_VARARGS | METH_KEYWORDS, "Run a Pipeline on many images across native threads, optionally saving each result, and get the results in order, with an exception in place of any that failed"},
+	{"capture", (PyCFunction)chivel_capture, METH_VARARGS | METH_KEYWORDS, "Capture the screen, a specific rectangle or a window's rectangle on the screen, including anything covering it"},
+	{"probe", (PyCFunction)chivel_probe, METH_VARARGS | METH_KEYWORDS, "Read only the given pixels (Points) or small areas (Rects, averaged) of a display and get their Colors"},
+	{"diff", (PyCFunction)chivel_diff, METH_VARARGS | METH_KEYWORDS, "Compare two images tile by tile and get the rectangles that changed"},
 	{"find_image", (PyCFunction)chivel_find_image, METH_VARARGS | METH_KEYWORDS, "Find images within an image"},
 	{"find_text", (PyCFunction)chivel_find_text, METH_VARARGS | METH_KEYWORDS, "Find text within an image"},
+	{"find_color", (PyCFunction)chivel_find_color, METH_VARARGS | METH_KEYWORDS, "Find the connected areas of a color within an image, largest first, with their pixel counts and centroids"},
+	{"wait_for", (PyCFunction)chivel_wait_for, METH_VARARGS | METH_KEYWORDS, "Wait until an image or text appears on the display, and return its matches"},
 	{"wait", chivel_wait, METH_VARARGS, "Wait for a specified number of seconds"},
 	{"mouse_move", (PyCFunction)chivel_mouse_move, METH_VARARGS | METH_KEYWORDS, "Move the mouse cursor to a specific position or rectangle on a display"},
 	{"mouse_click", (PyCFunction)chivel_mouse_click, METH_VARARGS | METH_KEYWORDS, "Click the mouse button"},
@@ -3192,6 +7040,16 @@ static PyMethodDef chivelMethods[] = {
 	{"record", (PyCFunction)chivel_record, METH_VARARGS | METH_KEYWORDS, "Record a sequence of actions to a Python script"},
 	{"play", chivel_play, METH_VARARGS, "Play a recorded sequence of actions from a Python script"},
 	{"display_get_rect", chivel_display_get_rect, METH_VARARGS, "Get the rectangle of a specific display, relative to the primary display"},
+	{"window_list", chivel_window_list, METH_NOARGS, "List the visible top level windows, front to back, as (handle, title, class_name)"},
+	{"window_find", (PyCFunction)chivel_window_find, METH_VARARGS | METH_KEYWORDS, "Find the frontmost window whose title and class name match the given patterns"},
+	{"window_get_rect", chivel_window_get_rect, METH_VARARGS, "Get the rectangle of a window, relative to the primary display"},
+	{"use_virtual_display", (PyCFunction)chivel_use_virtual_display, METH_VARARGS | METH_KEYWORDS, "Replace the screen with frames from an image, a directory of images or a video, and log input instead of sending it"},
+	{"use_native_display", chivel_use_native_display, METH_NOARGS, "Go back to the real screen, mouse and keyboard"},
+	{"get_backend", chivel_get_backend, METH_NOARGS, "Get the name of the backend in use"},
+	{"virtual_events", chivel_virtual_events, METH_NOARGS, "Remove and return the input events logged by the virtual display"},
+	{"memory_stats", chivel_memory_stats, METH_NOARGS, "Get how often pixel buffers were reused, and how many bytes the pool holds"},
+	{"buffer_pool_trim", chivel_buffer_pool_trim, METH_VARARGS, "Free the pool's retained pixel buffers, least recently used first, until at most keep bytes (default 0) are retained"},
+	{"buffer_pool_limit", chivel_buffer_pool_limit, METH_VARARGS, "Set the most bytes of pixel buffers the pool retains, freeing any over it. 0 turns reuse off"},
 	{nullptr, nullptr, 0, nullptr}
 };
 
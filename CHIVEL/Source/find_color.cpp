@@ -0,0 +1,69 @@
+// find_color.cpp : Locating areas of a color.
+#include "pch.h"
+
+#include "find_color.h"
+
+#include <opencv2/imgproc.hpp>
+#include <algorithm>
+
+namespace chivel
+{
+	// OpenCV's 8-bit hue runs from 0 to 179
+	static constexpr int HUE_RANGE = 180;
+
+	std::vector<ColorRegion> findColor(cv::Mat const& image, cv::Scalar color, cv::Scalar tolerance, bool hue, int minArea)
+	{
+		cv::Scalar lower = color - tolerance;
+		cv::Scalar upper = color + tolerance;
+		if (image.channels() == 4) {
+			lower[3] = 0;
+			upper[3] = 255;
+		}
+
+		// Bounds past 0 or 255 saturate, so they need no clamping, except for hue, which continues on the other end
+		cv::Mat mask;
+		if (hue && tolerance[0] * 2 + 1 < HUE_RANGE && (lower[0] < 0 || upper[0] >= HUE_RANGE)) {
+			cv::Scalar wrappedLower = lower;
+			cv::Scalar wrappedUpper = upper;
+			if (lower[0] < 0) {
+				lower[0] = 0;
+				wrappedLower[0] += HUE_RANGE;
+				wrappedUpper[0] = HUE_RANGE - 1;
+			}
+			else {
+				upper[0] = HUE_RANGE - 1;
+				wrappedLower[0] = 0;
+				wrappedUpper[0] -= HUE_RANGE;
+			}
+			cv::Mat wrapped;
+			cv::inRange(image, lower, upper, mask);
+			cv::inRange(image, wrappedLower, wrappedUpper, wrapped);
+			mask |= wrapped;
+		}
+		else {
+			if (hue && tolerance[0] * 2 + 1 >= HUE_RANGE) {
+				lower[0] = 0;
+				upper[0] = 255;
+			}
+			cv::inRange(image, lower, upper, mask);
+		}
+
+		cv::Mat labels, stats, centroids;
+		int count = cv::connectedComponentsWithStats(mask, labels, stats, centroids, 8, CV_32S);
+
+		// Label 0 is everything else
+		std::vector<ColorRegion> regions;
+		for (int label = 1; label < count; label++) {
+			int const* stat = stats.ptr<int>(label);
+			if (stat[cv::CC_STAT_AREA] < minArea)
+				continue;
+			ColorRegion region;
+			region.rect = cv::Rect(stat[cv::CC_STAT_LEFT], stat[cv::CC_STAT_TOP], stat[cv::CC_STAT_WIDTH], stat[cv::CC_STAT_HEIGHT]);
+			region.area = stat[cv::CC_STAT_AREA];
+			region.centroid = cv::Point2d(centroids.at<double>(label, 0), centroids.at<double>(label, 1));
+			regions.push_back(region);
+		}
+		std::stable_sort(regions.begin(), regions.end(), [](ColorRegion const& a, ColorRegion const& b) { return a.area > b.area; });
+		return regions;
+	}
+}
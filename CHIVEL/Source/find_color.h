@@ -0,0 +1,21 @@
+#pragma once
+
+#include <opencv2/core.hpp>
+#include <vector>
+
+namespace chivel
+{
+	// A connected area of pixels of one color
+	struct ColorRegion
+	{
+		cv::Rect rect;
+		int area = 0; // in pixels, not the area of the rect
+		cv::Point2d centroid;
+	};
+
+	// Finds the 8-connected areas of pixels within tolerance of color in every channel, largest first, skipping any
+	// smaller than minArea. The mask is one inRange pass and the areas one connected components pass.
+	// With hue set, the image is HSV and the first channel wraps around at 180, so reds on both ends are found together.
+	// A fourth channel (alpha) is ignored.
+	std::vector<ColorRegion> findColor(cv::Mat const& image, cv::Scalar color, cv::Scalar tolerance, bool hue, int minArea);
+}
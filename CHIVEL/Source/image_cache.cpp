@@ -0,0 +1,80 @@
+// image_cache.cpp : Process wide cache of decoded image files.
+#include "pch.h"
+
+#include "image_cache.h"
+
+#include <filesystem>
+
+namespace chivel
+{
+	static size_t mat_bytes(cv::Mat const& mat)
+	{
+		return mat.total() * mat.elemSize();
+	}
+
+	ImageCache& ImageCache::get()
+	{
+		static ImageCache cache;
+		return cache;
+	}
+
+	cv::Mat ImageCache::load(std::string const& path, int colorSpace, Decoder decode)
+	{
+		// Files that cannot be looked at are not cached, decoding them reports the problem
+		std::error_code error;
+		std::filesystem::path file = std::filesystem::absolute(path, error).lexically_normal();
+		auto modified = std::filesystem::last_write_time(file, error);
+		if (error)
+			return decode(path, colorSpace);
+		uintmax_t fileSize = std::filesystem::file_size(file, error);
+		if (error)
+			return decode(path, colorSpace);
+
+		std::pair<std::string, int> key(file.string(), colorSpace);
+		int64_t stamp = static_cast<int64_t>(modified.time_since_epoch().count());
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			auto found = entries.find(key);
+			if (found != entries.end() && found->second.modified == stamp && found->second.fileSize == fileSize) {
+				found->second.lastUse = ++uses;
+				return found->second.mat;
+			}
+		}
+
+		cv::Mat mat = decode(path, colorSpace);
+		if (mat.empty() || mat_bytes(mat) > MAX_BYTES)
+			return mat;
+
+		std::lock_guard<std::mutex> lock(mutex);
+		Entry& entry = entries[key];
+		bytes -= mat_bytes(entry.mat);
+		entry.mat = mat;
+		entry.modified = stamp;
+		entry.fileSize = fileSize;
+		entry.lastUse = ++uses;
+		bytes += mat_bytes(mat);
+		evict();
+		return mat;
+	}
+
+	void ImageCache::clear()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		entries.clear();
+		bytes = 0;
+	}
+
+	void ImageCache::evict()
+	{
+		// Only runs once the cache is full, so a scan for the oldest entry is fine
+		while (bytes > MAX_BYTES) {
+			auto oldest = entries.begin();
+			for (auto it = entries.begin(); it != entries.end(); ++it) {
+				if (it->second.lastUse < oldest->second.lastUse)
+					oldest = it;
+			}
+			bytes -= mat_bytes(oldest->second.mat);
+			entries.erase(oldest);
+		}
+	}
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <opencv2/core.hpp>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <utility>
+
+namespace chivel
+{
+	// Decoded images shared by the whole process, keyed by path and color space, and kept while the file's modification time
+	// and size stay the same. Loading a file again then costs a stat and a lookup.
+	// The cached pixels are handed out shared, so anything that writes to them in place has to copy them first, as Image does.
+	// At most MAX_BYTES of pixels are kept, the least recently loaded are dropped first.
+	class ImageCache
+	{
+	public:
+		// Reads a file into the given color space. Returns an empty Mat when it cannot.
+		using Decoder = cv::Mat(*)(std::string const& path, int colorSpace);
+
+		static constexpr size_t MAX_BYTES = 512 * 1024 * 1024;
+
+		static ImageCache& get();
+
+		// Gets the image from the cache, or decodes it and adds it. Returns an empty Mat when the file cannot be read.
+		// Safe to call from several threads, decoding happens outside the lock.
+		cv::Mat load(std::string const& path, int colorSpace, Decoder decode);
+		void clear();
+
+	private:
+		struct Entry
+		{
+			cv::Mat mat;
+			int64_t modified = 0;
+			uintmax_t fileSize = 0;
+			uint64_t lastUse = 0;
+		};
+
+		std::mutex mutex;
+		std::map<std::pair<std::string, int>, Entry> entries;
+		size_t bytes = 0;
+		uint64_t uses = 0;
+
+		void evict();
+	};
+}
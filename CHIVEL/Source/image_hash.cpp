@@ -0,0 +1,204 @@
+// image_hash.cpp : Image hashes and the BK-tree to search them.
+#include "pch.h"
+
+#include "image_hash.h"
+
+#include <opencv2/imgproc.hpp>
+#include <algorithm>
+#include <bit>
+
+namespace chivel
+{
+	// Shrinks to size by averaging. Big images first shrink by a whole factor, which OpenCV averages much faster than
+	// a fractional one, to about twice the size, and the rest of the way from there.
+	static cv::Mat shrink(cv::Mat const& image, cv::Size size, bool rgb)
+	{
+		int fx = std::max(1, image.cols / (size.width * 2));
+		int fy = std::max(1, image.rows / (size.height * 2));
+		cv::Mat small;
+		if (fx > 1 || fy > 1) {
+			// Drops the few pixels past the last whole block, so the factor is exact
+			cv::Mat blocks = image(cv::Rect(0, 0, image.cols / fx * fx, image.rows / fy * fy));
+			cv::resize(blocks, small, cv::Size(blocks.cols / fx, blocks.rows / fy), 0, 0, cv::INTER_AREA);
+		}
+		else {
+			small = image;
+		}
+
+		cv::Mat result;
+		cv::resize(small, result, size, 0, 0, cv::INTER_AREA);
+		cv::Mat gray;
+		if (result.channels() == 3)
+			cv::cvtColor(result, gray, rgb ? cv::COLOR_RGB2GRAY : cv::COLOR_BGR2GRAY);
+		else if (result.channels() == 4)
+			cv::cvtColor(result, gray, rgb ? cv::COLOR_RGBA2GRAY : cv::COLOR_BGRA2GRAY);
+		else
+			gray = result;
+		cv::Mat values;
+		gray.convertTo(values, CV_32F);
+		return values;
+	}
+
+	// Marks the cells of a size grid that any excluded area of the image touches, even partly
+	static cv::Mat exclusion_mask(cv::Size image, cv::Size size, std::vector<cv::Rect> const& exclude)
+	{
+		cv::Mat mask = cv::Mat::zeros(size, CV_8U);
+		for (cv::Rect const& rect : exclude) {
+			cv::Rect area = rect & cv::Rect(0, 0, image.width, image.height);
+			if (area.empty())
+				continue;
+			int x0 = static_cast<int>(static_cast<int64_t>(area.x) * size.width / image.width);
+			int y0 = static_cast<int>(static_cast<int64_t>(area.y) * size.height / image.height);
+			int x1 = static_cast<int>((static_cast<int64_t>(area.x + area.width) * size.width + image.width - 1) / image.width);
+			int y1 = static_cast<int>((static_cast<int64_t>(area.y + area.height) * size.height + image.height - 1) / image.height);
+			mask(cv::Rect(x0, y0, x1 - x0, y1 - y0)) = 1;
+		}
+		return mask;
+	}
+
+	uint64_t imageHash(cv::Mat const& image, HashType type, std::vector<cv::Rect> const& exclude, bool rgb)
+	{
+		cv::Size size = type == HashType::Average ? cv::Size(8, 8) : type == HashType::Difference ? cv::Size(9, 8) : cv::Size(32, 32);
+		cv::Mat values = shrink(image, size, rgb);
+		cv::Mat excluded = exclusion_mask(image.size(), size, exclude);
+		uint64_t hash = 0;
+		int bit = 0;
+
+		switch (type) {
+		case HashType::Average: {
+			cv::Mat included = excluded == 0;
+			double mean = cv::countNonZero(included) ? cv::mean(values, included)[0] : 0.0;
+			for (int y = 0; y < 8; y++) {
+				for (int x = 0; x < 8; x++, bit++) {
+					if (!excluded.at<uchar>(y, x) && values.at<float>(y, x) > mean)
+						hash |= 1ull << bit;
+				}
+			}
+			break;
+		}
+		case HashType::Difference:
+			for (int y = 0; y < 8; y++) {
+				for (int x = 0; x < 8; x++, bit++) {
+					if (!excluded.at<uchar>(y, x) && !excluded.at<uchar>(y, x + 1) && values.at<float>(y, x + 1) > values.at<float>(y, x))
+						hash |= 1ull << bit;
+				}
+			}
+			break;
+		case HashType::Perceptual: {
+			// Excluded cells take the average, so they add as little as possible to any frequency
+			if (cv::countNonZero(excluded)) {
+				cv::Mat included = excluded == 0;
+				double mean = cv::countNonZero(included) ? cv::mean(values, included)[0] : 0.0;
+				values.setTo(mean, excluded);
+			}
+			cv::Mat frequencies;
+			cv::dct(values, frequencies);
+			cv::Mat low = frequencies(cv::Rect(0, 0, 8, 8)).clone();
+			std::vector<float> sorted(low.begin<float>(), low.end<float>());
+			std::nth_element(sorted.begin(), sorted.begin() + 32, sorted.end());
+			float median = sorted[32];
+			for (int y = 0; y < 8; y++) {
+				for (int x = 0; x < 8; x++, bit++) {
+					if (low.at<float>(y, x) > median)
+						hash |= 1ull << bit;
+				}
+			}
+			break;
+		}
+		}
+		return hash;
+	}
+
+	int hashDistance(uint64_t a, uint64_t b)
+	{
+		return std::popcount(a ^ b);
+	}
+
+	void BKTree::add(uint64_t hash, int id)
+	{
+		count++;
+		if (nodes.empty()) {
+			nodes.push_back({ hash, { id }, {} });
+			return;
+		}
+
+		size_t index = 0;
+		while (true) {
+			int distance = hashDistance(hash, nodes[index].hash);
+			if (distance == 0) {
+				nodes[index].ids.push_back(id);
+				return;
+			}
+			auto& children = nodes[index].children;
+			auto child = std::find_if(children.begin(), children.end(), [&](std::pair<int, int> const& c) { return c.first == distance; });
+			if (child == children.end()) {
+				children.push_back({ distance, static_cast<int>(nodes.size()) });
+				nodes.push_back({ hash, { id }, {} });
+				return;
+			}
+			index = static_cast<size_t>(child->second);
+		}
+	}
+
+	void BKTree::clear()
+	{
+		nodes.clear();
+		count = 0;
+	}
+
+	size_t BKTree::size() const
+	{
+		return count;
+	}
+
+	std::vector<BKTree::Result> BKTree::search(uint64_t hash, int maxDistance) const
+	{
+		std::vector<Result> results;
+		if (nodes.empty())
+			return results;
+
+		std::vector<int> pending = { 0 };
+		while (!pending.empty()) {
+			Node const& node = nodes[pending.back()];
+			pending.pop_back();
+			int distance = hashDistance(hash, node.hash);
+			if (distance <= maxDistance) {
+				for (int id : node.ids)
+					results.push_back({ id, distance });
+			}
+			// By the triangle inequality, anything closer than maxDistance is under a child this far from the node
+			for (auto const& child : node.children) {
+				if (child.first >= distance - maxDistance && child.first <= distance + maxDistance)
+					pending.push_back(child.second);
+			}
+		}
+		std::stable_sort(results.begin(), results.end(), [](Result const& a, Result const& b) { return a.distance < b.distance; });
+		return results;
+	}
+
+	bool BKTree::nearest(uint64_t hash, int maxDistance, Result& result) const
+	{
+		if (nodes.empty())
+			return false;
+
+		// The same as search, narrowing the radius to the best distance so far
+		int best = maxDistance + 1;
+		std::vector<int> pending = { 0 };
+		while (!pending.empty()) {
+			Node const& node = nodes[pending.back()];
+			pending.pop_back();
+			int distance = hashDistance(hash, node.hash);
+			if (distance < best) {
+				best = distance;
+				result = { node.ids.front(), distance };
+				if (distance == 0)
+					return true;
+			}
+			for (auto const& child : node.children) {
+				if (child.first > distance - best && child.first < distance + best)
+					pending.push_back(child.second);
+			}
+		}
+		return best <= maxDistance;
+	}
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <opencv2/core.hpp>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace chivel
+{
+	// 64 bit hashes of what an image looks like, for telling apart known screens. Similar images get hashes a small
+	// Hamming distance apart. Each one shrinks the image to a few dozen pixels, so the cost barely depends on its size.
+	enum class HashType
+	{
+		Average, // 8x8 pixels, each brighter than the mean or not
+		Difference, // 9x8 pixels, each brighter than its left neighbour or not
+		Perceptual, // the lowest 8x8 frequencies of a 32x32 DCT, each above the median or not
+	};
+
+	// Hashes an 8-bit image with 1, 3 or 4 channels, in BGR(A) order, or RGB(A) with rgb set. Areas in exclude do not
+	// affect the hash, so things that change on their own (clocks, counters) can be left out. Their bits are always 0 in
+	// the average and difference hashes, and they are filled with the average in the perceptual hash.
+	uint64_t imageHash(cv::Mat const& image, HashType type, std::vector<cv::Rect> const& exclude = {}, bool rgb = false);
+
+	// The number of bits two hashes differ in
+	int hashDistance(uint64_t a, uint64_t b);
+
+	// Hashes with ids, searched by Hamming distance. Each node's children are keyed by their distance to it,
+	// so a search only visits the children within its radius of the query's distance to the node.
+	class BKTree
+	{
+	public:
+		struct Result
+		{
+			int id = -1;
+			int distance = 0;
+		};
+
+		void add(uint64_t hash, int id);
+		void clear();
+		size_t size() const;
+
+		// Every id within maxDistance, closest first
+		std::vector<Result> search(uint64_t hash, int maxDistance) const;
+		// The closest id within maxDistance. Returns false when there is none.
+		bool nearest(uint64_t hash, int maxDistance, Result& result) const;
+
+	private:
+		struct Node
+		{
+			uint64_t hash = 0;
+			std::vector<int> ids; // every id added with exactly this hash
+			std::vector<std::pair<int, int>> children; // distance, node index
+		};
+
+		std::vector<Node> nodes;
+		size_t count = 0;
+	};
+}
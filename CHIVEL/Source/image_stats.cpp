@@ -0,0 +1,129 @@
+// image_stats.cpp : One pass image statistics.
+#include "pch.h"
+
+#include "image_stats.h"
+
+#include <algorithm>
+#include <cmath>
+#include <mutex>
+#include <numeric>
+
+namespace chivel
+{
+	// Each channel is quantized to its top 4 bits for the dominant colors, so 3 channels make 4096 bins
+	static constexpr int COLOR_SHIFT = 4;
+	static constexpr int COLOR_BINS = 1 << (3 * (8 - COLOR_SHIFT));
+
+	// Rough number of pixels per stripe, so small images are not split up more than they are worth
+	static constexpr int STRIPE_PIXELS = 1 << 18;
+
+	struct StatsAccumulator
+	{
+		std::array<std::array<uint64_t, 256>, 4> histogram = {};
+		std::vector<uint64_t> colorCount = std::vector<uint64_t>(COLOR_BINS);
+		std::vector<std::array<uint64_t, 3>> colorSum = std::vector<std::array<uint64_t, 3>>(COLOR_BINS);
+		uint64_t count = 0;
+
+		void add(StatsAccumulator const& other)
+		{
+			for (size_t c = 0; c < histogram.size(); c++) {
+				for (size_t v = 0; v < 256; v++)
+					histogram[c][v] += other.histogram[c][v];
+			}
+			for (int bin = 0; bin < COLOR_BINS; bin++) {
+				colorCount[bin] += other.colorCount[bin];
+				for (int c = 0; c < 3; c++)
+					colorSum[bin][c] += other.colorSum[bin][c];
+			}
+			count += other.count;
+		}
+	};
+
+	template<int Channels>
+	static void accumulate_rows(cv::Mat const& image, cv::Mat const& mask, cv::Range rows, StatsAccumulator& acc)
+	{
+		constexpr int COLOR_CHANNELS = Channels < 3 ? Channels : 3;
+		for (int y = rows.start; y < rows.end; y++) {
+			uchar const* pixel = image.ptr(y);
+			uchar const* m = mask.empty() ? nullptr : mask.ptr(y);
+			for (int x = 0; x < image.cols; x++, pixel += Channels) {
+				if (m && !m[x])
+					continue;
+				for (int c = 0; c < Channels; c++)
+					acc.histogram[c][pixel[c]]++;
+				int bin = 0;
+				for (int c = 0; c < COLOR_CHANNELS; c++)
+					bin = (bin << (8 - COLOR_SHIFT)) | (pixel[c] >> COLOR_SHIFT);
+				acc.colorCount[bin]++;
+				for (int c = 0; c < COLOR_CHANNELS; c++)
+					acc.colorSum[bin][c] += pixel[c];
+				acc.count++;
+			}
+		}
+	}
+
+	ImageStats imageStats(cv::Mat const& image, cv::Mat const& mask, int dominantCount)
+	{
+		CV_Assert(image.depth() == CV_8U && image.channels() <= 4);
+		CV_Assert(mask.empty() || (mask.type() == CV_8UC1 && mask.size() == image.size()));
+
+		int channels = image.channels();
+		int stripes = std::max(1, static_cast<int>(image.total() / STRIPE_PIXELS));
+		StatsAccumulator total;
+		std::mutex mutex;
+		cv::parallel_for_(cv::Range(0, image.rows), [&](cv::Range const& rows) {
+			StatsAccumulator acc;
+			switch (channels) {
+			case 1: accumulate_rows<1>(image, mask, rows, acc); break;
+			case 2: accumulate_rows<2>(image, mask, rows, acc); break;
+			case 3: accumulate_rows<3>(image, mask, rows, acc); break;
+			default: accumulate_rows<4>(image, mask, rows, acc); break;
+			}
+			std::lock_guard<std::mutex> lock(mutex);
+			total.add(acc);
+		}, stripes);
+
+		ImageStats stats;
+		stats.channels = channels;
+		stats.count = total.count;
+		stats.histogram = total.histogram;
+		if (total.count == 0)
+			return stats;
+
+		double n = static_cast<double>(total.count);
+		for (int c = 0; c < channels; c++) {
+			auto const& histogram = total.histogram[c];
+			double sum = 0.0;
+			double squares = 0.0;
+			for (int v = 0; v < 256; v++) {
+				double count = static_cast<double>(histogram[v]);
+				sum += count * v;
+				squares += count * v * v;
+			}
+			stats.mean[c] = sum / n;
+			stats.stddev[c] = std::sqrt(std::max(0.0, squares / n - stats.mean[c] * stats.mean[c]));
+			auto first = std::find_if(histogram.begin(), histogram.end(), [](uint64_t count) { return count > 0; });
+			auto last = std::find_if(histogram.rbegin(), histogram.rend(), [](uint64_t count) { return count > 0; });
+			stats.min[c] = static_cast<double>(first - histogram.begin());
+			stats.max[c] = static_cast<double>(255 - (last - histogram.rbegin()));
+		}
+
+		std::vector<int> bins(COLOR_BINS);
+		std::iota(bins.begin(), bins.end(), 0);
+		int kept = std::min(std::max(dominantCount, 0), COLOR_BINS);
+		std::partial_sort(bins.begin(), bins.begin() + kept, bins.end(), [&](int a, int b) {
+			return total.colorCount[a] > total.colorCount[b];
+		});
+		int colorChannels = std::min(channels, 3);
+		for (int i = 0; i < kept && total.colorCount[bins[i]] > 0; i++) {
+			int bin = bins[i];
+			double count = static_cast<double>(total.colorCount[bin]);
+			ImageStats::Dominant dominant;
+			for (int c = 0; c < colorChannels; c++)
+				dominant.color[c] = total.colorSum[bin][c] / count;
+			dominant.fraction = count / n;
+			stats.dominant.push_back(dominant);
+		}
+		return stats;
+	}
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <opencv2/core.hpp>
+#include <array>
+#include <cstdint>
+#include <vector>
+
+namespace chivel
+{
+	// Statistics of the pixels of an 8-bit image, all gathered in one pass over it
+	struct ImageStats
+	{
+		// A common color, the average of the pixels that quantize to it
+		struct Dominant
+		{
+			cv::Scalar color;
+			double fraction = 0.0; // of the counted pixels
+		};
+
+		int channels = 0;
+		uint64_t count = 0; // pixels counted, those under the mask if there is one
+		std::array<std::array<uint64_t, 256>, 4> histogram = {};
+		// Per channel, derived exactly from the histograms. All 0 when nothing was counted.
+		cv::Scalar mean, stddev, min, max;
+		std::vector<Dominant> dominant; // most common first
+	};
+
+	// Counts every pixel of image where mask (8-bit, 1 channel, image sized, or empty for all) is not 0, in parallel
+	// stripes. Besides the per channel histograms, the first 3 channels are quantized to 16 levels each for the
+	// dominant colors, of which the dominantCount most common are kept.
+	ImageStats imageStats(cv::Mat const& image, cv::Mat const& mask, int dominantCount);
+}
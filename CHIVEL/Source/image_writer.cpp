@@ -0,0 +1,85 @@
+// image_writer.cpp : Background image saving.
+#include "pch.h"
+
+#include "image_writer.h"
+
+#include <opencv2/imgcodecs.hpp>
+
+namespace chivel
+{
+	ImageWriter& ImageWriter::get()
+	{
+		// Never destroyed, the threads are stopped at interpreter exit instead, while it is still safe to join them
+		static ImageWriter* writer = new ImageWriter();
+		return *writer;
+	}
+
+	bool ImageWriter::submit(cv::Mat const& mat, std::string const& path, std::vector<int> const& params)
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		if (stopping)
+			return false;
+		if (threads.empty()) {
+			for (int i = 0; i < THREADS; i++)
+				threads.emplace_back(&ImageWriter::run, this);
+		}
+		room.wait(lock, [&]() { return jobs.size() < CAPACITY || stopping; });
+		if (stopping)
+			return false;
+		jobs.push_back({ mat, path, params });
+		queued.notify_one();
+		return true;
+	}
+
+	std::vector<std::string> ImageWriter::flush()
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		done.wait(lock, [&]() { return jobs.empty() && active == 0; });
+		std::vector<std::string> result;
+		result.swap(failed);
+		return result;
+	}
+
+	void ImageWriter::stop()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		queued.notify_all();
+		room.notify_all();
+		for (std::thread& thread : threads)
+			thread.join();
+		threads.clear();
+	}
+
+	void ImageWriter::run()
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		while (true) {
+			// Stopping still writes whatever was queued before
+			queued.wait(lock, [&]() { return !jobs.empty() || stopping; });
+			if (jobs.empty())
+				return;
+			Job job = std::move(jobs.front());
+			jobs.pop_front();
+			active++;
+			room.notify_one();
+
+			lock.unlock();
+			bool written = false;
+			try {
+				written = cv::imwrite(job.path, job.mat, job.params);
+			}
+			catch (cv::Exception const&) {
+			}
+			job.mat.release();
+			lock.lock();
+
+			if (!written)
+				failed.push_back(job.path);
+			active--;
+			done.notify_all();
+		}
+	}
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <opencv2/core.hpp>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace chivel
+{
+	// Saves images to files on a few background threads, so encoding never holds up the caller.
+	// The queue is bounded: once it is full, submit waits for room instead of letting memory grow.
+	class ImageWriter
+	{
+	public:
+		static constexpr int THREADS = 2;
+		static constexpr size_t CAPACITY = 32;
+
+		// The writer, created the first time. Its threads start with the first submit.
+		static ImageWriter& get();
+
+		// Queues a save of the pixels, which must not change until it is done. Waits while the queue is full.
+		// Returns false once the writer has been stopped.
+		bool submit(cv::Mat const& mat, std::string const& path, std::vector<int> const& params);
+		// Waits until everything submitted so far is written, and returns the paths that failed since the last flush.
+		std::vector<std::string> flush();
+		// Writes everything still queued, then joins the threads. Nothing can be submitted afterwards.
+		void stop();
+
+	private:
+		struct Job
+		{
+			cv::Mat mat;
+			std::string path;
+			std::vector<int> params;
+		};
+
+		std::mutex mutex;
+		std::condition_variable queued; // a job was added, or the writer is stopping
+		std::condition_variable room; // a job was taken off the queue
+		std::condition_variable done; // a job was finished
+		std::deque<Job> jobs;
+		size_t active = 0; // jobs taken off the queue and still being written
+		std::vector<std::string> failed;
+		std::vector<std::thread> threads;
+		bool stopping = false;
+
+		ImageWriter() = default;
+		void run();
+	};
+}
@@ -0,0 +1,85 @@
+// lookup_table.cpp : Per-channel lookup tables composed from per-pixel operations.
+#include "pch.h"
+
+#include "lookup_table.h"
+
+#include <opencv2/imgproc.hpp>
+#include <algorithm>
+#include <cfloat>
+
+namespace chivel
+{
+	LookupTable::LookupTable()
+	{
+		for (int channel = 0; channel < MAX_CHANNELS; channel++) {
+			for (int i = 0; i < 256; i++)
+				tables[channel][i] = static_cast<uchar>(i);
+		}
+	}
+
+	void LookupTable::brightness(double value, int channel)
+	{
+		each(channel, [&](cv::Mat& table) { table.convertTo(table, -1, 1, value); });
+	}
+
+	void LookupTable::contrast(double factor, int channel)
+	{
+		each(channel, [&](cv::Mat& table) { table.convertTo(table, -1, factor, 0); });
+	}
+
+	void LookupTable::invert(int channel)
+	{
+		each(channel, [&](cv::Mat& table) { cv::bitwise_not(table, table); });
+	}
+
+	void LookupTable::threshold(double thresh, double maxval, int channel)
+	{
+		each(channel, [&](cv::Mat& table) { cv::threshold(table, table, thresh, maxval, cv::THRESH_BINARY); });
+	}
+
+	void LookupTable::normalize(double inMin, double inMax, double alpha, double beta, int channel)
+	{
+		// The same scale and shift cv::normalize uses for NORM_MINMAX, which maps to the lower of alpha and beta
+		// and up to the higher one, whichever order they come in
+		double low = std::min(alpha, beta);
+		double high = std::max(alpha, beta);
+		double range = inMax - inMin;
+		double scale = range > DBL_EPSILON ? (high - low) / range : 0.0;
+		double shift = low - inMin * scale;
+		each(channel, [&](cv::Mat& table) { table.convertTo(table, -1, scale, shift); });
+	}
+
+	bool LookupTable::isIdentity() const
+	{
+		for (int channel = 0; channel < MAX_CHANNELS; channel++) {
+			for (int i = 0; i < 256; i++) {
+				if (tables[channel][i] != i)
+					return false;
+			}
+		}
+		return true;
+	}
+
+	cv::Mat LookupTable::getTable(int channel) const
+	{
+		return cv::Mat(1, 256, CV_8U, const_cast<uchar*>(tables[channel]));
+	}
+
+	cv::Mat LookupTable::getTables(int channels) const
+	{
+		if (channels == 1)
+			return getTable(0);
+		cv::Mat merged(1, 256, CV_8UC(channels));
+		uchar* out = merged.ptr();
+		for (int i = 0; i < 256; i++) {
+			for (int channel = 0; channel < channels; channel++)
+				*out++ = tables[channel][i];
+		}
+		return merged;
+	}
+
+	void LookupTable::apply(cv::Mat const& src, cv::Mat& dst) const
+	{
+		cv::LUT(src, getTables(src.channels()), dst);
+	}
+}
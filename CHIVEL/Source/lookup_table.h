@@ -0,0 +1,51 @@
+#pragma once
+
+#include <opencv2/core.hpp>
+
+namespace chivel
+{
+	// One 256-entry table per channel, built by composing per-pixel 8-bit operations.
+	// Each operation is applied to the tables the same way the matching Image method applies it to pixels,
+	// so applying the tables gives the same result as running the operations one after the other, in a single pass.
+	class LookupTable
+	{
+	public:
+		static constexpr int MAX_CHANNELS = 4;
+
+		// Starts as the identity, which leaves every value as it is
+		LookupTable();
+
+		// channel is 0 to 3, or -1 for every channel
+		void brightness(double value, int channel = -1);
+		void contrast(double factor, int channel = -1);
+		void invert(int channel = -1);
+		void threshold(double thresh, double maxval, int channel = -1);
+		// Maps [inMin, inMax] to [min(alpha, beta), max(alpha, beta)], like Image.normalize does with the image's own minimum and maximum
+		void normalize(double inMin, double inMax, double alpha, double beta, int channel = -1);
+
+		bool isIdentity() const;
+		// The table of a single channel, 1 x 256 CV_8U. Only a header, it is valid for as long as this LookupTable is.
+		cv::Mat getTable(int channel) const;
+		// The first channels tables interleaved, 1 x 256 with that many channels, as cv::LUT takes them
+		cv::Mat getTables(int channels) const;
+
+		// Applies the tables to an 8-bit image with up to 4 channels. src and dst may be the same.
+		void apply(cv::Mat const& src, cv::Mat& dst) const;
+
+	private:
+		// Plain arrays, so copies are independent
+		uchar tables[MAX_CHANNELS][256];
+
+		// Calls f with a Mat header over each selected table. OpenCV writes in place when the output already fits.
+		template<typename F>
+		void each(int channel, F f)
+		{
+			for (int i = 0; i < MAX_CHANNELS; i++) {
+				if (channel < 0 || channel == i) {
+					cv::Mat table(1, 256, CV_8U, tables[i]);
+					f(table);
+				}
+			}
+		}
+	};
+}
@@ -1,4 +1,4 @@
-from typing import Any, List, Tuple, Optional
+from typing import Any, Callable, Dict, List, Tuple, Optional
 
 class Point:
     x: int
@@ -19,6 +19,8 @@ class Rect:
 class Match:
     rect: Rect
     label: str | None
+    area: int
+    centroid: Point | None
     def __init__(self, rect: Rect, label: str | None = None) -> None: ...
     def __repr__(self) -> str: ...
 
@@ -35,7 +37,14 @@ class Image:
     def get_size(self) -> Point: ...
     def show(self, window_name: str = ...) -> None: ...
     def clone(self) -> 'Image': ...
+    def get_origin(self) -> Point: ...
+    @staticmethod
+    def from_buffer(obj: Any, color_space: int = ...) -> 'Image': ...
+    def __buffer__(self, flags: int) -> memoryview: ...
+    def detach(self) -> None: ...
+    def equals(self, other: 'Image', region: Optional[Rect] = None) -> bool: ...
     def crop(self, rect: Rect) -> None: ...
+    def view(self, rect: Rect) -> 'Image': ...
     def grayscale(self) -> None: ...
     def scale(self, x: float, y: float = ...) -> None: ...
     def rotate(self, angle: float) -> None: ...
@@ -61,13 +70,113 @@ class Image:
     def convert(self, color_space: int) -> None: ...
     def range(self, lower: Color, upper: Color) -> None: ...
     def mask(self, mask: 'Image') -> None: ...
+    def encode(self, fmt: str = "png", *, quality: int = -1, compression: int = -1) -> bytes: ...
+    def phash(self, exclude: Optional[Rect | List[Rect]] = None) -> int: ...
+    def dhash(self, exclude: Optional[Rect | List[Rect]] = None) -> int: ...
+    def ahash(self, exclude: Optional[Rect | List[Rect]] = None) -> int: ...
+    def stats(self, region: Optional[Rect] = None, mask: Optional['Image'] = None, *, dominant: int = 5) -> Dict[str, Any]: ...
 
-def load(path: str) -> Image: ...
-def save(image: Image, path: str) -> None: ...
-def capture(display_index: int = ..., rect: Rect = ...) -> Image: ...
+class Capturer:
+    display_index: int
+    def __init__(self, display_index: int = 0, rect: Optional[Rect] = None) -> None: ...
+    def grab(self, copy: bool = False, color_space: int = ..., scale: float = 1.0) -> Image: ...
+    def grab_damage(self) -> Tuple[Image, List[Rect]]: ...
+    def get_rect(self) -> Rect: ...
+
+class CaptureStream:
+    def __init__(self, display_index: int = 0, rect: Optional[Rect] = None, fps: float = 30.0, buffers: int = 3) -> None: ...
+    def latest(self) -> Optional[Tuple[Image, float]]: ...
+    def next(self, timeout: Optional[float] = None) -> Optional[Tuple[Image, float]]: ...
+    def get_dropped(self) -> int: ...
+    def get_frame_count(self) -> int: ...
+    def close(self) -> None: ...
+
+class Watcher:
+    def __init__(self, display_index: int = 0, rect: Optional[Rect] = None, interval: float = 0.05) -> None: ...
+    def add(self, target: Image | str, callback: Optional[Callable[[int, List[Match]], Any]] = None, region: Optional[Rect] = None, threshold: float = ..., text_level: int = ...) -> int: ...
+    def remove(self, id: int) -> None: ...
+    def poll(self) -> List[int]: ...
+    def run(self, timeout: Optional[float] = None) -> None: ...
+    def stop(self) -> None: ...
+    def get_matches(self, id: int) -> List[Match]: ...
+    def get_timings(self) -> Dict[int, Tuple[float, float, int]]: ...
+
+class LookupTable:
+    def __init__(self) -> None: ...
+    def brightness(self, value: float, channel: Optional[int] = None) -> 'LookupTable': ...
+    def contrast(self, factor: float, channel: Optional[int] = None) -> 'LookupTable': ...
+    def invert(self, channel: Optional[int] = None) -> 'LookupTable': ...
+    def threshold(self, thresh: float = 128.0, maxval: float = 255.0, channel: Optional[int] = None) -> 'LookupTable': ...
+    # maps [in_min, in_max] to [min(alpha, beta), max(alpha, beta)], whichever order alpha and beta are in
+    def normalize(self, in_min: float, in_max: float, alpha: float = 0.0, beta: float = 255.0, channel: Optional[int] = None) -> 'LookupTable': ...
+    def get_table(self, channel: int = 0) -> bytes: ...
+    def apply(self, image: Image) -> None: ...
+
+class Pipeline:
+    def __init__(self) -> None: ...
+    def __len__(self) -> int: ...
+    def grayscale(self) -> 'Pipeline': ...
+    def brightness(self, value: float) -> 'Pipeline': ...
+    def contrast(self, factor: float) -> 'Pipeline': ...
+    def invert(self) -> 'Pipeline': ...
+    def threshold(self, thresh: float = 128.0, maxval: float = 255.0) -> 'Pipeline': ...
+    def normalize(self, alpha: float = 0.0, beta: float = 255.0) -> 'Pipeline': ...
+    def blur(self, amount: int = 3) -> 'Pipeline': ...
+    def sharpen(self, strength: float = 1.0) -> 'Pipeline': ...
+    def edge(self, threshold1: float = 100.0, threshold2: float = 200.0) -> 'Pipeline': ...
+    def emboss(self) -> 'Pipeline': ...
+    def resize(self, size: Point) -> 'Pipeline': ...
+    def scale(self, x: float, y: float = ...) -> 'Pipeline': ...
+    def clear(self) -> None: ...
+    def run(self, image: Image) -> Image: ...
+    def apply(self, image: Image) -> None: ...
+
+class Bundle:
+    def __len__(self) -> int: ...
+    def __getitem__(self, name: str) -> Image: ...
+    def __contains__(self, name: str) -> bool: ...
+    def names(self) -> List[str]: ...
+    def get(self, name: str, variant: str = "original") -> Image: ...
+    def info(self, name: str) -> Dict[str, Any]: ...
+
+class ScreenIndex:
+    def __init__(self, kind: str = "phash", exclude: Optional[Rect | List[Rect]] = None) -> None: ...
+    def __len__(self) -> int: ...
+    def add(self, label: Any, image: Image | int) -> int: ...
+    def query(self, image: Image | int, max_distance: int = 10) -> Optional[Tuple[Any, int]]: ...
+    def query_all(self, image: Image | int, max_distance: int = 10) -> List[Tuple[Any, int]]: ...
+    def hash(self, image: Image) -> int: ...
+    def clear(self) -> None: ...
+
+class ProbeSet:
+    display_index: int
+    def __init__(self, display_index: int = 0) -> None: ...
+    def __len__(self) -> int: ...
+    def add(self, position: Point | Rect, color: Color, tolerance: int = 0) -> int: ...
+    def check(self) -> List[bool]: ...
+    def all(self) -> bool: ...
+    def read(self) -> List[Color]: ...
+    def clear(self) -> None: ...
+
+def load(path: str, color_space: int = ...) -> Image: ...
+def load_dir(path: str, pattern: str = "*.png", color_space: int = ...) -> Dict[str, Image]: ...
+def clear_image_cache() -> None: ...
+def save_bundle(templates: Dict[str, Image] | List[Image], path: str) -> None: ...
+def open_bundle(path: str) -> Bundle: ...
+def save(image: Image, path: str, *, quality: int = -1, compression: int = -1) -> None: ...
+def save_async(image: Image, path: str, *, quality: int = -1, compression: int = -1) -> None: ...
+def flush() -> List[str]: ...
+def decode(data: bytes, color_space: int = ...) -> Image: ...
+def batch(images: List[Image], ops: Pipeline, paths: Optional[List[str]] = None) -> List[Image | Exception]: ...
+# window captures the window's rectangle of the screen, so other windows on top of it show up in the capture
+def capture(display_index: int = ..., rect: Rect = ..., color_space: int = ..., scale: float = 1.0, window: Optional[int | str] = None) -> Image: ...
+def probe(points: List[Point | Rect], display_index: int = 0) -> List[Color]: ...
+def diff(a: Image, b: Image, tile: int = 32, tolerance: int = 0) -> List[Rect]: ...
 def find_image(source: Image, search: Image, threshold: float = 0.8) -> List[Match]: ...
 def find_text(source: Image, search: str, threshold: float = 0.0, text_level: int = ...) -> List[Match]: ...
+def find_color(source: Image, color: Color | Tuple[int, int, int], tolerance: int | Tuple[int, int, int] = 0, min_area: int = 1, region: Optional[Rect] = None, hsv: bool = False) -> List[Match]: ...
 def wait(seconds: float) -> None: ...
+def wait_for(target: Image | str, region: Optional[Rect] = None, timeout: float = 10.0, interval: float = 0.05, display_index: int = 0, threshold: float = ..., text_level: int = ...) -> List[Match]: ...
 def mouse_move(pos: Any, display_index: int = ...) -> None: ...
 def mouse_click(button: int = ..., count: int = ...) -> None: ...
 def mouse_down(button: int = ...) -> None: ...
@@ -81,6 +190,16 @@ def key_down(key: int) -> None: ...
 def key_up(key: int) -> None: ...
 def record(output_path: str, simplify: bool = ..., stop_key: int = ...) -> None: ...
 def display_get_rect(display_index: int = ...) -> Rect: ...
+def window_list() -> List[Tuple[int, str, str]]: ...
+def window_find(title: Optional[str] = None, class_name: Optional[str] = None) -> Optional[int]: ...
+def window_get_rect(handle: int) -> Optional[Rect]: ...
+def use_virtual_display(source: str, fps: float = 0.0, loop: bool = True) -> None: ...
+def use_native_display() -> None: ...
+def get_backend() -> str: ...
+def virtual_events() -> List[Tuple[Any, ...]]: ...
+def memory_stats() -> Dict[str, int]: ...
+def buffer_pool_trim(keep: int = 0) -> None: ...
+def buffer_pool_limit(bytes: int) -> None: ...
 
 # Constants
 TEXT_BLOCK: int
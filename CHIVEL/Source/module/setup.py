@@ -1,4 +1,68 @@
-from setuptools import setup
+import subprocess
+import sys
+from setuptools import setup, Extension
+
+package_data = [
+    "chivel.pyd",
+    "chivel.pyi",
+    "archive.dll",
+    "bz2.dll",
+    "gif.dll",
+    "jpeg62.dll",
+    "leptonica-1.85.0.dll",
+    "libcrypto-3-x64.dll",
+    "libcurl.dll",
+    "liblzma.dll",
+    "libpng16.dll",
+    "libsharpyuv.dll",
+    "libssl-3-x64.dll",
+    "libwebp.dll",
+    "libwebpdecoder.dll",
+    "libwebpdemux.dll",
+    "libwebpmux.dll",
+    "libxml2.dll",
+    "lz4.dll",
+    "opencv_world4110.dll",
+    "openjp2.dll",
+    "tesseract55.dll",
+    "tiff.dll",
+    "turbojpeg.dll",
+    "zlib1.dll",
+    "zstd.dll",
+    "tessdata/*"
+]
+ext_modules = []
+
+if sys.platform.startswith("linux"):
+    # Windows ships the prebuilt chivel.pyd, Linux builds it from source against the system libraries
+    packages = ["opencv4", "tesseract", "lept", "x11", "xext", "xtst", "xrandr", "xdamage", "xfixes"]
+    def pkg_config(flag):
+        return subprocess.check_output(["pkg-config", flag] + packages).decode().split()
+
+    package_data = ["chivel.pyi", "tessdata/*"]
+    ext_modules.append(Extension(
+        "chivel.chivel",
+        sources=[
+            "../blend.cpp",
+            "../buffer_pool.cpp",
+            "../bundle.cpp",
+            "../capture_stream.cpp",
+            "../damage.cpp",
+            "../dllmain.cpp",
+            "../backend_virtual.cpp",
+            "../backend_x11.cpp",
+            "../find_color.cpp",
+            "../image_cache.cpp",
+            "../image_hash.cpp",
+            "../image_stats.cpp",
+            "../image_writer.cpp",
+            "../lookup_table.cpp",
+            "../pipeline.cpp",
+        ],
+        include_dirs=[".."],
+        extra_compile_args=["-std=c++20", "-O2"] + pkg_config("--cflags"),
+        extra_link_args=pkg_config("--libs"),
+    ))
 
 setup(
     name="chivel",
@@ -10,34 +74,7 @@ setup(
     author="Mitchell Talyat",
     packages=["chivel"],
     package_dir={"chivel": "chivel"},
-    package_data={"chivel": [
-        "chivel.pyd", 
-        "chivel.pyi",
-        "archive.dll",
-        "bz2.dll",
-        "gif.dll",
-        "jpeg62.dll",
-        "leptonica-1.85.0.dll",
-        "libcrypto-3-x64.dll",
-        "libcurl.dll",
-        "liblzma.dll",
-        "libpng16.dll",
-        "libsharpyuv.dll",
-        "libssl-3-x64.dll",
-        "libwebp.dll",
-        "libwebpdecoder.dll",
-        "libwebpdemux.dll",
-        "libwebpmux.dll",
-        "libxml2.dll",
-        "lz4.dll",
-        "opencv_world4110.dll",
-        "openjp2.dll",
-        "tesseract55.dll",
-        "tiff.dll",
-        "turbojpeg.dll",
-        "zlib1.dll",
-        "zstd.dll",
-        "tessdata/*"
-    ]},
+    package_data={"chivel": package_data},
+    ext_modules=ext_modules,
     include_package_data=True,
-)
\ No newline at end of file
+)
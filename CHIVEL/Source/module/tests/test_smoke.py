@@ -0,0 +1,119 @@
+# Smoke tests for a built chivel. From CHIVEL/Source/module, run
+#     python -m unittest discover tests
+# The virtual display tests run anywhere. The X11 tests run when there is a display, such as under
+#     xvfb-run -s "-screen 0 640x480x24" python -m unittest discover tests
+import os
+import sys
+import tempfile
+import unittest
+
+import chivel
+
+
+class VirtualDisplayTest(unittest.TestCase):
+    def setUp(self):
+        # Two frames, black then white, so every capture shows which frame it read
+        self.directory = tempfile.TemporaryDirectory()
+        frame = chivel.Image(64, 48)
+        chivel.save(frame, os.path.join(self.directory.name, "0.png"))
+        frame.invert()
+        chivel.save(frame, os.path.join(self.directory.name, "1.png"))
+        chivel.use_virtual_display(self.directory.name)
+
+    def tearDown(self):
+        chivel.use_native_display()
+        self.directory.cleanup()
+
+    def test_capture(self):
+        self.assertEqual(chivel.get_backend(), "virtual")
+        rect = chivel.display_get_rect(0)
+        self.assertEqual((rect.width, rect.height), (64, 48))
+
+        size = chivel.capture().get_size()
+        self.assertEqual((size.x, size.y), (64, 48))
+        size = chivel.capture(rect=chivel.Rect(8, 8, 16, 16)).get_size()
+        self.assertEqual((size.x, size.y), (16, 16))
+
+    def test_capture_converts(self):
+        image = chivel.capture(color_space=chivel.COLOR_SPACE_BGRA, scale=0.5)
+        size = image.get_size()
+        self.assertEqual((size.x, size.y), (32, 24))
+        # The first frame is black, and converted captures are opaque
+        stats = image.stats()
+        self.assertEqual(stats["max"], (0, 0, 0, 255))
+        self.assertEqual(stats["min"], (0, 0, 0, 255))
+
+    def test_frames_advance_per_capture(self):
+        first = chivel.probe([chivel.Point(1, 1)])[0]
+        second = chivel.probe([chivel.Point(1, 1)])[0]
+        self.assertEqual((first.r, first.g, first.b), (0, 0, 0))
+        self.assertEqual((second.r, second.g, second.b), (255, 255, 255))
+
+    def test_probe_reads_one_frame(self):
+        colors = chivel.probe([chivel.Point(1, 1), chivel.Point(60, 40), chivel.Rect(8, 8, 4, 4)])
+        self.assertEqual([(color.r, color.g, color.b) for color in colors], [(0, 0, 0)] * 3)
+
+        probes = chivel.ProbeSet()
+        probes.add(chivel.Point(1, 1), chivel.Color(255, 255, 255))
+        probes.add(chivel.Point(60, 40), chivel.Color(255, 255, 255))
+        self.assertEqual(probes.check(), [True, True])
+
+    def test_input_is_logged(self):
+        chivel.virtual_events()
+        chivel.mouse_move(chivel.Point(10, 20))
+        chivel.mouse_click()
+        chivel.key_click(chivel.KEY_ENTER)
+        chivel.type("a", 0)
+
+        location, display_index = chivel.mouse_get_location()
+        self.assertEqual((location.x, location.y, display_index), (10, 20, 0))
+
+        events = chivel.virtual_events()
+        self.assertEqual([event[1] for event in events], ["mouse_move", "mouse_down", "mouse_up", "key_down", "key_up", "type"])
+        self.assertEqual(events[0][2:], (10, 20))
+        self.assertEqual(events[-1][2], "a")
+        self.assertEqual(chivel.virtual_events(), [])
+
+
+class BundleTest(unittest.TestCase):
+    def test_drawing_does_not_change_the_bundle(self):
+        with tempfile.TemporaryDirectory() as directory:
+            path = os.path.join(directory, "templates.bundle")
+            chivel.save_bundle({"button": chivel.Image(32, 16)}, path)
+            bundle = chivel.open_bundle(path)
+
+            drawn = bundle["button"]
+            drawn.draw_rect(chivel.Rect(0, 0, 32, 16), chivel.Color(255, 255, 255))
+            self.assertTrue(bundle["button"].equals(chivel.Image(32, 16)))
+            self.assertFalse(drawn.equals(bundle["button"]))
+            del drawn, bundle
+
+
+@unittest.skipUnless(sys.platform.startswith("linux") and os.environ.get("DISPLAY"), "needs an X display")
+class X11Test(unittest.TestCase):
+    def setUp(self):
+        chivel.use_native_display()
+        self.assertEqual(chivel.get_backend(), "x11")
+
+    def test_capture(self):
+        rect = chivel.display_get_rect(0)
+        size = chivel.capture().get_size()
+        self.assertEqual((size.x, size.y), (rect.width, rect.height))
+        size = chivel.capture(rect=chivel.Rect(0, 0, 32, 16)).get_size()
+        self.assertEqual((size.x, size.y), (32, 16))
+
+    def test_mouse_move(self):
+        rect = chivel.display_get_rect(0)
+        chivel.mouse_move(chivel.Point(30, 40))
+        location, display_index = chivel.mouse_get_location()
+        self.assertEqual((location.x, location.y, display_index), (rect.x + 30, rect.y + 40, 0))
+
+    def test_input(self):
+        # XTest input has nothing to read back without a window, so this only checks that it is accepted
+        chivel.mouse_click()
+        chivel.key_click(chivel.KEY_SHIFT)
+        chivel.type("a", 0)
+
+
+if __name__ == "__main__":
+    unittest.main()
@@ -0,0 +1,318 @@
+// pipeline.cpp : Recorded image operation chains, fused into as few passes as possible.
+#include "pch.h"
+
+#include "pipeline.h"
+
+#include <opencv2/imgproc.hpp>
+#include <algorithm>
+#include <cstring>
+
+namespace chivel
+{
+	// The same fixed point weights cvtColor uses for 8-bit BGR to gray, so the results match it exactly
+	static constexpr int GRAY_SHIFT = 14;
+	static constexpr int GRAY_B = 1868;
+	static constexpr int GRAY_G = 9617;
+	static constexpr int GRAY_R = 4899;
+
+	// Rough size of one band of one buffer, small enough that a few of them stay in L2
+	static constexpr size_t BAND_BYTES = 256 * 1024;
+
+	static void apply_point(LookupTable const& before, bool gray, LookupTable const& after, cv::Mat const& src, cv::Mat& dst)
+	{
+		if (!gray) {
+			before.apply(src, dst);
+			return;
+		}
+
+		// Look up, convert to gray and look up again, all in one pass
+		uchar const* blue = before.getTable(0).ptr();
+		uchar const* green = before.getTable(1).ptr();
+		uchar const* red = before.getTable(2).ptr();
+		uchar const* second = after.getTable(0).ptr();
+		int channels = src.channels();
+		for (int y = 0; y < src.rows; y++) {
+			uchar const* in = src.ptr(y);
+			uchar* out = dst.ptr(y);
+			for (int x = 0; x < src.cols; x++, in += channels) {
+				int value = blue[in[0]] * GRAY_B + green[in[1]] * GRAY_G + red[in[2]] * GRAY_R;
+				out[x] = second[(value + (1 << (GRAY_SHIFT - 1))) >> GRAY_SHIFT];
+			}
+		}
+	}
+
+	// The size a resize or scale operation turns an image of the given size into
+	static cv::Size resized_size(Pipeline::Op const& op, cv::Size size)
+	{
+		cv::Size result;
+		if (op.type == Pipeline::OpType::Resize)
+			result = cv::Size(static_cast<int>(op.a), static_cast<int>(op.b));
+		else
+			result = cv::Size(static_cast<int>(size.width * op.a), static_cast<int>(size.height * op.b));
+		if (result.width < 1 || result.height < 1)
+			CV_Error(cv::Error::StsBadSize, "Resulting image size is too small");
+		return result;
+	}
+
+	Pipeline::Pipeline(Pipeline const& other)
+	{
+		std::lock_guard<std::mutex> lock(other.mutex);
+		ops = other.ops;
+	}
+
+	void Pipeline::add(Op op)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		ops.push_back(op);
+		compiledType = -1;
+	}
+
+	void Pipeline::clear()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		ops.clear();
+		stages.clear();
+		bandBuffers.clear();
+		wholeBuffers.clear();
+		compiledType = -1;
+	}
+
+	size_t Pipeline::size() const
+	{
+		return ops.size();
+	}
+
+	void Pipeline::compile(int type)
+	{
+		stages.clear();
+		int channels = CV_MAT_CN(type);
+
+		// The point stage at the end of the chain, to fold the next per-pixel operation into
+		auto point = [&]() -> Stage& {
+			if (stages.empty() || stages.back().type != StageType::Point) {
+				Stage stage;
+				stage.type = StageType::Point;
+				stage.channels = channels;
+				stages.push_back(stage);
+			}
+			return stages.back();
+		};
+		// Tables are applied before the gray conversion until there is one, and after it from then on
+		auto table = [&]() -> LookupTable& {
+			Stage& stage = point();
+			return stage.gray ? stage.after : stage.before;
+		};
+		auto to_gray = [&]() {
+			if (channels == 1)
+				return;
+			Stage& stage = point();
+			stage.gray = true;
+			stage.channels = channels = 1;
+		};
+		auto filter = [&](Op const& op, cv::Mat kernel, int radius) {
+			Stage stage;
+			stage.type = StageType::Filter;
+			stage.op = op;
+			stage.kernel = kernel;
+			stage.radius = radius;
+			stage.channels = channels;
+			stages.push_back(stage);
+		};
+		auto whole = [&](Op const& op) {
+			Stage stage;
+			stage.type = StageType::Whole;
+			stage.op = op;
+			stage.channels = channels;
+			stages.push_back(stage);
+		};
+
+		for (Op const& op : ops) {
+			switch (op.type) {
+			case OpType::Grayscale:
+				to_gray();
+				break;
+			case OpType::Brightness:
+				table().brightness(op.a);
+				break;
+			case OpType::Contrast:
+				table().contrast(op.a);
+				break;
+			case OpType::Invert:
+				table().invert();
+				break;
+			case OpType::Threshold:
+				to_gray();
+				table().threshold(op.a, op.b);
+				break;
+			case OpType::Normalize:
+				whole(op);
+				break;
+			case OpType::Blur:
+				filter(op, cv::Mat(), static_cast<int>(op.a) - 1);
+				break;
+			case OpType::Sharpen: {
+				float strength = static_cast<float>(op.a);
+				cv::Mat kernel = (cv::Mat_<float>(3, 3) <<
+					0, -strength, 0,
+					-strength, 1 + 4 * strength, -strength,
+					0, -strength, 0);
+				filter(op, kernel, 1);
+				break;
+			}
+			case OpType::Edge:
+				to_gray();
+				whole(op);
+				break;
+			case OpType::Resize:
+			case OpType::Scale:
+				whole(op);
+				break;
+			case OpType::Emboss: {
+				to_gray();
+				cv::Mat kernel = (cv::Mat_<float>(3, 3) <<
+					-2, -1, 0,
+					-1, 1, 1,
+					0, 1, 2);
+				filter(op, kernel, 1);
+				// Adding 128 to whole numbers saturates the same way as brightness
+				table().brightness(128);
+				break;
+			}
+			}
+		}
+
+		// Operations that cancel out, or grayscale on a gray image, leave point stages that do nothing
+		stages.erase(std::remove_if(stages.begin(), stages.end(), [](Stage const& stage) {
+			return stage.type == StageType::Point && !stage.gray && stage.before.isIdentity();
+		}), stages.end());
+
+		compiledType = type;
+	}
+
+	cv::Mat Pipeline::run(cv::Mat const& src)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (compiledType != src.type())
+			compile(src.type());
+
+		if (stages.empty())
+			return src.clone();
+
+		cv::Mat current = src;
+		cv::Mat result;
+		size_t whole = 0;
+		size_t i = 0;
+		while (i < stages.size()) {
+			// Find the run of banded stages, or the single whole image stage, starting here
+			size_t end = i + 1;
+			if (stages[i].type != StageType::Whole) {
+				while (end < stages.size() && stages[end].type != StageType::Whole)
+					end++;
+			}
+
+			// The last step writes straight into the result, everything before into buffers kept for the next run
+			bool last = end == stages.size();
+			if (!last && whole == wholeBuffers.size())
+				wholeBuffers.emplace_back();
+			cv::Mat& target = last ? result : wholeBuffers[whole++];
+
+			Stage const& stage = stages[i];
+			if (stage.type == StageType::Whole) {
+				switch (stage.op.type) {
+				case OpType::Normalize:
+					cv::normalize(current, target, stage.op.a, stage.op.b, cv::NORM_MINMAX);
+					break;
+				case OpType::Edge:
+					cv::Canny(current, target, stage.op.a, stage.op.b);
+					break;
+				default:
+					cv::resize(current, target, resized_size(stage.op, current.size()), 0, 0, cv::INTER_LINEAR);
+					break;
+				}
+			}
+			else {
+				// Sizes can change along the way, so each step is sized after its input
+				target.create(current.rows, current.cols, CV_8UC(stages[end - 1].channels));
+				runBands(current, target, i, end);
+			}
+			current = target;
+			i = end;
+		}
+		return result;
+	}
+
+	void Pipeline::runBands(cv::Mat const& src, cv::Mat& dst, size_t first, size_t last)
+	{
+		int rows = src.rows;
+		int halo = 0;
+		int widest = src.channels();
+		for (size_t i = first; i < last; i++) {
+			halo += stages[i].radius;
+			widest = std::max(widest, stages[i].channels);
+		}
+
+		// Bands are never much thinner than the rows they have to read around them
+		size_t rowBytes = static_cast<size_t>(src.cols) * widest;
+		int bandRows = static_cast<int>(std::max<size_t>(16, BAND_BYTES / std::max<size_t>(rowBytes, 1)));
+		bandRows = std::min(std::max(bandRows, halo * 4), rows);
+		int bands = (rows + bandRows - 1) / bandRows;
+
+		size_t stride = stages.size();
+		if (bandBuffers.size() < static_cast<size_t>(bands) * stride)
+			bandBuffers.resize(static_cast<size_t>(bands) * stride);
+
+		cv::parallel_for_(cv::Range(0, bands), [&](cv::Range const& range) {
+			std::vector<cv::Range> input(last - first);
+			for (int band = range.start; band < range.end; band++) {
+				cv::Range output(band * bandRows, std::min(rows, (band + 1) * bandRows));
+
+				// Working backwards, every filter needs its radius more rows of input, up to the edges of the image
+				cv::Range needed = output;
+				for (size_t i = last; i-- > first;) {
+					int radius = stages[i].radius;
+					needed = cv::Range(std::max(0, needed.start - radius), std::min(rows, needed.end + radius));
+					input[i - first] = needed;
+				}
+
+				cv::Mat current = src.rowRange(input[0]);
+				cv::Range currentRows = input[0];
+				for (size_t i = first; i < last; i++) {
+					Stage const& stage = stages[i];
+					bool final = i + 1 == last;
+					cv::Range nextRows = final ? output : input[i + 1 - first];
+					cv::Mat& buffer = bandBuffers[static_cast<size_t>(band) * stride + i];
+
+					if (stage.type == StageType::Point) {
+						// Point stages need no extra rows, so they can write straight into the result
+						cv::Mat target;
+						if (final) {
+							target = dst.rowRange(nextRows);
+						}
+						else {
+							buffer.create(currentRows.size(), src.cols, CV_8UC(stage.channels));
+							target = buffer;
+						}
+						apply_point(stage.before, stage.gray, stage.after, current, target);
+						current = target;
+					}
+					else {
+						// The whole band is filtered as if it were the image, which is exact everywhere but the extra rows,
+						// and those are dropped. At the real edges of the image the band edge is the image edge.
+						int border = cv::BORDER_DEFAULT | cv::BORDER_ISOLATED;
+						if (stage.op.type == OpType::Blur) {
+							int ksize = stage.radius * 2 + 1;
+							cv::GaussianBlur(current, buffer, cv::Size(ksize, ksize), 0, 0, border);
+						}
+						else {
+							cv::filter2D(current, buffer, CV_8U, stage.kernel, cv::Point(-1, -1), 0, border);
+						}
+						current = buffer.rowRange(nextRows.start - currentRows.start, nextRows.end - currentRows.start);
+						if (final)
+							current.copyTo(dst.rowRange(nextRows));
+					}
+					currentRows = nextRows;
+				}
+			}
+		});
+	}
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include "lookup_table.h"
+
+#include <opencv2/core.hpp>
+#include <mutex>
+#include <vector>
+
+namespace chivel
+{
+	// A recorded chain of image operations, with the same results as calling the matching Image methods one by one.
+	// Nothing runs until run() is called. The chain is compiled once per input type:
+	// - Adjacent per-pixel operations (brightness, contrast, invert, threshold, grayscale) become one pass,
+	//   a LookupTable, optionally with a grayscale conversion between two of them.
+	// - Neighbourhood filters (blur, sharpen, emboss) and the per-pixel passes around them run band by band,
+	//   so each band's intermediates are still in cache for the next step. Bands run in parallel.
+	// - Operations that need the whole image (normalize, edge, resize, scale) run on the whole image between the bands.
+	// Intermediate buffers are kept between runs, so the same chain on frames of the same size does not allocate.
+	class Pipeline
+	{
+	public:
+		enum class OpType
+		{
+			Grayscale,
+			Brightness, // a = value
+			Contrast, // a = factor
+			Invert,
+			Threshold, // a = thresh, b = maxval
+			Normalize, // a = alpha, b = beta
+			Blur, // a = amount, the same as Image.blur
+			Sharpen, // a = strength
+			Edge, // a = threshold1, b = threshold2
+			Emboss,
+			Resize, // a = width, b = height
+			Scale, // a = x, b = y, the same as Image.scale
+		};
+
+		struct Op
+		{
+			OpType type = OpType::Grayscale;
+			double a = 0.0;
+			double b = 0.0;
+		};
+
+		Pipeline() = default;
+		// Copies only the recorded operations. The copy compiles and keeps buffers of its own, so the two can run at the same time.
+		Pipeline(Pipeline const& other);
+
+		void add(Op op);
+		void clear();
+		size_t size() const;
+
+		// Runs the chain on an 8-bit image with 1, 3 or 4 channels. The result is a new Mat, it never shares pixels with src.
+		// Safe to call from several threads, runs are serialized.
+		cv::Mat run(cv::Mat const& src);
+
+	private:
+		enum class StageType
+		{
+			Point,
+			Filter,
+			Whole,
+		};
+
+		struct Stage
+		{
+			StageType type = StageType::Point;
+			int channels = 0; // of the output
+			// Point: before, then an optional grayscale conversion, then after (only with gray)
+			LookupTable before;
+			bool gray = false;
+			LookupTable after;
+			// Filter and Whole
+			Op op;
+			cv::Mat kernel;
+			int radius = 0;
+		};
+
+		std::vector<Op> ops;
+		std::vector<Stage> stages;
+		int compiledType = -1;
+
+		// Band scratch, [band * stages + stage], and the whole image outputs of each group of banded stages
+		std::vector<cv::Mat> bandBuffers;
+		std::vector<cv::Mat> wholeBuffers;
+		mutable std::mutex mutex;
+
+		void compile(int type);
+		void runBands(cv::Mat const& src, cv::Mat& dst, size_t first, size_t last);
+	};
+}